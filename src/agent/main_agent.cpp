@@ -0,0 +1,127 @@
+#include <sodium.h>
+#include <sys/resource.h>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "VaultManager.h"
+#include "agent/AgentClient.h"
+#include "agent/AgentServer.h"
+#include "core/platform/PlatformPaths.h"
+#include "utils/Logger.h"
+
+static AgentServer *g_server = nullptr;
+
+static void onSignal(int) {
+    if (g_server != nullptr) {
+        g_server->stop();
+    }
+}
+
+/**
+ * Prints agent usage
+ */
+static void usage() {
+    std::cout << "Usage:\n"
+                 "  - encora_agent start <password> [--idle-timeout <seconds>]\n"
+                 "      unlock the vault in ./data once and serve encora_cli until stopped\n"
+                 "      or idle (default 900 s, 0 = never)\n"
+                 "  - encora_agent stop <password>\n"
+                 "  - encora_agent status\n";
+}
+
+/**
+ * Entry point for Encora agent
+ *
+ * Keeps the vault unlocked so encora_cli add / get / list / remove skip the Argon2id
+ * unlock: they go through data/agent.sock whenever an agent is listening there (see
+ * AgentServer). Runs in the foreground; SIGINT / SIGTERM lock the vault and exit.
+ */
+int main(int argc, char *argv[]) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.empty()) {
+        usage();
+        return EXIT_SUCCESS;
+    }
+
+    const auto socketPath = AgentProtocol::socketPath(PlatformPaths::dataDir());
+    const auto &command = args[0];
+    if ((command == "stop" && args.size() >= 2) || command == "status") {
+        auto agent = AgentClient::connect(socketPath);
+        if (!agent) {
+            std::cout << "No agent is running for this vault.\n";
+            return command == "stop" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        try {
+            if (command == "stop") {
+                agent->stop(args[1]);
+                std::cout << "Agent stopped.\n";
+            } else {
+                agent->ping();
+                std::cout << "Agent running: " << socketPath << "\n";
+            }
+        } catch (const std::exception &e) {
+            std::cout << "Agent error: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (command != "start" || args.size() < 2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    AgentOptions options;
+    for (std::size_t i = 2; i + 1 < args.size(); ++i) {
+        if (args[i] == "--idle-timeout") {
+            options.idleTimeout = std::chrono::seconds(std::stoul(args[++i]));
+        }
+    }
+
+    // Keep the keys out of core dumps and away from debuggers attaching as our user.
+    const rlimit noCore {0, 0};
+    ::setrlimit(RLIMIT_CORE, &noCore);
+#ifdef __linux__
+    ::prctl(PR_SET_DUMPABLE, 0, 0, 0, 0);
+#endif
+
+    EncoraLogger::Logger::init("logs");
+    int exitCode = EXIT_SUCCESS;
+    try {
+        std::unique_ptr<AgentServer> server;
+        {
+            VaultManager vault;
+            if (!vault.unlock(args[1])) {
+                std::cout << "Unlock failed.\n";
+                EncoraLogger::Logger::shutdown();
+                return EXIT_FAILURE;
+            }
+            auto vmk = vault.sessionVMK();
+            server = std::make_unique<AgentServer>(socketPath, vmk, args[1], options);
+            sodium_memzero(vmk.data(), vmk.size());
+            // From here on the storage holds the only copy of the VMK.
+        }
+
+        g_server = server.get();
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        std::signal(SIGPIPE, SIG_IGN);
+        std::cout << "Agent listening on " << socketPath << "\n" << std::flush;
+
+        server->run();
+        g_server = nullptr;
+    } catch (const std::exception &e) {
+        std::cout << "Agent failed: " << e.what() << "\n";
+        exitCode = EXIT_FAILURE;
+    }
+
+    EncoraLogger::Logger::shutdown();
+
+    return exitCode;
+}
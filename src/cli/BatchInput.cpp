@@ -0,0 +1,94 @@
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+#include "BatchInput.h"
+
+#include "utils/Base64.h"
+
+using json = nlohmann::json;
+
+// Call 'parse' with every non-blank line of 'in' and its line number.
+static void forEachLine(std::istream &in, const std::function<void(const json &, const std::string &where)> &parse) {
+    std::string line;
+    for (size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        const auto where = "line " + std::to_string(lineNo) + ": ";
+        const auto value = json::parse(line, nullptr, false);
+        if (value.is_discarded()) {
+            throw std::runtime_error(where + "invalid JSON");
+        }
+        parse(value, where);
+    }
+}
+
+// Run 'read' on the file, or on stdin for "-".
+template <typename Read>
+static auto fromFile(const std::string &file, Read read) {
+    if (file == "-") {
+        return read(std::cin);
+    }
+
+    std::ifstream ifs(file);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Failed to open batch file: " + file);
+    }
+    return read(ifs);
+}
+
+std::vector<EncryptedVaultStorage::NewRecord> BatchInput::readRecords(std::istream &in) {
+    std::vector<EncryptedVaultStorage::NewRecord> records;
+    forEachLine(in, [&](const json &line, const std::string &where) {
+        if (!line.is_object() || !line.contains("name") || !line["name"].is_string()
+            || !line.contains("type") || !line["type"].is_string()) {
+            throw std::runtime_error(where + "expected {\"name\", \"type\", \"data\" | \"data_b64\"}");
+        }
+
+        EncryptedVaultStorage::NewRecord record;
+        record.name = line["name"].get<std::string>();
+        record.type = line["type"].get<std::string>();
+        if (line.contains("data_b64") && line["data_b64"].is_string()) {
+            record.data = Base64::decode(line["data_b64"].get<std::string>());
+        } else if (line.contains("data") && line["data"].is_string()) {
+            const auto &data = line["data"].get_ref<const std::string &>();
+            record.data.assign(data.begin(), data.end());
+        } else {
+            throw std::runtime_error(where + "missing \"data\" or \"data_b64\"");
+        }
+
+        if (record.name.empty() || record.data.empty()) {
+            throw std::runtime_error(where + "name and data must not be empty");
+        }
+        records.push_back(std::move(record));
+    });
+
+    return records;
+}
+
+std::vector<std::string> BatchInput::readNames(std::istream &in) {
+    std::vector<std::string> names;
+    forEachLine(in, [&](const json &line, const std::string &where) {
+        if (line.is_string()) {
+            names.push_back(line.get<std::string>());
+        } else if (line.is_object() && line.contains("name") && line["name"].is_string()) {
+            names.push_back(line["name"].get<std::string>());
+        } else {
+            throw std::runtime_error(where + "expected {\"name\"} or a name string");
+        }
+    });
+
+    return names;
+}
+
+std::vector<EncryptedVaultStorage::NewRecord> BatchInput::readRecords(const std::string &file) {
+    return fromFile(file, [](std::istream &in) { return readRecords(in); });
+}
+
+std::vector<std::string> BatchInput::readNames(const std::string &file) {
+    return fromFile(file, [](std::istream &in) { return readNames(in); });
+}
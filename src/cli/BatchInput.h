@@ -0,0 +1,29 @@
+#ifndef CLI_BATCH_INPUT_H
+#define CLI_BATCH_INPUT_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "storage/EncryptedVaultStorage.h"
+
+/**
+ * BatchInput
+ *
+ * Newline-delimited JSON input of add-batch / remove-batch: one value per line, blank
+ * lines skipped. The whole input is parsed before anything is written, and a bad line
+ * throws std::runtime_error naming it by its line number in the input ("line 3: ...").
+ *
+ *      add-batch:      {"name": "...", "type": "...", "data": "<text>"} or "data_b64": "<base64>"
+ *      remove-batch:   {"name": "..."} or a bare "name" string
+ */
+class BatchInput {
+public:
+    static std::vector<EncryptedVaultStorage::NewRecord> readRecords(std::istream &in);
+    static std::vector<std::string> readNames(std::istream &in);
+    // Same, from a file or stdin ("-").
+    static std::vector<EncryptedVaultStorage::NewRecord> readRecords(const std::string &file);
+    static std::vector<std::string> readNames(const std::string &file);
+};
+
+#endif //CLI_BATCH_INPUT_H
@@ -23,8 +23,30 @@ static std::string join(const std::vector<std::string> &v, size_t start) {
 CLIOptions::CLIOptions(int argc, char *argv[]) {
     if (argc > 1) {
         command = argv[1];
-        for (int i = 2; i < argc; ++i) {
-            args.emplace_back(argv[i]);
+        // --jobs <n>, --paranoid and the session cache apply to every command that unlocks. They come right
+        // after the command: from its first argument (or a '--') on, everything is an argument, so a
+        // password or inline data that looks like one is left alone.
+        int at = 2;
+        for (; at < argc; ++at) {
+            const std::string option = argv[at];
+            if (option == "--") {
+                ++at;
+                break;
+            }
+            if (option == "--jobs" && at + 1 < argc) {
+                jobs = argv[++at];
+            } else if (option == "--paranoid") {
+                paranoid = true;
+            } else if (option == "--session-cache" && at + 1 < argc) {
+                sessionCache = argv[++at];
+            } else if (option == "--session-keyring" && at + 1 < argc) {
+                sessionKeyring = argv[++at];
+            } else {
+                break;
+            }
+        }
+        for (; at < argc; ++at) {
+            args.emplace_back(argv[at]);
         }
 
         if (command == "add") {
@@ -58,10 +80,13 @@ CLIOptions::CLIOptions(int argc, char *argv[]) {
                 }
             }
         } else if (command == "list") {
-            // list <password>
+            // list <password> [<prefix>]
             if (args.size() >= 1) {
                 password = args[0];
             }
+            if (args.size() >= 2) {
+                prefix = args[1];
+            }
         } else if (command == "get" || command == "remove") {
             // get <password> <name>
             // remove <password> <name>
@@ -69,12 +94,58 @@ CLIOptions::CLIOptions(int argc, char *argv[]) {
                 password = args[0];
                 name = args[1];
             }
-        } else if (command == "init" || command == "unlock") {
-            // init <password>
+        } else if (command == "add-batch" || command == "remove-batch") {
+            // add-batch <password> [<file> | -]
+            // remove-batch <password> [<file> | -]
+            if (args.size() >= 1) {
+                password = args[0];
+                path = args.size() >= 2 ? args[1] : "-";
+            }
+        } else if (command == "compact") {
+            // compact <password> [--min-dead-ratio <r>] [--min-dead-bytes <n>]
+            if (args.size() >= 1) {
+                password = args[0];
+            }
+            for (size_t i = 1; i + 1 < args.size(); ++i) {
+                if (args[i] == "--min-dead-ratio") {
+                    minDeadRatio = args[++i];
+                } else if (args[i] == "--min-dead-bytes") {
+                    minDeadBytes = args[++i];
+                }
+            }
+        } else if (command == "gc") {
+            // gc <password> [--dry-run] [--quarantine]
+            if (args.size() >= 1) {
+                password = args[0];
+            }
+            for (size_t i = 1; i < args.size(); ++i) {
+                if (args[i] == "--dry-run") {
+                    dryRun = true;
+                } else if (args[i] == "--quarantine") {
+                    quarantine = true;
+                }
+            }
+        } else if (command == "init" || command == "retune-kdf") {
+            // init <password> [--kdf-target-ms <ms>] [--kdf-max-mem <size>]
+            // retune-kdf <password> [--kdf-target-ms <ms>] [--kdf-max-mem <size>]
+            if (args.size() >= 1) {
+                password = args[0];
+            }
+            for (size_t i = 1; i + 1 < args.size(); ++i) {
+                if (args[i] == "--kdf-target-ms") {
+                    kdfTargetMs = args[++i];
+                } else if (args[i] == "--kdf-max-mem") {
+                    kdfMaxMem = args[++i];
+                }
+            }
+        } else if (command == "unlock" || command == "train-dict") {
             // unlock <password>
+            // train-dict <password>
             if (args.size() >= 1) {
                 password = args[0];
             }
+        } else if (command == "lock") {
+            // lock: nothing but the global options
         } else if (command == "export" || command == "import") {
             if (args.size() >= 2) {
                 password = args[0];
@@ -82,12 +153,24 @@ CLIOptions::CLIOptions(int argc, char *argv[]) {
             }
         } else {
             std::cout << "Usage:\n"
-                         "  - encora_cli init <password>\n"
+                         "  - encora_cli init <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]\n"
+                         "  - encora_cli retune-kdf <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]\n"
                          "  - encora_cli unlock <password>\n"
                          "  - encora_cli add <password> <name> <type> [<data...> | --data-file <path> | -]\n"
-                         "  - encora_cli list <password>\n"
+                         "  - encora_cli add-batch <password> [<ndjson file> | -]\n"
+                         "  - encora_cli list <password> [<prefix>]\n"
                          "  - encora_cli get <password> <name>\n"
-                         "  - encora_cli remove <password> <name>\n";
+                         "  - encora_cli remove <password> <name>\n"
+                         "  - encora_cli remove-batch <password> [<ndjson file> | -]\n"
+                         "  - encora_cli compact <password> [--min-dead-ratio <0..1>] [--min-dead-bytes <n>]\n"
+                         "  - encora_cli gc <password> [--dry-run] [--quarantine]\n"
+                         "  - encora_cli train-dict <password>\n"
+                         "  - encora_cli lock [--session-keyring <user | session>]\n"
+                         "  Any command, right after it (encora_cli <command> [options] [--] <arguments>):\n"
+                         "               --jobs <n>  verify integrity with n threads on unlock (0 = all cores)\n"
+                         "               --paranoid  rehash every file on unlock, ignoring the stat cache\n"
+                         "               --session-cache <seconds>  cache the unlock in the kernel keyring (Linux)\n"
+                         "               --session-keyring <user | session>  keyring of the cache (default: user)\n";
         }
     }
 }
@@ -12,14 +12,27 @@
  * to avoid re-parsing in main.
  *
  * Commands:
- *      init <password>
+ *      init <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]
+ *      retune-kdf <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]
  *      unlock <password>
  *      add <password> <name> <type> [--data-file <path> | - | <inline data...>]
- *      list <password>
+ *      add-batch <password> [<ndjson file> | -]
+ *      list <password> [<prefix>]
  *      get <password> <name>
  *      remove <password> <name>
+ *      remove-batch <password> [<ndjson file> | -]
+ *      compact <password> [--min-dead-ratio <0..1>] [--min-dead-bytes <n>]
+ *      gc <password> [--dry-run] [--quarantine]
+ *      train-dict <password>
+ *      lock
  *      export <password> <path>
  *      import <password> <path>
+ *
+ * Global, right after the command and before its arguments ('--' ends them):
+ *      --jobs <n>      integrity verification threads on unlock (0 = all cores)
+ *      --paranoid      rehash every file on unlock instead of trusting MANIFEST.cache
+ *      --session-cache <seconds>   keep the derived key in the kernel keyring that long (Linux)
+ *      --session-keyring <user | session>  keyring of the session cache (default: user)
  */
 class CLIOptions {
 public:
@@ -30,7 +43,18 @@ public:
     std::string password;
     std::string name;
     std::string type;
-    std::string path; // for export/import
+    std::string path; // for export/import, NDJSON input for add-batch/remove-batch ("-" = stdin)
+    std::string prefix; // for list
+    std::string minDeadRatio; // for compact (raw, validated by the command)
+    std::string minDeadBytes; // for compact
+    bool dryRun = false; // for gc
+    bool quarantine = false; // for gc
+    std::string kdfTargetMs; // for init / retune-kdf (raw, validated in main)
+    std::string kdfMaxMem; // for init / retune-kdf
+    std::string jobs; // --jobs (raw, validated in main)
+    bool paranoid = false; // --paranoid
+    std::string sessionCache; // --session-cache (raw, validated in main)
+    std::string sessionKeyring; // --session-keyring
 
     bool m_useStdin = false;
     std::string dataFIle;
@@ -5,29 +5,43 @@
 #include <fcntl.h>
 #endif
 
+#include <cctype>
 #include <filesystem>
 #include <fstream>
+#include <optional>
+#include <set>
+#include <sstream>
 
+#include "BatchInput.h"
 #include "CLIOptions.h"
 #include "VaultManager.h"
 #include "storage/EncryptedVaultStorage.h"
 #include "storage/VaultExporter.h"
 #include "utils/Logger.h"
 
+#ifndef _WIN32
+#include "agent/AgentClient.h"
+#include "core/platform/PlatformPaths.h"
+#endif
+
 /**
  * Prints CLI usage
  */
 static void usage();
 
 /**
- * Reads binary file
+ * Argon2id parameters for init / retune-kdf: calibrated on this host if 'calibrate' or a --kdf-* flag
+ * is given (printing what was picked), libsodium's MODERATE profile otherwise
  */
-static std::vector<unsigned char> readBinary(const std::string &file);
+static KdfParams kdfParamsFor(const CLIOptions &opts, bool calibrate);
 
+#ifndef _WIN32
 /**
- * Reads binary from stdin
+ * Runs add / get / list / remove through encora_agent when one serves the vault, and refuses the
+ * commands that would write to the vault behind its back. std::nullopt: no agent, unlock as usual.
  */
-static std::vector<unsigned char> readStdinBinary();
+static std::optional<int> runWithAgent(const CLIOptions &opts);
+#endif
 
 /**
  * Entry point for Encora CLI
@@ -36,16 +50,43 @@ static std::vector<unsigned char> readStdinBinary();
  *      encora_cli init <password>
  *          - initializes a brand new vault (generates salt, VMK, etc.)
  *
+ *      encora_cli init <password> --kdf-target-ms <ms> --kdf-max-mem <size>
+ *          - benchmarks Argon2id first and picks parameters for that unlock time within that memory
+ *
+ *      encora_cli retune-kdf <password> [--kdf-target-ms <ms>] [--kdf-max-mem <size>]
+ *          - recalibrates (500 ms, a quarter of the memory by default) and re-wraps the VMK;
+ *            records are not touched
+ *
  *      encora_cli unlock <password>
  *          - attempts to unlock existing vault using the given password
  *
+ *      encora_cli get <password> <name>
+ *          - writes the record to stdout chunk by chunk (messages and log go to stderr)
+ *
+ *      Global options go right after the command, before its arguments; '--' ends them:
+ *      encora_cli <command> [options] [--] <arguments>
+ *
+ *      --jobs <n> (any command)
+ *          - verifies vault integrity on unlock with n threads (0 = all cores)
+ *
+ *      --paranoid (any command)
+ *          - rehashes every file on unlock, even those the stat cache says are unchanged
+ *
+ *      --session-cache <seconds> (any command)
+ *          - leaves the derived key in the kernel keyring: later commands with the same flag skip
+ *            Argon2id (and the password check) until it expires or 'encora_cli lock' revokes it
+ *
+ *      While encora_agent runs for the vault, add / get / list / remove go through it and skip
+ *      the Argon2id unlock (the password is still checked, by the agent).
+ *
  * Note:
  *      The vault metadata us currently stored at "data/vault.meta"
  *      (this path is defined in VaultManager::metaPath()).
  */
 int main(int argc, char *argv[]) {
-    EncoraLogger::Logger::init();
     CLIOptions opts(argc, argv);
+    // 'get' writes the record itself to stdout.
+    EncoraLogger::Logger::init("logs", opts.command == "get" ? std::cerr : std::cout);
 
     if (opts.command.empty()) {
         usage();
@@ -54,27 +95,69 @@ int main(int argc, char *argv[]) {
         return EXIT_SUCCESS;
     }
 
+#ifndef _WIN32
+    if (const auto served = runWithAgent(opts)) {
+        EncoraLogger::Logger::shutdown();
+
+        return *served;
+    }
+#endif
+
     int exitCode = 0;
 
     try {
         VaultManager vault;
+        if (!opts.jobs.empty() || opts.paranoid) {
+            VerifyOptions verify;
+            if (!opts.jobs.empty()) {
+                verify.jobs = static_cast<unsigned>(std::stoul(opts.jobs));
+            }
+            verify.paranoid = opts.paranoid;
+            vault.setVerifyOptions(verify);
+        }
+        if (!opts.sessionCache.empty() || opts.command == "lock") {
+            // 'lock' revokes what an earlier --session-cache left in the keyring.
+            SessionCacheOptions cache;
+            if (!opts.sessionCache.empty()) {
+                cache.timeout = std::chrono::seconds(std::stoul(opts.sessionCache));
+            }
+            if (cache.timeout.count() == 0) {
+                throw std::invalid_argument("--session-cache needs a timeout of at least 1 second.");
+            }
+            if (opts.sessionKeyring == "session") {
+                cache.keyring = SessionCacheOptions::Keyring::Session;
+            } else if (!opts.sessionKeyring.empty() && opts.sessionKeyring != "user") {
+                throw std::invalid_argument("--session-keyring must be 'user' or 'session'.");
+            }
+            vault.setSessionCache(cache);
+        }
         if (opts.command == "init") {
             if (opts.password.empty()) {
                 std::cout << "Error: password is required.\n";
                 usage();
-            } else if (vault.init(opts.password)) {
+            } else if (vault.init(opts.password, kdfParamsFor(opts, false))) {
                 std::cout << "Vault created successfully.\n";
             } else {
                 std::cout << "Failed to create vault.\n";
                 exitCode = EXIT_FAILURE;
             }
+        } else if (opts.command == "retune-kdf") {
+            if (opts.password.empty()) {
+                std::cout << "Error: password is required.\n";
+                usage();
+            } else if (vault.retune(opts.password, kdfParamsFor(opts, true))) {
+                std::cout << "Vault key re-wrapped under the new parameters.\n";
+            } else {
+                std::cout << "Retune failed.\n";
+                exitCode = EXIT_FAILURE;
+            }
         } else if (opts.command == "unlock") {
             if (opts.password.empty()) {
                 std::cout << "Error: password is required.\n";
                 usage();
             } else if (vault.unlock(opts.password)) {
                 std::cout << "Vault unlocked successfully.\n";
-                switch (vault.integrityStatus()) {
+                switch (vault.integrityStatus()->wait().status) {
                     case IntegrityStatus::OK:
                         std::cout << "Integrity: OK.\n";
                         break;
@@ -101,14 +184,19 @@ int main(int argc, char *argv[]) {
             if (opts.password.empty()) {
                 std::cout << "Error: password is required.\n";
                 usage();
-            } else if (!vault.unlock(opts.password)) {
+            } else if (!vault.unlock(opts.password, VaultManager::UnlockMode::Deferred)) {
                 std::cout << "Unlock failed.\n";
                 exitCode = EXIT_FAILURE;
             } else {
+                // Listing only reads index.log, which the deferred unlock has already checked.
                 EncryptedVaultStorage storage(vault.sessionVMK());
-                for (const auto &rec : storage.list()) {
+                storage.setIntegrityVerification(vault.integrityStatus());
+                for (const auto &rec : storage.list(opts.prefix)) {
                     std::cout << " * " << rec << "\n";
                 }
+                if (const auto integrity = vault.integrityStatus(); integrity->ready() && integrity->status() != IntegrityStatus::OK) {
+                    std::cout << "WARNING: Integrity check failed (see log).\n";
+                }
             }
         } else if (opts.command == "add") {
             if (opts.password.empty() || opts.name.empty() || opts.type.empty()) {
@@ -118,36 +206,66 @@ int main(int argc, char *argv[]) {
                 std::cout << "Unlock failed.\n";
                 exitCode = EXIT_FAILURE;
             } else {
-                std::vector<unsigned char> payload;
-
-                try {
-                    if (opts.m_useStdin) {
-                        payload = readStdinBinary();
-                    } else if (!opts.dataFIle.empty()) {
-                        payload = readBinary(opts.dataFIle);
-                    } else {
-                        payload.assign(opts.dataInline.begin(), opts.dataInline.end());
-                    }
-                } catch (const std::exception &e) {
-                    std::cout << "Read data failed: " << e.what() << "\n";
-                    EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("add: ") + e.what());
-                    EncoraLogger::Logger::shutdown();
-
-                    return EXIT_FAILURE;
+                // stdin and data files are streamed in as a chunked record; inline data is sealed whole.
+                std::ifstream file;
+                std::istream *in = nullptr;
+                if (opts.m_useStdin) {
+#ifdef _WIN32
+                    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+                    in = &std::cin;
+                } else if (!opts.dataFIle.empty()) {
+                    file.open(opts.dataFIle, std::ios::binary);
+                    in = &file;
                 }
 
-                if (payload.empty()) {
+                if (!opts.dataFIle.empty() && !file.is_open()) {
+                    std::cout << "Read data failed: Failed to open data file: " << opts.dataFIle << "\n";
+                    EncoraLogger::Logger::log(EncoraLogger::Level::Error, "add: cannot open data file: " + opts.dataFIle);
+                    exitCode = EXIT_FAILURE;
+                } else if (in != nullptr ? in->peek() == std::char_traits<char>::eof() : opts.dataInline.empty()) {
                     std::cout << "No data provided (stdin/file/inline is empty).\n";
                 } else {
-                    EncryptedVaultStorage storage(vault.sessionVMK());
-                    if (storage.addRecord(opts.name, opts.type, payload)) {
+                    try {
+                        EncryptedVaultStorage storage(vault.sessionVMK());
+                        if (in != nullptr) {
+                            (void) storage.addRecordFrom(opts.name, opts.type, *in);
+                        } else {
+                            std::vector<unsigned char> payload(opts.dataInline.begin(), opts.dataInline.end());
+                            (void) storage.addRecord(opts.name, opts.type, payload);
+                        }
                         std::cout << "Added: " << opts.name << "\n";
-                    } else {
-                        std::cout << "Add failed.\n";
+                    } catch (const std::exception &e) {
+                        std::cout << "Add failed: " << e.what() << "\n";
+                        EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("add: ") + e.what());
                         exitCode = EXIT_FAILURE;
                     }
                 }
             }
+        } else if (opts.command == "get") {
+            // Only the record goes to stdout; messages go to stderr.
+            if (opts.password.empty() || opts.name.empty()) {
+                std::cerr << "Error: password and name are required.\n";
+                usage();
+            } else if (!vault.unlock(opts.password, VaultManager::UnlockMode::Deferred)) {
+                std::cerr << "Unlock failed.\n";
+                exitCode = EXIT_FAILURE;
+            } else {
+                try {
+                    // The file holding the record is verified before it is read; the rest in the background.
+                    EncryptedVaultStorage storage(vault.sessionVMK());
+                    storage.setIntegrityVerification(vault.integrityStatus());
+#ifdef _WIN32
+                    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                    (void) storage.loadRecordTo(opts.name, std::cout);
+                    std::cout.flush();
+                } catch (const std::exception &e) {
+                    std::cerr << "Get failed: " << e.what() << "\n";
+                    EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("get: ") + e.what());
+                    exitCode = EXIT_FAILURE;
+                }
+            }
         } else if (opts.command == "remove") {
             // Stub: keeping UX + usage consistent; we'll wire once storage exposes remove API.
             if (opts.password.empty() || opts.name.empty()) {
@@ -167,6 +285,109 @@ int main(int argc, char *argv[]) {
                     exitCode = EXIT_FAILURE;
                 }
             }
+        } else if (opts.command == "add-batch" || opts.command == "remove-batch") {
+            // One unlock, one transaction, one manifest update for the whole input.
+            const bool isAdd = opts.command == "add-batch";
+            if (opts.password.empty()) {
+                std::cout << "Error: password is required.\n";
+                usage();
+            } else if (!vault.unlock(opts.password)) {
+                std::cout << "Unlock failed.\n";
+                exitCode = EXIT_FAILURE;
+            } else {
+                try {
+                    if (isAdd) {
+                        const auto records = BatchInput::readRecords(opts.path);
+                        EncryptedVaultStorage storage(vault.sessionVMK());
+                        const auto added = storage.addRecords(records);
+                        std::cout << "Added " << added << " record(s).\n";
+                    } else {
+                        const auto names = BatchInput::readNames(opts.path);
+                        EncryptedVaultStorage storage(vault.sessionVMK());
+                        const auto removed = storage.removeRecords(names);
+                        std::cout << "Removed " << removed << " record(s).\n";
+                    }
+                } catch (const std::exception &e) {
+                    std::cout << (isAdd ? "Add" : "Remove") << " batch failed, nothing changed: " << e.what() << "\n";
+                    EncoraLogger::Logger::log(EncoraLogger::Level::Error, opts.command + ": " + e.what());
+                    exitCode = EXIT_FAILURE;
+                }
+            }
+        } else if (opts.command == "compact") {
+            if (opts.password.empty()) {
+                std::cout << "Error: password is required.\n";
+                usage();
+            } else if (!vault.unlock(opts.password)) {
+                std::cout << "Unlock failed.\n";
+                exitCode = EXIT_FAILURE;
+            } else {
+                CompactionOptions options;
+                if (!opts.minDeadRatio.empty()) {
+                    options.minDeadRatio = std::stod(opts.minDeadRatio);
+                }
+                if (!opts.minDeadBytes.empty()) {
+                    options.minDeadBytes = std::stoull(opts.minDeadBytes);
+                }
+
+                EncryptedVaultStorage storage(vault.sessionVMK());
+                const auto report = storage.compact(options);
+                std::cout << "Compacted " << report.segmentsRewritten << " segment(s), moved " << report.recordsMoved << " record(s), dropped "
+                          << report.chunksDropped << " chunk(s).\n"
+                          << "Reclaimed " << report.reclaimedBytes() << " bytes (store " << report.storeBytesReclaimed
+                          << ", index " << report.indexBytesReclaimed << ") in " << report.elapsed.count() << " ms.\n";
+            }
+        } else if (opts.command == "gc") {
+            if (opts.password.empty()) {
+                std::cout << "Error: password is required.\n";
+                usage();
+            } else if (!vault.unlock(opts.password)) {
+                std::cout << "Unlock failed.\n";
+                exitCode = EXIT_FAILURE;
+            } else {
+                EncryptedVaultStorage storage(vault.sessionVMK());
+                const auto report = storage.collectGarbage(GcOptions {opts.dryRun, opts.quarantine});
+                const auto &space = report.space;
+                std::cout << "Live:     " << space.liveRecords << " record(s), " << space.liveBytes << " bytes\n"
+                          << "Dead:     " << space.deadBytes << " bytes in segments (run 'compact' to reclaim)\n"
+                          << "Orphaned: " << space.orphans.size() << " file(s), " << space.orphanBytes << " bytes\n"
+                          << "Index:    " << space.indexBytes << " bytes\n"
+                          << "Dead fraction: " << static_cast<int>(space.deadFraction() * 100) << "%\n";
+                if (opts.dryRun) {
+                    for (const auto &orphan : space.orphans) {
+                        std::cout << "  " << orphan.name << " (" << orphan.size << " bytes)\n";
+                    }
+                } else if (!report.quarantineDir.empty()) {
+                    std::cout << "Quarantined " << report.filesRemoved << " file(s), " << report.bytesRemoved << " bytes, to "
+                              << report.quarantineDir << "\n";
+                } else {
+                    std::cout << "Removed " << report.filesRemoved << " file(s), " << report.bytesRemoved << " bytes.\n";
+                }
+                if (report.filesRemoved < space.orphans.size() && !opts.dryRun) {
+                    exitCode = EXIT_FAILURE;
+                }
+            }
+        } else if (opts.command == "train-dict") {
+            if (opts.password.empty()) {
+                std::cout << "Error: password is required.\n";
+                usage();
+            } else if (!vault.unlock(opts.password)) {
+                std::cout << "Unlock failed.\n";
+                exitCode = EXIT_FAILURE;
+            } else {
+                EncryptedVaultStorage storage(vault.sessionVMK());
+                const auto report = storage.trainDictionary();
+                if (report.id == 0) {
+                    std::cout << "Not enough small records to train a dictionary on (" << report.samples << " record(s), "
+                              << report.sampleBytes << " bytes).\n";
+                } else {
+                    std::cout << "Dictionary " << report.id << ": " << report.size << " bytes, trained on " << report.samples
+                              << " record(s) (" << report.sampleBytes << " bytes) in " << report.elapsed.count() << " ms.\n"
+                              << "Small records added from now on are compressed with it.\n";
+                }
+            }
+        } else if (opts.command == "lock") {
+            vault.lock();
+            std::cout << "Session cache revoked.\n";
         } else if (opts.command == "export") {
             if (opts.password.empty() || opts.path.empty()) {
                 std::cout << "Error: password and destination path are required.\n";
@@ -211,28 +432,124 @@ int main(int argc, char *argv[]) {
 
 static void usage() {
     std::cout << "Usage:\n"
-                 "  - encora_cli init <password>\n"
+                 "  - encora_cli init <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]\n"
+                 "  - encora_cli retune-kdf <password> [--kdf-target-ms <ms>] [--kdf-max-mem <bytes | n K/M/G>]\n"
                  "  - encora_cli unlock <password>\n"
                  "  - encora_cli add <password> <name> <type> [--data-file <path> | - | <inline data...>]\n"
-                 "  - encora_cli list <password>\n"
+                 "  - encora_cli add-batch <password> [<ndjson file> | -]\n"
+                 "  - encora_cli list <password> [<prefix>]\n"
                  "  - encora_cli get <password> <name>\n"
-                 "  - encora_cli remove <password> <name>\n";
+                 "  - encora_cli remove <password> <name>\n"
+                 "  - encora_cli remove-batch <password> [<ndjson file> | -]\n"
+                 "  - encora_cli compact <password> [--min-dead-ratio <0..1>] [--min-dead-bytes <n>]\n"
+                 "  - encora_cli gc <password> [--dry-run] [--quarantine]\n"
+                 "  - encora_cli train-dict <password>\n"
+                 "  - encora_cli lock [--session-keyring <user | session>]\n"
+                 "  Any command, right after it (encora_cli <command> [options] [--] <arguments>):\n"
+                 "               --jobs <n>  verify integrity with n threads on unlock (0 = all cores)\n"
+                 "               --paranoid  rehash every file on unlock, ignoring the stat cache\n"
+                 "               --session-cache <seconds>  cache the unlock in the kernel keyring (Linux)\n"
+                 "               --session-keyring <user | session>  keyring of the cache (default: user)\n"
+                 "  With encora_agent running, add / get / list / remove are served by it without an unlock.\n";
 }
 
-static std::vector<unsigned char> readBinary(const std::string &file) {
-    std::ifstream ifs(file, std::ios::binary);
-    if (!ifs.is_open()) {
-        throw std::runtime_error("Failed to open data file: " + file);
+static KdfParams kdfParamsFor(const CLIOptions &opts, const bool calibrate) {
+    if (!calibrate && opts.kdfTargetMs.empty() && opts.kdfMaxMem.empty()) {
+        return KeyDerivation::defaultParams();
+    }
+
+    KdfTarget target;
+    if (!opts.kdfTargetMs.empty()) {
+        target.latency = std::chrono::milliseconds(std::stoul(opts.kdfTargetMs));
+    }
+    if (!opts.kdfMaxMem.empty()) {
+        // Bytes, or a number with a K / M / G (binary) suffix.
+        size_t digits = 0;
+        target.maxMemory = std::stoull(opts.kdfMaxMem, &digits);
+        const std::string unit = opts.kdfMaxMem.substr(digits);
+        if (unit == "K" || unit == "k") {
+            target.maxMemory <<= 10;
+        } else if (unit == "M" || unit == "m") {
+            target.maxMemory <<= 20;
+        } else if (unit == "G" || unit == "g") {
+            target.maxMemory <<= 30;
+        } else if (!unit.empty()) {
+            throw std::invalid_argument("--kdf-max-mem: unknown unit '" + unit + "' (use K, M or G).");
+        }
     }
 
-    return std::vector<unsigned char>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    std::cout << "Calibrating Argon2id for " << target.latency.count() << " ms...\n";
+    const auto calibration = KeyDerivation::calibrate(target);
+    std::cout << "KDF: opslimit=" << calibration.params.opsLimit << " memlimit=" << (calibration.params.memLimit >> 20)
+              << " MiB, one unlock takes ~" << calibration.elapsed.count() << " ms here.\n";
+
+    return calibration.params;
 }
 
-static std::vector<unsigned char> readStdinBinary() {
-#ifdef _WIN32
-    _setmode(_fileno(stdin), _O_BINARY);
-#endif
-    std::istreambuf_iterator<char> begin(std::cin), end;
+#ifndef _WIN32
+static std::optional<int> runWithAgent(const CLIOptions &opts) {
+    static const std::set<std::string> served {"add", "get", "list", "remove"};
+    // Commands that open the store themselves; 'export' would read it while the agent writes.
+    static const std::set<std::string> writers {"init", "retune-kdf", "add-batch", "remove-batch", "compact", "gc", "train-dict",
+        "import", "export"};
+    if (!served.contains(opts.command) && !writers.contains(opts.command)) {
+        return std::nullopt;
+    }
+
+    auto agent = AgentClient::connect(AgentProtocol::socketPath(PlatformPaths::dataDir()));
+    if (!agent) {
+        return std::nullopt;
+    }
+    if (writers.contains(opts.command)) {
+        std::cout << "An agent is serving this vault; stop it first (encora_agent stop <password>).\n";
+        return EXIT_FAILURE;
+    }
+    // Missing arguments are reported as without an agent.
+    if (opts.password.empty() || (opts.command != "list" && opts.name.empty()) || (opts.command == "add" && opts.type.empty())) {
+        return std::nullopt;
+    }
+
+    // 'get' writes the record itself to stdout.
+    std::ostream &messages = opts.command == "get" ? std::cerr : std::cout;
+    try {
+        if (opts.command == "add") {
+            std::ifstream file;
+            std::istringstream inlineData(opts.dataInline);
+            std::istream *in = &inlineData;
+            if (opts.m_useStdin) {
+                in = &std::cin;
+            } else if (!opts.dataFIle.empty()) {
+                file.open(opts.dataFIle, std::ios::binary);
+                if (!file.is_open()) {
+                    std::cout << "Read data failed: Failed to open data file: " << opts.dataFIle << "\n";
+                    return EXIT_FAILURE;
+                }
+                in = &file;
+            }
+            if (in->peek() == std::char_traits<char>::eof()) {
+                std::cout << "No data provided (stdin/file/inline is empty).\n";
+                return EXIT_SUCCESS;
+            }
+            (void) agent->add(opts.password, opts.name, opts.type, *in);
+            std::cout << "Added: " << opts.name << "\n";
+        } else if (opts.command == "get") {
+            (void) agent->get(opts.password, opts.name, std::cout);
+            std::cout.flush();
+        } else if (opts.command == "list") {
+            for (const auto &rec : agent->list(opts.password, opts.prefix)) {
+                std::cout << " * " << rec << "\n";
+            }
+        } else if (agent->remove(opts.password, opts.name)) {
+            std::cout << "Removed successfully: " << opts.name << "\n";
+        }
+    } catch (const std::exception &e) {
+        auto command = opts.command;
+        command[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(command[0])));
+        messages << command << " failed: " << e.what() << "\n";
+        EncoraLogger::Logger::log(EncoraLogger::Level::Error, opts.command + " (agent): " + e.what());
+        return EXIT_FAILURE;
+    }
 
-    return std::vector<unsigned char>(begin, end);
-}
\ No newline at end of file
+    return EXIT_SUCCESS;
+}
+#endif
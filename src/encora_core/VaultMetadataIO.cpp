@@ -3,6 +3,7 @@
 #include <fstream>
 
 #include "VaultMetadataIO.h"
+#include "platform/FileHandle.h"
 #include "utils/Base64.h"
 #include "utils/HMAC.h"
 
@@ -57,11 +58,25 @@ void VaultMetadataIO::save(const std::string &path, const VaultMetadata &meta, c
     j["hmac"] = Base64::encode(hmac);
 
     fs::create_directories(fs::path(path).parent_path());
-    std::ofstream ofs(path);
-    if (!ofs.is_open()) {
-        throw std::runtime_error("Failed to open vault meta for writing.");
+    // The wrapped VMK has no other copy: write aside and swap, never leave a torn file.
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::trunc);
+        if (!ofs.is_open()) {
+            throw std::runtime_error("Failed to open vault meta for writing.");
+        }
+
+        ofs << j.dump(4);
+        if (!ofs.good()) {
+            throw std::runtime_error("Failed to write vault meta.");
+        }
+    }
+
+    if (FileHandle tmp; !tmp.open(tmpPath, true)) {
+        throw std::runtime_error("Failed to open vault meta for sync.");
+    } else {
+        tmp.sync();
     }
 
-    ofs << j.dump(4);
-    ofs.close();
+    fs::rename(tmpPath, path);
 }
\ No newline at end of file
@@ -15,7 +15,7 @@ public:
     // Load metadata from disk path. Throws on failure.
     static VaultMetadata load(const std::string &path, const std::vector<unsigned char> &derived);
 
-    // Save metadata to disk path. Overwrites existing file.
+    // Save metadata to disk path. Replaces an existing file atomically (temp file, fsync, rename).
     static void save(const std::string &path, const VaultMetadata &meta, const std::vector<unsigned char> &derived);
 };
 
@@ -0,0 +1,170 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <utility>
+
+#include "AgentClient.h"
+
+using Op = AgentProtocol::Op;
+using Status = AgentProtocol::Status;
+
+std::optional<AgentClient> AgentClient::connect(const std::string &socketPath) {
+    sockaddr_un address {};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return std::nullopt;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    // The password goes out with every request: only to an agent of our own.
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || !AgentProtocol::peerIsSelf(fd)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    return AgentClient(fd);
+}
+
+AgentClient::~AgentClient() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+AgentClient::AgentClient(AgentClient &&other) noexcept : m_fd(std::exchange(other.m_fd, -1)), m_message(std::move(other.m_message)) {}
+
+AgentClient &AgentClient::operator=(AgentClient &&other) noexcept {
+    if (this != &other) {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        m_fd = std::exchange(other.m_fd, -1);
+        m_message = std::move(other.m_message);
+    }
+    return *this;
+}
+
+void AgentClient::ping() {
+    send(request(Op::Ping, {}));
+    reply().end();
+}
+
+std::uint64_t AgentClient::add(const std::string &password, const std::string &name, const std::string &type, std::istream &in) {
+    auto message = request(Op::Add, password);
+    message.string(name).string(type);
+    send(message);
+    reply().end();
+
+    std::vector<char> piece(AgentProtocol::PIECE_SIZE);
+    while (in) {
+        in.read(piece.data(), static_cast<std::streamsize>(piece.size()));
+        const auto got = static_cast<std::size_t>(in.gcount());
+        if (got > 0) {
+            AgentProtocol::send(m_fd, std::span(reinterpret_cast<const unsigned char *>(piece.data()), got));
+        }
+    }
+    if (in.bad()) {
+        // Closing the stream early would store a truncated record: drop the connection instead.
+        ::shutdown(m_fd, SHUT_RDWR);
+        throw AgentError("Failed to read the data to add.");
+    }
+    AgentProtocol::send(m_fd, {});
+
+    auto result = reply();
+    const auto stored = result.u64();
+    result.end();
+
+    return stored;
+}
+
+std::uint64_t AgentClient::get(const std::string &password, const std::string &name, std::ostream &out) {
+    auto message = request(Op::Get, password);
+    message.string(name);
+    send(message);
+    reply().end();
+
+    std::uint64_t written = 0;
+    for (;;) {
+        if (!AgentProtocol::receive(m_fd, m_message)) {
+            throw AgentError("Agent closed the connection.");
+        }
+        if (m_message.empty()) {
+            break;
+        }
+        out.write(reinterpret_cast<const char *>(m_message.data()), static_cast<std::streamsize>(m_message.size()));
+        written += m_message.size();
+    }
+
+    auto result = reply();
+    (void) result.u64();
+    result.end();
+
+    return written;
+}
+
+std::vector<std::string> AgentClient::list(const std::string &password, const std::string &prefix) {
+    auto message = request(Op::List, password);
+    message.string(prefix);
+    send(message);
+
+    auto result = reply();
+    std::vector<std::string> names(result.u32());
+    for (auto &name : names) {
+        name = result.string();
+    }
+    result.end();
+
+    return names;
+}
+
+bool AgentClient::remove(const std::string &password, const std::string &name) {
+    auto message = request(Op::Remove, password);
+    message.string(name);
+    send(message);
+
+    auto result = reply();
+    const bool removed = result.u8() != 0;
+    result.end();
+
+    return removed;
+}
+
+void AgentClient::stop(const std::string &password) {
+    send(request(Op::Stop, password));
+    reply().end();
+}
+
+AgentProtocol::Writer AgentClient::request(const Op op, const std::string &password) {
+    AgentProtocol::Writer message;
+    message.u8(static_cast<std::uint8_t>(op)).string(password);
+    return message;
+}
+
+void AgentClient::send(const AgentProtocol::Writer &message) const {
+    AgentProtocol::send(m_fd, message.bytes());
+}
+
+AgentProtocol::Reader AgentClient::reply() {
+    if (!AgentProtocol::receive(m_fd, m_message)) {
+        throw AgentError("Agent closed the connection.");
+    }
+
+    AgentProtocol::Reader reader(m_message);
+    const auto status = static_cast<Status>(reader.u8());
+    auto text = reader.string();
+    switch (status) {
+        case Status::Ok:
+            return reader;
+        case Status::Denied:
+            throw AgentError(text.empty() ? "Wrong password." : text);
+        case Status::Failed:
+            throw AgentError(text);
+        default:
+            throw AgentError("Malformed agent reply.");
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CORE_AGENT_AGENT_CLIENT_H
+#define CORE_AGENT_AGENT_CLIENT_H
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AgentProtocol.h"
+
+/**
+ * AgentClient
+ *
+ * One connection to encora_agent (see AgentServer, AgentProtocol). Requests carry the
+ * password the caller was given; the agent answers Denied, and the call throws, unless it
+ * is the one the vault was unlocked with. Every request throws AgentError when it fails.
+ */
+class AgentClient {
+public:
+    // Connect to the agent listening on 'socketPath'; std::nullopt if none is running there
+    // or it does not run as our user.
+    static std::optional<AgentClient> connect(const std::string &socketPath);
+
+    ~AgentClient();
+    AgentClient(AgentClient &&other) noexcept;
+    AgentClient &operator=(AgentClient &&other) noexcept;
+
+    AgentClient(const AgentClient &) = delete;
+    AgentClient &operator=(const AgentClient &) = delete;
+
+    void ping();
+    // Add (or replace) a record read from 'in' up to EOF. Returns the bytes stored.
+    std::uint64_t add(const std::string &password, const std::string &name, const std::string &type, std::istream &in);
+    // Write a record to 'out'. Returns the bytes written; on failure a prefix may have been written.
+    std::uint64_t get(const std::string &password, const std::string &name, std::ostream &out);
+    std::vector<std::string> list(const std::string &password, const std::string &prefix);
+    bool remove(const std::string &password, const std::string &name);
+    // Have the agent lock the vault and exit.
+    void stop(const std::string &password);
+
+private:
+    explicit AgentClient(int fd) : m_fd(fd) {}
+
+    int m_fd = -1;
+    std::vector<unsigned char> m_message;
+
+    // Start a request; its arguments follow.
+    static AgentProtocol::Writer request(AgentProtocol::Op op, const std::string &password);
+    void send(const AgentProtocol::Writer &message) const;
+    // Receive a reply and throw unless it is Ok; the returned reader is past status and message.
+    AgentProtocol::Reader reply();
+};
+
+#endif //CORE_AGENT_AGENT_CLIENT_H
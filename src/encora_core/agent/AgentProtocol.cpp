@@ -0,0 +1,171 @@
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include "AgentProtocol.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// recv(2) exactly 'size' bytes. Returns how many arrived before the peer closed the connection.
+static std::size_t receiveAll(const int fd, unsigned char *out, const std::size_t size) {
+    std::size_t got = 0;
+    while (got < size) {
+        const auto n = ::recv(fd, out + got, size - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw AgentError(errno == EAGAIN || errno == EWOULDBLOCK ? std::string("Agent connection timed out.")
+                                                                     : std::string("Agent receive failed: ") + std::strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        got += static_cast<std::size_t>(n);
+    }
+
+    return got;
+}
+
+static void sendAll(const int fd, std::span<const unsigned char> data) {
+    while (!data.empty()) {
+        const auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            throw AgentError(std::string("Agent send failed: ") + std::strerror(errno));
+        }
+        data = data.subspan(static_cast<std::size_t>(n));
+    }
+}
+
+AgentProtocol::Writer &AgentProtocol::Writer::u8(const std::uint8_t value) {
+    m_bytes.push_back(value);
+    return *this;
+}
+
+AgentProtocol::Writer &AgentProtocol::Writer::u32(const std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        m_bytes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+    return *this;
+}
+
+AgentProtocol::Writer &AgentProtocol::Writer::u64(const std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        m_bytes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+    return *this;
+}
+
+AgentProtocol::Writer &AgentProtocol::Writer::string(const std::string &value) {
+    if (value.size() > MAX_MESSAGE) {
+        throw AgentError("Agent message too long.");
+    }
+    u32(static_cast<std::uint32_t>(value.size()));
+    m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+    return *this;
+}
+
+std::span<const unsigned char> AgentProtocol::Reader::take(const std::size_t size) {
+    if (size > m_body.size() - m_at) {
+        throw AgentError("Malformed agent message.");
+    }
+    const auto bytes = m_body.subspan(m_at, size);
+    m_at += size;
+
+    return bytes;
+}
+
+std::uint8_t AgentProtocol::Reader::u8() {
+    return take(1)[0];
+}
+
+std::uint32_t AgentProtocol::Reader::u32() {
+    const auto bytes = take(4);
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = value << 8 | bytes[static_cast<std::size_t>(i)];
+    }
+    return value;
+}
+
+std::uint64_t AgentProtocol::Reader::u64() {
+    const auto bytes = take(8);
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = value << 8 | bytes[static_cast<std::size_t>(i)];
+    }
+    return value;
+}
+
+std::string AgentProtocol::Reader::string() {
+    const auto bytes = take(u32());
+    return {bytes.begin(), bytes.end()};
+}
+
+void AgentProtocol::Reader::end() const {
+    if (m_at != m_body.size()) {
+        throw AgentError("Malformed agent message.");
+    }
+}
+
+std::string AgentProtocol::socketPath(const std::string &dataDir) {
+    return (std::filesystem::path(dataDir) / SOCKET_NAME).string();
+}
+
+void AgentProtocol::send(const int fd, const std::span<const unsigned char> body) {
+    if (body.size() > MAX_MESSAGE) {
+        throw AgentError("Agent message too long.");
+    }
+
+    const auto size = static_cast<std::uint32_t>(body.size());
+    const unsigned char length[4] = {
+        static_cast<unsigned char>(size), static_cast<unsigned char>(size >> 8),
+        static_cast<unsigned char>(size >> 16), static_cast<unsigned char>(size >> 24)
+    };
+    sendAll(fd, length);
+    sendAll(fd, body);
+}
+
+bool AgentProtocol::receive(const int fd, std::vector<unsigned char> &body) {
+    unsigned char length[4];
+    const auto got = receiveAll(fd, length, sizeof(length));
+    if (got == 0) {
+        return false;
+    }
+    if (got < sizeof(length)) {
+        throw AgentError("Agent connection closed mid-message.");
+    }
+
+    std::uint32_t size = 0;
+    for (int i = 3; i >= 0; --i) {
+        size = size << 8 | length[i];
+    }
+    if (size > MAX_MESSAGE) {
+        throw AgentError("Agent message too long.");
+    }
+    body.resize(size);
+    if (receiveAll(fd, body.data(), size) < size) {
+        throw AgentError("Agent connection closed mid-message.");
+    }
+
+    return true;
+}
+
+bool AgentProtocol::peerIsSelf(const int fd) {
+#ifdef SO_PEERCRED
+    ucred credentials {};
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+        return false;
+    }
+    return credentials.uid == ::geteuid();
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    return ::getpeereid(fd, &uid, &gid) == 0 && uid == ::geteuid();
+#endif
+}
@@ -0,0 +1,111 @@
+#ifndef CORE_AGENT_AGENT_PROTOCOL_H
+#define CORE_AGENT_AGENT_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class AgentError final : public std::runtime_error {
+public:
+    explicit AgentError(const std::string &err) : std::runtime_error(err) {};
+};
+
+/**
+ * AgentProtocol
+ *
+ * Wire format between encora_agent and encora_cli over the agent's Unix domain socket
+ * (socketPath(): next to vault.meta, so an agent serves the vault of the directory it was
+ * started in). Every message is a u32 LE length followed by that many bytes, at most
+ * MAX_MESSAGE; integers are little-endian, strings a u32 length and their bytes.
+ *
+ * Request:  op (u8) | password (string, empty for Ping) | arguments of the op
+ *      Ping, Stop:     -
+ *      Add:            name | type
+ *      Get:            name
+ *      List:           prefix
+ *      Remove:         name
+ * Reply:    status (u8) | message (string, empty unless Failed / Denied) | result of the op
+ *      Add, Get:       bytes (u64)
+ *      List:           count (u32) | names (string)*
+ *      Remove:         removed (u8)
+ * Add and Get move the record as a stream: a run of messages of at most PIECE_SIZE bytes each,
+ * ended by an empty one. The agent first replies Ok (nothing else) to accept the request,
+ * then the stream goes out (Add: from the client, Get: from the agent), then the agent sends
+ * the reply proper. A failure midway still ends the stream before the reply says what went wrong.
+ *
+ * A connection carries any number of requests, one at a time.
+ */
+class AgentProtocol {
+public:
+    enum class Op : std::uint8_t {
+        Ping = 1,
+        Add = 2,
+        Get = 3,
+        List = 4,
+        Remove = 5,
+        // Lock the vault and exit.
+        Stop = 6,
+    };
+
+    enum class Status : std::uint8_t {
+        Ok = 0,
+        Failed = 1,
+        // Wrong password: nothing was done.
+        Denied = 2,
+    };
+
+    // Bounds a List reply too: 16 MiB of names.
+    static constexpr std::uint32_t MAX_MESSAGE = 16 * 1024 * 1024;
+    static constexpr std::size_t PIECE_SIZE = 64 * 1024;
+    static constexpr const char *SOCKET_NAME = "agent.sock";
+
+    // Builds the body of a message.
+    class Writer {
+    public:
+        Writer &u8(std::uint8_t value);
+        Writer &u32(std::uint32_t value);
+        Writer &u64(std::uint64_t value);
+        Writer &string(const std::string &value);
+
+        [[nodiscard]]
+        const std::vector<unsigned char> &bytes() const { return m_bytes; }
+
+    private:
+        std::vector<unsigned char> m_bytes;
+    };
+
+    // Reads the body of a message front to back; throws AgentError past its end.
+    class Reader {
+    public:
+        explicit Reader(std::span<const unsigned char> body) : m_body(body) {}
+
+        std::uint8_t u8();
+        std::uint32_t u32();
+        std::uint64_t u64();
+        std::string string();
+        // Throws AgentError unless the whole body was read.
+        void end() const;
+
+    private:
+        std::span<const unsigned char> m_body;
+        std::size_t m_at = 0;
+
+        std::span<const unsigned char> take(std::size_t size);
+    };
+
+    // Socket of the agent serving the vault in 'dataDir'.
+    static std::string socketPath(const std::string &dataDir);
+
+    // Send one message over a connected socket. Throws AgentError.
+    static void send(int fd, std::span<const unsigned char> body);
+    // Receive one message into 'body'. Returns false if the peer closed the connection
+    // before a message started; throws AgentError on a broken or oversized one.
+    static bool receive(int fd, std::vector<unsigned char> &body);
+    // Whether the process at the other end of a connected socket runs as our user.
+    static bool peerIsSelf(int fd);
+};
+
+#endif //CORE_AGENT_AGENT_PROTOCOL_H
@@ -0,0 +1,430 @@
+#include <sodium.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <utility>
+
+#include "AgentServer.h"
+#include "AgentClient.h"
+#include "storage/EncryptedVaultStorage.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+using Op = AgentProtocol::Op;
+using Status = AgentProtocol::Status;
+
+namespace {
+    // Longest wait between idle checks.
+    constexpr int POLL_INTERVAL_MS = 1000;
+
+    AgentProtocol::Writer reply(const Status status, const std::string &message = {}) {
+        AgentProtocol::Writer writer;
+        writer.u8(static_cast<std::uint8_t>(status)).string(message);
+        return writer;
+    }
+
+    void setCloseOnExec(const int fd) {
+        ::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+
+    // The stream of an Add request, read as an std::istream.
+    class PieceReader final : public std::streambuf {
+    public:
+        explicit PieceReader(const int fd) : m_fd(fd) {}
+        ~PieceReader() override { sodium_memzero(m_piece.data(), m_piece.size()); }
+
+        // Skip what is left of the stream, so the connection can carry the reply.
+        void drain() {
+            while (!m_ended) {
+                setg(nullptr, nullptr, nullptr);
+                (void) underflow();
+            }
+        }
+
+        // The connection failed midway: it cannot carry a reply.
+        [[nodiscard]]
+        bool broken() const { return m_broken; }
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+            if (m_ended) {
+                return traits_type::eof();
+            }
+
+            sodium_memzero(m_piece.data(), m_piece.size());
+            try {
+                if (!AgentProtocol::receive(m_fd, m_piece)) {
+                    throw AgentError("Agent connection closed mid-stream.");
+                }
+            } catch (...) {
+                m_broken = true;
+                m_ended = true;
+                throw;
+            }
+            if (m_piece.empty()) {
+                m_ended = true;
+                return traits_type::eof();
+            }
+
+            auto *begin = reinterpret_cast<char *>(m_piece.data());
+            setg(begin, begin, begin + m_piece.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        int m_fd;
+        std::vector<unsigned char> m_piece;
+        bool m_ended = false;
+        bool m_broken = false;
+    };
+
+    // The stream of a Get reply, written as an std::ostream: a piece per PIECE_SIZE bytes.
+    class PieceWriter final : public std::streambuf {
+    public:
+        explicit PieceWriter(const int fd) : m_fd(fd), m_piece(AgentProtocol::PIECE_SIZE) {
+            setp(m_piece.data(), m_piece.data() + m_piece.size());
+        }
+        ~PieceWriter() override { sodium_memzero(m_piece.data(), m_piece.size()); }
+
+        // Send what is buffered and end the stream.
+        void finish() {
+            if (!flush()) {
+                throw AgentError("Agent connection failed mid-stream.");
+            }
+            AgentProtocol::send(m_fd, {});
+        }
+
+        [[nodiscard]]
+        bool broken() const { return m_broken; }
+
+    protected:
+        int_type overflow(const int_type c) override {
+            if (!flush()) {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override { return flush() ? 0 : -1; }
+
+    private:
+        int m_fd;
+        std::vector<char> m_piece;
+        bool m_broken = false;
+
+        bool flush() {
+            if (m_broken) {
+                return false;
+            }
+            const auto size = static_cast<std::size_t>(pptr() - pbase());
+            if (size > 0) {
+                try {
+                    AgentProtocol::send(m_fd, std::span(reinterpret_cast<const unsigned char *>(m_piece.data()), size));
+                } catch (const AgentError &) {
+                    m_broken = true;
+                    return false;
+                }
+            }
+            setp(m_piece.data(), m_piece.data() + m_piece.size());
+            return true;
+        }
+    };
+}
+
+AgentServer::AgentServer(const std::string &socketPath, const std::vector<unsigned char> &vmk, const std::string &password,
+    const AgentOptions &options) : m_socketPath(socketPath), m_options(options) {
+    if (sodium_init() < 0) {
+        throw AgentError("libsodium initialization failed.");
+    }
+
+    std::error_code ec;
+    if (fs::exists(fs::symlink_status(socketPath, ec))) {
+        if (AgentClient::connect(socketPath)) {
+            throw AgentError("An agent is already serving this vault (" + socketPath + ").");
+        }
+        if (!fs::is_socket(fs::symlink_status(socketPath, ec))) {
+            throw AgentError("Not a socket, leaving it alone: " + socketPath);
+        }
+        // Left behind by an agent that did not exit cleanly.
+        fs::remove(socketPath, ec);
+    }
+
+    m_storage = std::make_unique<EncryptedVaultStorage>(vmk);
+    randombytes_buf(m_passwordKey.data(), m_passwordKey.size());
+    crypto_generichash(m_passwordHash.data(), m_passwordHash.size(), reinterpret_cast<const unsigned char *>(password.data()),
+        password.size(), m_passwordKey.data(), m_passwordKey.size());
+
+    sockaddr_un address {};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw AgentError("Agent socket path too long: " + socketPath);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw AgentError(std::string("Cannot create agent socket: ") + std::strerror(errno));
+    }
+    setCloseOnExec(fd);
+    // Never reachable by anyone else, not even between bind and chmod.
+    const auto mask = ::umask(0077);
+    const bool bound = ::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    const auto bindError = errno;
+    ::umask(mask);
+    if (!bound || ::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(fd, SOMAXCONN) != 0
+        || ::pipe(m_wake) != 0) {
+        const auto error = bound ? errno : bindError;
+        ::close(fd);
+        if (bound) {
+            ::unlink(socketPath.c_str());
+        }
+        throw AgentError("Cannot listen on " + socketPath + ": " + std::strerror(error));
+    }
+    setCloseOnExec(m_wake[0]);
+    setCloseOnExec(m_wake[1]);
+    m_listen = fd;
+    touch();
+
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Agent: listening on " + socketPath + ".");
+}
+
+AgentServer::~AgentServer() {
+    ::close(m_listen);
+    ::unlink(m_socketPath.c_str());
+    ::close(m_wake[0]);
+    ::close(m_wake[1]);
+    sodium_memzero(m_passwordKey.data(), m_passwordKey.size());
+    sodium_memzero(m_passwordHash.data(), m_passwordHash.size());
+    m_storage.reset();
+
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Agent: vault locked, socket removed.");
+}
+
+void AgentServer::run() {
+    for (;;) {
+        pollfd fds[2] = {{m_listen, POLLIN, 0}, {m_wake[0], POLLIN, 0}};
+        const int ready = ::poll(fds, 2, POLL_INTERVAL_MS);
+        if (ready < 0 && errno != EINTR) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Agent: poll failed: ") + std::strerror(errno));
+            break;
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN) != 0) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Agent: stopping.");
+            break;
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN) != 0) {
+            const int fd = ::accept(m_listen, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            setCloseOnExec(fd);
+            if (!m_peerCheck(fd)) {
+                EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Agent: refused a connection from another user.");
+                ::close(fd);
+                continue;
+            }
+
+            std::lock_guard lock(m_mutex);
+            m_connections.emplace(fd, false);
+            std::thread([this, fd] { serve(fd); }).detach();
+            continue;
+        }
+
+        std::lock_guard lock(m_mutex);
+        const auto idle = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(m_lastRequest.load()));
+        const bool busy = std::ranges::any_of(m_connections, [](const auto &connection) { return connection.second; });
+        if (!busy && m_options.idleTimeout.count() > 0 && idle >= m_options.idleTimeout) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Agent: idle for "
+                + std::to_string(m_options.idleTimeout.count()) + " s, locking.");
+            break;
+        }
+    }
+
+    // Requests in progress are finished; connections waiting for one are closed.
+    std::unique_lock lock(m_mutex);
+    m_stopping = true;
+    for (const auto &[fd, busy] : m_connections) {
+        if (!busy) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    m_idle.wait(lock, [this] { return m_connections.empty(); });
+}
+
+void AgentServer::setPeerCheck(std::function<bool(int)> check) {
+    m_peerCheck = std::move(check);
+}
+
+void AgentServer::stop() noexcept {
+    const char byte = 0;
+    (void) !::write(m_wake[1], &byte, 1);
+}
+
+bool AgentServer::passwordMatches(const std::string &password) const {
+    std::array<unsigned char, 32> hash {};
+    crypto_generichash(hash.data(), hash.size(), reinterpret_cast<const unsigned char *>(password.data()), password.size(),
+        m_passwordKey.data(), m_passwordKey.size());
+    const bool matches = sodium_memcmp(hash.data(), m_passwordHash.data(), hash.size()) == 0;
+    sodium_memzero(hash.data(), hash.size());
+
+    return matches;
+}
+
+void AgentServer::serve(const int fd) {
+    std::vector<unsigned char> message;
+    try {
+        while (AgentProtocol::receive(fd, message)) {
+            {
+                std::lock_guard lock(m_mutex);
+                m_connections[fd] = true;
+            }
+            touch();
+
+            AgentProtocol::Reader reader(message);
+            const auto op = static_cast<Op>(reader.u8());
+            auto password = reader.string();
+            const bool allowed = op == Op::Ping || passwordMatches(password);
+            sodium_memzero(password.data(), password.size());
+            if (allowed) {
+                handle(fd, op, reader);
+            } else {
+                EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Agent: refused a request with the wrong password.");
+                AgentProtocol::send(fd, reply(Status::Denied, "Wrong password.").bytes());
+            }
+            sodium_memzero(message.data(), message.size());
+            touch();
+
+            std::lock_guard lock(m_mutex);
+            m_connections[fd] = false;
+            if (m_stopping) {
+                break;
+            }
+        }
+    } catch (const std::exception &e) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("Agent: connection dropped: ") + e.what());
+    }
+    sodium_memzero(message.data(), message.size());
+
+    {
+        // Last touch of 'this': run() may return as soon as the set is empty.
+        std::lock_guard lock(m_mutex);
+        m_connections.erase(fd);
+        m_idle.notify_all();
+    }
+    ::close(fd);
+}
+
+void AgentServer::handle(const int fd, const Op op, AgentProtocol::Reader &arguments) {
+    switch (op) {
+        case Op::Ping:
+            arguments.end();
+            AgentProtocol::send(fd, reply(Status::Ok).bytes());
+            return;
+        case Op::Stop:
+            arguments.end();
+            AgentProtocol::send(fd, reply(Status::Ok).bytes());
+            stop();
+            return;
+        case Op::List: {
+            const auto prefix = arguments.string();
+            arguments.end();
+            std::vector<std::string> names;
+            try {
+                names = m_storage->list(prefix);
+            } catch (const std::exception &e) {
+                AgentProtocol::send(fd, reply(Status::Failed, e.what()).bytes());
+                return;
+            }
+            auto result = reply(Status::Ok);
+            result.u32(static_cast<std::uint32_t>(names.size()));
+            for (const auto &name : names) {
+                result.string(name);
+            }
+            AgentProtocol::send(fd, result.bytes());
+            return;
+        }
+        case Op::Remove: {
+            const auto name = arguments.string();
+            arguments.end();
+            bool removed = false;
+            try {
+                removed = m_storage->remove(name);
+            } catch (const std::exception &e) {
+                AgentProtocol::send(fd, reply(Status::Failed, e.what()).bytes());
+                return;
+            }
+            AgentProtocol::send(fd, reply(Status::Ok).u8(removed ? 1 : 0).bytes());
+            return;
+        }
+        case Op::Add: {
+            const auto name = arguments.string();
+            const auto type = arguments.string();
+            arguments.end();
+            AgentProtocol::send(fd, reply(Status::Ok).bytes());
+
+            PieceReader pieces(fd);
+            std::istream in(&pieces);
+            std::uint64_t stored = 0;
+            try {
+                stored = m_storage->addRecordFrom(name, type, in);
+            } catch (const std::exception &e) {
+                if (pieces.broken()) {
+                    throw AgentError(std::string("Add of '") + name + "' cut short: " + e.what());
+                }
+                pieces.drain();
+                AgentProtocol::send(fd, reply(Status::Failed, e.what()).bytes());
+                return;
+            }
+            AgentProtocol::send(fd, reply(Status::Ok).u64(stored).bytes());
+            return;
+        }
+        case Op::Get: {
+            const auto name = arguments.string();
+            arguments.end();
+            AgentProtocol::send(fd, reply(Status::Ok).bytes());
+
+            PieceWriter pieces(fd);
+            std::ostream out(&pieces);
+            std::uint64_t written = 0;
+            std::string failure;
+            try {
+                written = m_storage->loadRecordTo(name, out);
+            } catch (const std::exception &e) {
+                if (pieces.broken()) {
+                    throw AgentError(std::string("Get of '") + name + "' cut short: " + e.what());
+                }
+                failure = e.what();
+            }
+            pieces.finish();
+            AgentProtocol::send(fd, (failure.empty() ? reply(Status::Ok).u64(written) : reply(Status::Failed, failure)).bytes());
+            return;
+        }
+    }
+
+    AgentProtocol::send(fd, reply(Status::Failed, "Unknown request.").bytes());
+}
+
+void AgentServer::touch() {
+    m_lastRequest.store(std::chrono::steady_clock::now().time_since_epoch().count());
+}
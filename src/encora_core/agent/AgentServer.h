@@ -0,0 +1,83 @@
+#ifndef CORE_AGENT_AGENT_SERVER_H
+#define CORE_AGENT_AGENT_SERVER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AgentProtocol.h"
+
+class EncryptedVaultStorage;
+
+struct AgentOptions {
+    // Lock the vault and exit after this long without a request; 0 keeps it unlocked until stopped.
+    std::chrono::seconds idleTimeout {15 * 60};
+};
+
+/**
+ * AgentServer
+ *
+ * The vault kept unlocked by encora_agent: one EncryptedVaultStorage, served to encora_cli
+ * over a Unix domain socket (AgentProtocol) so commands skip the Argon2id unlock.
+ *
+ * The socket is created mode 0600 and only connections from processes of our own user are
+ * served (SO_PEERCRED). Requests but Ping must carry the password the vault was unlocked with: it is
+ * kept as a BLAKE2b hash under a random key, so a check costs microseconds and the password
+ * itself is not kept. Each connection is served on a thread of its own; the storage
+ * serializes what it must.
+ *
+ * run() returns on stop() (a Stop request, or a signal handler) or once no request came for
+ * AgentOptions::idleTimeout, after finishing the requests in progress; the destructor then
+ * drops the storage (and its keys) and removes the socket.
+ */
+class AgentServer {
+public:
+    // Listen on 'socketPath' for the vault of 'vmk', unlocked with 'password'. Throws AgentError
+    // if an agent is already listening there or the socket cannot be created.
+    AgentServer(const std::string &socketPath, const std::vector<unsigned char> &vmk, const std::string &password,
+        const AgentOptions &options = {});
+    ~AgentServer();
+
+    AgentServer(const AgentServer &) = delete;
+    AgentServer &operator=(const AgentServer &) = delete;
+
+    // Serve connections until stop() or the idle timeout, then wait for those in progress.
+    void run();
+    // Make run() return. Async-signal-safe.
+    void stop() noexcept;
+    // Decides whether the peer of an accepted connection is served (AgentProtocol::peerIsSelf). Set before run().
+    void setPeerCheck(std::function<bool(int)> check);
+
+private:
+    std::string m_socketPath;
+    AgentOptions m_options;
+    std::unique_ptr<EncryptedVaultStorage> m_storage;
+    std::array<unsigned char, 32> m_passwordKey {};
+    std::array<unsigned char, 32> m_passwordHash {};
+    int m_listen = -1;
+    // Self-pipe: stop() writes to it to wake run().
+    int m_wake[2] = {-1, -1};
+    std::function<bool(int)> m_peerCheck = AgentProtocol::peerIsSelf;
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    // Open connections, and whether each is in the middle of a request.
+    std::unordered_map<int, bool> m_connections;
+    bool m_stopping = false;
+    std::atomic<std::chrono::steady_clock::rep> m_lastRequest {0};
+
+    [[nodiscard]]
+    bool passwordMatches(const std::string &password) const;
+    void serve(int fd);
+    void handle(int fd, AgentProtocol::Op op, AgentProtocol::Reader &arguments);
+    void touch();
+};
+
+#endif //CORE_AGENT_AGENT_SERVER_H
@@ -1,28 +1,188 @@
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
 #include "CryptoEngine.h"
 
-std::vector<unsigned char> CryptoEngine::encrypt(const std::string &text, const std::vector<unsigned char> &key) {
-    // TEMPORARY FAKE ENCRYPTION
-    // just XOR for each byte with key[0] for stub logic
-    // (this is NOT secure, it's just to prove pipeline)
-    std::vector<unsigned char> result;
-    result.reserve(text.size());
-    const unsigned char k = key.empty() ? 0xAA : key[0];
-    for (const unsigned char c : text) {
-        result.push_back(c ^ k);
+namespace {
+    // Cipher suite policies: sizes, key schedule and the libsodium calls of one AEAD.
+    struct XChaCha20Poly1305Policy {
+        static constexpr CipherSuite SUITE = CipherSuite::XChaCha20Poly1305;
+        static constexpr std::string_view NAME = "XChaCha20-Poly1305";
+        static constexpr std::size_t NONCE_SIZE = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+        using State = std::array<unsigned char, crypto_aead_xchacha20poly1305_ietf_KEYBYTES>;
+
+        static bool available() { return true; }
+
+        static void expand(State &state, const unsigned char *key) {
+            std::memcpy(state.data(), key, state.size());
+        }
+
+        static void encrypt(const State &state, unsigned char *out, const unsigned char *plain, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            crypto_aead_xchacha20poly1305_ietf_encrypt(out, nullptr, plain, size, aad, aadSize, nullptr, nonce, state.data());
+        }
+
+        static bool decrypt(const State &state, unsigned char *out, const unsigned char *sealed, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            return crypto_aead_xchacha20poly1305_ietf_decrypt(out, nullptr, nullptr, sealed, size, aad, aadSize, nonce, state.data()) == 0;
+        }
+    };
+
+    struct Aes256GcmPolicy {
+        static constexpr CipherSuite SUITE = CipherSuite::Aes256Gcm;
+        static constexpr std::string_view NAME = "AES-256-GCM";
+        static constexpr std::size_t NONCE_SIZE = crypto_aead_aes256gcm_NPUBBYTES;
+        using State = crypto_aead_aes256gcm_state;
+
+        static bool available() {
+            static const bool cpu = crypto_aead_aes256gcm_is_available() != 0;
+            return cpu;
+        }
+
+        static void expand(State &state, const unsigned char *key) {
+            crypto_aead_aes256gcm_beforenm(&state, key);
+        }
+
+        static void encrypt(const State &state, unsigned char *out, const unsigned char *plain, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            crypto_aead_aes256gcm_encrypt_afternm(out, nullptr, plain, size, aad, aadSize, nullptr, nonce, &state);
+        }
+
+        static bool decrypt(const State &state, unsigned char *out, const unsigned char *sealed, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            return crypto_aead_aes256gcm_decrypt_afternm(out, nullptr, nullptr, sealed, size, aad, aadSize, nonce, &state) == 0;
+        }
+    };
+
+    static_assert(crypto_aead_xchacha20poly1305_ietf_KEYBYTES == CryptoEngine::KEY_SIZE);
+    static_assert(crypto_aead_aes256gcm_KEYBYTES == CryptoEngine::KEY_SIZE);
+    static_assert(crypto_aead_xchacha20poly1305_ietf_ABYTES == CryptoEngine::TAG_SIZE);
+    static_assert(crypto_aead_aes256gcm_ABYTES == CryptoEngine::TAG_SIZE);
+    static_assert(XChaCha20Poly1305Policy::NONCE_SIZE <= CryptoEngine::MAX_NONCE_SIZE);
+    static_assert(Aes256GcmPolicy::NONCE_SIZE <= CryptoEngine::MAX_NONCE_SIZE);
+
+    void initSodium() {
+        // Once per process: an engine is constructed for every record.
+        static const int status = sodium_init();
+        if (status < 0) {
+            throw std::runtime_error("CryptoEngine: sodium_init() failed.");
+        }
     }
+}
+
+struct CryptoEngine::Dispatch {
+    CipherSuite suite;
+    std::string_view name;
+    std::size_t nonceSize;
+    bool (*available)();
+    void (*expand)(void *state, const unsigned char *key);
+    void (*encrypt)(const void *state, unsigned char *out, const unsigned char *plain, std::size_t size,
+        const unsigned char *aad, std::size_t aadSize, const unsigned char *nonce);
+    bool (*decrypt)(const void *state, unsigned char *out, const unsigned char *sealed, std::size_t size,
+        const unsigned char *aad, std::size_t aadSize, const unsigned char *nonce);
+};
 
-    return result;
+namespace {
+    template <class Policy>
+    constexpr CryptoEngine::Dispatch DISPATCH {
+        Policy::SUITE,
+        Policy::NAME,
+        Policy::NONCE_SIZE,
+        &Policy::available,
+        [](void *state, const unsigned char *key) {
+            Policy::expand(*static_cast<typename Policy::State *>(state), key);
+        },
+        [](const void *state, unsigned char *out, const unsigned char *plain, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            Policy::encrypt(*static_cast<const typename Policy::State *>(state), out, plain, size, aad, aadSize, nonce);
+        },
+        [](const void *state, unsigned char *out, const unsigned char *sealed, const std::size_t size,
+            const unsigned char *aad, const std::size_t aadSize, const unsigned char *nonce) {
+            return Policy::decrypt(*static_cast<const typename Policy::State *>(state), out, sealed, size, aad, aadSize, nonce);
+        },
+    };
+
+    const CryptoEngine::Dispatch &dispatchOf(const CipherSuite suite) {
+        switch (suite) {
+            case CipherSuite::XChaCha20Poly1305:
+                return DISPATCH<XChaCha20Poly1305Policy>;
+            case CipherSuite::Aes256Gcm:
+                return DISPATCH<Aes256GcmPolicy>;
+        }
+        throw std::runtime_error("Unknown cipher suite: " + std::to_string(static_cast<unsigned>(suite)));
+    }
 }
 
-std::string CryptoEngine::decrypt(const std::string &cipher, const std::vector<unsigned char> &key) {
-    // reverse of encrypt() stub
-    const unsigned char k = key.empty() ? 0xAA : key[0];
-    std::string result;
-    result.reserve(cipher.size());
+CipherSuite CryptoEngine::preferred() {
+    static const CipherSuite suite = available(CipherSuite::Aes256Gcm) ? CipherSuite::Aes256Gcm : CipherSuite::XChaCha20Poly1305;
+    return suite;
+}
+
+bool CryptoEngine::available(const CipherSuite suite) {
+    initSodium();
+    return dispatchOf(suite).available();
+}
+
+CipherSuite CryptoEngine::suiteOf(const unsigned id) {
+    if (id > UINT8_MAX) {
+        throw std::runtime_error("Unknown cipher suite: " + std::to_string(id));
+    }
+    return dispatchOf(static_cast<CipherSuite>(id)).suite;
+}
 
-    for (const unsigned char c : cipher) {
-        result.push_back(static_cast<char>(c ^ k));
+std::size_t CryptoEngine::nonceSize(const CipherSuite suite) {
+    return dispatchOf(suite).nonceSize;
+}
+
+std::string_view CryptoEngine::name(const CipherSuite suite) {
+    return dispatchOf(suite).name;
+}
+
+CryptoEngine::CryptoEngine(const std::span<const unsigned char> key, const CipherSuite suite) : m_dispatch(&dispatchOf(suite)) {
+    if (key.size() != KEY_SIZE) {
+        throw std::invalid_argument("CryptoEngine: wrong key size.");
+    }
+    if (!available(suite)) {
+        throw std::runtime_error(std::string(m_dispatch->name) + " is not available on this CPU.");
+    }
+
+    m_dispatch->expand(m_state.data(), key.data());
+}
+
+CryptoEngine::~CryptoEngine() {
+    sodium_memzero(m_state.data(), m_state.size());
+}
+
+CipherSuite CryptoEngine::suite() const {
+    return m_dispatch->suite;
+}
+
+std::size_t CryptoEngine::nonceSize() const {
+    return m_dispatch->nonceSize;
+}
+
+void CryptoEngine::encrypt(const std::span<unsigned char> out, const std::span<const unsigned char> plain,
+    const std::span<const unsigned char> nonce, const std::span<const unsigned char> aad) const {
+    if (nonce.size() != m_dispatch->nonceSize || out.size() < plain.size() + TAG_SIZE) {
+        throw std::invalid_argument("CryptoEngine::encrypt: wrong nonce or output size.");
+    }
+
+    m_dispatch->encrypt(m_state.data(), out.data(), plain.data(), plain.size(), aad.data(), aad.size(), nonce.data());
+}
+
+bool CryptoEngine::decrypt(const std::span<unsigned char> out, const std::span<const unsigned char> sealed,
+    const std::span<const unsigned char> nonce, const std::span<const unsigned char> aad) const {
+    if (nonce.size() != m_dispatch->nonceSize) {
+        throw std::invalid_argument("CryptoEngine::decrypt: wrong nonce size.");
+    }
+    if (sealed.size() < TAG_SIZE) {
+        return false;
+    }
+    if (out.size() < sealed.size() - TAG_SIZE) {
+        throw std::invalid_argument("CryptoEngine::decrypt: output too small.");
     }
 
-    return result;
+    return m_dispatch->decrypt(m_state.data(), out.data(), sealed.data(), sealed.size(), aad.data(), aad.size(), nonce.data());
 }
@@ -1,25 +1,84 @@
 #ifndef CORE_CRYPTO_ENGINE_H
 #define CORE_CRYPTO_ENGINE_H
 
-#include <string>
-#include <vector>
+#include <sodium.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+// AEAD algorithm of sealed data. The id is stored with the data (0 = what everything
+// was sealed with before suites existed).
+enum class CipherSuite : unsigned char {
+    XChaCha20Poly1305 = 0,
+    Aes256Gcm = 1,
+};
 
 /**
  * CryptoEngine
  *
- * Placeholder for symmetric encryption/decryption.
- * Later will wrap libsodium (XChaCha20-Poly1305).
+ * The AEAD layer: a key bound to one cipher suite, all suites with a 32-byte key and a
+ * 16-byte tag.
+ *      XChaCha20Poly1305   - 24-byte nonces, safe to pick at random; runs everywhere
+ *      Aes256Gcm           - 12-byte nonces; needs AES-NI + CLMUL (libsodium has no
+ *                            portable AES), several times faster where it has them
+ *
+ * Each suite is a policy (nonce size, key schedule, encrypt / decrypt); the engine
+ * resolves the suite's functions once, when it is constructed, and every call goes
+ * straight to them. AES-256-GCM keys are expanded once per engine, not per call.
+ * An engine is immutable after construction: encrypt / decrypt may run on many threads.
  *
- * For now it's just a skeleton so code links.
+ * preferred() is the suite for new data on this machine, decided once per process.
+ * Data sealed with AES-256-GCM cannot be opened on a CPU without AES-NI; that throws.
  */
 class CryptoEngine {
 public:
-    CryptoEngine() = default;
+    static constexpr std::size_t KEY_SIZE = 32;
+    static constexpr std::size_t TAG_SIZE = 16;
+    static constexpr std::size_t MAX_NONCE_SIZE = 24;
+
+    // AES-256-GCM if this CPU has AES-NI and CLMUL, else XChaCha20-Poly1305.
+    static CipherSuite preferred();
+    // Whether this machine can use 'suite'; probed once per process.
+    static bool available(CipherSuite suite);
+    // Suite with id 'id'. Throws std::runtime_error if there is none.
+    static CipherSuite suiteOf(unsigned id);
+    static std::size_t nonceSize(CipherSuite suite);
+    static std::string_view name(CipherSuite suite);
+
+    // Throws std::invalid_argument if 'key' is not KEY_SIZE bytes, std::runtime_error if
+    // 'suite' is not available here.
+    explicit CryptoEngine(std::span<const unsigned char> key, CipherSuite suite = preferred());
+    ~CryptoEngine();
+
+    CryptoEngine(const CryptoEngine &) = delete;
+    CryptoEngine &operator=(const CryptoEngine &) = delete;
+
+    [[nodiscard]]
+    CipherSuite suite() const;
+    [[nodiscard]]
+    std::size_t nonceSize() const;
+
+    // out = ciphertext || tag of 'plain'; 'out' holds plain.size() + TAG_SIZE bytes. 'nonce' is
+    // nonceSize() bytes and must never be used twice with this key.
+    void encrypt(std::span<unsigned char> out, std::span<const unsigned char> plain, std::span<const unsigned char> nonce,
+        std::span<const unsigned char> aad = {}) const;
+    // out = plaintext of 'sealed' (ciphertext || tag); 'out' holds sealed.size() - TAG_SIZE bytes.
+    // False if 'sealed' does not authenticate.
+    [[nodiscard]]
+    bool decrypt(std::span<unsigned char> out, std::span<const unsigned char> sealed, std::span<const unsigned char> nonce,
+        std::span<const unsigned char> aad = {}) const;
+
+    // A suite's functions, instantiated from its policy (see CryptoEngine.cpp).
+    struct Dispatch;
+
+private:
+    static constexpr std::size_t STATE_SIZE = std::max(sizeof(crypto_aead_aes256gcm_state), KEY_SIZE);
 
-    // Encrypt plain text using some key -> cipher_text
-    std::vector<unsigned char> encrypt(const std::string &text, const std::vector<unsigned char> &key);
-    // Decrypt cipher_text using some key -> plain text
-    std::string decrypt(const std::string &cipher, const std::vector<unsigned char> &key);
+    const Dispatch *m_dispatch;
+    // The suite's key schedule.
+    alignas(16) std::array<unsigned char, STATE_SIZE> m_state {};
 };
 
 #endif //CORE_CRYPTO_ENGINE_H
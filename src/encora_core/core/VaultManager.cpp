@@ -15,23 +15,22 @@
 
 using json = nlohmann::json;
 
-VaultManager::VaultManager() : m_isUnlocked(false) {
+VaultManager::VaultManager() : m_isUnlocked(false), m_integrity(IntegrityVerification::completed({})) {
     sodium_init(); // safe to call multiple times :)
 }
 
 VaultManager::~VaultManager() {
-    lock();
+    // The session cache outlives the instance: only lock() revokes it.
+    wipe();
 }
 
-bool VaultManager::init(const std::string &password) {
+bool VaultManager::init(const std::string &password, const KdfParams &params) {
     EncoraLogger::Logger::log(EncoraLogger::Level::Info, "VaultManager::init: called.");
     if (password.empty()) {
         EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Cannot initialize vault: empty password.");
         return false;
     }
 
-    // Generate KDF parameters
-    const KdfParams params = KeyDerivation::defaultParams();
     // Generate random salt
     std::vector<unsigned char> salt(crypto_pwhash_SALTBYTES);
     randombytes_buf(salt.data(), salt.size());
@@ -76,11 +75,12 @@ bool VaultManager::init(const std::string &password) {
     return true;
 }
 
-bool VaultManager::unlock(const std::string &password) {
+bool VaultManager::unlock(const std::string &password, const UnlockMode mode) {
     EncoraLogger::Logger::log(EncoraLogger::Level::Info, "VaultManager::unlock: called.");
 
     VaultMetadata metadata;
     std::vector<unsigned char> derived;
+    bool cached = false;
     try {
         // Read first the file to extract KDF parameters.
         json tmp;
@@ -96,9 +96,24 @@ bool VaultManager::unlock(const std::string &password) {
         unsigned long long mem = tmp.at("kdf_mem_limit").get<unsigned long long>();
         std::vector<unsigned char> salt = Base64::decode(tmp.at("kdf_salt").get<std::string>());
 
-        KdfParams params {ops, static_cast<size_t>(mem)};
-        derived = KeyDerivation::derive(password, salt, params);
-        metadata = VaultMetadataIO::load(metaPath(), derived);
+        if (m_sessionCache) {
+            // The cached key goes through the same HMAC check as a derived one.
+            if (auto key = SessionCache(*m_sessionCache).load(salt)) {
+                try {
+                    metadata = VaultMetadataIO::load(metaPath(), *key);
+                    derived = std::move(*key);
+                    cached = true;
+                } catch (const std::exception &) {
+                    sodium_memzero(key->data(), key->size());
+                    EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Session cache: cached key does not open vault.meta, deriving.");
+                }
+            }
+        }
+        if (!cached) {
+            KdfParams params {ops, static_cast<size_t>(mem)};
+            derived = KeyDerivation::derive(password, salt, params);
+            metadata = VaultMetadataIO::load(metaPath(), derived);
+        }
     } catch (std::exception &e) {
         EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Failed to load vault metadata: ") + e.what());
         return false;
@@ -108,10 +123,18 @@ bool VaultManager::unlock(const std::string &password) {
     WrappedKey wrapped {metadata.wrappedNonce, metadata.wrappedCipherText};
     try {
         m_vmk = KeyWrap::unwrap(wrapped, derived);
+        (void) sodium_mlock(m_vmk.data(), m_vmk.size());
     } catch (const std::exception &e) {
+        sodium_memzero(derived.data(), derived.size());
         EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Failed to unwrap vault: ") + e.what());
         return false;
     }
+    if (cached) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Derived key taken from the session cache (key derivation skipped).");
+    } else if (m_sessionCache) {
+        (void) SessionCache(*m_sessionCache).store(metadata.kdfSalt, derived);
+    }
+    sodium_memzero(derived.data(), derived.size());
 
     if (!std::filesystem::exists("data/MANIFEST.json")) {
         std::string err;
@@ -121,8 +144,20 @@ bool VaultManager::unlock(const std::string &password) {
     m_isUnlocked = true;
     // After VMK is available, verify integrity (if manifest present).
     {
-        auto r = IntegrityChecker::verify("data", m_vmk);
-        m_integrityStatus = r.status;
+        IntegrityReport r;
+        if (mode == UnlockMode::Deferred) {
+            // The files every command reads first are checked now; the background pass logs its own result.
+            m_integrity = IntegrityChecker::verifyDeferred("data", m_vmk, {"vault.meta", "vault_store/index.log"}, m_verifyOptions);
+            if (!m_integrity->ready()) {
+                EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Integrity: manifest OK, verifying files in the background.");
+                EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Vault unlocked successfully.");
+                return true;
+            }
+            r = m_integrity->wait();
+        } else {
+            r = IntegrityChecker::verify("data", m_vmk, m_verifyOptions);
+            m_integrity = IntegrityVerification::completed(r);
+        }
         switch (r.status) {
             case IntegrityStatus::OK:
                 EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Integrity: OK. " + r.message);
@@ -148,10 +183,97 @@ bool VaultManager::unlock(const std::string &password) {
     return true;
 }
 
+bool VaultManager::retune(const std::string &password, const KdfParams &params) {
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info, "VaultManager::retune: called.");
+    if (password.empty()) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Cannot retune vault: empty password.");
+        return false;
+    }
+
+    // The password has to open the vault under the current parameters (never from the session cache).
+    VaultMetadata metadata;
+    std::vector<unsigned char> vmk;
+    try {
+        json tmp;
+        std::ifstream ifs(metaPath());
+        if (!ifs.is_open()) {
+            throw std::runtime_error("Vault metadata not found.");
+        }
+        ifs >> tmp;
+        ifs.close();
+
+        const KdfParams current {tmp.at("kdf_ops_limit").get<unsigned long long>(),
+            static_cast<size_t>(tmp.at("kdf_mem_limit").get<unsigned long long>())};
+        const auto derived = KeyDerivation::derive(password, Base64::decode(tmp.at("kdf_salt").get<std::string>()), current);
+        metadata = VaultMetadataIO::load(metaPath(), derived);
+        vmk = KeyWrap::unwrap({metadata.wrappedNonce, metadata.wrappedCipherText}, derived);
+    } catch (const std::exception &e) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Failed to open vault for retune: ") + e.what());
+        return false;
+    }
+
+    const auto oldSalt = metadata.kdfSalt;
+    std::vector<unsigned char> salt(crypto_pwhash_SALTBYTES);
+    randombytes_buf(salt.data(), salt.size());
+    bool saved = false;
+    try {
+        const auto derivedKey = KeyDerivation::derive(password, salt, params);
+        const WrappedKey wrapped = KeyWrap::wrap(vmk, derivedKey);
+
+        metadata.version = 2;
+        metadata.kdfOpsLimit = params.opsLimit;
+        metadata.kdfMemLimit = params.memLimit;
+        metadata.kdfSalt = salt;
+        metadata.wrappedNonce = wrapped.nonce;
+        metadata.wrappedCipherText = wrapped.cipherText;
+        VaultMetadataIO::save(metaPath(), metadata, derivedKey);
+        saved = true;
+
+        // vault.meta is in the manifest: sign its new hash.
+        std::string err;
+        if (!ManifestWriter::update("data", vmk, err)) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Manifest update failed: " + err));
+        }
+    } catch (const std::exception &e) {
+        const std::string what = saved ? "Manifest update failed: " : "Failed to retune vault: ";
+        EncoraLogger::Logger::log(EncoraLogger::Level::Error, what + e.what());
+    }
+    sodium_memzero(vmk.data(), vmk.size());
+
+    if (saved) {
+        // Whatever was cached opens under the old parameters only; don't leave it lying around.
+        SessionCache(m_sessionCache.value_or(SessionCacheOptions {})).revoke(oldSalt);
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Vault retuned: opslimit=" + std::to_string(params.opsLimit)
+            + " memlimit=" + std::to_string(params.memLimit) + ".");
+    }
+
+    return saved;
+}
+
 void VaultManager::lock() {
+    if (m_sessionCache) {
+        try {
+            json tmp;
+            std::ifstream ifs(metaPath());
+            if (ifs.is_open()) {
+                ifs >> tmp;
+                SessionCache(*m_sessionCache).revoke(Base64::decode(tmp.at("kdf_salt").get<std::string>()));
+            }
+        } catch (const std::exception &e) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("Session cache not revoked: ") + e.what());
+        }
+    }
+
+    wipe();
+}
+
+void VaultManager::wipe() {
+    // Stop hashing on behalf of a session that is over.
+    m_integrity->cancel();
     if (!m_vmk.empty()) {
         EncoraLogger::Logger::log(EncoraLogger::Level::Info, "VaultManager::lock: called.");
-        sodium_memzero(m_vmk.data(), m_vmk.size());
+        // Wipes it as well.
+        sodium_munlock(m_vmk.data(), m_vmk.size());
         m_vmk.clear();
     }
 
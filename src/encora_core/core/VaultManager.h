@@ -1,10 +1,13 @@
 #ifndef CORE_VAULT_MANAGER_H
 #define CORE_VAULT_MANAGER_H
 
+#include <memory>
 #include <string>
 #include <optional>
 #include <vector>
 
+#include "secrets/KeyDerivation.h"
+#include "secrets/SessionCache.h"
 #include "security/IntegrityChecker.h"
 
 /**
@@ -21,17 +24,41 @@
  *
  * The vault is represented be metadata stored on disk (vault.meta)
  * and Vault Master Key kept in secure memory while unlocked.
+ *
+ * UnlockMode::Deferred returns as soon as the VMK is unwrapped and the manifest HMAC
+ * checks out (plus vault.meta and index.log hashed); the remaining files are hashed
+ * in the background. Hand integrityStatus() to EncryptedVaultStorage so reads check
+ * their file on demand and writes wait for the pass.
+ *
+ * With a session cache (setSessionCache, Linux), unlock() leaves the derived key in the
+ * kernel keyring for a while (see SessionCache): the next unlock of the vault by a process
+ * possessing it skips Argon2id, whatever password it is given, and still checks the
+ * vault.meta HMAC. lock() revokes it; an instance going out of scope only wipes its own
+ * copy, leaving the cache to the next command.
+ *
+ * retune() moves the vault to new KDF parameters (e.g. from KeyDerivation::calibrate):
+ * the VMK is re-wrapped under a key derived with a fresh salt; records stay as they are.
  */
 class VaultManager {
 public:
+    enum class UnlockMode {
+        // Hash every file before unlock() returns.
+        Verify,
+        // Authenticate the manifest now, hash files in the background.
+        Deferred
+    };
+
     VaultManager();
     ~VaultManager();
 
     // Create new vault (generate salt, VMK, encrypt it, save metadata)
-    bool init(const std::string &password);
+    bool init(const std::string &password, const KdfParams &params = KeyDerivation::defaultParams());
     // Unlock existing vault (load metadata, derive key, decrypt VMK)
-    bool unlock(const std::string &password);
-    // Lock vault (wipe VMK from memory)
+    bool unlock(const std::string &password, UnlockMode mode = UnlockMode::Verify);
+    // Re-wrap the VMK under 'params' and a new salt (checks 'password' first, revokes the session cache).
+    // Leaves the vault locked.
+    bool retune(const std::string &password, const KdfParams &params);
+    // Lock vault (wipe VMK from memory, revoke the session cache)
     void lock();
     [[nodiscard]]
     bool isUnlocked() const;
@@ -40,13 +67,23 @@ public:
     // Returns copy of VMK (COPY!), if vault in unlocked.
     [[nodiscard]]
     std::vector<unsigned char> sessionVMK() const;
+    // Integrity pass of the last unlock: poll with status()/ready() or block in wait().
+    // Never null; the pass is done when unlock() returns unless it was Deferred.
     [[nodiscard]]
-    IntegrityStatus integrityStatus() const { return m_integrityStatus; }
+    std::shared_ptr<IntegrityVerification> integrityStatus() const { return m_integrity; }
+    // Options for the integrity check run by unlock() (e.g. parallel jobs).
+    void setVerifyOptions(const VerifyOptions &options) { m_verifyOptions = options; }
+    // Cache unlocks in the kernel keyring; std::nullopt (the default) derives the key every time.
+    void setSessionCache(std::optional<SessionCacheOptions> options) { m_sessionCache = options; }
 
 private:
     bool m_isUnlocked;
     std::vector<unsigned char> m_vmk;
-    IntegrityStatus m_integrityStatus = IntegrityStatus::Unknown;
+    std::shared_ptr<IntegrityVerification> m_integrity;
+    VerifyOptions m_verifyOptions;
+    std::optional<SessionCacheOptions> m_sessionCache;
+    // Wipe the VMK.
+    void wipe();
     // Path to metadata file (for new hardcoded)
     [[nodiscard]]
     std::string metaPath() const;
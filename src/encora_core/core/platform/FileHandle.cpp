@@ -0,0 +1,237 @@
+#include "FileHandle.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#ifdef ENCORA_PLATFORM_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileHandle::~FileHandle() {
+    close();
+}
+
+FileHandle::FileHandle(FileHandle &&other) noexcept {
+    *this = std::move(other);
+}
+
+FileHandle &FileHandle::operator=(FileHandle &&other) noexcept {
+    if (this != &other) {
+        close();
+#ifdef ENCORA_PLATFORM_WINDOWS
+        m_handle = std::exchange(other.m_handle, nullptr);
+#else
+        m_fd = std::exchange(other.m_fd, -1);
+#endif
+        m_path = std::move(other.m_path);
+        m_end = std::exchange(other.m_end, 0);
+    }
+
+    return *this;
+}
+
+#ifdef ENCORA_PLATFORM_WINDOWS
+
+bool FileHandle::open(const std::string &path, const bool writable) {
+    close();
+
+    HANDLE handle = CreateFileA(
+        path.c_str(),
+        writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        writable ? OPEN_ALWAYS : OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    m_handle = handle;
+    m_path = path;
+    m_end = static_cast<std::uint64_t>(size.QuadPart);
+    return true;
+}
+
+void FileHandle::close() {
+    if (m_handle != nullptr) {
+        CloseHandle(static_cast<HANDLE>(m_handle));
+        m_handle = nullptr;
+    }
+    m_end = 0;
+}
+
+bool FileHandle::isOpen() const {
+    return m_handle != nullptr;
+}
+
+void FileHandle::readAt(const std::uint64_t offset, void *buffer, const std::size_t length) const {
+    auto *out = static_cast<unsigned char *>(buffer);
+    std::size_t done = 0;
+    while (done < length) {
+        OVERLAPPED ov {};
+        const std::uint64_t at = offset + done;
+        ov.Offset = static_cast<DWORD>(at & 0xFFFFFFFFULL);
+        ov.OffsetHigh = static_cast<DWORD>(at >> 32);
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(length - done, 1U << 30));
+        DWORD got = 0;
+        if (!ReadFile(static_cast<HANDLE>(m_handle), out + done, chunk, &got, &ov) || got == 0) {
+            throw std::runtime_error("FileHandle: short read: " + m_path);
+        }
+        done += got;
+    }
+}
+
+void FileHandle::writeAt(const std::uint64_t offset, const void *data, const std::size_t length) {
+    const auto *in = static_cast<const unsigned char *>(data);
+    std::size_t done = 0;
+    while (done < length) {
+        OVERLAPPED ov {};
+        const std::uint64_t at = offset + done;
+        ov.Offset = static_cast<DWORD>(at & 0xFFFFFFFFULL);
+        ov.OffsetHigh = static_cast<DWORD>(at >> 32);
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(length - done, 1U << 30));
+        DWORD wrote = 0;
+        if (!WriteFile(static_cast<HANDLE>(m_handle), in + done, chunk, &wrote, &ov)) {
+            throw std::runtime_error("FileHandle: write failed: " + m_path);
+        }
+        done += wrote;
+    }
+
+    m_end = std::max(m_end, offset + length);
+}
+
+void FileHandle::sync() {
+    if (!FlushFileBuffers(static_cast<HANDLE>(m_handle))) {
+        throw std::runtime_error("FileHandle: flush failed: " + m_path);
+    }
+}
+
+void FileHandle::truncate(const std::uint64_t length) {
+    FILE_END_OF_FILE_INFO info {};
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(length);
+    if (!SetFileInformationByHandle(static_cast<HANDLE>(m_handle), FileEndOfFileInfo, &info, sizeof(info))) {
+        throw std::runtime_error("FileHandle: truncate failed: " + m_path);
+    }
+    m_end = length;
+}
+
+void FileHandle::adviseSequential() const {
+    // Read-ahead is chosen at open (FILE_FLAG_SEQUENTIAL_SCAN); nothing to change afterwards.
+}
+
+#else
+
+bool FileHandle::open(const std::string &path, const bool writable) {
+    close();
+
+    const int flags = writable ? (O_RDWR | O_CREAT) : O_RDONLY;
+    const int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_path = path;
+    m_end = static_cast<std::uint64_t>(st.st_size);
+    return true;
+}
+
+void FileHandle::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_end = 0;
+}
+
+bool FileHandle::isOpen() const {
+    return m_fd >= 0;
+}
+
+void FileHandle::readAt(const std::uint64_t offset, void *buffer, const std::size_t length) const {
+    auto *out = static_cast<unsigned char *>(buffer);
+    std::size_t done = 0;
+    while (done < length) {
+        const auto got = ::pread(m_fd, out + done, length - done, static_cast<off_t>(offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            throw std::runtime_error("FileHandle: short read: " + m_path);
+        }
+        done += static_cast<std::size_t>(got);
+    }
+}
+
+void FileHandle::writeAt(const std::uint64_t offset, const void *data, const std::size_t length) {
+    const auto *in = static_cast<const unsigned char *>(data);
+    std::size_t done = 0;
+    while (done < length) {
+        const auto wrote = ::pwrite(m_fd, in + done, length - done, static_cast<off_t>(offset + done));
+        if (wrote < 0 && errno == EINTR) continue;
+        if (wrote < 0) {
+            throw std::runtime_error("FileHandle: write failed: " + m_path + ": " + std::strerror(errno));
+        }
+        done += static_cast<std::size_t>(wrote);
+    }
+
+    m_end = std::max(m_end, offset + length);
+}
+
+void FileHandle::sync() {
+#ifdef __APPLE__
+    const int r = ::fcntl(m_fd, F_FULLFSYNC);
+#else
+    const int r = ::fdatasync(m_fd);
+#endif
+    if (r != 0) {
+        throw std::runtime_error("FileHandle: sync failed: " + m_path);
+    }
+}
+
+void FileHandle::truncate(const std::uint64_t length) {
+    if (::ftruncate(m_fd, static_cast<off_t>(length)) != 0) {
+        throw std::runtime_error("FileHandle: truncate failed: " + m_path);
+    }
+    m_end = length;
+}
+
+void FileHandle::adviseSequential() const {
+#ifdef __APPLE__
+    (void) ::fcntl(m_fd, F_RDAHEAD, 1);
+#else
+    (void) ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+#endif
+
+std::uint64_t FileHandle::append(const void *data, const std::size_t length) {
+    const std::uint64_t start = m_end;
+    writeAt(start, data, length);
+
+    return start;
+}
+
+std::uint64_t FileHandle::size() const {
+    return m_end;
+}
@@ -0,0 +1,61 @@
+#ifndef CORE_PLATFORM_FILE_HANDLE_H
+#define CORE_PLATFORM_FILE_HANDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * FileHandle
+ *
+ * Thin wrapper over a native file descriptor / HANDLE for positional I/O:
+ *  - readAt: pread (one syscall for a whole record)
+ *  - append: write at end of file, returns the offset written at
+ *  - writeAt: pwrite, e.g. to fill in a header once the data behind it is known
+ *  - sync:   fsync / FlushFileBuffers
+ *
+ * Errors are reported with std::runtime_error. Move-only; closes in destructor.
+ */
+class FileHandle {
+public:
+    FileHandle() = default;
+    ~FileHandle();
+
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+    FileHandle(FileHandle &&other) noexcept;
+    FileHandle &operator=(FileHandle &&other) noexcept;
+
+    // Open 'path'. If writable, the file is created when missing.
+    // Returns false if the file cannot be opened.
+    bool open(const std::string &path, bool writable);
+    void close();
+
+    [[nodiscard]]
+    bool isOpen() const;
+    [[nodiscard]]
+    std::uint64_t size() const;
+
+    // Read exactly 'length' bytes at 'offset'. Throws on short read.
+    void readAt(std::uint64_t offset, void *buffer, std::size_t length) const;
+    // Write at the current end of file. Returns the offset of the first byte written.
+    std::uint64_t append(const void *data, std::size_t length);
+    // Write 'length' bytes at 'offset', overwriting or extending the file.
+    void writeAt(std::uint64_t offset, const void *data, std::size_t length);
+    // Flush file data to stable storage.
+    void sync();
+    void truncate(std::uint64_t length);
+    // Hint that the file will be read front to back once (read-ahead, drop-behind).
+    void adviseSequential() const;
+
+private:
+#ifdef ENCORA_PLATFORM_WINDOWS
+    void *m_handle = nullptr;
+#else
+    int m_fd = -1;
+#endif
+    std::string m_path;
+    std::uint64_t m_end = 0;
+};
+
+#endif //CORE_PLATFORM_FILE_HANDLE_H
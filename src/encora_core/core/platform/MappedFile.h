@@ -0,0 +1,45 @@
+#ifndef CORE_PLATFORM_MAPPED_FILE_H
+#define CORE_PLATFORM_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * MappedFile
+ *
+ * Read-only memory mapping of a whole file (mmap on Unix, file mapping on Windows).
+ * An empty file is "open" with size() == 0 and data() == nullptr.
+ * Move-only; unmaps in destructor.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // Map 'path' read-only. Returns false if the file cannot be opened or mapped.
+    bool open(const std::string &path);
+    void close();
+
+    [[nodiscard]]
+    bool isOpen() const { return m_isOpen; }
+    [[nodiscard]]
+    const unsigned char *data() const { return m_data; }
+    [[nodiscard]]
+    std::size_t size() const { return m_size; }
+
+private:
+    const unsigned char *m_data = nullptr;
+    std::size_t m_size = 0;
+    bool m_isOpen = false;
+#ifdef ENCORA_PLATFORM_WINDOWS
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+#endif //CORE_PLATFORM_MAPPED_FILE_H
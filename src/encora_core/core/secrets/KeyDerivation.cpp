@@ -1,13 +1,83 @@
 #include <sodium.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <optional>
 #include <stdexcept>
 #include <sstream>
 
+#ifdef ENCORA_PLATFORM_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "KeyDerivation.h"
 
 #include "utils/Logger.h"
 
 static constexpr std::size_t ENCORA_DERIVED_KEY_SIZE = 32; // 256-bit key
 
+namespace {
+    constexpr std::size_t MiB = 1024 * 1024;
+    // Calibration trades memory for time down to this much, unless the budget is smaller.
+    constexpr std::size_t MIN_CALIBRATED_MEMORY = 8 * MiB;
+    // Budget when none is given: a quarter of the available memory, but no more than this.
+    constexpr std::size_t MAX_DEFAULT_MEMORY = 1024 * MiB;
+
+    // Memory this process may use: physical memory, or the cgroup limit of a container if lower.
+    // 0 if unknown.
+    std::size_t availableMemory() {
+        std::size_t available = 0;
+#ifdef ENCORA_PLATFORM_WINDOWS
+        MEMORYSTATUSEX status {};
+        status.dwLength = sizeof(status);
+        if (GlobalMemoryStatusEx(&status)) {
+            available = static_cast<std::size_t>(status.ullTotalPhys);
+        }
+#else
+        const long pages = ::sysconf(_SC_PHYS_PAGES);
+        const long pageSize = ::sysconf(_SC_PAGESIZE);
+        if (pages > 0 && pageSize > 0) {
+            available = static_cast<std::size_t>(pages) * static_cast<std::size_t>(pageSize);
+        }
+#endif
+#ifdef __linux__
+        // cgroup v2, then v1. "max" (v2) does not parse and v1 reports a huge number when unlimited.
+        for (const char *path : {"/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes"}) {
+            std::ifstream in(path);
+            unsigned long long limit = 0;
+            if (in >> limit && limit > 0) {
+                if (available == 0 || limit < available) {
+                    available = static_cast<std::size_t>(limit);
+                }
+                break;
+            }
+        }
+#endif
+        return available;
+    }
+
+    // Time one derivation with 'params'. std::nullopt if crypto_pwhash failed (could not allocate).
+    std::optional<std::chrono::microseconds> timeDerivation(const KdfParams &params) {
+        static constexpr char PASSWORD[] = "encora-kdf-calibration";
+        std::array<unsigned char, crypto_pwhash_SALTBYTES> salt {};
+        randombytes_buf(salt.data(), salt.size());
+        std::array<unsigned char, ENCORA_DERIVED_KEY_SIZE> key {};
+
+        const auto start = std::chrono::steady_clock::now();
+        const int r = crypto_pwhash(key.data(), key.size(), PASSWORD, sizeof(PASSWORD) - 1, salt.data(),
+            params.opsLimit, params.memLimit, crypto_pwhash_ALG_ARGON2ID13);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        if (r != 0) {
+            return std::nullopt;
+        }
+
+        return elapsed;
+    }
+}
+
 KdfParams KeyDerivation::defaultParams() {
     KdfParams params;
     // These values correspond to "interactive" or "moderate" security profiles in libsodium terms.
@@ -61,3 +131,96 @@ std::vector<unsigned char> KeyDerivation::derive(const std::string &password, co
 
     return key;
 }
+
+KdfCalibration KeyDerivation::calibrate(const KdfTarget &target) {
+    using std::chrono::microseconds;
+
+    if (target.latency.count() <= 0) {
+        throw std::invalid_argument("KeyDerivation::calibrate: target latency must be positive.");
+    }
+    if (sodium_init() < 0) {
+        throw std::runtime_error("KeyDerivation::calibrate: sodium_init() failed.");
+    }
+
+    std::size_t budget = target.maxMemory;
+    if (budget == 0) {
+        const std::size_t available = availableMemory();
+        budget = available == 0 ? crypto_pwhash_MEMLIMIT_MODERATE : std::min(available / 4, MAX_DEFAULT_MEMORY);
+    }
+    budget = std::min(budget, crypto_pwhash_memlimit_max());
+    if (budget < crypto_pwhash_MEMLIMIT_MIN) {
+        throw std::invalid_argument("KeyDerivation::calibrate: memory budget is below the minimum of "
+            + std::to_string(crypto_pwhash_MEMLIMIT_MIN) + " bytes.");
+    }
+    // Whole MiB where there is one to spare (Argon2 works in KiB blocks anyway).
+    const auto roundDown = [](const std::size_t bytes) { return bytes >= MiB ? bytes - bytes % MiB : bytes; };
+    budget = roundDown(budget);
+    const std::size_t floor = std::min(MIN_CALIBRATED_MEMORY, budget);
+
+    // A throwaway pass over the whole budget first, halving it while it cannot be allocated:
+    // the first derivation in a process is slower (fresh memory faulted in, cold caches).
+    KdfParams params {1, budget};
+    while (!timeDerivation(params)) {
+        if (params.memLimit <= floor) {
+            throw std::runtime_error("KeyDerivation::calibrate: crypto_pwhash() failed even with "
+                + std::to_string(params.memLimit) + " bytes (OOM?).");
+        }
+        params.memLimit = std::max(floor, roundDown(params.memLimit / 2));
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "KDF calibration: cannot allocate the budget, trying "
+            + std::to_string(params.memLimit) + " bytes.");
+    }
+
+    const auto measure = [](const KdfParams &candidate) {
+        const auto elapsed = timeDerivation(candidate);
+        if (!elapsed) {
+            throw std::runtime_error("KeyDerivation::calibrate: crypto_pwhash() failed (OOM?).");
+        }
+        return *elapsed;
+    };
+    // Off by more than this, the pick is corrected and measured again (at most MAX_ROUNDS times).
+    const microseconds latency = target.latency;
+    const microseconds tolerance = latency / 8;
+    constexpr int MAX_ROUNDS = 3;
+
+    // A single pass is already too slow: give up memory (Argon2id time is about linear in it).
+    auto onePass = measure(params);
+    for (int round = 0; round < MAX_ROUNDS && onePass > latency && params.memLimit > floor; ++round) {
+        const double scale = static_cast<double>(latency.count()) / static_cast<double>(onePass.count());
+        params.memLimit = std::max(floor, roundDown(static_cast<std::size_t>(static_cast<double>(params.memLimit) * scale)));
+        onePass = measure(params);
+    }
+
+    if (onePass < latency) {
+        // time(ops) ~ fixed + ops * pass, where the fixed part is mostly allocating and filling the memory.
+        params.opsLimit = 3;
+        const microseconds pass = std::max((measure(params) - onePass) / 2, microseconds(1));
+        const microseconds fixed = std::max(onePass - pass, microseconds(0));
+        params.opsLimit = static_cast<std::uint64_t>(std::clamp<long long>((latency - fixed) / pass, crypto_pwhash_OPSLIMIT_MIN,
+            crypto_pwhash_OPSLIMIT_MAX));
+    }
+
+    // Measure what was picked, as the unlock will run it, and correct a noisy estimate.
+    auto elapsed = measure(params);
+    for (int round = 0; round < MAX_ROUNDS && (elapsed > latency + tolerance || elapsed < latency - tolerance); ++round) {
+        const double scale = static_cast<double>(latency.count()) / static_cast<double>(elapsed.count());
+        const auto ops = std::max<std::uint64_t>(crypto_pwhash_OPSLIMIT_MIN,
+            static_cast<std::uint64_t>(static_cast<double>(params.opsLimit) * scale + 0.5));
+        if (ops == params.opsLimit) {
+            // Memory-bound (one pass) or as close as whole passes get.
+            break;
+        }
+        params.opsLimit = ops;
+        elapsed = measure(params);
+    }
+    KdfCalibration calibration {params, std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)};
+
+    {
+        std::ostringstream oss;
+        oss << "KDF calibrated for " << target.latency.count() << " ms within " << budget << " bytes: opslimit="
+            << params.opsLimit << " memlimit=" << params.memLimit << " (" << calibration.elapsed.count() << " ms).";
+
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info, oss.str());
+    }
+
+    return calibration;
+}
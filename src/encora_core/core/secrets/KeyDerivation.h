@@ -1,6 +1,7 @@
 #ifndef CORE_SECRETS_KEY_DERIVATION_H
 #define CORE_SECRETS_KEY_DERIVATION_H
 
+#include <chrono>
 #include <vector>
 #include <string>
 #include <cstdint>
@@ -22,6 +23,11 @@
  *      1. Load salt from vault metadata (16 or 32 random bytes generated at vault creation).
  *      2 .Call derive(password, salt, params)
  *      3. Use returned key as AES/XChaCha20 key to unwrap VMK.
+ *
+ *  defaultParams() is libsodium's MODERATE profile wherever it runs. calibrate() instead
+ *  times crypto_pwhash on this host and picks the parameters: as much memory as the budget
+ *  allows (shrunk only if one pass over it already takes longer than the target), then as
+ *  many passes as fit in the target latency.
  */
 
 struct KdfParams {
@@ -32,6 +38,20 @@ struct KdfParams {
     std::size_t memLimit; // how memory-expensive (bytes)
 };
 
+struct KdfTarget {
+    // How long one key derivation (i.e. an unlock) should take on this host.
+    std::chrono::milliseconds latency {500};
+    // Most memory one derivation may use (bytes); 0 = a quarter of the memory available
+    // to the process (cgroup limit or physical), at most 1 GiB.
+    std::size_t maxMemory = 0;
+};
+
+struct KdfCalibration {
+    KdfParams params;
+    // Time one derivation with 'params' took while calibrating.
+    std::chrono::milliseconds elapsed {0};
+};
+
 class KeyDerivation {
 public:
     // Derive a 32-byte key from a password and salt using Argon2id.
@@ -42,6 +62,10 @@ public:
     static std::vector<unsigned char> derive(const std::string &password, const std::vector<unsigned char> &salt, const KdfParams &params);
     // Helper to generate recommended/default parameters.
     static KdfParams defaultParams();
+    // Benchmark Argon2id here and pick parameters for 'target'. Takes a few derivations' time.
+    // Throws std::invalid_argument on a target no parameters can meet (e.g. a budget under
+    // libsodium's minimum), std::runtime_error if even the smallest memory cannot be allocated.
+    static KdfCalibration calibrate(const KdfTarget &target);
 };
 
 #endif //CORE_SECRETS_KEY_DERIVATION_H
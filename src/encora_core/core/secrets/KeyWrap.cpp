@@ -3,10 +3,13 @@
 
 #include "KeyWrap.h"
 
+#include "CryptoEngine.h"
 #include "utils/Logger.h"
 
+// The VMK is always wrapped with XChaCha20-Poly1305: a vault must unlock on any CPU.
+static constexpr CipherSuite ENCORA_WRAP_SUITE = CipherSuite::XChaCha20Poly1305;
 static constexpr std::size_t ENCORA_VMK_SIZE = 32; // 256 bits: 32 bytes * 8 bits
-static constexpr std::size_t ENCORA_AEAD_KEY_SIZE = crypto_aead_xchacha20poly1305_ietf_KEYBYTES; // 32
+static constexpr std::size_t ENCORA_AEAD_KEY_SIZE = CryptoEngine::KEY_SIZE; // 32
 static constexpr std::size_t ENCORA_AEAD_NONCE_SIZE = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES; // 24
 
 WrappedKey KeyWrap::wrap(const std::vector<unsigned char> &vmk, const std::vector<unsigned char> &derived) {
@@ -26,28 +29,9 @@ WrappedKey KeyWrap::wrap(const std::vector<unsigned char> &vmk, const std::vecto
     out.nonce.resize(ENCORA_AEAD_NONCE_SIZE);
     randombytes_buf(out.nonce.data(), out.nonce.size());
 
-    // cipherText size = plainText size + MAC size
-    std::vector<unsigned char> cipherText(vmk.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES);
-    unsigned long long cipherTextLength = 0;
-
-    const int r = crypto_aead_xchacha20poly1305_ietf_encrypt(
-        cipherText.data(),
-        &cipherTextLength,
-        vmk.data(), // plain text
-        vmk.size(),
-        nullptr, // no AAD for now
-        0,
-        nullptr, // no secret nonce other than NPUB
-        out.nonce.data(), // public nonce
-        derived.data() // key
-        );
-
-    if (r != 0) {
-        throw std::runtime_error("KeyWrap::wrap: encrypt failed.");
-    }
-
-    cipherText.resize(static_cast<size_t>(cipherTextLength));
-    out.cipherText = std::move(cipherText);
+    // cipherText size = plainText size + MAC size; no AAD for now
+    out.cipherText.resize(vmk.size() + CryptoEngine::TAG_SIZE);
+    CryptoEngine(derived, ENCORA_WRAP_SUITE).encrypt(out.cipherText, vmk, out.nonce);
 
     EncoraLogger::Logger::log(EncoraLogger::Level::Debug, "VMK wrapped with XChaCha20-Poly1305 (sealed).");
 
@@ -67,27 +51,13 @@ std::vector<unsigned char> KeyWrap::unwrap(const WrappedKey &wrapped, const std:
         throw std::runtime_error("KeyWrap::unwrap: wrong size of derived.");
     }
 
-    std::vector<unsigned char> plainText(ENCORA_VMK_SIZE);
-    unsigned long long decryptedLength = 0;
-
-    const int r = crypto_aead_xchacha20poly1305_ietf_decrypt(
-        plainText.data(),
-        &decryptedLength,
-        nullptr,
-        wrapped.cipherText.data(),
-        wrapped.cipherText.size(),
-        nullptr,
-        0,
-        wrapped.nonce.data(),
-        derived.data()
-    );
-
-    if (r != 0) {
-        throw std::runtime_error("KeyWrap::unwrap: decrypt failed (wrong password or tampered data).");
+    if (wrapped.cipherText.size() != ENCORA_VMK_SIZE + CryptoEngine::TAG_SIZE) {
+        throw std::runtime_error("KeyWrap::unwrap: unexpected VMK length.");
     }
 
-    if (decryptedLength != ENCORA_VMK_SIZE) {
-        throw std::runtime_error("KeyWrap::unwrap: unexpected VMK length.");
+    std::vector<unsigned char> plainText(ENCORA_VMK_SIZE);
+    if (!CryptoEngine(derived, ENCORA_WRAP_SUITE).decrypt(plainText, wrapped.cipherText, wrapped.nonce)) {
+        throw std::runtime_error("KeyWrap::unwrap: decrypt failed (wrong password or tampered data).");
     }
 
     EncoraLogger::Logger::log(EncoraLogger::Level::Debug, "VMK successfully unwrapped and authenticated.");
@@ -9,7 +9,7 @@
  *
  * This module "wraps" (encrypts + authenticates) the Vault Master Key (VMK) using a key derived from the user's master password.
  *
- * We use XChaCha20-Poly1305 (AEAD) from libsodium.
+ * We use XChaCha20-Poly1305 (AEAD) through CryptoEngine, on every CPU.
  *
  * wrap():
  *      input: plainText VMK (32 bytes), derivedKey (32 bytes)
@@ -0,0 +1,133 @@
+#include <sodium.h>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/keyctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "SessionCache.h"
+#include "utils/Logger.h"
+
+namespace {
+    constexpr std::size_t DERIVED_KEY_SIZE = 32;
+
+    std::string describe(const std::vector<unsigned char> &kdfSalt) {
+        std::array<unsigned char, 16> id {};
+        crypto_generichash(id.data(), id.size(), kdfSalt.data(), kdfSalt.size(), nullptr, 0);
+        std::array<char, 33> hex {};
+        sodium_bin2hex(hex.data(), hex.size(), id.data(), id.size());
+
+        return std::string("encora:kek:") + hex.data();
+    }
+
+#ifdef __linux__
+    // key_perm_t bits (keyutils.h): view, read, write, search and setattr for the possessor only.
+    // Processes of the user that do not possess the key get nothing, not even view.
+    constexpr unsigned long KEY_PERMISSIONS = 0x01000000UL | 0x02000000UL | 0x04000000UL | 0x08000000UL | 0x20000000UL;
+    // While a key is set up: also link for the possessor, to link it into the target keyring.
+    constexpr unsigned long STAGING_PERMISSIONS = KEY_PERMISSIONS | 0x10000000UL;
+
+    long keyringOf(const SessionCacheOptions::Keyring keyring) {
+        return keyring == SessionCacheOptions::Keyring::Session ? KEY_SPEC_SESSION_KEYRING : KEY_SPEC_USER_KEYRING;
+    }
+
+    long findKey(const std::string &description, const SessionCacheOptions::Keyring keyring) {
+        return ::syscall(SYS_keyctl, KEYCTL_SEARCH, keyringOf(keyring), "user", description.c_str(), 0);
+    }
+#endif
+}
+
+bool SessionCache::available() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SessionCache::store(const std::vector<unsigned char> &kdfSalt, const std::vector<unsigned char> &derivedKey) const {
+#ifdef __linux__
+    const auto fail = [](const std::string &step, const long key, const long staging) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Session cache: " + step + " failed: " + std::strerror(errno));
+        if (key >= 0) {
+            ::syscall(SYS_keyctl, KEYCTL_REVOKE, key);
+        }
+        if (staging >= 0) {
+            ::syscall(SYS_keyctl, KEYCTL_UNLINK, staging, KEY_SPEC_THREAD_KEYRING);
+        }
+        return false;
+    };
+
+    // add_key gives a new key the default permissions, readable by every process of the user. So it
+    // is made in a keyring of this thread's own, with a placeholder payload, and only gets the derived
+    // key once it is possessor-only; then it is linked where the next unlock looks.
+    const auto staging = ::syscall(SYS_add_key, "keyring", "encora:staging", nullptr, 0, KEY_SPEC_THREAD_KEYRING);
+    if (staging < 0 || ::syscall(SYS_keyctl, KEYCTL_SETPERM, staging, STAGING_PERMISSIONS) != 0) {
+        return fail("creating a private keyring", -1, staging);
+    }
+    const unsigned char placeholder = 0;
+    const auto id = ::syscall(SYS_add_key, "user", describe(kdfSalt).c_str(), &placeholder, sizeof(placeholder), staging);
+    if (id < 0) {
+        return fail("add_key", -1, staging);
+    }
+    // Timeout first: a key that cannot expire is revoked right away.
+    if (::syscall(SYS_keyctl, KEYCTL_SET_TIMEOUT, id, static_cast<unsigned long>(m_options.timeout.count())) != 0
+        || ::syscall(SYS_keyctl, KEYCTL_SETPERM, id, STAGING_PERMISSIONS) != 0
+        || ::syscall(SYS_keyctl, KEYCTL_UPDATE, id, derivedKey.data(), derivedKey.size()) != 0) {
+        return fail("setting up the key", id, staging);
+    }
+    // Displaces a key of the same description there.
+    if (::syscall(SYS_keyctl, KEYCTL_LINK, id, keyringOf(m_options.keyring)) != 0
+        || ::syscall(SYS_keyctl, KEYCTL_SETPERM, id, KEY_PERMISSIONS) != 0) {
+        return fail("linking the key", id, staging);
+    }
+    ::syscall(SYS_keyctl, KEYCTL_UNLINK, staging, KEY_SPEC_THREAD_KEYRING);
+
+    EncoraLogger::Logger::log(EncoraLogger::Level::Debug, "Session cache: key cached for "
+        + std::to_string(m_options.timeout.count()) + " s.");
+    return true;
+#else
+    (void) kdfSalt;
+    (void) derivedKey;
+    return false;
+#endif
+}
+
+std::optional<std::vector<unsigned char>> SessionCache::load(const std::vector<unsigned char> &kdfSalt) const {
+#ifdef __linux__
+    const auto id = findKey(describe(kdfSalt), m_options.keyring);
+    if (id < 0) {
+        // Not cached, expired or revoked.
+        return std::nullopt;
+    }
+
+    // One byte more than a key: a longer payload (not ours) shows up as a size mismatch.
+    std::vector<unsigned char> key(DERIVED_KEY_SIZE + 1);
+    const auto size = ::syscall(SYS_keyctl, KEYCTL_READ, id, key.data(), key.size());
+    if (size != static_cast<long>(DERIVED_KEY_SIZE)) {
+        sodium_memzero(key.data(), key.size());
+        return std::nullopt;
+    }
+    key.resize(DERIVED_KEY_SIZE);
+
+    return key;
+#else
+    (void) kdfSalt;
+    return std::nullopt;
+#endif
+}
+
+void SessionCache::revoke(const std::vector<unsigned char> &kdfSalt) const {
+#ifdef __linux__
+    const auto id = findKey(describe(kdfSalt), m_options.keyring);
+    if (id >= 0 && ::syscall(SYS_keyctl, KEYCTL_REVOKE, id) == 0) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Session cache: cached key revoked.");
+    }
+#else
+    (void) kdfSalt;
+#endif
+}
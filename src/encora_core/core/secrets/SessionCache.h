@@ -0,0 +1,59 @@
+#ifndef CORE_SECRETS_SESSION_CACHE_H
+#define CORE_SECRETS_SESSION_CACHE_H
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct SessionCacheOptions {
+    enum class Keyring {
+        // The user keyring (@u), possessed through every session of the user, e.g. across deploy script steps.
+        User,
+        // The login session only (@s).
+        Session,
+    };
+
+    // How long after the unlock that stored it a cached key stays usable (not extended by hits).
+    std::chrono::seconds timeout {300};
+    Keyring keyring = Keyring::User;
+};
+
+/**
+ * SessionCache
+ *
+ * Caches the Argon2id-derived key of an unlocked vault in the Linux kernel keyring
+ * (add_key / keyctl, a "user" key), so the next unlock of the same vault within
+ * SessionCacheOptions::timeout skips Argon2id. Elsewhere nothing is cached and every
+ * unlock derives the key.
+ *
+ * The key is named after the vault (a hash of its KDF salt) and holds the derived key
+ * itself, readable by its possessors only (no permissions for other processes of the
+ * user that do not possess it) from before the key is written to it. It is not wrapped under anything computed from the
+ * password: a fast hash of it would let whoever reads the entry brute-force the password
+ * past Argon2id. So while it lives the entry stands in for the password, like a sudo
+ * timestamp; VaultManager still checks the vault.meta HMAC with it and unwraps the VMK
+ * as usual, so a cache left from before the vault was re-keyed does not open. The kernel
+ * drops the key when it expires; revoke() (VaultManager::lock) drops it before that.
+ */
+class SessionCache {
+public:
+    explicit SessionCache(const SessionCacheOptions &options) : m_options(options) {}
+
+    // Whether this platform has a keyring to cache in.
+    [[nodiscard]]
+    static bool available();
+
+    // Cache 'derivedKey' for the vault with KDF salt 'kdfSalt'. Returns false if the keyring refused it.
+    bool store(const std::vector<unsigned char> &kdfSalt, const std::vector<unsigned char> &derivedKey) const;
+    // The derived key cached for the vault with KDF salt 'kdfSalt', if there is one.
+    [[nodiscard]]
+    std::optional<std::vector<unsigned char>> load(const std::vector<unsigned char> &kdfSalt) const;
+    // Drop what is cached for the vault with KDF salt 'kdfSalt'.
+    void revoke(const std::vector<unsigned char> &kdfSalt) const;
+
+private:
+    SessionCacheOptions m_options;
+};
+
+#endif //CORE_SECRETS_SESSION_CACHE_H
@@ -0,0 +1,169 @@
+#include <sodium.h>
+#include <algorithm>
+#include <chrono>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "FileHash.h"
+
+#include "Sha256Batch.h"
+#include "platform/FileHandle.h"
+#include "utils/Logger.h"
+
+namespace FileHash {
+    std::string_view name(const Algorithm algorithm) {
+        switch (algorithm) {
+            case Algorithm::Sha256:
+                return "sha256";
+            case Algorithm::Blake2b256:
+                return "blake2b-256";
+        }
+        throw std::invalid_argument("FileHash: unknown algorithm.");
+    }
+
+    std::optional<Algorithm> parse(const std::string_view name) {
+        for (const auto algorithm : {Algorithm::Sha256, Algorithm::Blake2b256}) {
+            if (FileHash::name(algorithm) == name) {
+                return algorithm;
+            }
+        }
+        return std::nullopt;
+    }
+
+    Algorithm preferred() {
+        static const Algorithm fastest = [] {
+            const std::vector<unsigned char> buffer(1024 * 1024, 0x5a);
+            auto best = [&](const Algorithm algorithm) {
+                auto elapsed = std::chrono::steady_clock::duration::max();
+                for (int run = 0; run < 3; ++run) {
+                    const auto started = std::chrono::steady_clock::now();
+                    Hasher hasher(algorithm);
+                    hasher.update(buffer.data(), buffer.size());
+                    (void) hasher.final();
+                    elapsed = std::min(elapsed, std::chrono::steady_clock::now() - started);
+                }
+                return elapsed;
+            };
+
+            const auto choice = best(Algorithm::Blake2b256) < best(Algorithm::Sha256) ? Algorithm::Blake2b256 : Algorithm::Sha256;
+            EncoraLogger::Logger::log(EncoraLogger::Level::Debug, "FileHash: " + std::string(name(choice)) + " is faster on this host.");
+            return choice;
+        }();
+
+        return fastest;
+    }
+
+    Hasher::Hasher(const Algorithm algorithm) : m_algorithm(algorithm) {
+        if (m_algorithm == Algorithm::Blake2b256) {
+            crypto_generichash_init(&m_blake2b, nullptr, 0, std::tuple_size_v<Digest>);
+        } else {
+            crypto_hash_sha256_init(&m_sha256);
+        }
+    }
+
+    void Hasher::update(const unsigned char *data, const std::size_t length) {
+        if (m_algorithm == Algorithm::Blake2b256) {
+            crypto_generichash_update(&m_blake2b, data, length);
+        } else {
+            crypto_hash_sha256_update(&m_sha256, data, length);
+        }
+    }
+
+    Digest Hasher::final() const {
+        Digest digest {};
+        if (m_algorithm == Algorithm::Blake2b256) {
+            auto state = m_blake2b;
+            crypto_generichash_final(&state, digest.data(), digest.size());
+        } else {
+            auto state = m_sha256;
+            crypto_hash_sha256_final(&state, digest.data());
+        }
+        return digest;
+    }
+
+    std::uint64_t read(const std::string &path, const std::uint64_t offset, const ChunkFn &sink) {
+        FileHandle file;
+        if (!file.open(path, false)) {
+            throw std::runtime_error("FileHash: cannot open: " + path);
+        }
+        file.adviseSequential();
+
+        std::vector<unsigned char> buffer(CHUNK_SIZE);
+        std::uint64_t at = offset;
+        while (at < file.size()) {
+            const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), file.size() - at));
+            file.readAt(at, buffer.data(), length);
+            sink(buffer.data(), length);
+            at += length;
+        }
+
+        return at > offset ? at - offset : 0;
+    }
+
+    Digest digest(const std::string &path, const Algorithm algorithm) {
+        Hasher hasher(algorithm);
+        (void) read(path, 0, [&](const unsigned char *data, const std::size_t length) {
+            hasher.update(data, length);
+        });
+        return hasher.final();
+    }
+
+    Digest sha256(const std::string &path) {
+        return digest(path, Algorithm::Sha256);
+    }
+
+    std::string sha256Hex(const std::string &path) {
+        return toHex(sha256(path));
+    }
+
+    std::vector<std::optional<Digest>> sha256Files(const std::vector<std::string> &paths) {
+        std::vector<std::optional<Digest>> out(paths.size());
+        std::vector<std::vector<unsigned char>> contents;
+        std::vector<std::size_t> owners;
+        std::size_t pending = 0;
+
+        auto flush = [&] {
+            std::vector<std::span<const unsigned char>> messages(contents.begin(), contents.end());
+            std::vector<Digest> digests(messages.size());
+            Sha256Batch::hash(messages, digests);
+            for (std::size_t i = 0; i < owners.size(); ++i) {
+                out[owners[i]] = digests[i];
+            }
+            contents.clear();
+            owners.clear();
+            pending = 0;
+        };
+
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            FileHandle file;
+            if (!file.open(paths[i], false)) continue;
+
+            try {
+                std::vector<unsigned char> content(static_cast<std::size_t>(file.size()));
+                if (!content.empty()) {
+                    file.readAt(0, content.data(), content.size());
+                }
+                pending += content.size();
+                contents.push_back(std::move(content));
+                owners.push_back(i);
+            } catch (const std::exception &) {
+                continue;
+            }
+
+            if (pending >= BATCH_BYTES) {
+                flush();
+            }
+        }
+        flush();
+
+        return out;
+    }
+
+    std::string toHex(const Digest &digest) {
+        std::string hex(digest.size() * 2 + 1, '\0');
+        sodium_bin2hex(hex.data(), hex.size(), digest.data(), digest.size());
+        hex.pop_back();
+        return hex;
+    }
+}
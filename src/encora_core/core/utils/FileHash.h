@@ -0,0 +1,79 @@
+#ifndef CORE_UTILS_FILE_HASH_H
+#define CORE_UTILS_FILE_HASH_H
+
+#include <sodium.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace FileHash {
+    // Bytes per pread. A hash never holds more than one chunk, whatever the file size.
+    constexpr std::size_t CHUNK_SIZE = 256 * 1024;
+
+    using Digest = std::array<unsigned char, 32>;
+    using ChunkFn = std::function<void(const unsigned char *data, std::size_t length)>;
+
+    // File digest algorithms of the manifest; both give 32 bytes. The values are stored (signed) in manifests.
+    enum class Algorithm : unsigned char {
+        Sha256 = 1,
+        Blake2b256 = 2,
+    };
+
+    // "sha256" / "blake2b-256", as written in MANIFEST.json.
+    std::string_view name(Algorithm algorithm);
+    std::optional<Algorithm> parse(std::string_view name);
+    // The faster algorithm on this host (SHA-256 wins only with SHA extensions).
+    // Measured once per process on a small in-memory buffer.
+    Algorithm preferred();
+
+    /**
+     * Incremental digest in either algorithm. Copyable, so a hash can be finalized
+     * and later resumed from the same state.
+     */
+    class Hasher {
+    public:
+        explicit Hasher(Algorithm algorithm = Algorithm::Sha256);
+
+        void update(const unsigned char *data, std::size_t length);
+        // Digest of everything so far; the hasher can keep going.
+        [[nodiscard]]
+        Digest final() const;
+        [[nodiscard]]
+        Algorithm algorithm() const { return m_algorithm; }
+
+    private:
+        Algorithm m_algorithm;
+        crypto_hash_sha256_state m_sha256 {};
+        crypto_generichash_state m_blake2b {};
+    };
+
+    /**
+     * Streams the bytes of 'path' from 'offset' to its end (as of opening it) into 'sink',
+     * CHUNK_SIZE bytes at a time, reusing one buffer. Returns the number of bytes read.
+     * Throws std::runtime_error if the file cannot be opened or read.
+     */
+    std::uint64_t read(const std::string &path, std::uint64_t offset, const ChunkFn &sink);
+
+    /**
+     * Digest of a whole file, computed incrementally over read().
+     */
+    Digest digest(const std::string &path, Algorithm algorithm);
+    Digest sha256(const std::string &path);
+    std::string sha256Hex(const std::string &path);
+    /**
+     * SHA-256 of many small files: each is read whole and they are hashed side by side
+     * (see Sha256Batch), BATCH_BYTES of file data at a time. A file that cannot be read
+     * gives std::nullopt.
+     */
+    constexpr std::size_t BATCH_BYTES = 8 * 1024 * 1024;
+    std::vector<std::optional<Digest>> sha256Files(const std::vector<std::string> &paths);
+
+    std::string toHex(const Digest &digest);
+}
+
+#endif //CORE_UTILS_FILE_HASH_H
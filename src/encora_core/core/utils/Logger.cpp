@@ -8,7 +8,7 @@
 namespace fs = std::filesystem;
 
 namespace EncoraLogger {
-    void Logger::init(const std::string &logDir) {
+    void Logger::init(const std::string &logDir, std::ostream &console) {
         if (m_isInitialized) return;
 
         try {
@@ -19,7 +19,7 @@ namespace EncoraLogger {
             // 5MB x 5 files
             const auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(logDir + "/encora.log", 1024 * 1024 * 5, 5);
             // Colored console sink
-            const auto consoleSink = std::make_shared<spdlog::sinks::ostream_sink_mt>(std::cout);
+            const auto consoleSink = std::make_shared<spdlog::sinks::ostream_sink_mt>(console);
             std::vector<spdlog::sink_ptr> sinks { consoleSink, fileSink };
 
             m_logger = std::make_shared<spdlog::logger>("Encora", sinks.begin(), sinks.end());
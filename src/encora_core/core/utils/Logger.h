@@ -1,6 +1,7 @@
 #ifndef CORE_UTILS_LOGGER_H
 #define CORE_UTILS_LOGGER_H
 
+#include <iostream>
 #include <memory>
 #include <string>
 #include <spdlog/spdlog.h>
@@ -19,7 +20,8 @@ namespace EncoraLogger {
 
     class Logger final {
     public:
-        static void init(const std::string &logDir = "logs");
+        // Log to 'logDir'/encora.log and to 'console' (std::cerr when stdout carries data).
+        static void init(const std::string &logDir = "logs", std::ostream &console = std::cout);
         static void shutdown();
 
         static std::shared_ptr<spdlog::logger> &get();
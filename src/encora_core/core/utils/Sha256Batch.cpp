@@ -0,0 +1,236 @@
+#include <sodium.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "Sha256Batch.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ENCORA_SHA256_AVX2 1
+#include <immintrin.h>
+#else
+#define ENCORA_SHA256_AVX2 0
+#endif
+
+namespace {
+    constexpr std::size_t BLOCK_SIZE = 64;
+
+    // Message length -> number of padded blocks (0x80, zeros, 64-bit bit length).
+    std::size_t blockCount(const std::size_t length) {
+        return (length + 9 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    // The padded message, block by block, without copying its full blocks.
+    class PaddedMessage {
+    public:
+        void assign(const std::span<const unsigned char> message) {
+            m_message = message;
+            m_full = message.size() / BLOCK_SIZE;
+            m_blocks = blockCount(message.size());
+
+            m_tail.fill(0);
+            const auto rest = message.size() % BLOCK_SIZE;
+            if (rest != 0) {
+                std::memcpy(m_tail.data(), message.data() + m_full * BLOCK_SIZE, rest);
+            }
+            m_tail[rest] = 0x80;
+            const std::uint64_t bits = static_cast<std::uint64_t>(message.size()) * 8;
+            const auto end = (m_blocks - m_full) * BLOCK_SIZE;
+            for (std::size_t i = 0; i < 8; ++i) {
+                m_tail[end - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+            }
+        }
+
+        [[nodiscard]]
+        std::size_t blocks() const { return m_blocks; }
+
+        [[nodiscard]]
+        const unsigned char *block(const std::size_t index) const {
+            return index < m_full ? m_message.data() + index * BLOCK_SIZE : m_tail.data() + (index - m_full) * BLOCK_SIZE;
+        }
+
+    private:
+        std::span<const unsigned char> m_message;
+        std::size_t m_full = 0;
+        std::size_t m_blocks = 0;
+        std::array<unsigned char, 2 * BLOCK_SIZE> m_tail {};
+    };
+
+    void hashScalar(const std::span<const std::span<const unsigned char>> messages, const std::span<FileHash::Digest> out) {
+        for (std::size_t i = 0; i < messages.size(); ++i) {
+            crypto_hash_sha256(out[i].data(), messages[i].data(), messages[i].size());
+        }
+    }
+
+#if ENCORA_SHA256_AVX2
+    constexpr std::uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    constexpr std::uint32_t IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    int loadBigEndian(const unsigned char *p) {
+        return static_cast<int>(static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16
+            | static_cast<std::uint32_t>(p[2]) << 8 | static_cast<std::uint32_t>(p[3]));
+    }
+
+    template <int N>
+    __attribute__((target("avx2"))) inline __m256i rotr(const __m256i x) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+    }
+
+    __attribute__((target("avx2"))) inline __m256i add(const __m256i a, const __m256i b) {
+        return _mm256_add_epi32(a, b);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i xor3(const __m256i a, const __m256i b, const __m256i c) {
+        return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+    }
+
+    // One SHA-256 compression per lane; blocks[lane] is that lane's next 64-byte block.
+    __attribute__((target("avx2"))) void compress(__m256i state[8], const unsigned char *const blocks[8]) {
+        __m256i w[64];
+        for (std::size_t t = 0; t < 16; ++t) {
+            w[t] = _mm256_setr_epi32(
+                loadBigEndian(blocks[0] + 4 * t), loadBigEndian(blocks[1] + 4 * t), loadBigEndian(blocks[2] + 4 * t),
+                loadBigEndian(blocks[3] + 4 * t), loadBigEndian(blocks[4] + 4 * t), loadBigEndian(blocks[5] + 4 * t),
+                loadBigEndian(blocks[6] + 4 * t), loadBigEndian(blocks[7] + 4 * t));
+        }
+        for (std::size_t t = 16; t < 64; ++t) {
+            const __m256i s0 = xor3(rotr<7>(w[t - 15]), rotr<18>(w[t - 15]), _mm256_srli_epi32(w[t - 15], 3));
+            const __m256i s1 = xor3(rotr<17>(w[t - 2]), rotr<19>(w[t - 2]), _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = add(add(w[t - 16], s0), add(w[t - 7], s1));
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for (std::size_t t = 0; t < 64; ++t) {
+            const __m256i s1 = xor3(rotr<6>(e), rotr<11>(e), rotr<25>(e));
+            const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            const __m256i t1 = add(add(add(h, s1), add(ch, _mm256_set1_epi32(static_cast<int>(K[t])))), w[t]);
+            const __m256i s0 = xor3(rotr<2>(a), rotr<13>(a), rotr<22>(a));
+            const __m256i maj = xor3(_mm256_and_si256(a, b), _mm256_and_si256(a, c), _mm256_and_si256(b, c));
+            const __m256i t2 = add(s0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = add(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = add(t1, t2);
+        }
+
+        state[0] = add(state[0], a);
+        state[1] = add(state[1], b);
+        state[2] = add(state[2], c);
+        state[3] = add(state[3], d);
+        state[4] = add(state[4], e);
+        state[5] = add(state[5], f);
+        state[6] = add(state[6], g);
+        state[7] = add(state[7], h);
+    }
+
+    __attribute__((target("avx2"))) void extract(const __m256i state[8], const std::size_t lane, FileHash::Digest &out) {
+        for (std::size_t word = 0; word < 8; ++word) {
+            alignas(32) std::uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), state[word]);
+            for (std::size_t i = 0; i < 4; ++i) {
+                out[4 * word + i] = static_cast<unsigned char>(lanes[lane] >> (24 - 8 * i));
+            }
+        }
+    }
+
+    __attribute__((target("avx2"))) void hashAvx2(const std::span<const std::span<const unsigned char>> messages,
+        const std::span<FileHash::Digest> out) {
+        // Similar lengths side by side, so lanes run out of blocks at about the same time.
+        std::vector<std::size_t> order(messages.size());
+        std::iota(order.begin(), order.end(), std::size_t {0});
+        std::stable_sort(order.begin(), order.end(), [&](const std::size_t l, const std::size_t r) {
+            return blockCount(messages[l].size()) < blockCount(messages[r].size());
+        });
+
+        static constexpr unsigned char idle[BLOCK_SIZE] = {};
+        std::array<PaddedMessage, Sha256Batch::LANES> lanes;
+        for (std::size_t first = 0; first < order.size(); first += Sha256Batch::LANES) {
+            const std::size_t used = std::min(Sha256Batch::LANES, order.size() - first);
+            std::size_t rounds = 0;
+            for (std::size_t lane = 0; lane < used; ++lane) {
+                lanes[lane].assign(messages[order[first + lane]]);
+                rounds = std::max(rounds, lanes[lane].blocks());
+            }
+
+            __m256i state[8];
+            for (std::size_t word = 0; word < 8; ++word) {
+                state[word] = _mm256_set1_epi32(static_cast<int>(IV[word]));
+            }
+
+            const unsigned char *blocks[Sha256Batch::LANES];
+            for (std::size_t round = 0; round < rounds; ++round) {
+                for (std::size_t lane = 0; lane < Sha256Batch::LANES; ++lane) {
+                    blocks[lane] = lane < used && round < lanes[lane].blocks() ? lanes[lane].block(round) : idle;
+                }
+                compress(state, blocks);
+                for (std::size_t lane = 0; lane < used; ++lane) {
+                    if (round + 1 == lanes[lane].blocks()) {
+                        extract(state, lane, out[order[first + lane]]);
+                    }
+                }
+            }
+        }
+    }
+
+    bool hasAvx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif
+}
+
+namespace Sha256Batch {
+    Kernel kernel() {
+#if ENCORA_SHA256_AVX2
+        if (hasAvx2()) {
+            return Kernel::Avx2;
+        }
+#endif
+        return Kernel::Scalar;
+    }
+
+    std::string_view name(const Kernel kernel) {
+        return kernel == Kernel::Avx2 ? "avx2" : "scalar";
+    }
+
+    void hash(const std::span<const std::span<const unsigned char>> messages, const std::span<FileHash::Digest> out) {
+        hash(messages, out, kernel());
+    }
+
+    void hash(const std::span<const std::span<const unsigned char>> messages, const std::span<FileHash::Digest> out, const Kernel kernel) {
+        if (out.size() != messages.size()) {
+            throw std::invalid_argument("Sha256Batch: one digest per message expected.");
+        }
+
+#if ENCORA_SHA256_AVX2
+        if (kernel == Kernel::Avx2 && hasAvx2()) {
+            hashAvx2(messages, out);
+            return;
+        }
+#else
+        (void) kernel;
+#endif
+        hashScalar(messages, out);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef CORE_UTILS_SHA256_BATCH_H
+#define CORE_UTILS_SHA256_BATCH_H
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+#include "FileHash.h"
+
+/**
+ * Multi-buffer SHA-256: hashes independent messages side by side, one message per
+ * 32-bit SIMD lane, so short messages are not bound by the latency of a single
+ * compression chain.
+ *
+ * Kernels, picked at runtime:
+ *      Avx2    - 8 lanes (x86-64 with AVX2, GCC / Clang)
+ *      Scalar  - one crypto_hash_sha256 call per message
+ *
+ * Messages are grouped by block count so the lanes of a group finish together; a lane
+ * that is done early is fed a dummy block and its result read out at its last block.
+ * Worth it for small files only: past SMALL_MESSAGE_LIMIT bytes a single stream is
+ * already throughput-bound.
+ */
+namespace Sha256Batch {
+    constexpr std::size_t LANES = 8;
+    constexpr std::size_t SMALL_MESSAGE_LIMIT = 64 * 1024;
+
+    enum class Kernel {
+        Scalar,
+        Avx2,
+    };
+
+    // Best kernel for this CPU.
+    Kernel kernel();
+    std::string_view name(Kernel kernel);
+
+    // out[i] = SHA-256(messages[i]). 'out' must have messages.size() entries.
+    void hash(std::span<const std::span<const unsigned char>> messages, std::span<FileHash::Digest> out);
+    // Same with a given kernel; falls back to Scalar if it is not available here.
+    void hash(std::span<const std::span<const unsigned char>> messages, std::span<FileHash::Digest> out, Kernel kernel);
+}
+
+#endif //CORE_UTILS_SHA256_BATCH_H
@@ -1,9 +1,22 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 #include <fstream>
 #include <sodium.h>
 
 #include "IntegrityChecker.h"
+#include "ManifestWriter.h"
+#include "MerkleTree.h"
+#include "StatCache.h"
+#include "utils/FileHash.h"
+#include "utils/Logger.h"
+#include "utils/Sha256Batch.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -18,22 +31,6 @@ static std::vector<unsigned char> readAll(const fs::path &path, bool &ok) {
     return bytes;
 }
 
-static std::string toHex(const unsigned char *buffer, size_t length) {
-    std::ostringstream oss;
-    for (size_t i = 0; i < length; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(buffer[i]);
-    }
-
-    return oss.str();
-}
-
-static std::string sha256Hex(const std::vector<unsigned char> &bytes) {
-    unsigned char out[crypto_hash_sha256_BYTES];
-    crypto_hash_sha256(out, bytes.data(), bytes.size());
-
-    return toHex(out, sizeof(out));
-}
-
 static std::vector<unsigned char> hmacSha256(const std::string &data, const std::vector<unsigned char> &key) {
     std::vector<unsigned char> mac(crypto_auth_hmacsha256_BYTES);
     crypto_auth_hmacsha256_state state;
@@ -44,101 +41,553 @@ static std::vector<unsigned char> hmacSha256(const std::string &data, const std:
     return mac;
 }
 
-IntegrityReport IntegrityChecker::verify(const std::string &root, const std::vector<unsigned char> &vmk) {
-    IntegrityReport report;
-
-    try {
-        const fs::path rootPath = root;
-        const fs::path manifestPath = rootPath / "MANIFEST.json";
-        const fs::path hmacPath = rootPath / "MANIFEST.hmac";
+namespace {
+    struct ManifestEntry {
+        std::string path;
+        std::string hex;
+        MerkleTree::Hash digest {};
+    };
 
-        if (!fs::exists(manifestPath) || !fs::exists(hmacPath)) {
-            report.status = IntegrityStatus::MissingManifest;
-            report.message = "MANIFEST.* not found.";
+    struct LoadedManifest {
+        std::vector<ManifestEntry> entries;   // sorted by path
+        MerkleTree tree;                      // empty for v1
+        int version = 1;
+        FileHash::Algorithm algorithm = FileHash::Algorithm::Sha256;
 
-            return report;
+        [[nodiscard]]
+        std::vector<std::string> paths() const {
+            std::vector<std::string> out;
+            out.reserve(entries.size());
+            for (const auto &entry : entries) {
+                out.push_back(entry.path);
+            }
+            return out;
         }
+    };
 
-        bool isOk = false;
-        const auto manifestBytes = readAll(manifestPath, isOk);
-        if (!isOk) {
-            report.status = IntegrityStatus::Error;
-            report.message = "Failed to read MANIFEST.json.";
-            return report;
+    // Digest of a file hashed ahead of the per-file pass, with its stat from before the read.
+    struct Prehashed {
+        std::optional<StatCache::FileStat> stat;
+        MerkleTree::Hash digest {};
+    };
+
+    IntegrityReport failure(const IntegrityStatus status, std::string message) {
+        return IntegrityReport {status, std::move(message)};
+    }
+}
+
+// Read MANIFEST.{json, hmac} and authenticate them: v1 by the HMAC over the document,
+// v2+ by the HMAC over the Merkle root the entries hash up to (and, from v3, the digest
+// algorithm). Returns OK or the failure.
+static IntegrityReport loadManifest(const fs::path &rootPath, const std::vector<unsigned char> &vmk, LoadedManifest &out) {
+    const fs::path manifestPath = rootPath / "MANIFEST.json";
+    const fs::path hmacPath = rootPath / "MANIFEST.hmac";
+
+    if (!fs::exists(manifestPath) || !fs::exists(hmacPath)) {
+        return failure(IntegrityStatus::MissingManifest, "MANIFEST.* not found.");
+    }
+
+    bool isOk = false;
+    const auto manifestBytes = readAll(manifestPath, isOk);
+    if (!isOk) {
+        return failure(IntegrityStatus::Error, "Failed to read MANIFEST.json.");
+    }
+
+    const std::string manifestStr(manifestBytes.begin(), manifestBytes.end());
+    const auto macBytes = readAll(hmacPath, isOk);
+    if (!isOk) {
+        return failure(IntegrityStatus::Error, "Failed to read MANIFEST.hmac.");
+    }
+
+    if (macBytes.size() != crypto_auth_hmacsha256_BYTES) {
+        return failure(IntegrityStatus::Error, "Invalid MANIFEST.hmac size.");
+    }
+
+    // If VMK is empty, we cannot authenticate manifest -> HMAC mismatch
+    if (vmk.empty()) {
+        return failure(IntegrityStatus::HMACMismatch, "VMK is empty. Cannot verify HMAC.");
+    }
+
+    const auto j = json::parse(manifestStr, nullptr, false);
+    out.version = j.is_object() ? j.value("version", 1) : 1;
+    if (out.version < 2) {
+        // Verify HMAC (MANIFEST.json, VMK)
+        const auto macCalculated = hmacSha256(manifestStr, vmk);
+        if (sodium_memcmp(macCalculated.data(), macBytes.data(), macCalculated.size()) != 0) {
+            return failure(IntegrityStatus::HMACMismatch, "HMAC verification failed.");
         }
+    }
 
-        const std::string manifestStr(manifestBytes.begin(), manifestBytes.end());
-        const auto macBytes = readAll(hmacPath, isOk);
-        if (!isOk) {
-            report.status = IntegrityStatus::Error;
-            report.message = "Failed to read MANIFEST.hmac.";
-            return report;
+    if (!j.is_object() || !j.contains("files") || !j["files"].is_array()) {
+        return failure(IntegrityStatus::Error, "MANIFEST.json malformed: missing 'files'.");
+    }
+
+    if (out.version >= 3) {
+        // The algorithm is bound by the HMAC below; an unknown one cannot verify anyway.
+        const auto algorithm = FileHash::parse(j.value("alg", std::string {}));
+        if (!algorithm) {
+            return failure(IntegrityStatus::Error, "MANIFEST.json: unsupported 'alg'.");
         }
+        out.algorithm = *algorithm;
+    }
 
-        if (macBytes.size() != crypto_auth_hmacsha256_BYTES) {
-            report.status = IntegrityStatus::Error;
-            report.message = "Invalid MANIFEST.hmac size.";
-            return report;
+    const char *digestKey = out.version >= 3 ? "digest" : "sha256";
+    for (const auto &f : j["files"]) {
+        ManifestEntry entry {f.at("path").get<std::string>(), f.at(digestKey).get<std::string>(), {}};
+        if (entry.hex.size() != 2 * MerkleTree::HASH_SIZE
+            || sodium_hex2bin(entry.digest.data(), entry.digest.size(), entry.hex.data(), entry.hex.size(),
+                nullptr, nullptr, nullptr) != 0) {
+            return failure(IntegrityStatus::Error, "MANIFEST.json malformed: bad digest for " + entry.path);
         }
+        out.entries.push_back(std::move(entry));
+    }
 
-        // If VMK is empty, we cannot authenticate manifest -> HMAC mismatch
-        if (vmk.empty()) {
-            report.status = IntegrityStatus::HMACMismatch;
-            report.message = "VMK is empty. Cannot verify HMAC.";
-            return report;
+    if (out.version >= 2) {
+        // Verify HMAC (Merkle root, VMK); the entries must hash up to the signed root.
+        std::vector<MerkleTree::Hash> leaves;
+        leaves.reserve(out.entries.size());
+        for (const auto &entry : out.entries) {
+            leaves.push_back(MerkleTree::leafHash(entry.path, entry.digest));
         }
+        out.tree.assign(std::move(leaves));
 
-        // Verify HMAC (MANIFEST.json, VMK)
-        const auto macCalculated = hmacSha256(manifestStr, vmk);
+        const auto macCalculated = ManifestWriter::signRoot(out.tree.root(), out.tree.size(), out.algorithm, vmk,
+            static_cast<unsigned char>(std::min(out.version, 255)));
         if (sodium_memcmp(macCalculated.data(), macBytes.data(), macCalculated.size()) != 0) {
-            report.status = IntegrityStatus::HMACMismatch;
-            report.message = "HMAC verification failed.";
-            return report;
+            return failure(IntegrityStatus::HMACMismatch, "HMAC verification failed.");
         }
+    }
 
-        // Verify per-file SHA256
-        const auto j = json::parse(manifestStr, nullptr, true);
-        if (!j.contains("files") || !j["files"].is_array()) {
-            report.status = IntegrityStatus::Error;
-            report.message = "MANIFEST.json malformed: missing 'files'.";
-            return report;
+    return IntegrityReport {IntegrityStatus::OK, {}};
+}
+
+// Hash one listed file (or take its digest from 'cache' while its stat tuple is
+// unchanged, or from 'prehashed') and compare it with its manifest entry. From v2 the
+// leaf is checked through its inclusion proof against the signed root.
+static IntegrityReport verifyEntry(const fs::path &rootPath, const LoadedManifest &manifest, const std::size_t index, StatCache *cache,
+    const Prehashed *prehashed = nullptr) {
+    const auto &entry = manifest.entries[index];
+    const fs::path abs = rootPath / fs::path(entry.path);
+    if (!fs::exists(abs)) {
+        return failure(IntegrityStatus::HashMismatch, "Missing file listed in MANIFEST: " + abs.string());
+    }
+
+    auto matches = [&](const MerkleTree::Hash &digest) {
+        return manifest.version >= 2
+            ? MerkleTree::verify(MerkleTree::leafHash(entry.path, digest), manifest.tree.proof(index), manifest.tree.root())
+            : sodium_memcmp(digest.data(), entry.digest.data(), digest.size()) == 0;
+    };
+
+    // Stat before reading: if the file changes while it is hashed, the entry stored below is stale at once.
+    std::optional<StatCache::FileStat> stat;
+    if (prehashed) {
+        stat = prehashed->stat;
+    } else if (cache) {
+        stat = StatCache::stat(abs.string());
+        if (stat) {
+            if (const auto cached = cache->lookup(entry.path, *stat); cached && matches(*cached)) {
+                return IntegrityReport {IntegrityStatus::OK, {}};
+            }
+        }
+    }
+
+    MerkleTree::Hash digest {};
+    if (prehashed) {
+        digest = prehashed->digest;
+    } else {
+        try {
+            digest = FileHash::digest(abs.string(), manifest.algorithm);
+        } catch (const std::exception &) {
+            return failure(IntegrityStatus::Error, "Failed to read: " + abs.string());
+        }
+    }
+
+    if (!matches(digest)) {
+        return failure(IntegrityStatus::HashMismatch, "Hash mismatch for: " + abs.string());
+    }
+
+    if (cache && stat) {
+        cache->store(entry.path, *stat, digest);
+    }
+    return IntegrityReport {IntegrityStatus::OK, {}};
+}
+
+// SHA-256 manifests: hash the small files among 'selected' that 'cache' cannot vouch
+// for side by side (FileHash::sha256Files), ahead of the per-file pass. Indexed like
+// manifest.entries; files it skipped or could not read are left to verifyEntry.
+static std::vector<std::optional<Prehashed>> prehashSmallFiles(const fs::path &rootPath, const LoadedManifest &manifest,
+    const std::vector<std::size_t> &selected, const StatCache *cache) {
+    std::vector<std::optional<Prehashed>> out;
+    if (manifest.algorithm != FileHash::Algorithm::Sha256) {
+        return out;
+    }
+
+    std::vector<std::size_t> indices;
+    std::vector<std::optional<StatCache::FileStat>> stats;
+    std::vector<std::string> paths;
+    for (const auto index : selected) {
+        const auto &entry = manifest.entries[index];
+        const auto abs = (rootPath / fs::path(entry.path)).string();
+        const auto stat = StatCache::stat(abs);
+        if (!stat || stat->size > Sha256Batch::SMALL_MESSAGE_LIMIT || (cache && cache->lookup(entry.path, *stat))) {
+            continue;
+        }
+        indices.push_back(index);
+        stats.push_back(stat);
+        paths.push_back(abs);
+    }
+    if (indices.size() < 2) {
+        return out;
+    }
+
+    const auto digests = FileHash::sha256Files(paths);
+    out.resize(manifest.entries.size());
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        if (digests[i]) {
+            out[indices[i]] = Prehashed {stats[i], *digests[i]};
         }
+    }
+    return out;
+}
 
-        for (const auto &f : j["files"]) {
-            const auto rel = f.at("path").get<std::string>();
-            const auto want = f.at("sha256").get<std::string>();
-            const fs::path abs = rootPath / fs::path(rel);
+// Verify 'selected' entries on up to 'jobs' threads. Workers claim entries in manifest
+// order; after a failure, entries past it are no longer started. Every entry before
+// the first failure has already been claimed and runs to completion, so the reported
+// failure is the first in manifest order, the same one a sequential pass finds.
+// Memory in flight is bounded by one read buffer per worker.
+static IntegrityReport verifyEntries(const fs::path &rootPath, const LoadedManifest &manifest, const std::vector<std::size_t> &selected,
+    unsigned jobs, StatCache *cache) {
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, selected.size()));
+
+    const auto prehashed = prehashSmallFiles(rootPath, manifest, selected, cache);
+    auto prehashedFor = [&](const std::size_t index) -> const Prehashed * {
+        return index < prehashed.size() && prehashed[index] ? &*prehashed[index] : nullptr;
+    };
 
-            if (!fs::exists(abs)) {
-                report.status = IntegrityStatus::HashMismatch;
-                report.message = "Missing file listed in MANIFEST: " + abs.string();
+    if (jobs <= 1) {
+        for (const auto index : selected) {
+            if (auto report = verifyEntry(rootPath, manifest, index, cache, prehashedFor(index)); report.status != IntegrityStatus::OK) {
                 return report;
             }
+        }
+        return IntegrityReport {IntegrityStatus::OK, {}};
+    }
 
-            bool isOKF = false;
-            const auto bytes = readAll(abs, isOKF);
-            if (!isOKF) {
-                report.status = IntegrityStatus::Error;
-                report.message = "Failed to read: " + abs.string();
-                return report;
+    constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+    std::atomic<std::size_t> next {0};
+    std::atomic<std::size_t> firstFailure {none};
+    std::vector<IntegrityReport> failures(selected.size());
+
+    auto worker = [&] {
+        for (;;) {
+            const auto position = next.fetch_add(1);
+            if (position >= selected.size() || position > firstFailure.load()) {
+                return;
             }
 
-            const auto got = sha256Hex(bytes);
-            if (got != want) {
-                report.status = IntegrityStatus::HashMismatch;
-                report.message = "Hash mismatch for: " + abs.string();
-                return report;
+            IntegrityReport report;
+            try {
+                report = verifyEntry(rootPath, manifest, selected[position], cache, prehashedFor(selected[position]));
+            } catch (const std::exception &e) {
+                report = failure(IntegrityStatus::Error, e.what());
+            }
+            if (report.status == IntegrityStatus::OK) continue;
+
+            failures[position] = std::move(report);
+            auto current = firstFailure.load();
+            while (position < current && !firstFailure.compare_exchange_weak(current, position)) {
             }
         }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (unsigned i = 0; i < jobs; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto &thread : workers) {
+        thread.join();
+    }
 
-        report.status = IntegrityStatus::OK;
-        report.message = "Vault integrity verified.";
+    if (const auto position = firstFailure.load(); position != none) {
+        return failures[position];
+    }
+    return IntegrityReport {IntegrityStatus::OK, {}};
+}
+
+// Verify the entries whose path starts with 'prefix' ("" = all).
+static IntegrityReport verifyMatching(const std::string &root, const std::vector<unsigned char> &vmk, const std::string &prefix,
+    const bool exact, const VerifyOptions &options) {
+    try {
+        const fs::path rootPath = root;
+        LoadedManifest manifest;
+        if (auto report = loadManifest(rootPath, vmk, manifest); report.status != IntegrityStatus::OK) {
+            return report;
+        }
 
-        return report;
+        std::vector<std::size_t> selected;
+        for (std::size_t i = 0; i < manifest.entries.size(); ++i) {
+            const auto &path = manifest.entries[i].path;
+            if (exact ? path == prefix : path.starts_with(prefix)) {
+                selected.push_back(i);
+            }
+        }
+
+        std::unique_ptr<StatCache> cache;
+        if (!options.paranoid) {
+            cache = std::make_unique<StatCache>(root, vmk, manifest.algorithm);
+        }
+        const auto report = verifyEntries(rootPath, manifest, selected, options.jobs, cache.get());
+        if (cache) {
+            if (prefix.empty()) {
+                cache->retain(manifest.paths());
+            }
+            cache->save();
+        }
+        if (report.status != IntegrityStatus::OK) {
+            return report;
+        }
+
+        const auto checked = selected.size();
+        if (exact && checked == 0) {
+            return failure(IntegrityStatus::HashMismatch, "Not listed in MANIFEST: " + prefix);
+        }
+
+        return IntegrityReport {IntegrityStatus::OK, prefix.empty() ? "Vault integrity verified."
+            : "Verified " + std::to_string(checked) + " file(s) under '" + prefix + "'."};
+    } catch (const std::exception &e) {
+        return failure(IntegrityStatus::Error, e.what());
+    }
+}
+
+IntegrityReport IntegrityChecker::verify(const std::string &root, const std::vector<unsigned char> &vmk, const VerifyOptions &options) {
+    return verifyMatching(root, vmk, "", false, options);
+}
+
+IntegrityReport IntegrityChecker::verifyFile(const std::string &root, const std::vector<unsigned char> &vmk, const std::string &path) {
+    return verifyMatching(root, vmk, path, true, {});
+}
+
+IntegrityReport IntegrityChecker::verifySubtree(const std::string &root, const std::vector<unsigned char> &vmk, const std::string &prefix,
+    const VerifyOptions &options) {
+    return verifyMatching(root, vmk, prefix, false, options);
+}
+
+struct IntegrityVerification::State {
+    enum Progress : unsigned char { Pending, Running, Done };
+
+    fs::path root;
+    LoadedManifest manifest;
+    std::unordered_map<std::string, std::size_t> byPath;
+    std::unique_ptr<StatCache> cache;                               // null when paranoid
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+    std::vector<Progress> progress;
+    std::vector<IntegrityReport> reports;
+    std::size_t next = 0;                                           // background cursor
+    std::size_t firstFailure = std::numeric_limits<std::size_t>::max();
+    unsigned running = 0;                                           // background threads still working
+    bool cancelled = false;
+    bool done = false;
+    IntegrityReport result;
+
+    // Under 'mutex'.
+    void record(const std::size_t index, IntegrityReport report) {
+        if (report.status != IntegrityStatus::OK) {
+            firstFailure = std::min(firstFailure, index);
+        }
+        reports[index] = std::move(report);
+        progress[index] = Done;
+        cv.notify_all();
+    }
+
+    // Once no background thread is left; not under 'mutex' (file I/O).
+    void saveCache() const {
+        if (cache) {
+            cache->retain(manifest.paths());
+            cache->save();
+        }
+    }
+
+    // Under 'mutex', once no background thread is left.
+    void finish() {
+        if (firstFailure < reports.size()) {
+            result = reports[firstFailure];
+        } else if (cancelled) {
+            result = failure(IntegrityStatus::Unknown, "Integrity verification cancelled.");
+        } else {
+            result = IntegrityReport {IntegrityStatus::OK, "Vault integrity verified."};
+        }
+        done = true;
+        cv.notify_all();
+    }
+};
+
+IntegrityVerification::IntegrityVerification() : m_state(std::make_unique<State>()) {
+}
+
+IntegrityVerification::~IntegrityVerification() {
+    cancel();
+}
+
+std::shared_ptr<IntegrityVerification> IntegrityVerification::completed(IntegrityReport report) {
+    std::shared_ptr<IntegrityVerification> verification(new IntegrityVerification());
+    verification->m_state->result = std::move(report);
+    verification->m_state->done = true;
+    return verification;
+}
+
+bool IntegrityVerification::ready() const {
+    std::lock_guard lock(m_state->mutex);
+    return m_state->done;
+}
+
+IntegrityStatus IntegrityVerification::status() const {
+    std::lock_guard lock(m_state->mutex);
+    return m_state->done ? m_state->result.status : IntegrityStatus::Unknown;
+}
+
+IntegrityReport IntegrityVerification::wait() const {
+    std::unique_lock lock(m_state->mutex);
+    m_state->cv.wait(lock, [&] { return m_state->done; });
+    return m_state->result;
+}
+
+IntegrityReport IntegrityVerification::verifyFile(const std::string &path) {
+    auto &state = *m_state;
+    const auto it = state.byPath.find(path);
+    if (it == state.byPath.end()) {
+        return IntegrityReport {IntegrityStatus::OK, "Not listed in MANIFEST: " + path};
+    }
+
+    const auto index = it->second;
+    {
+        std::unique_lock lock(state.mutex);
+        if (state.progress[index] == State::Running) {
+            state.cv.wait(lock, [&] { return state.progress[index] == State::Done; });
+        }
+        if (state.progress[index] == State::Done) {
+            return state.reports[index];
+        }
+        state.progress[index] = State::Running;
+    }
+
+    IntegrityReport report;
+    try {
+        report = verifyEntry(state.root, state.manifest, index, state.cache.get());
+    } catch (const std::exception &e) {
+        report = failure(IntegrityStatus::Error, e.what());
+    }
+
+    std::lock_guard lock(state.mutex);
+    state.record(index, report);
+    return report;
+}
+
+void IntegrityVerification::cancel() {
+    {
+        std::lock_guard lock(m_state->mutex);
+        m_state->cancelled = true;
+    }
+    for (auto &worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void IntegrityVerification::run() {
+    auto &state = *m_state;
+    std::unique_lock lock(state.mutex);
+    for (;;) {
+        // Same early stop as IntegrityChecker::verify: nothing past the first failure.
+        while (state.next < state.progress.size() && state.progress[state.next] != State::Pending) {
+            ++state.next;
+        }
+        if (state.cancelled || state.next >= state.progress.size() || state.next > state.firstFailure) {
+            break;
+        }
+
+        const auto index = state.next++;
+        state.progress[index] = State::Running;
+        lock.unlock();
+
+        IntegrityReport report;
+        try {
+            report = verifyEntry(state.root, state.manifest, index, state.cache.get());
+        } catch (const std::exception &e) {
+            report = failure(IntegrityStatus::Error, e.what());
+        }
+
+        lock.lock();
+        state.record(index, std::move(report));
+    }
+
+    // Entries claimed on demand may still be running; the result must include them.
+    state.cv.wait(lock, [&] {
+        return std::none_of(state.progress.begin(), state.progress.begin() + static_cast<std::ptrdiff_t>(
+            std::min(state.progress.size(), state.firstFailure)), [](const auto p) { return p == State::Running; });
+    });
+
+    if (--state.running == 0) {
+        lock.unlock();
+        state.saveCache();
+        lock.lock();
+        state.finish();
+        lock.unlock();
+        if (state.result.status == IntegrityStatus::OK) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Integrity (background): OK. " + state.result.message);
+        } else {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Error, "Integrity (background): " + state.result.message);
+        }
+    }
+}
+
+std::shared_ptr<IntegrityVerification> IntegrityChecker::verifyDeferred(const std::string &root, const std::vector<unsigned char> &vmk,
+    const std::vector<std::string> &eager, const VerifyOptions &options) {
+    std::shared_ptr<IntegrityVerification> verification(new IntegrityVerification());
+    auto &state = *verification->m_state;
+    using State = IntegrityVerification::State;
+    state.root = root;
+    try {
+        if (auto report = loadManifest(state.root, vmk, state.manifest); report.status != IntegrityStatus::OK) {
+            return IntegrityVerification::completed(std::move(report));
+        }
     } catch (const std::exception &e) {
-        report.status = IntegrityStatus::Error;
-        report.message = e.what();
+        return IntegrityVerification::completed(failure(IntegrityStatus::Error, e.what()));
+    }
+
+    if (!options.paranoid) {
+        state.cache = std::make_unique<StatCache>(root, vmk, state.manifest.algorithm);
+    }
+
+    const auto count = state.manifest.entries.size();
+    state.progress.assign(count, State::Pending);
+    state.reports.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        state.byPath.emplace(state.manifest.entries[i].path, i);
+    }
 
-        return report;
+    for (const auto &path : eager) {
+        (void) verification->verifyFile(path);
     }
+
+    unsigned jobs = options.jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.jobs;
+    jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, count));
+    {
+        std::lock_guard lock(state.mutex);
+        state.running = jobs;
+        if (jobs == 0) {
+            state.finish();
+        }
+    }
+    for (unsigned i = 0; i < jobs; ++i) {
+        verification->m_workers.emplace_back([raw = verification.get()] { raw->run(); });
+    }
+
+    return verification;
 }
@@ -1,7 +1,9 @@
 #ifndef CORE_SECURITY_INTEGRITY_CHECKER_H
 #define CORE_SECURITY_INTEGRITY_CHECKER_H
 
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 enum class IntegrityStatus {
@@ -18,23 +20,104 @@ struct IntegrityReport {
     std::string message;
 };
 
+struct VerifyOptions {
+    // Files hashed in parallel; 0 = one per hardware thread.
+    unsigned jobs = 1;
+    // Hash every file, ignoring (and not updating) the stat cache.
+    bool paranoid = false;
+};
+
 /**
  * IntegrityChecker verifies vault integrity using MANIFEST.json and MANIFEST.hmac
  *
  * Layout (under vault root, currently ./data):
  *      data/
  *          vault.meta
+ *          vault.wal           <-- transient redo log, not in the manifest
  *          vault_store/
- *              index.json
- *              record_*.bin
- *          MANIFEST.json       <-- contains list of files + their sha256 (hex)
- *          MANIFEST.hmac       <-- HMAC-SHA256 (MANIFEST.json, key = VMK)
+ *              index.log
+ *              segment_*.dat
+ *              record_*.bin      (legacy, if exist)
+ *          MANIFEST.json       <-- contains list of files + their digests (hex), the digest "alg" (v3) and the Merkle root (v2+)
+ *          MANIFEST.hmac       <-- HMAC-SHA256 over the Merkle root (v2+) or MANIFEST.json (v1), key = VMK
+ *
+ * Files are hashed with the manifest's algorithm: SHA-256 (v1, v2) or the "alg" of a v3
+ * manifest (SHA-256 or BLAKE2b-256). For a v2+ manifest each file is checked through its inclusion proof against the
+ * signed root, so verifyFile / verifySubtree hash only the files they are asked about.
+ *
+ * With VerifyOptions::jobs > 1 files are hashed on a pool of threads, each streaming
+ * through its own FileHash::CHUNK_SIZE buffer. No new file is started past the first failure, and
+ * the report is always the first failure in manifest order, the same as a single
+ * thread would return.
+ *
+ * Unless VerifyOptions::paranoid, a file whose size, mtime, ctime and inode match its
+ * MANIFEST.cache entry is not read again (see StatCache); files that are hashed refresh
+ * the cache.
  */
+class IntegrityVerification;
+
 class IntegrityChecker {
 public:
     // Verify integrity under 'root' (usually "data") using VMK for HMAC
     // Returns report with status/message. Does not throw; converts to Error.
-    static IntegrityReport verify(const std::string &root, const std::vector<unsigned char> &vmk);
+    static IntegrityReport verify(const std::string &root, const std::vector<unsigned char> &vmk, const VerifyOptions &options = {});
+    // Verify one file, by its path relative to 'root' (e.g. "vault_store/segment_000001.dat").
+    static IntegrityReport verifyFile(const std::string &root, const std::vector<unsigned char> &vmk, const std::string &path);
+    // Verify every listed file whose path starts with 'prefix' (e.g. "vault_store/").
+    static IntegrityReport verifySubtree(const std::string &root, const std::vector<unsigned char> &vmk, const std::string &prefix,
+        const VerifyOptions &options = {});
+    // Authenticate the manifest and check the 'eager' files now; hash the rest on
+    // background threads. Never null; ready at once if the manifest itself fails.
+    static std::shared_ptr<IntegrityVerification> verifyDeferred(const std::string &root, const std::vector<unsigned char> &vmk,
+        const std::vector<std::string> &eager, const VerifyOptions &options = {});
+};
+
+/**
+ * IntegrityVerification
+ *
+ * Future-like handle on an integrity pass that may still be running (see
+ * IntegrityChecker::verifyDeferred). Poll with ready() / status(), block with wait().
+ * verifyFile() checks one file right away unless the background pass has already
+ * done it (or is doing it, then it waits for that), so a reader never has to wait
+ * for the whole vault.
+ *
+ * The final report is the first failure in manifest order, like IntegrityChecker::verify.
+ * Background threads need no key material. The destructor cancels and joins them.
+ * Thread-safe.
+ */
+class IntegrityVerification {
+public:
+    // A pass that is already over.
+    static std::shared_ptr<IntegrityVerification> completed(IntegrityReport report);
+
+    ~IntegrityVerification();
+
+    IntegrityVerification(const IntegrityVerification &) = delete;
+    IntegrityVerification &operator=(const IntegrityVerification &) = delete;
+
+    [[nodiscard]]
+    bool ready() const;
+    // Final status, or Unknown while files are still being checked.
+    [[nodiscard]]
+    IntegrityStatus status() const;
+    // Block until every file has been checked (or the pass was cancelled).
+    [[nodiscard]]
+    IntegrityReport wait() const;
+    // Check 'path' (relative to the vault root) now unless that already happened.
+    // Files the manifest does not list are reported OK.
+    IntegrityReport verifyFile(const std::string &path);
+    // Stop starting new files and join the background threads.
+    void cancel();
+
+private:
+    friend class IntegrityChecker;
+    struct State;
+
+    std::unique_ptr<State> m_state;
+    std::vector<std::thread> m_workers;
+
+    IntegrityVerification();
+    void run();
 };
 
 #endif //CORE_SECURITY_INTEGRITY_CHECKER_H
@@ -2,9 +2,12 @@
 #include <nlohmann/json.hpp>
 #include <fstream>
 #include <sodium.h>
-#include <iomanip>
 
 #include "ManifestWriter.h"
+#include "MerkleTree.h"
+#include "utils/FileHash.h"
+#include "utils/Sha256Batch.h"
+#include "storage/SegmentStore.h"
 #include "utils/Logger.h"
 
 namespace fs = std::filesystem;
@@ -36,99 +39,314 @@ static void writeAll(const fs::path &path, const std::vector<unsigned char> &dat
     ofs.close();
 }
 
-static std::string toHex(const unsigned char *buffer, size_t length) {
-    std::ostringstream oss;
-    for (size_t i = 0; i < length; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(buffer[i]);
-    }
+static std::vector<unsigned char> hmacSha256(const std::string &data, const std::vector<unsigned char> &key) {
+    std::vector<unsigned char> mac(crypto_auth_hmacsha256_BYTES);
+    crypto_auth_hmacsha256_state state;
+    crypto_auth_hmacsha256_init(&state, key.data(), key.size());
+    crypto_auth_hmacsha256_update(&state, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    crypto_auth_hmacsha256_final(&state, mac.data());
 
-    return oss.str();
+    return mac;
 }
 
-static std::string sha256Hex(const std::vector<unsigned char> &bytes) {
-    unsigned char out[crypto_hash_sha256_BYTES];
-    crypto_hash_sha256(out, bytes.data(), bytes.size());
-    return toHex(out, sizeof(out));
+struct ManifestWriter::FileState {
+    std::string hex;
+    MerkleTree::Hash digest {};
+    // Leaf position in m_tree.
+    std::size_t index = 0;
+    // Hash state after the first 'hashed' bytes; only valid when 'resumable'.
+    FileHash::Hasher hasher;
+    std::uint64_t hashed = 0;
+    bool resumable = false;
+};
+
+bool ManifestWriter::update(const std::string &root, const std::vector<unsigned char> &vmk, std::string &err) {
+    ManifestWriter writer(root, vmk);
+    return writer.rebuild(err);
 }
 
-static std::vector<unsigned char> hmacSha256(const std::string &data, const std::vector<unsigned char> &key) {
+std::vector<unsigned char> ManifestWriter::signRoot(const MerkleTree::Hash &root, const std::size_t leafCount,
+    const FileHash::Algorithm algorithm, const std::vector<unsigned char> &vmk, const unsigned char version) {
+    const unsigned char domain[] = {'E', 'N', 'C', 'M', 'R', 'K', 'L', version, static_cast<unsigned char>(algorithm)};
+    unsigned char count[8];
+    for (int i = 0; i < 8; ++i) {
+        count[i] = static_cast<unsigned char>(static_cast<std::uint64_t>(leafCount) >> (8 * i));
+    }
+
     std::vector<unsigned char> mac(crypto_auth_hmacsha256_BYTES);
     crypto_auth_hmacsha256_state state;
-    crypto_auth_hmacsha256_init(&state, key.data(), key.size());
-    crypto_auth_hmacsha256_update(&state, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    crypto_auth_hmacsha256_init(&state, vmk.data(), vmk.size());
+    // v2 had no algorithm byte.
+    crypto_auth_hmacsha256_update(&state, domain, version > 2 ? sizeof(domain) : sizeof(domain) - 1);
+    crypto_auth_hmacsha256_update(&state, count, sizeof(count));
+    crypto_auth_hmacsha256_update(&state, root.data(), root.size());
     crypto_auth_hmacsha256_final(&state, mac.data());
 
     return mac;
 }
 
-bool ManifestWriter::update(const std::string &root, const std::vector<unsigned char> &vmk, std::string &err) {
+ManifestWriter::ManifestWriter(std::string root, const std::vector<unsigned char> &vmk)
+    : m_root(std::move(root)), m_vmk(vmk), m_rebuildAlgorithm(FileHash::preferred()), m_algorithm(m_rebuildAlgorithm) {
+}
+
+ManifestWriter::~ManifestWriter() {
+    if (!m_vmk.empty()) {
+        sodium_memzero(m_vmk.data(), m_vmk.size());
+    }
+}
+
+bool ManifestWriter::rebuild(std::string &err) {
     try {
-        if (vmk.empty()) {
+        if (m_vmk.empty()) {
             throw std::runtime_error("VMK is empty. Cannot sign manifest.");
         }
 
-        const fs::path rootPath = root;
-        fs::create_directories(rootPath);
-        const fs::path metaPath = rootPath / "vault.meta";
-        const fs::path storePath = rootPath / "vault_store";
+        m_algorithm = m_rebuildAlgorithm;
+        scanAll();
+        rebuildTree();
+        write();
+        m_loaded = true;
+        m_failed = false;
+
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Manifest updated successfully.");
+
+        return true;
+    } catch (const std::exception &e) {
+        err = e.what();
+        m_loaded = false;
+        m_failed = true;
+        EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Manifest updated failed: ") + e.what());
+
+        return false;
+    }
+}
+
+bool ManifestWriter::update(const Changes &changes, std::string &err) {
+    if (m_failed) {
+        // Changes handed to a failed update are lost: only a full pass is safe.
+        return rebuild(err);
+    }
+    if (!m_loaded && !load()) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "MANIFEST.json missing or not verifiable, rebuilding it.");
+        return rebuild(err);
+    }
+
+    try {
+        // Files added or removed shift leaf positions: rebuild the tree then.
+        bool reshaped = false;
+        for (const auto &rel : changes.replaced) {
+            reshaped |= hashFile(rel, false);
+        }
+        for (const auto &rel : changes.appended) {
+            if (!changes.replaced.contains(rel)) {
+                reshaped |= hashFile(rel, true);
+            }
+        }
+
+        if (reshaped) {
+            rebuildTree();
+        } else {
+            for (const auto *set : {&changes.replaced, &changes.appended}) {
+                for (const auto &rel : *set) {
+                    if (const auto it = m_files.find(rel); it != m_files.end()) {
+                        m_tree.set(it->second->index, MerkleTree::leafHash(rel, it->second->digest));
+                    }
+                }
+            }
+        }
+        write();
+
+        EncoraLogger::Logger::log(EncoraLogger::Level::Debug,
+            "Manifest updated (" + std::to_string(changes.appended.size() + changes.replaced.size()) + " file(s) changed).");
+
+        return true;
+    } catch (const std::exception &e) {
+        err = e.what();
+        m_loaded = false;
+        m_failed = true;
+        m_files.clear();
+        EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Manifest updated failed: ") + e.what());
+
+        return false;
+    }
+}
+
+bool ManifestWriter::load() {
+    m_files.clear();
+    try {
+        const fs::path rootPath = m_root;
         const fs::path manifestPath = rootPath / "MANIFEST.json";
         const fs::path hmacManifestPath = rootPath / "MANIFEST.hmac";
+        if (m_vmk.empty() || !fs::exists(manifestPath) || !fs::exists(hmacManifestPath)) {
+            return false;
+        }
 
-        if (!fs::exists(metaPath)) {
-            throw std::runtime_error("vault.meta not found.");
+        const auto manifestBytes = readAll(manifestPath);
+        const auto macBytes = readAll(hmacManifestPath);
+        const std::string manifestStr(manifestBytes.begin(), manifestBytes.end());
+        const auto j = json::parse(manifestStr);
+        const int version = j.value("version", 1);
+        if (version < 2) {
+            // v1: HMAC over the whole document. Rewritten as v3 on the next write.
+            const auto mac = hmacSha256(manifestStr, m_vmk);
+            if (macBytes.size() != mac.size() || sodium_memcmp(mac.data(), macBytes.data(), mac.size()) != 0) {
+                return false;
+            }
         }
 
-        json j;
-        j["version"] = 1;
-        j["files"] = json::array();
+        const auto algorithm = version >= 3 ? FileHash::parse(j.at("alg").get<std::string>()) : FileHash::Algorithm::Sha256;
+        if (!algorithm) {
+            return false;
+        }
+        m_algorithm = *algorithm;
 
-        auto appendWithHash = [&](const fs::path &rel) {
-            const auto abs = rootPath / rel;
-            if (!fs::exists(abs)) return;
+        const char *digestKey = version >= 3 ? "digest" : "sha256";
+        for (const auto &f : j.at("files")) {
+            auto state = std::make_unique<FileState>();
+            state->hex = f.at(digestKey).get<std::string>();
+            if (state->hex.size() != 2 * MerkleTree::HASH_SIZE
+                || sodium_hex2bin(state->digest.data(), state->digest.size(), state->hex.data(), state->hex.size(),
+                    nullptr, nullptr, nullptr) != 0) {
+                return false;
+            }
+            m_files[f.at("path").get<std::string>()] = std::move(state);
+        }
+        rebuildTree();
 
-            const auto bytes = readAll(abs);
+        if (version >= 2) {
+            // v2+: only the root is signed; the entries must hash up to it.
+            const auto mac = signRoot(m_tree.root(), m_tree.size(), m_algorithm, m_vmk, static_cast<unsigned char>(std::min(version, 255)));
+            if (macBytes.size() != mac.size() || sodium_memcmp(mac.data(), macBytes.data(), mac.size()) != 0) {
+                m_files.clear();
+                return false;
+            }
+        }
+    } catch (const std::exception &) {
+        m_files.clear();
+        return false;
+    }
 
-            json f = {
-                {"path", rel.generic_string()},
-                {"sha256", sha256Hex(bytes)}
-            };
-            j["files"].push_back(f);
-        };
+    m_loaded = true;
+    return true;
+}
 
-        appendWithHash("vault.meta");
-        appendWithHash(fs::path("vault_store") / "index.json");
+void ManifestWriter::scanAll() {
+    const fs::path rootPath = m_root;
+    const fs::path storePath = rootPath / "vault_store";
+    fs::create_directories(rootPath);
+    if (!fs::exists(rootPath / "vault.meta")) {
+        throw std::runtime_error("vault.meta not found.");
+    }
 
-        if (fs::exists(storePath)) {
-            for (auto &entry : fs::directory_iterator(storePath)) {
-                if (!entry.is_regular_file()) continue;
-                if (const auto name = entry.path().filename().string(); name.rfind("record_", 0) == 0 && entry.path().extension() == ".bin") {
-                    appendWithHash(fs::path("vault_store") / name);
-                }
+    m_files.clear();
+    // index.json / index.bin: legacy, until migrated. dictionaries.bin: once a dictionary is trained.
+    std::vector<std::string> listed = {"vault.meta", "vault_store/index.json", "vault_store/index.bin", "vault_store/index.log",
+        "vault_store/dictionaries.bin"};
+    if (fs::exists(storePath)) {
+        for (auto &entry : fs::directory_iterator(storePath)) {
+            if (!entry.is_regular_file()) continue;
+            // Segments hold all new records; record_*.bin are left from before segments.
+            if (const auto name = entry.path().filename().string();
+                SegmentStore::isSegmentFile(name) || (name.rfind("record_", 0) == 0 && entry.path().extension() == ".bin")) {
+                listed.push_back("vault_store/" + name);
             }
         }
+    }
 
-        // Write MANIFEST.json
-        {
-            std::ofstream ofs(manifestPath, std::ios::binary | std::ios::trunc);
-            if (!ofs.is_open()) {
-                throw std::runtime_error("Failed to write MANIFEST.json");
+    // Small files (legacy record_*.bin, mostly) are hashed side by side in one batch.
+    std::vector<std::string> small;
+    if (m_algorithm == FileHash::Algorithm::Sha256) {
+        std::erase_if(listed, [&](const std::string &rel) {
+            std::error_code ec;
+            const auto size = fs::file_size(rootPath / rel, ec);
+            if (ec || size > Sha256Batch::SMALL_MESSAGE_LIMIT) {
+                return false;
             }
-            ofs << j.dump(2);
+            small.push_back(rel);
+            return true;
+        });
+    }
+
+    std::vector<std::string> smallPaths;
+    smallPaths.reserve(small.size());
+    for (const auto &rel : small) {
+        smallPaths.push_back((rootPath / rel).string());
+    }
+    const auto digests = FileHash::sha256Files(smallPaths);
+    for (std::size_t i = 0; i < small.size(); ++i) {
+        if (!digests[i]) {
+            // Gone or unreadable since it was listed: take the regular path.
+            listed.push_back(small[i]);
+            continue;
         }
+        // No resumable state: an append to it rehashes the (small) file.
+        auto file = std::make_unique<FileState>();
+        file->digest = *digests[i];
+        file->hex = FileHash::toHex(file->digest);
+        m_files[small[i]] = std::move(file);
+    }
 
-        // Write MANIFEST.hmac = HMAC(MANIFEST.json, VMK)
-        const auto manifestBytes = readAll(manifestPath);
-        const std::string manifestStr(manifestBytes.begin(), manifestBytes.end());
-        const auto mac = hmacSha256(manifestStr, vmk);
-        writeAll(hmacManifestPath, mac);
+    for (const auto &rel : listed) {
+        hashFile(rel, false);
+    }
+}
 
-        EncoraLogger::Logger::log(EncoraLogger::Level::Info, "Manifest updated successfully.");
+bool ManifestWriter::hashFile(const std::string &rel, const bool appended) {
+    const auto abs = fs::path(m_root) / rel;
+    if (!fs::exists(abs)) {
+        return m_files.erase(rel) > 0;
+    }
 
-        return true;
-    } catch (const std::exception &e) {
-        err = e.what();
-        EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("Manifest updated failed: ") + e.what());
+    auto &file = m_files[rel];
+    const bool added = !file;
+    if (added) {
+        file = std::make_unique<FileState>();
+    }
 
-        return false;
+    // Continue from the previous hash only if the file can still be its extension.
+    if (!appended || !file->resumable || file->hasher.algorithm() != m_algorithm || fs::file_size(abs) < file->hashed) {
+        file->hasher = FileHash::Hasher(m_algorithm);
+        file->hashed = 0;
     }
+
+    file->resumable = false;
+    file->hashed += FileHash::read(abs.string(), file->hashed, [&](const unsigned char *data, const std::size_t length) {
+        file->hasher.update(data, length);
+    });
+    file->resumable = true;
+
+    // final() works on a copy, so later appends can resume from 'hasher'.
+    file->digest = file->hasher.final();
+    file->hex = FileHash::toHex(file->digest);
+
+    return added;
+}
+
+void ManifestWriter::rebuildTree() {
+    std::vector<MerkleTree::Hash> leaves;
+    leaves.reserve(m_files.size());
+    for (auto &[rel, file] : m_files) {
+        file->index = leaves.size();
+        leaves.push_back(MerkleTree::leafHash(rel, file->digest));
+    }
+    m_tree.assign(std::move(leaves));
+}
+
+void ManifestWriter::write() const {
+    const fs::path rootPath = m_root;
+
+    const auto root = m_tree.root();
+
+    json j;
+    j["version"] = VERSION;
+    j["alg"] = std::string(FileHash::name(m_algorithm));
+    j["root"] = FileHash::toHex(root);
+    j["files"] = json::array();
+    for (const auto &[rel, file] : m_files) {
+        j["files"].push_back({{"path", rel}, {"digest", file->hex}});
+    }
+
+    const auto manifestStr = j.dump();
+    writeAll(rootPath / "MANIFEST.json", std::vector<unsigned char>(manifestStr.begin(), manifestStr.end()));
+    writeAll(rootPath / "MANIFEST.hmac", signRoot(root, m_tree.size(), m_algorithm, m_vmk));
 }
@@ -1,24 +1,109 @@
 #ifndef CORE_SECURITY_MANIFEST_WRITER_H
 #define CORE_SECURITY_MANIFEST_WRITER_H
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
+#include "MerkleTree.h"
+#include "utils/FileHash.h"
+
 /**
  * ManifestWriter regenerates MANIFEST.json and MANIFEST.hmac in the live vault root (e.g., "data/").
- * MANIFEST.json lists SHA-256 hashes for:
+ * MANIFEST.json lists file digests (SHA-256 or BLAKE2b-256, see "alg") for:
  *      - vault.meta
- *      - vault_store/index.json (if exists)
- *      - vault_store/record_*.bin (each record)
- * MANIFEST.hmac = HMAC-SHA256 (MANIFEST.json, key = VMK)
+ *      - vault_store/index.log (and legacy index.bin / index.json, if exist)
+ *      - vault_store/segment_*.dat (packed records)
+ *      - vault_store/record_*.bin (legacy per-record files, if exist)
+ * Format v3: the entries, sorted by path, are the leaves of a MerkleTree. MANIFEST.json
+ * carries the file digest algorithm, the entries and the root; only the root is signed:
+ *      {"alg":"blake2b-256","files":[{"digest":hex,"path":...}],"root":hex,"version":3}
+ *      MANIFEST.hmac = HMAC-SHA256 ("ENCMRKL" || 0x03 || alg id || u64 leaf count || root, key = VMK)
+ * so a single file can be checked against the signed root with an inclusion proof
+ * (see IntegrityChecker::verifyFile). A rebuilt manifest uses the faster algorithm for
+ * the host (FileHash::preferred); incremental updates keep the algorithm of the manifest
+ * on disk. v2 manifests
+ * (SHA-256, "sha256" entries, no alg id in the HMAC) and v1 manifests (HMAC over the
+ * whole MANIFEST.json) are still read and are rewritten as v3 on the next update.
+ *
+ * The static update() rebuilds everything from disk. A ManifestWriter instance keeps
+ * the manifest in memory and patches it: update(changes) rehashes only the files that
+ * changed plus their tree paths (O(log n) node hashes; adding or dropping a file
+ * rebuilds the tree from the in-memory leaves). Files that only grew by appends
+ * (segments, index.log) have just their new bytes hashed, resuming from the hash
+ * state of the previous update. The root is signed before the manifest is written,
+ * never by reading it back.
  *
  * Call this after any mutation (add/remove) to keep integrity up-to-date.
  */
 class ManifestWriter {
 public:
+    static constexpr unsigned char VERSION = 3;
+
+    // Files changed since the last update, relative to the root (e.g. "vault_store/index.log").
+    struct Changes {
+        // Only grown by appends.
+        std::set<std::string> appended;
+        // Created, rewritten or deleted.
+        std::set<std::string> replaced;
+
+        [[nodiscard]]
+        bool empty() const { return appended.empty() && replaced.empty(); }
+        void clear() {
+            appended.clear();
+            replaced.clear();
+        }
+    };
+
     // Recalculate and write MANIFEST.{json, hmac} under root using VMK.
     // Returns true on success; on failure returns false and fills err.
     static bool update(const std::string &root, const std::vector<unsigned char> &vmk, std::string &err);
+    // MANIFEST.hmac content for a tree with 'leafCount' leaves and 'root'. 'version' 2
+    // predates "alg" (always SHA-256) and leaves it out.
+    static std::vector<unsigned char> signRoot(const MerkleTree::Hash &root, std::size_t leafCount, FileHash::Algorithm algorithm,
+        const std::vector<unsigned char> &vmk, unsigned char version = VERSION);
+
+    ManifestWriter(std::string root, const std::vector<unsigned char> &vmk);
+    ~ManifestWriter();
+
+    ManifestWriter(const ManifestWriter &) = delete;
+    ManifestWriter &operator=(const ManifestWriter &) = delete;
+
+    // Patch the manifest with 'changes' and re-sign it. The first call loads the signed
+    // manifest from disk (or rebuilds it if it is missing or does not verify).
+    bool update(const Changes &changes, std::string &err);
+    // Rehash every file and re-sign.
+    bool rebuild(std::string &err);
+    // Digest algorithm of rebuild() (default: FileHash::preferred()).
+    void setAlgorithm(FileHash::Algorithm algorithm) { m_rebuildAlgorithm = algorithm; }
+
+private:
+    struct FileState;
+
+    std::string m_root;
+    std::vector<unsigned char> m_vmk;
+    FileHash::Algorithm m_rebuildAlgorithm;
+    // Algorithm of m_files: the loaded manifest's, or m_rebuildAlgorithm after a rebuild.
+    FileHash::Algorithm m_algorithm;
+    // Manifest entries by relative path (sorted, so output is stable).
+    std::map<std::string, std::unique_ptr<FileState>> m_files;
+    MerkleTree m_tree;
+    bool m_loaded = false;
+    // The last write failed: the next update rehashes everything.
+    bool m_failed = false;
+
+    // Read and verify the manifest on disk. Returns false if it cannot be trusted.
+    bool load();
+    void scanAll();
+    // Hash 'rel' from scratch, or only its new tail when 'appended' and resumable.
+    // Returns true if the entry was added or removed.
+    bool hashFile(const std::string &rel, bool appended);
+    // Rebuild m_tree from m_files and renumber leaves.
+    void rebuildTree();
+    void write() const;
 };
 
 #endif //CORE_SECURITY_MANIFEST_WRITER_H
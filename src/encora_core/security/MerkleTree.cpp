@@ -0,0 +1,124 @@
+#include <sodium.h>
+#include <stdexcept>
+
+#include "MerkleTree.h"
+
+static constexpr unsigned char LEAF_DOMAIN = 0x00;
+static constexpr unsigned char NODE_DOMAIN = 0x01;
+static constexpr unsigned char EMPTY_DOMAIN = 0x02;
+
+MerkleTree::Hash MerkleTree::leafHash(const std::string_view path, const Hash &fileDigest) {
+    constexpr unsigned char separator = 0x00;
+    crypto_hash_sha256_state state;
+    crypto_hash_sha256_init(&state);
+    crypto_hash_sha256_update(&state, &LEAF_DOMAIN, 1);
+    crypto_hash_sha256_update(&state, reinterpret_cast<const unsigned char *>(path.data()), path.size());
+    crypto_hash_sha256_update(&state, &separator, 1);
+    crypto_hash_sha256_update(&state, fileDigest.data(), fileDigest.size());
+
+    Hash out {};
+    crypto_hash_sha256_final(&state, out.data());
+    return out;
+}
+
+MerkleTree::Hash MerkleTree::nodeHash(const Hash &left, const Hash &right) {
+    crypto_hash_sha256_state state;
+    crypto_hash_sha256_init(&state);
+    crypto_hash_sha256_update(&state, &NODE_DOMAIN, 1);
+    crypto_hash_sha256_update(&state, left.data(), left.size());
+    crypto_hash_sha256_update(&state, right.data(), right.size());
+
+    Hash out {};
+    crypto_hash_sha256_final(&state, out.data());
+    return out;
+}
+
+bool MerkleTree::verify(const Hash &leaf, const Proof &proof, const Hash &root) {
+    if (proof.index >= proof.leafCount) {
+        return false;
+    }
+
+    Hash current = leaf;
+    std::size_t index = proof.index;
+    std::size_t count = proof.leafCount;
+    std::size_t used = 0;
+    while (count > 1) {
+        const bool promoted = index % 2 == 0 && index + 1 == count;
+        if (!promoted) {
+            if (used == proof.siblings.size()) {
+                return false;
+            }
+            const auto &sibling = proof.siblings[used++];
+            current = index % 2 == 0 ? nodeHash(current, sibling) : nodeHash(sibling, current);
+        }
+        index /= 2;
+        count = (count + 1) / 2;
+    }
+
+    return used == proof.siblings.size() && sodium_memcmp(current.data(), root.data(), HASH_SIZE) == 0;
+}
+
+MerkleTree::MerkleTree(std::vector<Hash> leaves) {
+    assign(std::move(leaves));
+}
+
+void MerkleTree::assign(std::vector<Hash> leaves) {
+    m_levels.clear();
+    if (leaves.empty()) {
+        return;
+    }
+
+    m_levels.push_back(std::move(leaves));
+    while (m_levels.back().size() > 1) {
+        const auto &below = m_levels.back();
+        std::vector<Hash> level;
+        level.reserve((below.size() + 1) / 2);
+        for (std::size_t i = 0; i < below.size(); i += 2) {
+            level.push_back(i + 1 < below.size() ? nodeHash(below[i], below[i + 1]) : below[i]);
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+void MerkleTree::set(std::size_t index, const Hash &leaf) {
+    if (index >= size()) {
+        throw std::out_of_range("MerkleTree: leaf index out of range.");
+    }
+
+    m_levels[0][index] = leaf;
+    for (std::size_t level = 1; level < m_levels.size(); ++level) {
+        const auto &below = m_levels[level - 1];
+        const std::size_t left = index & ~static_cast<std::size_t>(1);
+        index /= 2;
+        m_levels[level][index] = left + 1 < below.size() ? nodeHash(below[left], below[left + 1]) : below[left];
+    }
+}
+
+MerkleTree::Hash MerkleTree::root() const {
+    if (m_levels.empty()) {
+        Hash out {};
+        crypto_hash_sha256(out.data(), &EMPTY_DOMAIN, 1);
+        return out;
+    }
+
+    return m_levels.back().front();
+}
+
+MerkleTree::Proof MerkleTree::proof(std::size_t index) const {
+    if (index >= size()) {
+        throw std::out_of_range("MerkleTree: leaf index out of range.");
+    }
+
+    Proof proof;
+    proof.index = index;
+    proof.leafCount = size();
+    for (std::size_t level = 0; level + 1 < m_levels.size(); ++level) {
+        const std::size_t sibling = index ^ 1;
+        if (sibling < m_levels[level].size()) {
+            proof.siblings.push_back(m_levels[level][sibling]);
+        }
+        index /= 2;
+    }
+
+    return proof;
+}
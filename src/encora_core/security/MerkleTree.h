@@ -0,0 +1,64 @@
+#ifndef CORE_SECURITY_MERKLE_TREE_H
+#define CORE_SECURITY_MERKLE_TREE_H
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * MerkleTree
+ *
+ * Binary SHA-256 hash tree over the manifest entries (manifest v2).
+ *      leaf = SHA-256(0x00 || path || 0x00 || file digest)
+ *      node = SHA-256(0x01 || left || right)
+ * The domain bytes keep a leaf from ever being read as a node. A level with an odd
+ * number of nodes promotes its last node unchanged to the level above.
+ *
+ * All levels are kept in memory: replacing a leaf rehashes its path to the root
+ * (O(log n)); adding or removing leaves rebuilds the tree (O(n) node hashes, no file I/O).
+ *
+ * An inclusion proof is the list of siblings from a leaf up to the root; together
+ * with the leaf position and the leaf count it recomputes the root.
+ */
+class MerkleTree {
+public:
+    static constexpr std::size_t HASH_SIZE = 32;
+    using Hash = std::array<unsigned char, HASH_SIZE>;
+
+    struct Proof {
+        std::size_t index = 0;
+        std::size_t leafCount = 0;
+        // Bottom-up; levels where the node was promoted have no entry.
+        std::vector<Hash> siblings;
+    };
+
+    static Hash leafHash(std::string_view path, const Hash &fileDigest);
+    static Hash nodeHash(const Hash &left, const Hash &right);
+    // True if 'leaf' at the position in 'proof' hashes up to 'root'.
+    [[nodiscard]]
+    static bool verify(const Hash &leaf, const Proof &proof, const Hash &root);
+
+    MerkleTree() = default;
+    explicit MerkleTree(std::vector<Hash> leaves);
+
+    // Rebuild from scratch.
+    void assign(std::vector<Hash> leaves);
+    // Replace leaf 'index' and rehash its path to the root.
+    void set(std::size_t index, const Hash &leaf);
+
+    [[nodiscard]]
+    std::size_t size() const { return m_levels.empty() ? 0 : m_levels.front().size(); }
+    // Root hash; an empty tree has SHA-256(0x02) as root.
+    [[nodiscard]]
+    Hash root() const;
+    [[nodiscard]]
+    Proof proof(std::size_t index) const;
+
+private:
+    // m_levels[0] = leaves, m_levels.back() = { root }
+    std::vector<std::vector<Hash>> m_levels;
+};
+
+#endif //CORE_SECURITY_MERKLE_TREE_H
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sodium.h>
+
+#ifndef ENCORA_PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
+
+#include "StatCache.h"
+
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+static bool fromHex(const std::string &hex, unsigned char *out, const std::size_t size) {
+    return hex.size() == 2 * size && sodium_hex2bin(out, size, hex.data(), hex.size(), nullptr, nullptr, nullptr) == 0;
+}
+
+std::optional<StatCache::FileStat> StatCache::stat(const std::string &path) {
+#ifdef ENCORA_PLATFORM_WINDOWS
+    std::error_code ec;
+    FileStat out;
+    out.size = fs::file_size(path, ec);
+    if (ec) return std::nullopt;
+    out.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(fs::last_write_time(path, ec).time_since_epoch()).count();
+    if (ec) return std::nullopt;
+    return out;
+#else
+    struct ::stat st {};
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return std::nullopt;
+    }
+
+    FileStat out;
+    out.size = static_cast<std::uint64_t>(st.st_size);
+    out.inode = static_cast<std::uint64_t>(st.st_ino);
+#ifdef __APPLE__
+    out.mtimeNs = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1'000'000'000 + st.st_mtimespec.tv_nsec;
+    out.ctimeNs = static_cast<std::int64_t>(st.st_ctimespec.tv_sec) * 1'000'000'000 + st.st_ctimespec.tv_nsec;
+#else
+    out.mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+    out.ctimeNs = static_cast<std::int64_t>(st.st_ctim.tv_sec) * 1'000'000'000 + st.st_ctim.tv_nsec;
+#endif
+    return out;
+#endif
+}
+
+StatCache::StatCache(std::string root, const std::vector<unsigned char> &vmk, const FileHash::Algorithm algorithm)
+    : m_root(std::move(root)), m_vmk(vmk), m_algorithm(algorithm) {
+    load();
+}
+
+StatCache::~StatCache() {
+    if (!m_vmk.empty()) {
+        sodium_memzero(m_vmk.data(), m_vmk.size());
+    }
+}
+
+std::optional<MerkleTree::Hash> StatCache::lookup(const std::string &path, const FileStat &current) const {
+    std::lock_guard lock(m_mutex);
+    const auto it = m_entries.find(path);
+    if (it == m_entries.end() || it->second.stat != current || current.mtimeNs >= m_racyFrom) {
+        return std::nullopt;
+    }
+
+    return it->second.digest;
+}
+
+void StatCache::store(const std::string &path, const FileStat &current, const MerkleTree::Hash &digest) {
+    std::lock_guard lock(m_mutex);
+    m_entries[path] = Entry {current, digest};
+    m_dirty = true;
+}
+
+void StatCache::retain(const std::vector<std::string> &keep) {
+    std::lock_guard lock(m_mutex);
+    std::erase_if(m_entries, [&](const auto &entry) {
+        if (std::binary_search(keep.begin(), keep.end(), entry.first)) {
+            return false;
+        }
+        m_dirty = true;
+        return true;
+    });
+}
+
+void StatCache::save() {
+    std::lock_guard lock(m_mutex);
+    if (!m_dirty || m_vmk.empty()) {
+        return;
+    }
+
+    const fs::path target = fs::path(m_root) / FILE_NAME;
+    const fs::path temp = fs::path(m_root) / (std::string(FILE_NAME) + ".tmp");
+    try {
+        json files = json::array();
+        for (const auto &[path, entry] : m_entries) {
+            files.push_back({
+                {"path", path},
+                {"size", entry.stat.size},
+                {"mtime_ns", entry.stat.mtimeNs},
+                {"ctime_ns", entry.stat.ctimeNs},
+                {"inode", entry.stat.inode},
+                {"digest", FileHash::toHex(entry.digest)},
+            });
+        }
+
+        const auto filesStr = files.dump();
+        const auto mac = sign(filesStr);
+        std::string macHex(2 * mac.size() + 1, '\0');
+        sodium_bin2hex(macHex.data(), macHex.size(), mac.data(), mac.size());
+        macHex.pop_back();
+
+        json j;
+        j["version"] = VERSION;
+        j["alg"] = std::string(FileHash::name(m_algorithm));
+        j["files"] = std::move(files);
+        j["mac"] = macHex;
+
+        {
+            std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+            ofs << j.dump();
+            if (!ofs.good()) {
+                throw std::runtime_error("cannot write " + temp.string());
+            }
+        }
+        fs::rename(temp, target);
+        m_dirty = false;
+    } catch (const std::exception &e) {
+        std::error_code ec;
+        fs::remove(temp, ec);
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("StatCache: not saved: ") + e.what());
+    }
+}
+
+void StatCache::load() {
+    const fs::path path = fs::path(m_root) / FILE_NAME;
+    const auto cacheStat = stat(path.string());
+    if (!cacheStat || m_vmk.empty()) {
+        return;
+    }
+
+    std::ifstream ifs(path, std::ios::binary);
+    const auto j = json::parse(ifs, nullptr, false);
+    if (!j.is_object() || j.value("version", 0) != VERSION || !j.contains("files") || !j["files"].is_array()
+        || !j.contains("mac") || !j["mac"].is_string()) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "StatCache: ignoring malformed " + path.string());
+        return;
+    }
+    if (j.value("alg", std::string {}) != FileHash::name(m_algorithm)) {
+        // Written for a manifest of another algorithm; rebuilt as files are hashed.
+        return;
+    }
+
+    std::vector<unsigned char> mac(crypto_auth_hmacsha256_BYTES);
+    const auto expected = sign(j["files"].dump());
+    if (!fromHex(j["mac"].get<std::string>(), mac.data(), mac.size())
+        || sodium_memcmp(mac.data(), expected.data(), mac.size()) != 0) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "StatCache: MAC mismatch, ignoring " + path.string());
+        return;
+    }
+
+    try {
+        for (const auto &f : j["files"]) {
+            Entry entry;
+            entry.stat.size = f.at("size").get<std::uint64_t>();
+            entry.stat.mtimeNs = f.at("mtime_ns").get<std::int64_t>();
+            entry.stat.ctimeNs = f.at("ctime_ns").get<std::int64_t>();
+            entry.stat.inode = f.at("inode").get<std::uint64_t>();
+            if (!fromHex(f.at("digest").get<std::string>(), entry.digest.data(), entry.digest.size())) {
+                throw std::runtime_error("bad digest");
+            }
+            m_entries.emplace(f.at("path").get<std::string>(), entry);
+        }
+    } catch (const std::exception &e) {
+        m_entries.clear();
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "StatCache: ignoring " + path.string() + ": " + e.what());
+        return;
+    }
+
+    m_racyFrom = cacheStat->mtimeNs;
+}
+
+std::vector<unsigned char> StatCache::sign(const std::string &files) const {
+    const unsigned char domain[] = {'E', 'N', 'C', 'S', 'T', 'A', 'T', VERSION, static_cast<unsigned char>(m_algorithm)};
+    std::vector<unsigned char> mac(crypto_auth_hmacsha256_BYTES);
+    crypto_auth_hmacsha256_state state;
+    crypto_auth_hmacsha256_init(&state, m_vmk.data(), m_vmk.size());
+    crypto_auth_hmacsha256_update(&state, domain, sizeof(domain));
+    crypto_auth_hmacsha256_update(&state, reinterpret_cast<const unsigned char *>(files.data()), files.size());
+    crypto_auth_hmacsha256_final(&state, mac.data());
+
+    return mac;
+}
@@ -0,0 +1,89 @@
+#ifndef CORE_SECURITY_STAT_CACHE_H
+#define CORE_SECURITY_STAT_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MerkleTree.h"
+#include "utils/FileHash.h"
+
+/**
+ * StatCache
+ *
+ * Remembers, per manifest path, the digest a file hashed to together with its stat
+ * tuple (size, mtime, ctime, inode), the way git's index does. While the tuple is
+ * unchanged IntegrityChecker takes the cached digest instead of reading the file, so
+ * verifying an unchanged vault is a metadata scan.
+ *
+ * Stored next to the manifest as MANIFEST.cache:
+ *      {"alg":"sha256","files":[{path,size,mtime_ns,ctime_ns,inode,digest}],"mac":hex,"version":2}
+ *      mac = HMAC-SHA256 ("ENCSTAT" || 0x02 || alg id || files as JSON, key = VMK)
+ * A cache that is missing, malformed, does not authenticate or holds digests of another
+ * algorithm than the manifest's is ignored and rebuilt.
+ *
+ * An entry whose mtime is not older than the cache file itself is "racily clean": the
+ * file may have changed again within the timestamp granularity after it was hashed,
+ * so it is hashed again (and the cache rewritten) rather than trusted.
+ *
+ * The cache only trusts the filesystem's metadata; VerifyOptions::paranoid bypasses it.
+ */
+class StatCache {
+public:
+    static constexpr const char *FILE_NAME = "MANIFEST.cache";
+    static constexpr unsigned char VERSION = 2;
+
+    struct FileStat {
+        std::uint64_t size = 0;
+        std::int64_t mtimeNs = 0;
+        std::int64_t ctimeNs = 0;   // 0 where the platform has none
+        std::uint64_t inode = 0;    // 0 where the platform has none
+
+        bool operator==(const FileStat &) const = default;
+    };
+
+    // Stat tuple of 'path', or std::nullopt if it cannot be read.
+    static std::optional<FileStat> stat(const std::string &path);
+
+    // Load 'root'/MANIFEST.cache (empty if there is no trustworthy one for 'algorithm').
+    StatCache(std::string root, const std::vector<unsigned char> &vmk, FileHash::Algorithm algorithm);
+    ~StatCache();
+
+    StatCache(const StatCache &) = delete;
+    StatCache &operator=(const StatCache &) = delete;
+
+    // Cached digest of 'path' (relative to the root) if 'current' still matches. Thread-safe.
+    [[nodiscard]]
+    std::optional<MerkleTree::Hash> lookup(const std::string &path, const FileStat &current) const;
+    // Record a freshly computed digest. Thread-safe.
+    void store(const std::string &path, const FileStat &current, const MerkleTree::Hash &digest);
+    // Drop entries for paths not in 'keep' (sorted).
+    void retain(const std::vector<std::string> &keep);
+
+    // Write the cache if it changed. Failures are logged, never thrown: the cache is an optimization.
+    void save();
+
+private:
+    struct Entry {
+        FileStat stat;
+        MerkleTree::Hash digest {};
+    };
+
+    std::string m_root;
+    std::vector<unsigned char> m_vmk;
+    FileHash::Algorithm m_algorithm;
+    mutable std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    // mtime of the cache file when loaded; entries modified at or after it are not trusted.
+    std::int64_t m_racyFrom = 0;
+    bool m_dirty = false;
+
+    void load();
+    [[nodiscard]]
+    std::vector<unsigned char> sign(const std::string &files) const;
+};
+
+#endif //CORE_SECURITY_STAT_CACHE_H
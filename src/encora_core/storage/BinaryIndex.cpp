@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "BinaryIndex.h"
+#include "StorageError.h"
+
+namespace fs = std::filesystem;
+
+static_assert(std::endian::native == std::endian::little, "index.bin is stored little-endian");
+
+namespace {
+    constexpr char MAGIC[8] = {'E', 'N', 'C', 'I', 'D', 'X', '\0', '\0'};
+
+    struct DiskHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t entrySize;
+        std::uint32_t reserved;
+        std::uint64_t entriesOffset;
+        std::uint64_t stringsOffset;
+        std::uint64_t stringsSize;
+        unsigned char padding[16];
+    };
+
+    struct DiskEntry {
+        std::uint32_t nameOffset;
+        std::uint32_t nameLength;
+        std::uint32_t idOffset;
+        std::uint32_t idLength;
+        std::uint32_t typeOffset;
+        std::uint32_t typeLength;
+        unsigned char salt[StorageIndex::SALT_SIZE];
+        std::int64_t createdAt;
+        // v2
+        std::uint32_t segment;
+        std::uint32_t length;
+        std::uint64_t offset;
+    };
+
+    constexpr std::size_t ENTRY_SIZE_V1 = 64;
+
+    static_assert(sizeof(DiskHeader) == 64);
+    static_assert(sizeof(DiskEntry) == 80);
+}
+
+std::vector<unsigned char> BinaryIndex::serialize(const StorageIndex &index) {
+    std::vector<const StorageIndex::Entry *> sorted;
+    sorted.reserve(index.size());
+    for (const auto &entry : index.entries()) {
+        sorted.push_back(&entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->name < b->name; });
+
+    // String table: sorted names first, then ids and types.
+    std::string strings;
+    auto appendString = [&strings](std::string_view str, std::uint32_t &offset, std::uint32_t &length) {
+        if (strings.size() + str.size() > UINT32_MAX) {
+            throw StorageError("BinaryIndex: string table exceeds 4 GiB.");
+        }
+        offset = static_cast<std::uint32_t>(strings.size());
+        length = static_cast<std::uint32_t>(str.size());
+        strings.append(str);
+    };
+
+    std::vector<DiskEntry> entries(sorted.size());
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        appendString(sorted[i]->name, entries[i].nameOffset, entries[i].nameLength);
+    }
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        appendString(sorted[i]->id, entries[i].idOffset, entries[i].idLength);
+        appendString(sorted[i]->type, entries[i].typeOffset, entries[i].typeLength);
+        std::memcpy(entries[i].salt, sorted[i]->salt.data(), StorageIndex::SALT_SIZE);
+        entries[i].createdAt = sorted[i]->createdAt;
+        entries[i].segment = sorted[i]->location.segment;
+        entries[i].length = sorted[i]->location.length;
+        entries[i].offset = sorted[i]->location.offset;
+    }
+
+    DiskHeader header {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.entryCount = static_cast<std::uint32_t>(entries.size());
+    header.entrySize = sizeof(DiskEntry);
+    header.entriesOffset = sizeof(DiskHeader);
+    header.stringsOffset = header.entriesOffset + entries.size() * sizeof(DiskEntry);
+    header.stringsSize = strings.size();
+
+    std::vector<unsigned char> image(header.stringsOffset + strings.size());
+    std::memcpy(image.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(image.data() + header.entriesOffset, entries.data(), entries.size() * sizeof(DiskEntry));
+    }
+    if (!strings.empty()) {
+        std::memcpy(image.data() + header.stringsOffset, strings.data(), strings.size());
+    }
+
+    return image;
+}
+
+void BinaryIndex::write(const std::string &path, const StorageIndex &index) {
+    const auto image = serialize(index);
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            throw StorageError("BinaryIndex: cannot write: " + tmpPath);
+        }
+        ofs.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+        if (!ofs.good()) {
+            throw StorageError("BinaryIndex: write failed: " + tmpPath);
+        }
+    }
+
+    fs::rename(tmpPath, path);
+}
+
+bool BinaryIndex::open(const std::string &path) {
+    close();
+    if (!m_file.open(path)) {
+        return false;
+    }
+
+    attach({m_file.data(), m_file.size()});
+    return true;
+}
+
+void BinaryIndex::attach(const std::span<const unsigned char> image) {
+    if (image.size() < sizeof(DiskHeader)) {
+        throw StorageError("BinaryIndex: image too small.");
+    }
+
+    DiskHeader header {};
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw StorageError("BinaryIndex: bad magic.");
+    }
+    if (header.version == 0 || header.version > VERSION) {
+        throw StorageError("BinaryIndex: unsupported version " + std::to_string(header.version) + ".");
+    }
+    const std::size_t expectedEntrySize = header.version == 1 ? ENTRY_SIZE_V1 : sizeof(DiskEntry);
+    if (header.entrySize != expectedEntrySize) {
+        throw StorageError("BinaryIndex: unexpected entry size.");
+    }
+
+    const std::uint64_t entriesBytes = std::uint64_t{header.entryCount} * header.entrySize;
+    if (header.entriesOffset > image.size() || entriesBytes > image.size() - header.entriesOffset
+        || header.stringsOffset > image.size() || header.stringsSize > image.size() - header.stringsOffset) {
+        throw StorageError("BinaryIndex: truncated image.");
+    }
+
+    m_image = image;
+    m_entries = image.subspan(header.entriesOffset, entriesBytes);
+    m_strings = image.subspan(header.stringsOffset, header.stringsSize);
+    m_count = header.entryCount;
+    m_entrySize = header.entrySize;
+    m_isOpen = true;
+}
+
+void BinaryIndex::close() {
+    m_file.close();
+    m_image = {};
+    m_entries = {};
+    m_strings = {};
+    m_count = 0;
+    m_entrySize = 0;
+    m_isOpen = false;
+}
+
+std::string_view BinaryIndex::stringAt(const std::uint32_t offset, const std::uint32_t length) const {
+    if (offset > m_strings.size() || length > m_strings.size() - offset) {
+        throw StorageError("BinaryIndex: string reference out of bounds.");
+    }
+
+    return {reinterpret_cast<const char *>(m_strings.data()) + offset, length};
+}
+
+std::string_view BinaryIndex::nameAt(const std::size_t pos) const {
+    std::uint32_t ref[2];
+    std::memcpy(ref, m_entries.data() + pos * m_entrySize + offsetof(DiskEntry, nameOffset), sizeof(ref));
+
+    return stringAt(ref[0], ref[1]);
+}
+
+BinaryIndex::EntryView BinaryIndex::at(const std::size_t pos) const {
+    if (pos >= m_count) {
+        throw StorageError("BinaryIndex: entry position out of range.");
+    }
+
+    // v1 entries are a prefix of v2 entries; missing fields stay zero.
+    const unsigned char *raw = m_entries.data() + pos * m_entrySize;
+    DiskEntry entry {};
+    std::memcpy(&entry, raw, m_entrySize);
+
+    return {
+        stringAt(entry.nameOffset, entry.nameLength),
+        stringAt(entry.idOffset, entry.idLength),
+        stringAt(entry.typeOffset, entry.typeLength),
+        std::span<const unsigned char, StorageIndex::SALT_SIZE>(raw + offsetof(DiskEntry, salt), StorageIndex::SALT_SIZE),
+        entry.createdAt,
+        {entry.segment, entry.length, entry.offset}
+    };
+}
+
+std::size_t BinaryIndex::lowerBound(const std::string_view name) const {
+    std::size_t lo = 0;
+    std::size_t hi = m_count;
+    while (lo < hi) {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        if (nameAt(mid) < name) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+std::optional<BinaryIndex::EntryView> BinaryIndex::find(const std::string_view name) const {
+    const auto pos = lowerBound(name);
+    if (pos == m_count || nameAt(pos) != name) {
+        return std::nullopt;
+    }
+
+    return at(pos);
+}
+
+void BinaryIndex::load(StorageIndex &out) const {
+    out.clear();
+    for (std::size_t pos = 0; pos < m_count; ++pos) {
+        const auto entry = at(pos);
+        StorageIndex::Salt salt;
+        std::copy(entry.salt.begin(), entry.salt.end(), salt.begin());
+        out.upsert(entry.name, entry.id, entry.type, salt, entry.createdAt, entry.location);
+    }
+}
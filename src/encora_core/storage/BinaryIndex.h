@@ -0,0 +1,100 @@
+#ifndef CORE_STORAGE_BINARY_INDEX_H
+#define CORE_STORAGE_BINARY_INDEX_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StorageIndex.h"
+#include "platform/MappedFile.h"
+
+/**
+ * BinaryIndex (index.bin, format v2)
+ *
+ * Compact, mmap-able on-disk form of StorageIndex. All integers are little-endian.
+ *
+ *  [Header: 64 bytes]
+ *      magic "ENCIDX\0\0", version, entry count, entry size,
+ *      offsets/sizes of the entry table and the string table
+ *  [Entry table: count * 80 bytes, sorted by name (bytewise)]
+ *      name/id/type as (offset, length) into the string table, salt[32], created_at,
+ *      record location (segment, length, offset)
+ *  [String table]
+ *      all names first, in the same sorted order (the sorted name table),
+ *      then ids and types
+ *
+ * Lookup is a binary search over the entry table; a prefix scan is a
+ * lower_bound followed by a forward walk. Neither parses nor allocates.
+ *
+ * The view can sit on a mapped file (open) or on any caller-owned buffer (attach).
+ * v1 images (64-byte entries, no location) are still readable.
+ */
+class BinaryIndex {
+public:
+    static constexpr std::uint32_t VERSION = 2;
+
+    struct EntryView {
+        std::string_view name;
+        std::string_view id;
+        std::string_view type;
+        std::span<const unsigned char, StorageIndex::SALT_SIZE> salt;
+        std::int64_t createdAt = 0;
+        RecordLocation location;
+    };
+
+    // Serialize 'index' into the binary format.
+    static std::vector<unsigned char> serialize(const StorageIndex &index);
+    // Serialize and atomically replace 'path' (write temp file + rename).
+    static void write(const std::string &path, const StorageIndex &index);
+
+    // Map 'path' and validate header. Returns false if the file does not exist.
+    // Throws StorageError if the file exists but is not a valid index.
+    bool open(const std::string &path);
+    // Use an in-memory image. The buffer must outlive this view.
+    void attach(std::span<const unsigned char> image);
+    void close();
+
+    [[nodiscard]]
+    bool isOpen() const { return m_isOpen; }
+    [[nodiscard]]
+    std::size_t size() const { return m_count; }
+    [[nodiscard]]
+    EntryView at(std::size_t pos) const;
+    [[nodiscard]]
+    std::optional<EntryView> find(std::string_view name) const;
+    // Position of the first entry whose name is not less than 'name'.
+    [[nodiscard]]
+    std::size_t lowerBound(std::string_view name) const;
+
+    // Call fn(EntryView) for every entry whose name starts with 'prefix', in name order.
+    template<typename Fn>
+    void forEachWithPrefix(std::string_view prefix, Fn &&fn) const {
+        for (std::size_t pos = lowerBound(prefix); pos < m_count; ++pos) {
+            const auto entry = at(pos);
+            if (entry.name.substr(0, prefix.size()) != prefix) break;
+            fn(entry);
+        }
+    }
+
+    // Copy all entries into 'out' (replaces its content).
+    void load(StorageIndex &out) const;
+
+private:
+    MappedFile m_file;
+    std::span<const unsigned char> m_image;
+    std::span<const unsigned char> m_entries;
+    std::span<const unsigned char> m_strings;
+    std::size_t m_count = 0;
+    std::size_t m_entrySize = 0;
+    bool m_isOpen = false;
+
+    [[nodiscard]]
+    std::string_view stringAt(std::uint32_t offset, std::uint32_t length) const;
+    [[nodiscard]]
+    std::string_view nameAt(std::size_t pos) const;
+};
+
+#endif //CORE_STORAGE_BINARY_INDEX_H
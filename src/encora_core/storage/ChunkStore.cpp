@@ -0,0 +1,225 @@
+#include <sodium.h>
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#include "ChunkStore.h"
+
+static_assert(std::endian::native == std::endian::little, "chunk lists are stored little-endian");
+
+namespace {
+    constexpr std::uint64_t SUBKEY_ID = 1;
+    constexpr char SUBKEY_CONTEXT[crypto_kdf_CONTEXTBYTES] = {'E', 'n', 'c', 'C', 'h', 'u', 'n', 'k'};
+
+    // FastCDC masks for 8 KiB chunks: more bits (harder to cut) below the average size, fewer
+    // above, spread over the hash so the cut depends on a wide window of bytes.
+    constexpr std::uint64_t MASK_SMALL = 0x0000d9f003530000ULL;
+    constexpr std::uint64_t MASK_LARGE = 0x0000d90003530000ULL;
+
+    // Gear table: 256 fixed pseudo-random words (splitmix64), part of the chunk format.
+    constexpr std::array<std::uint64_t, 256> makeGear() {
+        std::array<std::uint64_t, 256> gear {};
+        std::uint64_t state = 0x656e636f72614344ULL;
+        for (auto &word : gear) {
+            state += 0x9e3779b97f4a7c15ULL;
+            std::uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+        return gear;
+    }
+
+    constexpr auto GEAR = makeGear();
+
+    static_assert(std::popcount(MASK_SMALL) == 15 && std::popcount(MASK_LARGE) == 11);
+    static_assert(ChunkStore::MAX_CHUNK <= UINT32_MAX);
+
+    int hexValue(const char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+}
+
+std::size_t ChunkStore::cut(const std::span<const unsigned char> data) {
+    if (data.size() <= MIN_CHUNK) {
+        return data.size();
+    }
+
+    const auto end = std::min(data.size(), MAX_CHUNK);
+    const auto normal = std::min(end, AVERAGE_CHUNK);
+    std::uint64_t hash = 0;
+    std::size_t i = MIN_CHUNK;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + GEAR[data[i]];
+        if ((hash & MASK_SMALL) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + GEAR[data[i]];
+        if ((hash & MASK_LARGE) == 0) {
+            return i + 1;
+        }
+    }
+
+    return end;
+}
+
+std::string ChunkStore::nameOf(const ChunkId &id) {
+    std::string hex(id.size() * 2 + 1, '\0');
+    sodium_bin2hex(hex.data(), hex.size(), id.data(), id.size());
+    hex.pop_back();
+
+    return std::string(NAME_PREFIX) + hex;
+}
+
+bool ChunkStore::isChunkName(const std::string_view name) {
+    return name.starts_with(NAME_PREFIX);
+}
+
+ChunkStore::ChunkId ChunkStore::idOf(const std::string_view name) {
+    if (!isChunkName(name) || name.size() != NAME_PREFIX.size() + ID_SIZE * 2) {
+        throw std::runtime_error("ChunkStore: not a chunk name.");
+    }
+
+    ChunkId id;
+    const auto hex = name.substr(NAME_PREFIX.size());
+    for (std::size_t i = 0; i < id.size(); ++i) {
+        const auto high = hexValue(hex[2 * i]);
+        const auto low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            throw std::runtime_error("ChunkStore: not a chunk name.");
+        }
+        id[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+
+    return id;
+}
+
+std::vector<unsigned char> ChunkStore::encode(const std::span<const ChunkRef> refs) {
+    std::vector<unsigned char> list(refs.size() * REF_SIZE);
+    auto *out = list.data();
+    for (const auto &ref : refs) {
+        std::memcpy(out, ref.id.data(), ID_SIZE);
+        std::memcpy(out + ID_SIZE, &ref.size, sizeof(ref.size));
+        out += REF_SIZE;
+    }
+
+    return list;
+}
+
+std::vector<ChunkStore::ChunkRef> ChunkStore::decode(const std::span<const unsigned char> list) {
+    if (list.size() % REF_SIZE != 0) {
+        throw std::runtime_error("ChunkStore: malformed chunk list.");
+    }
+
+    std::vector<ChunkRef> refs(list.size() / REF_SIZE);
+    const auto *in = list.data();
+    for (auto &ref : refs) {
+        std::memcpy(ref.id.data(), in, ID_SIZE);
+        std::memcpy(&ref.size, in + ID_SIZE, sizeof(ref.size));
+        if (ref.size == 0 || ref.size > MAX_CHUNK) {
+            throw std::runtime_error("ChunkStore: malformed chunk list.");
+        }
+        in += REF_SIZE;
+    }
+
+    return refs;
+}
+
+std::uint64_t ChunkStore::totalSize(const std::span<const ChunkRef> refs) {
+    std::uint64_t total = 0;
+    for (const auto &ref : refs) {
+        total += ref.size;
+    }
+
+    return total;
+}
+
+ChunkStore::ChunkStore(const std::vector<unsigned char> &vmk) {
+    if (vmk.size() != crypto_kdf_KEYBYTES) {
+        throw std::invalid_argument("ChunkStore: VMK has unexpected size.");
+    }
+
+    crypto_kdf_derive_from_key(m_key.data(), m_key.size(), SUBKEY_ID, SUBKEY_CONTEXT, vmk.data());
+}
+
+ChunkStore::~ChunkStore() {
+    sodium_memzero(m_key.data(), m_key.size());
+}
+
+ChunkStore::ChunkRef ChunkStore::refOf(const std::span<const unsigned char> chunk) const {
+    if (chunk.empty() || chunk.size() > MAX_CHUNK) {
+        throw std::invalid_argument("ChunkStore: chunk size out of range.");
+    }
+
+    ChunkRef ref;
+    crypto_generichash(ref.id.data(), ref.id.size(), chunk.data(), chunk.size(), m_key.data(), m_key.size());
+    ref.size = static_cast<std::uint32_t>(chunk.size());
+
+    return ref;
+}
+
+void ChunkStore::count(const std::span<const std::vector<ChunkRef>> lists) {
+    m_references.clear();
+    m_counted = true;
+    for (const auto &refs : lists) {
+        reference(refs);
+    }
+}
+
+void ChunkStore::reset() {
+    m_references.clear();
+    m_counted = false;
+}
+
+void ChunkStore::reference(const std::span<const ChunkRef> refs) {
+    if (!m_counted) {
+        return;
+    }
+
+    for (const auto &ref : refs) {
+        ++m_references[ref.id];
+    }
+}
+
+std::vector<ChunkStore::ChunkId> ChunkStore::release(const std::span<const ChunkRef> refs) {
+    std::vector<ChunkId> unreferenced;
+    if (!m_counted) {
+        return unreferenced;
+    }
+
+    for (const auto &ref : refs) {
+        const auto it = m_references.find(ref.id);
+        if (it == m_references.end()) {
+            continue;
+        }
+        if (--it->second == 0) {
+            m_references.erase(it);
+            unreferenced.push_back(ref.id);
+        }
+    }
+
+    return unreferenced;
+}
+
+void ChunkStore::forget(const ChunkId &id) {
+    m_references.erase(id);
+}
+
+bool ChunkStore::inUse(const ChunkId &id) const {
+    return !m_counted || m_references.contains(id) || m_holds.contains(id);
+}
+
+void ChunkStore::hold(const ChunkId &id) {
+    ++m_holds[id];
+}
+
+void ChunkStore::unhold(const ChunkId &id) {
+    const auto it = m_holds.find(id);
+    if (it != m_holds.end() && --it->second == 0) {
+        m_holds.erase(it);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef CORE_STORAGE_CHUNK_STORE_H
+#define CORE_STORAGE_CHUNK_STORE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * ChunkStore
+ *
+ * Deduplication of large records (EncryptedVaultStorage::setDeduplication): a record is cut
+ * into content-defined chunks (FastCDC: gear rolling hash, normalized chunking between
+ * MIN_CHUNK and MAX_CHUNK, AVERAGE_CHUNK on average), so an edit only changes the chunks
+ * around it and the rest of a near-identical file is found again.
+ *
+ * A chunk is named by a keyed BLAKE2b of its plaintext, under a subkey of the VMK (crypto_kdf,
+ * context "EncChunk"): equal chunks get equal ids, and only the VMK holder can tell which
+ * plaintext an id stands for. Each chunk is stored once, as a hidden record of the vault
+ * (nameOf); a deduplicated record holds its chunk list instead of its bytes:
+ *      (chunk id (32 bytes) | chunk size (u32 LE))*
+ *
+ * Reference counts are not stored: they follow from the chunk lists of the live records, and
+ * are counted from those the first time they are needed, then kept up as records come and go.
+ * A chunk nothing references any more is dropped by compaction; until then it can be taken up
+ * again. A chunk is "held" while a record that uses it is still being written, so compaction
+ * leaves it alone even if nothing references it yet.
+ *
+ * Chunk boundaries depend only on the gear table and masks below: changing them means equal
+ * data written before and after no longer shares chunks.
+ *
+ * Not thread-safe (EncryptedVaultStorage serializes it), except refOf and the static functions.
+ */
+class ChunkStore {
+public:
+    static constexpr std::size_t MIN_CHUNK = 2 * 1024;
+    static constexpr std::size_t AVERAGE_CHUNK = 8 * 1024;
+    static constexpr std::size_t MAX_CHUNK = 64 * 1024;
+    static constexpr std::size_t ID_SIZE = 32;
+    // Size of one entry of a chunk list.
+    static constexpr std::size_t REF_SIZE = ID_SIZE + sizeof(std::uint32_t);
+    // Record names of chunks start with this; it cannot start a name of the vault's own.
+    static constexpr std::string_view NAME_PREFIX = "\x01" "chunk:";
+    static constexpr const char *TYPE = "chunk";
+
+    using ChunkId = std::array<unsigned char, ID_SIZE>;
+
+    struct ChunkRef {
+        ChunkId id {};
+        std::uint32_t size = 0;
+    };
+
+    // Length of the first chunk of 'data': all of it if it ends before a cut point.
+    static std::size_t cut(std::span<const unsigned char> data);
+
+    static std::string nameOf(const ChunkId &id);
+    static bool isChunkName(std::string_view name);
+    // Throws std::runtime_error if 'name' is not a chunk's name.
+    static ChunkId idOf(std::string_view name);
+
+    static std::vector<unsigned char> encode(std::span<const ChunkRef> refs);
+    // Throws std::runtime_error if 'list' is not a chunk list.
+    static std::vector<ChunkRef> decode(std::span<const unsigned char> list);
+    static std::uint64_t totalSize(std::span<const ChunkRef> refs);
+
+    // Throws std::invalid_argument if 'vmk' has the wrong size.
+    explicit ChunkStore(const std::vector<unsigned char> &vmk);
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore &) = delete;
+    ChunkStore &operator=(const ChunkStore &) = delete;
+
+    // Id and size of 'chunk'.
+    [[nodiscard]]
+    ChunkRef refOf(std::span<const unsigned char> chunk) const;
+
+    // Whether reference counts are kept yet; until they are, reference / release do nothing.
+    [[nodiscard]]
+    bool counted() const { return m_counted; }
+    // Start keeping counts, 'lists' being the chunk lists of every live record.
+    void count(std::span<const std::vector<ChunkRef>> lists);
+    // Stop keeping counts, e.g. after a chunk list could not be read; they are counted again when next needed.
+    void reset();
+    // A record with 'refs' was added / went away. release returns the chunks nothing references now.
+    void reference(std::span<const ChunkRef> refs);
+    std::vector<ChunkId> release(std::span<const ChunkRef> refs);
+    // The chunk was dropped from the vault.
+    void forget(const ChunkId &id);
+    // Whether a chunk is referenced or held (unknown until counted: true).
+    [[nodiscard]]
+    bool inUse(const ChunkId &id) const;
+
+    void hold(const ChunkId &id);
+    void unhold(const ChunkId &id);
+
+private:
+    struct IdHash {
+        std::size_t operator()(const ChunkId &id) const {
+            std::size_t hash;
+            std::memcpy(&hash, id.data(), sizeof(hash));
+            return hash;
+        }
+    };
+
+    std::array<unsigned char, 32> m_key {};
+    bool m_counted = false;
+    std::unordered_map<ChunkId, std::uint32_t, IdHash> m_references;
+    std::unordered_map<ChunkId, std::uint32_t, IdHash> m_holds;
+};
+
+#endif //CORE_STORAGE_CHUNK_STORE_H
@@ -0,0 +1,186 @@
+#include <sodium.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChunkedAead.h"
+
+namespace {
+    constexpr std::size_t SUITE_OFFSET = 5;
+    constexpr std::size_t NONCE_OFFSET = 8;
+    constexpr std::size_t NONCE_SIZE = ChunkedAead::HEADER_SIZE - NONCE_OFFSET;
+    static_assert(NONCE_SIZE == CryptoEngine::MAX_NONCE_SIZE);
+
+    // Suite named in 'header' (checked before the key is bound to it).
+    CipherSuite suiteOf(const ChunkedAead::Header &header) {
+        std::uint32_t chunkSize = 0;
+        std::memcpy(&chunkSize, header.data(), sizeof(chunkSize));
+        if (chunkSize != ChunkedAead::CHUNK_SIZE || header[sizeof(chunkSize)] != ChunkedAead::VERSION
+            || header[SUITE_OFFSET + 1] != 0 || header[SUITE_OFFSET + 2] != 0) {
+            throw std::runtime_error("Record file corrupted: unknown chunk layout.");
+        }
+        return CryptoEngine::suiteOf(header[SUITE_OFFSET]);
+    }
+
+    // fn(i) for every i in [0, count) on up to 'jobs' threads; rethrows the first failure.
+    void forEachChunk(const std::size_t count, unsigned jobs, const std::function<void(std::size_t)> &fn) {
+        if (jobs == 0) {
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, count));
+        if (jobs <= 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        std::atomic<std::size_t> next {0};
+        std::mutex failureMutex;
+        std::exception_ptr failure;
+        const auto work = [&] {
+            for (std::size_t i; (i = next.fetch_add(1)) < count;) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard lock(failureMutex);
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                    next = count;
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(jobs - 1);
+        for (unsigned i = 1; i < jobs; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+}
+
+ChunkedAead::Header ChunkedAead::newHeader(const CipherSuite suite) {
+    Header header {};
+    const auto chunkSize = static_cast<std::uint32_t>(CHUNK_SIZE);
+    std::memcpy(header.data(), &chunkSize, sizeof(chunkSize));
+    header[sizeof(chunkSize)] = VERSION;
+    header[SUITE_OFFSET] = static_cast<unsigned char>(suite);
+    randombytes_buf(header.data() + NONCE_OFFSET, NONCE_SIZE);
+
+    return header;
+}
+
+std::uint64_t ChunkedAead::plainSize(const std::uint64_t sealedSize) {
+    if (sealedSize < HEADER_SIZE + TAG_SIZE) {
+        throw std::runtime_error("Record file corrupted: too small.");
+    }
+
+    const auto body = sealedSize - HEADER_SIZE;
+    const auto rest = body % SEALED_CHUNK_SIZE;
+    if (rest != 0 && rest < TAG_SIZE) {
+        throw std::runtime_error("Record file corrupted: partial chunk.");
+    }
+
+    return body / SEALED_CHUNK_SIZE * CHUNK_SIZE + (rest == 0 ? 0 : rest - TAG_SIZE);
+}
+
+std::uint64_t ChunkedAead::sealedSize(const std::uint64_t plainSize) {
+    const auto chunks = std::max<std::uint64_t>(1, (plainSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    return HEADER_SIZE + plainSize + chunks * TAG_SIZE;
+}
+
+std::uint64_t ChunkedAead::chunkCount(const std::uint64_t sealedSize) {
+    (void) plainSize(sealedSize);
+    const auto body = sealedSize - HEADER_SIZE;
+    return body / SEALED_CHUNK_SIZE + (body % SEALED_CHUNK_SIZE == 0 ? 0 : 1);
+}
+
+ChunkedAead::ChunkedAead(const std::span<const unsigned char> key, const Header &header, const unsigned jobs)
+    : m_header(header), m_engine(key, suiteOf(header)), m_jobs(jobs) {
+}
+
+void ChunkedAead::nonceOf(const std::uint64_t chunk, unsigned char (&nonce)[NONCE_SIZE]) const {
+    const auto size = m_engine.nonceSize();
+    std::memcpy(nonce, m_header.data() + NONCE_OFFSET, size);
+    for (std::size_t i = 0; i < sizeof(chunk); ++i) {
+        nonce[size - sizeof(chunk) + i] ^= static_cast<unsigned char>(chunk >> (8 * i));
+    }
+}
+
+std::size_t ChunkedAead::seal(const std::uint64_t first, const std::span<const unsigned char> plain, const bool final,
+    const std::span<unsigned char> out) const {
+    const std::size_t chunks = final
+        ? std::max<std::size_t>(1, (plain.size() + CHUNK_SIZE - 1) / CHUNK_SIZE)
+        : plain.size() / CHUNK_SIZE;
+    if (!final && plain.size() % CHUNK_SIZE != 0) {
+        throw std::invalid_argument("ChunkedAead: only the final chunk may be short.");
+    }
+    const std::size_t sealedBytes = plain.size() + chunks * TAG_SIZE;
+    if (out.size() < sealedBytes) {
+        throw std::invalid_argument("ChunkedAead: output too small.");
+    }
+
+    forEachChunk(chunks, m_jobs, [&](const std::size_t i) {
+        const bool last = final && i + 1 == chunks;
+        unsigned char aad[HEADER_SIZE + 1];
+        std::memcpy(aad, m_header.data(), HEADER_SIZE);
+        aad[HEADER_SIZE] = last ? 1 : 0;
+        unsigned char nonce[NONCE_SIZE];
+        nonceOf(first + i, nonce);
+
+        const auto offset = i * CHUNK_SIZE;
+        const auto length = std::min(CHUNK_SIZE, plain.size() - offset);
+        m_engine.encrypt(out.subspan(i * SEALED_CHUNK_SIZE, length + TAG_SIZE), plain.subspan(offset, length),
+            std::span(nonce, m_engine.nonceSize()), aad);
+    });
+
+    return sealedBytes;
+}
+
+std::size_t ChunkedAead::open(const std::uint64_t first, const std::span<const unsigned char> sealed, const bool final,
+    const std::span<unsigned char> out) const {
+    const auto rest = sealed.size() % SEALED_CHUNK_SIZE;
+    if ((rest != 0 && (!final || rest < TAG_SIZE)) || (sealed.empty() && final)) {
+        throw std::runtime_error("Record file corrupted: partial chunk.");
+    }
+    const std::size_t chunks = sealed.size() / SEALED_CHUNK_SIZE + (rest == 0 ? 0 : 1);
+    const std::size_t plainBytes = sealed.size() - chunks * TAG_SIZE;
+    if (out.size() < plainBytes) {
+        throw std::invalid_argument("ChunkedAead: output too small.");
+    }
+
+    forEachChunk(chunks, m_jobs, [&](const std::size_t i) {
+        const bool last = final && i + 1 == chunks;
+        unsigned char aad[HEADER_SIZE + 1];
+        std::memcpy(aad, m_header.data(), HEADER_SIZE);
+        aad[HEADER_SIZE] = last ? 1 : 0;
+        unsigned char nonce[NONCE_SIZE];
+        nonceOf(first + i, nonce);
+
+        const auto offset = i * SEALED_CHUNK_SIZE;
+        const auto length = std::min(SEALED_CHUNK_SIZE, sealed.size() - offset);
+        if (!m_engine.decrypt(out.subspan(i * CHUNK_SIZE, length - TAG_SIZE), sealed.subspan(offset, length),
+            std::span(nonce, m_engine.nonceSize()), aad)) {
+            throw std::runtime_error("Failed to decrypt record: chunk " + std::to_string(first + i) + " does not authenticate.");
+        }
+    });
+
+    return plainBytes;
+}
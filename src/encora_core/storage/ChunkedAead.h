@@ -0,0 +1,76 @@
+#ifndef CORE_STORAGE_CHUNKED_AEAD_H
+#define CORE_STORAGE_CHUNKED_AEAD_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "CryptoEngine.h"
+
+/**
+ * ChunkedAead
+ *
+ * Sealed layout of random-access records: the plaintext is cut into CHUNK_SIZE chunks
+ * that are sealed independently (CryptoEngine, the suite named in the header), so any
+ * chunk can be opened on its own and many chunks are sealed / opened in parallel.
+ *
+ *  [Header: 32 bytes]  u32 chunk size, u8 version, u8 cipher suite, 2 reserved bytes, 24-byte record nonce
+ *  [Chunk]*            CHUNK_SIZE bytes + tag; the last chunk (possibly shorter or empty) is final
+ *
+ * Chunk i is sealed with
+ *      nonce = the suite's nonce size of the record nonce, its last 8 bytes XOR i (little-endian)
+ *      AAD   = header || final flag (1 for the last chunk, else 0)
+ * so a chunk only opens at its own position, a record cut at a chunk boundary fails
+ * on its new last chunk, and any change to the header fails every chunk.
+ *
+ * The key must be unique per record (EncryptedVaultStorage derives one from the record salt).
+ */
+class ChunkedAead {
+public:
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr std::size_t HEADER_SIZE = 32;
+    static constexpr std::size_t TAG_SIZE = CryptoEngine::TAG_SIZE;
+    static constexpr std::size_t SEALED_CHUNK_SIZE = CHUNK_SIZE + TAG_SIZE;
+    static constexpr unsigned char VERSION = 1;
+
+    using Header = std::array<unsigned char, HEADER_SIZE>;
+
+    // Header of a new record sealed with 'suite', with a random nonce.
+    static Header newHeader(CipherSuite suite = CryptoEngine::preferred());
+    // Plaintext size of a sealed record of 'sealedSize' bytes (header included).
+    // Throws std::runtime_error if no record has that size.
+    static std::uint64_t plainSize(std::uint64_t sealedSize);
+    // Sealed size of a 'plainSize' byte record sealed in one go (header included).
+    static std::uint64_t sealedSize(std::uint64_t plainSize);
+    // Number of chunks of a sealed record of 'sealedSize' bytes.
+    static std::uint64_t chunkCount(std::uint64_t sealedSize);
+
+    // 'key': CryptoEngine::KEY_SIZE bytes. Throws std::runtime_error if 'header' is not one this
+    // version can read, or its suite is not available here. 'jobs': threads per call (0 = one per hardware thread).
+    ChunkedAead(std::span<const unsigned char> key, const Header &header, unsigned jobs = 0);
+
+    ChunkedAead(const ChunkedAead &) = delete;
+    ChunkedAead &operator=(const ChunkedAead &) = delete;
+
+    // Seal chunks first, first + 1, ... from 'plain': whole chunks, except that the last one may be
+    // short (or 'plain' empty) if it is the record's 'final' chunk. 'out' takes the sealed chunks;
+    // returns the bytes written.
+    std::size_t seal(std::uint64_t first, std::span<const unsigned char> plain, bool final, std::span<unsigned char> out) const;
+    // Open the sealed chunks first, first + 1, ... in 'sealed'; 'final' if the last of them is the
+    // record's last chunk. Returns the plaintext bytes written to 'out'. Throws std::runtime_error if
+    // a chunk does not authenticate.
+    std::size_t open(std::uint64_t first, std::span<const unsigned char> sealed, bool final, std::span<unsigned char> out) const;
+
+    [[nodiscard]]
+    CipherSuite suite() const { return m_engine.suite(); }
+
+private:
+    Header m_header {};
+    CryptoEngine m_engine;
+    unsigned m_jobs;
+
+    void nonceOf(std::uint64_t chunk, unsigned char (&nonce)[CryptoEngine::MAX_NONCE_SIZE]) const;
+};
+
+#endif //CORE_STORAGE_CHUNKED_AEAD_H
@@ -1,16 +1,38 @@
 #include <sodium.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <map>
 #include <nlohmann/json.hpp>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+
+#ifdef ENCORA_PLATFORM_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "EncryptedVaultStorage.h"
 
+#include "ChunkedAead.h"
+#include "StorageError.h"
 #include "security/ManifestWriter.h"
 #include "utils/Base64.h"
 #include "utils/Logger.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
+using PlainSink = std::function<void(std::uint64_t, std::span<const unsigned char>)>;
+
+static_assert(std::is_same_v<ChunkStore::ChunkId, StorageIndex::Salt>, "a chunk is sealed with its id as salt");
 
 static std::vector<unsigned char> hmacSha256Bytes(
     const std::vector<unsigned char> &key,
@@ -33,52 +55,278 @@ static std::vector<unsigned char> hmacSha256Bytes(
     return mac;
 }
 
-static inline void strip_cr(std::string& str) {
-    str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
+// read(2) that retries on EINTR; 0 = end of input.
+static std::size_t readFd(const int fd, const std::span<unsigned char> buffer) {
+    for (;;) {
+#ifdef ENCORA_PLATFORM_WINDOWS
+        const auto got = _read(fd, buffer.data(), static_cast<unsigned>(std::min<std::size_t>(buffer.size(), INT_MAX)));
+#else
+        const auto got = ::read(fd, buffer.data(), buffer.size());
+#endif
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            throw std::runtime_error(std::string("Read failed: ") + std::strerror(errno));
+        }
+        return static_cast<std::size_t>(got);
+    }
 }
 
-static inline bool safeParseLine(const std::string &line, json &out) {
-    if (line.empty()) return false;
-    auto j = json::parse(line, nullptr, false);
-    if (j.is_discarded()) return false;
-    out = std::move(j);
+// write(2) all of 'data', retrying on EINTR and short writes.
+static void writeFd(const int fd, std::span<const unsigned char> data) {
+    while (!data.empty()) {
+#ifdef ENCORA_PLATFORM_WINDOWS
+        const auto wrote = _write(fd, data.data(), static_cast<unsigned>(std::min<std::size_t>(data.size(), INT_MAX)));
+#else
+        const auto wrote = ::write(fd, data.data(), data.size());
+#endif
+        if (wrote < 0 && errno == EINTR) continue;
+        if (wrote < 0) {
+            throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+        }
+        data = data.subspan(static_cast<std::size_t>(wrote));
+    }
+}
 
-    return true;
+// Segment record header format word: the layout in the low byte, the cipher suite in the next one,
+// then the compression codec and the content.
+static std::uint32_t formatWord(const EncryptedVaultStorage::RecordFormat format, const CipherSuite suite,
+    const RecordCodec::Codec codec = RecordCodec::Codec::None,
+    const EncryptedVaultStorage::RecordContent content = EncryptedVaultStorage::RecordContent::Data) {
+    return static_cast<std::uint32_t>(format) | static_cast<std::uint32_t>(suite) << 8 | static_cast<std::uint32_t>(codec) << 16
+        | static_cast<std::uint32_t>(content) << 24;
 }
 
-static bool rewrite(const std::string &name) {
-    std::ifstream ifs("data/vault_store/index.json");
-    if (!ifs.is_open()) {
-        return true;
+// Layout, cipher suite, codec and content from a segment record header's format word.
+static void parseFormat(const std::uint32_t word, EncryptedVaultStorage::RecordFormat &format, CipherSuite &suite,
+    RecordCodec::Codec &codec, EncryptedVaultStorage::RecordContent &content) {
+    using RecordContent = EncryptedVaultStorage::RecordContent;
+    if ((word & 0xFF) > static_cast<std::uint32_t>(EncryptedVaultStorage::RecordFormat::RandomAccess)
+        || word >> 24 > static_cast<std::uint32_t>(RecordContent::ChunkList)) {
+        throw std::runtime_error("Record has an unknown format: " + std::to_string(word));
+    }
+    format = static_cast<EncryptedVaultStorage::RecordFormat>(word & 0xFF);
+    suite = CryptoEngine::suiteOf(word >> 8 & 0xFF);
+    codec = RecordCodec::codecOf(word >> 16 & 0xFF);
+    content = static_cast<RecordContent>(word >> 24);
+    if (content == RecordContent::ChunkList && (codec != RecordCodec::Codec::None || format == EncryptedVaultStorage::RecordFormat::Chunked)) {
+        throw std::runtime_error("Record has an unknown format: " + std::to_string(word));
     }
+}
 
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(ifs, line)) {
-        if (line.empty()) continue;
-        json j = json::parse(line, nullptr, false);
-        if (j.is_discarded()) continue;
-        if (j.value("name", "") != name) {
-            lines.push_back(line);
+// Compression header at the start of a compressed record's stored bytes; it must name the
+// codec of the format word.
+static RecordCodec::Header codecHeaderOf(const std::span<const unsigned char> stored, const RecordCodec::Codec codec) {
+    const auto header = RecordCodec::Header::parse(stored);
+    if (header.codec != codec) {
+        throw std::runtime_error("Record has a corrupted compression header.");
+    }
+    return header;
+}
+
+// Plaintext size of a record from its sealed length alone.
+static std::uint64_t plainSizeOf(const std::uint64_t sealedLength, const EncryptedVaultStorage::RecordFormat format,
+    const CipherSuite suite) {
+    switch (format) {
+        case EncryptedVaultStorage::RecordFormat::Sealed: {
+            const auto overhead = CryptoEngine::nonceSize(suite) + CryptoEngine::TAG_SIZE;
+            if (sealedLength < overhead) {
+                throw std::runtime_error("Record file corrupted: too small.");
+            }
+            return sealedLength - overhead;
         }
+        case EncryptedVaultStorage::RecordFormat::Chunked: {
+            // Full chunks, then a shorter (possibly empty) final one.
+            constexpr std::uint64_t tagSize = crypto_secretstream_xchacha20poly1305_ABYTES;
+            constexpr std::uint64_t chunkSize = EncryptedVaultStorage::STREAM_CHUNK_SIZE + tagSize;
+            constexpr std::uint64_t headerSize = crypto_secretstream_xchacha20poly1305_HEADERBYTES;
+            if (sealedLength < headerSize + tagSize || (sealedLength - headerSize) % chunkSize < tagSize) {
+                throw std::runtime_error("Record file corrupted: partial chunk.");
+            }
+            const auto body = sealedLength - headerSize;
+            return body - (body / chunkSize + 1) * tagSize;
+        }
+        case EncryptedVaultStorage::RecordFormat::RandomAccess:
+            return ChunkedAead::plainSize(sealedLength);
     }
+    throw std::runtime_error("Record has an unknown format.");
+}
 
-    ifs.close();
+// EncryptedVaultStorage::deriveRecordKey into 'key', without allocating.
+static void recordKeyOf(const std::vector<unsigned char> &vmk, const std::span<const unsigned char> salt,
+    const RecordCodec::Header &codec, const std::span<unsigned char, crypto_auth_hmacsha256_BYTES> key) {
+    crypto_auth_hmacsha256_state state;
+    crypto_auth_hmacsha256_init(&state, vmk.data(), vmk.size());
+    crypto_auth_hmacsha256_update(&state, salt.data(), salt.size());
+    if (codec.codec != RecordCodec::Codec::None) {
+        const auto header = codec.bytes();
+        crypto_auth_hmacsha256_update(&state, header.data(), header.size());
+    }
+    crypto_auth_hmacsha256_final(&state, key.data());
+    sodium_memzero(&state, sizeof(state));
+}
 
-    std::ofstream ofs("data/vault_store/index.json", std::ios::trunc);
-    if (!ofs.is_open()) {
-        return false;
+// Whole-record format: nonce || ciphertext, nonce and ciphertext of the record's suite.
+static std::uint64_t openSealed(const std::vector<unsigned char> &sealed, const std::vector<unsigned char> &recordKey,
+    const CipherSuite suite, const PlainSink &write) {
+    const CryptoEngine engine(recordKey, suite);
+    const std::size_t nonceSize = engine.nonceSize();
+    if (sealed.size() < nonceSize + CryptoEngine::TAG_SIZE) {
+        throw std::runtime_error("Record file corrupted: too small.");
     }
 
-    for (auto &l : lines) {
-        ofs << l << "\n";
+    const auto nonce = std::span(sealed).first(nonceSize);
+    const auto cipherText = std::span(sealed).subspan(nonceSize);
+
+    std::vector<unsigned char> decrypted(cipherText.size());
+    if (!engine.decrypt(decrypted, cipherText, nonce)) {
+        throw std::runtime_error("Failed to decrypt record.");
     }
 
-    return true;
+    decrypted.resize(cipherText.size() - CryptoEngine::TAG_SIZE);
+    write(0, decrypted);
+    sodium_memzero(decrypted.data(), decrypted.size());
+
+    return decrypted.size();
+}
+
+// secretstream format: header, then full chunks, then the shorter FINAL one. Sequential only.
+static std::uint64_t openStream(const FileHandle &segment, const RecordLocation &location, const std::vector<unsigned char> &recordKey,
+    const PlainSink &write) {
+    constexpr std::size_t headerSize = crypto_secretstream_xchacha20poly1305_HEADERBYTES;
+    constexpr std::size_t chunkSize = EncryptedVaultStorage::STREAM_CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES;
+    if (location.length < headerSize + crypto_secretstream_xchacha20poly1305_ABYTES) {
+        throw std::runtime_error("Record file corrupted: too small.");
+    }
+
+    unsigned char header[headerSize];
+    segment.readAt(location.offset, header, headerSize);
+    crypto_secretstream_xchacha20poly1305_state state;
+    if (crypto_secretstream_xchacha20poly1305_init_pull(&state, header, recordKey.data()) != 0) {
+        throw std::runtime_error("Failed to decrypt record.");
+    }
+
+    std::vector<unsigned char> cipher(chunkSize);
+    std::vector<unsigned char> plain(EncryptedVaultStorage::STREAM_CHUNK_SIZE);
+    std::uint64_t total = 0;
+    bool final = false;
+    try {
+        for (std::uint64_t at = headerSize; at < location.length;) {
+            if (final) {
+                throw std::runtime_error("Failed to decrypt record: data after its final chunk.");
+            }
+
+            const auto piece = static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, location.length - at));
+            segment.readAt(location.offset + at, cipher.data(), piece);
+            unsigned long long plainLength = 0;
+            unsigned char tag = 0;
+            if (crypto_secretstream_xchacha20poly1305_pull(&state, plain.data(), &plainLength, &tag, cipher.data(), piece, nullptr, 0) != 0) {
+                throw std::runtime_error("Failed to decrypt record.");
+            }
+            final = tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL;
+
+            write(total, std::span(plain.data(), static_cast<std::size_t>(plainLength)));
+            total += plainLength;
+            at += piece;
+        }
+        if (!final) {
+            throw std::runtime_error("Failed to decrypt record: truncated.");
+        }
+    } catch (...) {
+        sodium_memzero(plain.data(), plain.size());
+        sodium_memzero(&state, sizeof(state));
+        throw;
+    }
+    sodium_memzero(plain.data(), plain.size());
+    sodium_memzero(&state, sizeof(state));
+
+    return total;
+}
+
+// Random-access format (ChunkedAead): opens only the chunks holding plaintext bytes [from, to),
+// a batch at a time on all cores.
+static std::uint64_t openChunks(const FileHandle &segment, const RecordLocation &location, const std::vector<unsigned char> &recordKey,
+    const std::uint64_t from, const std::uint64_t to, const PlainSink &write) {
+    const auto size = ChunkedAead::plainSize(location.length);
+    const auto chunks = ChunkedAead::chunkCount(location.length);
+    ChunkedAead::Header header {};
+    segment.readAt(location.offset, header.data(), header.size());
+    const ChunkedAead aead(recordKey, header);
+
+    // The empty record is one empty chunk, still opened to check the header.
+    const auto first = std::min(from, size) / ChunkedAead::CHUNK_SIZE;
+    const auto end = std::max<std::uint64_t>(first + 1,
+        std::min(chunks, (std::min(to, size) + ChunkedAead::CHUNK_SIZE - 1) / ChunkedAead::CHUNK_SIZE));
+    const auto batch = std::min<std::uint64_t>(EncryptedVaultStorage::STREAM_BATCH_CHUNKS, end - first);
+
+    std::vector<unsigned char> sealed(static_cast<std::size_t>(batch) * ChunkedAead::SEALED_CHUNK_SIZE);
+    std::vector<unsigned char> plain(static_cast<std::size_t>(batch) * ChunkedAead::CHUNK_SIZE);
+    std::uint64_t total = 0;
+    try {
+        for (auto chunk = first; chunk < end;) {
+            const auto count = std::min(batch, end - chunk);
+            const auto begin = ChunkedAead::HEADER_SIZE + chunk * ChunkedAead::SEALED_CHUNK_SIZE;
+            const auto length = static_cast<std::size_t>(
+                std::min<std::uint64_t>(location.length, begin + count * ChunkedAead::SEALED_CHUNK_SIZE) - begin);
+            segment.readAt(location.offset + begin, sealed.data(), length);
+
+            const auto plainBytes = aead.open(chunk, std::span(sealed.data(), length), chunk + count == chunks, plain);
+            write(chunk * ChunkedAead::CHUNK_SIZE, std::span(plain.data(), plainBytes));
+            total += plainBytes;
+            chunk += count;
+        }
+    } catch (...) {
+        sodium_memzero(plain.data(), plain.size());
+        throw;
+    }
+    sodium_memzero(plain.data(), plain.size());
+
+    return total;
 }
 
-EncryptedVaultStorage::EncryptedVaultStorage(const std::vector<unsigned char> &vmk) : m_vmk(vmk) {
+EncryptedVaultStorage::EncryptedVaultStorage(const std::vector<unsigned char> &vmk, const std::uint64_t segmentSize)
+    : m_vmk(vmk), m_log(vmk), m_segments("data/vault_store", segmentSize), m_wal(vmk),
+      m_codec("data/vault_store", vmk), m_chunks(vmk), m_manifest("data", vmk) {
     ensureStorageDir();
+    openIndex();
+    m_hasChunks = !m_log.names(ChunkStore::NAME_PREFIX).empty();
+    recover();
+    // Kept out of swap for as long as the storage lives (best effort: RLIMIT_MEMLOCK may refuse).
+    (void) sodium_mlock(m_vmk.data(), m_vmk.size());
+}
+
+EncryptedVaultStorage::~EncryptedVaultStorage() {
+    // Clean shutdown: once index.log is on disk the WAL has nothing left to redo.
+    try {
+        std::lock_guard lock(m_mutex);
+        if (!m_wal.empty()) {
+            m_log.sync();
+            m_wal.reset();
+        }
+    } catch (const std::exception &e) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("WAL reset on close failed: ") + e.what());
+    }
+    // Wipes the VMK as it unlocks it.
+    sodium_munlock(m_vmk.data(), m_vmk.size());
+}
+
+void EncryptedVaultStorage::recover() {
+    const auto replayed = m_wal.open(walPath(), [this](std::uint64_t, const std::vector<WriteAheadLog::Operation> &ops) {
+        applyOperations(ops);
+    });
+    m_nextApply = m_wal.nextSeq();
+    m_wal.setBeforeSync([this] {
+        std::lock_guard lock(m_mutex);
+        m_segments.sync();
+    });
+
+    if (replayed > 0) {
+        m_log.sync();
+        m_wal.reset();
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+            "Recovered " + std::to_string(replayed) + " transaction(s) from the write-ahead log.");
+        // Segments the replayed transactions wrote may never have made it into the manifest.
+        updateManifest("recovery", true);
+    }
 }
 
 void EncryptedVaultStorage::ensureStorageDir() const {
@@ -86,7 +334,13 @@ void EncryptedVaultStorage::ensureStorageDir() const {
 }
 
 std::vector<unsigned char> EncryptedVaultStorage::deriveRecordKey(const std::vector<unsigned char> &vmk,
-    const std::vector<unsigned char> &salt) {
+    const std::vector<unsigned char> &salt, const RecordCodec::Header &codec) {
+    if (codec.codec == RecordCodec::Codec::None) {
+        return hmacSha256Bytes(vmk, salt, {});
+    }
+
+    const auto header = codec.bytes();
+    return hmacSha256Bytes(vmk, salt, std::vector<unsigned char>(header.begin(), header.end()));
 }
 
 std::string EncryptedVaultStorage::base64Encode(const std::vector<unsigned char> &data) {
@@ -101,222 +355,1398 @@ std::string EncryptedVaultStorage::path(const std::string &id) const {
     return "data/vault_store/record_" + id + ".bin";
 }
 
-bool EncryptedVaultStorage::addRecord(const std::string &name, const std::string &type, std::vector<unsigned char> &data) {
-    // 1. Generate per-record salt.
-    std::vector<unsigned char> salt(32);
-    randombytes_buf(salt.data(), salt.size());
+std::string EncryptedVaultStorage::indexPath() const {
+    return "data/vault_store/index.log";
+}
+
+std::string EncryptedVaultStorage::walPath() const {
+    return "data/vault.wal";
+}
+
+void EncryptedVaultStorage::openIndex() {
+    const std::string binPath = "data/vault_store/index.bin";
+    const std::string jsonPath = "data/vault_store/index.json";
+    if (fs::exists(indexPath()) || (!fs::exists(binPath) && !fs::exists(jsonPath))) {
+        m_log.open(indexPath());
+        return;
+    }
+
+    // One-time migration of the plaintext index (index.bin, or older index.json lines).
+    StorageIndex legacy;
+    if (BinaryIndex bin; bin.open(binPath)) {
+        bin.load(legacy);
+    } else {
+        legacy.loadJsonLines(jsonPath);
+    }
+
+    m_log.create(indexPath(), legacy);
+    fs::remove(binPath);
+    fs::remove(jsonPath);
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+        "Migrated plaintext index to encrypted index.log (" + std::to_string(legacy.size()) + " records).");
+
+    std::string err;
+    if (!m_manifest.rebuild(err)) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Manifest update after index migration failed: " + err);
+    }
+}
+
+bool EncryptedVaultStorage::lookup(const std::string &name, std::string &id, std::vector<unsigned char> &salt,
+    RecordLocation &location) const {
+    const auto entry = m_log.find(name);
+    if (!entry) return false;
+
+    id.assign(entry->id);
+    salt.assign(entry->salt.begin(), entry->salt.end());
+    location = entry->location;
+    return true;
+}
+
+std::vector<unsigned char> EncryptedVaultStorage::readSealed(const std::string &id, const RecordLocation &location) const {
+    if (location.segment != 0) {
+        return m_segments.read(location);
+    }
+
+    // Record written before segments existed.
+    std::ifstream ifs(path(id), std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Cannot open record file. Not found: " + path(id));
+    }
+
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+// Names of the vault's own records; chunks of deduplicated records have names of their own.
+static void checkRecordName(const std::string &name) {
+    if (ChunkStore::isChunkName(name)) {
+        throw std::invalid_argument("Record names cannot start with a \\x01 byte.");
+    }
+}
+
+void EncryptedVaultStorage::Transaction::add(const std::string &name, const std::string &type, std::vector<unsigned char> data) {
+    checkRecordName(name);
+    m_ops.push_back({false, name, type, std::move(data)});
+}
+
+void EncryptedVaultStorage::Transaction::remove(const std::string &name) {
+    checkRecordName(name);
+    m_ops.push_back({true, name, {}, {}});
+}
+
+void EncryptedVaultStorage::Transaction::clear() {
+    for (auto &op : m_ops) {
+        if (!op.data.empty()) {
+            sodium_memzero(op.data.data(), op.data.size());
+        }
+    }
+    m_ops.clear();
+}
+
+EncryptedVaultStorage::Transaction::~Transaction() {
+    clear();
+}
+
+std::pair<std::vector<unsigned char>, std::uint32_t> EncryptedVaultStorage::sealPayload(const StorageIndex::Salt &salt,
+    const std::span<const unsigned char> data, const std::optional<CompressionOptions> &compression, const RecordContent content) const {
+    // 1. Compress, when that pays: the header goes in front of the sealed bytes and into the key.
+    RecordCodec::Header codec;
+    auto compressed = compression ? m_codec.compress(data, *compression, codec) : std::vector<unsigned char> {};
+    const bool isCompressed = codec.codec != RecordCodec::Codec::None;
+    const auto payload = isCompressed ? std::span<const unsigned char>(compressed) : data;
+    const std::size_t prefix = isCompressed ? RecordCodec::Header::SIZE : 0;
     // 2. Derive record key from VMK + salt.
-    auto recordKey = deriveRecordKey(m_vmk, salt);
-    // 3. Encrypt with XChaCha20-Poly1305 (unique nonce per record)
-    std::vector<unsigned char> nonce(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
-    randombytes_buf(nonce.data(), nonce.size());
-
-    std::vector<unsigned char> cipherText(data.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES);
-    unsigned long long cipherTextLength = 0;
-    if (crypto_aead_xchacha20poly1305_ietf_encrypt(
-        cipherText.data(),
-        &cipherTextLength,
-        data.data(),
-        data.size(),
-        nullptr,
-        0,
-        nullptr,
-        nonce.data(),
-        recordKey.data()
-        )) {
-        throw std::runtime_error("AddRecord: encryption failed.");
-    }
-
-    cipherText.resize(cipherTextLength);
-
-    // 4. Persist record
-    std::string id = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
-    std::ofstream ofs(path(id), std::ios::binary);
-    if (!ofs.is_open()) {
-        throw std::runtime_error("Cannot open record file for write.");
-    }
-
-    rewrite(name);
-    ofs.write((char*)nonce.data(), nonce.size());
-    ofs.write((char*)cipherText.data(), cipherText.size());
-    ofs.close();
-
-    // 5. Append to index.json (JSON lines), include base64 salt
-    json j = {
-        {"id", id},
-        {"name", name},
-        {"type", type},
-        {"created_at", std::time(nullptr)},
-        {"salt_b64", base64Encode(recordKey)}
+    auto recordKey = deriveRecordKey(m_vmk, std::vector<unsigned char>(salt.begin(), salt.end()), codec);
+    // 3. Encrypt with this machine's cipher suite: big records as random-access chunks, others in one go.
+    const auto suite = CryptoEngine::preferred();
+    const auto format = payload.size() >= PARALLEL_SEAL_SIZE ? RecordFormat::RandomAccess : RecordFormat::Sealed;
+    std::vector<unsigned char> sealed;
+    if (format == RecordFormat::RandomAccess) {
+        const auto header = ChunkedAead::newHeader(suite);
+        sealed.resize(prefix + ChunkedAead::sealedSize(payload.size()));
+        std::copy(header.begin(), header.end(), sealed.begin() + static_cast<std::ptrdiff_t>(prefix));
+        ChunkedAead(recordKey, header).seal(0, payload, true, std::span(sealed).subspan(prefix + ChunkedAead::HEADER_SIZE));
+        sodium_memzero(recordKey.data(), recordKey.size());
+    } else {
+        const CryptoEngine engine(recordKey, suite);
+        sodium_memzero(recordKey.data(), recordKey.size());
+        const std::size_t nonceSize = engine.nonceSize();
+        sealed.resize(prefix + nonceSize + payload.size() + CryptoEngine::TAG_SIZE);
+        randombytes_buf(sealed.data() + prefix, nonceSize);
+        engine.encrypt(std::span(sealed).subspan(prefix + nonceSize), payload, std::span(sealed).subspan(prefix, nonceSize));
+    }
+    if (isCompressed) {
+        const auto header = codec.bytes();
+        std::copy(header.begin(), header.end(), sealed.begin());
+        sodium_memzero(compressed.data(), compressed.size());
+    }
+
+    return {std::move(sealed), formatWord(format, suite, codec.codec, content)};
+}
+
+WriteAheadLog::Operation EncryptedVaultStorage::sealRecord(const std::string &name, const std::string &type,
+    const StorageIndex::Salt &salt, const std::span<const unsigned char> data, const RecordContent content) {
+    const auto [sealed, format] = sealPayload(salt, data, content == RecordContent::Data ? m_compression : std::nullopt, content);
+
+    // Append to the active segment; the WAL commit syncs it before the transaction counts.
+    const auto location = m_segments.append(sealed, format);
+    m_manifestChanges.appended.insert(segmentManifestPath(location.segment));
+
+    return putOperation(name, type, salt, location);
+}
+
+void EncryptedVaultStorage::stageRecord(const std::string &name, const std::string &type, const std::vector<unsigned char> &data,
+    std::vector<WriteAheadLog::Operation> &ops, std::unordered_set<std::string> &sealedChunks) {
+    // Per-record salt.
+    StorageIndex::Salt salt {};
+    randombytes_buf(salt.data(), salt.size());
+    if (!m_deduplication || data.size() < *m_deduplication) {
+        ops.push_back(sealRecord(name, type, salt, data, RecordContent::Data));
+        return;
+    }
+
+    // Deduplicated: chunks the vault lacks become records of their own, sealed under their id; the
+    // record holds the list. A chunk sealed by a transaction not applied yet counts as there.
+    std::vector<ChunkStore::ChunkRef> refs;
+    for (std::size_t at = 0; at < data.size();) {
+        const auto rest = std::span(data).subspan(at);
+        const auto ref = m_chunks.refOf(rest.first(ChunkStore::cut(rest)));
+        const auto chunkName = ChunkStore::nameOf(ref.id);
+        if (!m_log.find(chunkName) && !m_pendingChunks.contains(chunkName) && sealedChunks.insert(chunkName).second) {
+            ops.push_back(sealRecord(chunkName, ChunkStore::TYPE, ref.id, rest.first(ref.size), RecordContent::Data));
+        }
+        refs.push_back(ref);
+        at += ref.size;
+    }
+
+    ops.push_back(sealRecord(name, type, salt, ChunkStore::encode(refs), RecordContent::ChunkList));
+}
+
+WriteAheadLog::Operation EncryptedVaultStorage::putOperation(const std::string &name, const std::string &type,
+    const StorageIndex::Salt &salt, const RecordLocation &location) {
+    WriteAheadLog::Operation op;
+    op.kind = WriteAheadLog::Operation::Kind::Put;
+    op.name = name;
+    op.id = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    op.type = type;
+    op.salt = salt;
+    op.createdAt = std::time(nullptr);
+    op.location = location;
+
+    return op;
+}
+
+void EncryptedVaultStorage::applyOperations(const std::vector<WriteAheadLog::Operation> &ops) {
+    using Kind = WriteAheadLog::Operation::Kind;
+    // Reference counts are kept from the first chunk on, counted from the index as it is before 'ops'.
+    m_hasChunks = m_hasChunks || std::any_of(ops.begin(), ops.end(), [](const WriteAheadLog::Operation &op) {
+        return op.kind == Kind::Put && ChunkStore::isChunkName(op.name);
+    });
+    const auto stopCounting = [this](const std::exception &e) {
+        // Nothing is dropped without counts. They are counted again once more chunks come in.
+        m_chunks.reset();
+        m_hasChunks = false;
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("Chunk reference counting stopped: ") + e.what());
     };
+    if (m_hasChunks && !m_chunks.counted()) {
+        try {
+            countChunks();
+        } catch (const std::exception &e) {
+            stopCounting(e);
+        }
+    }
+
+    for (const auto &op : ops) {
+        // A replaced or removed record from before segments has its own file to delete.
+        std::string legacyId;
+        std::optional<std::pair<StorageIndex::Salt, RecordLocation>> superseded;
+        if (const auto previous = m_log.find(op.name); previous && previous->location.segment == 0) {
+            legacyId.assign(previous->id);
+        } else if (previous) {
+            // Superseded segment bytes, reclaimed by compaction.
+            m_deadSinceCompaction += SegmentStore::RECORD_HEADER_SIZE + previous->location.length;
+            superseded.emplace();
+            std::copy(previous->salt.begin(), previous->salt.end(), superseded->first.begin());
+            superseded->second = previous->location;
+        }
 
-    std::ofstream idx("data/vault_store/index.json", std::ios::app);
-    if (!idx.is_open()) {
-        throw std::runtime_error("Cannot open index for append.");
+        if (op.kind == Kind::Put) {
+            m_log.put(op.name, op.id, op.type, op.salt, op.createdAt, op.location);
+        } else {
+            m_log.remove(op.name);
+        }
+
+        if (ChunkStore::isChunkName(op.name)) {
+            if (op.kind == Kind::Put) {
+                m_pendingChunks.erase(op.name);
+            } else {
+                m_chunks.forget(ChunkStore::idOf(op.name));
+            }
+        } else if (m_chunks.counted()) {
+            // The new record's chunks gain a reference before the old one's lose theirs: a record
+            // replaced by the same content keeps its chunks referenced throughout.
+            try {
+                if (op.kind == Kind::Put) {
+                    m_chunks.reference(chunksAt(op.salt, op.location));
+                }
+                if (superseded) {
+                    for (const auto &id : m_chunks.release(chunksAt(superseded->first, superseded->second))) {
+                        if (const auto chunk = m_log.find(ChunkStore::nameOf(id))) {
+                            m_deadSinceCompaction += SegmentStore::RECORD_HEADER_SIZE + chunk->location.length;
+                        }
+                    }
+                }
+            } catch (const std::exception &e) {
+                stopCounting(e);
+            }
+        }
+
+        if (!legacyId.empty()) {
+            std::error_code ec;
+            fs::remove(path(legacyId), ec);
+            m_manifestChanges.replaced.insert("vault_store/record_" + legacyId + ".bin");
+        }
+    }
+    m_manifestChanges.appended.insert("vault_store/index.log");
+}
+
+void EncryptedVaultStorage::commit(Transaction &tx) {
+    if (tx.empty()) {
+        return;
     }
-    idx << j.dump() << std::endl;
+    awaitIntegrity();
+
+    // 1. Seal records into segments and queue the transaction in the WAL.
+    std::vector<WriteAheadLog::Operation> ops;
+    ops.reserve(tx.size());
+    std::uint64_t seq = 0;
+    {
+        std::lock_guard lock(m_mutex);
+        // Whether a name exists as seen by this transaction: the index plus its own earlier operations.
+        std::unordered_map<std::string, bool> staged;
+        std::unordered_set<std::string> sealedChunks;
+        for (const auto &op : tx.m_ops) {
+            if (!op.isRemove) {
+                stageRecord(op.name, op.type, op.data, ops, sealedChunks);
+                staged[op.name] = true;
+                continue;
+            }
 
-    // 6. Update manifest (integrity) - important!
+            const auto it = staged.find(op.name);
+            if (const bool exists = it != staged.end() ? it->second : m_log.find(op.name).has_value(); !exists) {
+                throw std::runtime_error("Record does not exist: " + op.name);
+            }
+            staged[op.name] = false;
+
+            WriteAheadLog::Operation remove;
+            remove.kind = WriteAheadLog::Operation::Kind::Remove;
+            remove.name = op.name;
+            ops.push_back(std::move(remove));
+        }
+        seq = m_wal.enqueue(ops);
+        m_pendingChunks.insert(sealedChunks.begin(), sealedChunks.end());
+    }
+    tx.clear();
+
+    finishCommit(seq, ops);
+}
+
+void EncryptedVaultStorage::finishCommit(const std::uint64_t seq, const std::vector<WriteAheadLog::Operation> &ops) {
+    // 2. Group commit: one fsync for every transaction queued meanwhile.
     try {
-        std::string err;
-        // VMK available while vault is unlocked.
-        if (!ManifestWriter::update("data", m_vmk, err)) {
-            EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Manifest update after add failed: " + err);
+        m_wal.waitDurable(seq);
+    } catch (...) {
+        // The WAL failed: wake whoever waits for everything to be applied (awaitApplied).
+        std::lock_guard lock(m_mutex);
+        m_applyCv.notify_all();
+        throw;
+    }
+    // 3. Apply to the index in WAL order.
+    applyCommitted(seq, ops);
+    // 4. Update manifest (integrity) once per transaction.
+    updateManifest("commit");
+
+    maybeAutoGc();
+    maybeAutoCompact();
+}
+
+void EncryptedVaultStorage::applyCommitted(const std::uint64_t seq, const std::vector<WriteAheadLog::Operation> &ops) {
+    std::unique_lock lock(m_mutex);
+    m_applyCv.wait(lock, [&] { return m_nextApply == seq; });
+    try {
+        applyOperations(ops);
+        m_log.flush();
+    } catch (...) {
+        // The WAL still has it; replayed on next open.
+        ++m_nextApply;
+        m_applyCv.notify_all();
+        throw;
+    }
+    ++m_nextApply;
+    m_applyCv.notify_all();
+
+    if (m_wal.size() >= WAL_TRIM_SIZE && m_nextApply == m_wal.nextSeq()) {
+        m_log.sync();
+        m_wal.reset();
+    }
+}
+
+void EncryptedVaultStorage::awaitApplied(std::unique_lock<std::mutex> &lock) {
+    m_applyCv.wait(lock, [&] { return m_nextApply == m_wal.nextSeq() || m_wal.failed(); });
+    if (m_nextApply != m_wal.nextSeq()) {
+        throw StorageError("A write-ahead log commit failed; reopen the vault.");
+    }
+}
+
+void EncryptedVaultStorage::setCompression(std::optional<CompressionOptions> options) {
+    std::lock_guard lock(m_mutex);
+    m_compression = std::move(options);
+}
+
+void EncryptedVaultStorage::setDeduplication(const std::optional<std::size_t> minSize) {
+    std::lock_guard lock(m_mutex);
+    m_deduplication = minSize;
+}
+
+DictionaryReport EncryptedVaultStorage::trainDictionary() {
+    const auto started = std::chrono::steady_clock::now();
+    awaitIntegrity();
+    std::size_t maxSize = CompressionOptions {}.dictionaryMaxSize;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_compression) {
+            maxSize = m_compression->dictionaryMaxSize;
         }
+    }
+
+    // 1. Sample the small records, in plaintext.
+    DictionaryReport report;
+    std::vector<std::vector<unsigned char>> samples;
+    const auto wipeSamples = [&samples] {
+        for (auto &sample : samples) {
+            sodium_memzero(sample.data(), sample.size());
+        }
+    };
+    try {
+        for (const auto &name : list()) {
+            if (report.sampleBytes >= TRAINING_SAMPLE_BYTES) break;
+            try {
+                const auto size = recordSize(name);
+                if (size == 0 || size > maxSize) continue;
+                samples.push_back(loadRecord(name));
+                report.sampleBytes += size;
+            } catch (const std::exception &) {
+                // Removed meanwhile: nothing to learn from it.
+                std::lock_guard lock(m_mutex);
+                if (m_log.find(name)) throw;
+            }
+        }
+        report.samples = samples.size();
+
+        // 2. Train and store it; records sealed from now on use it.
+        const std::vector<std::span<const unsigned char>> spans(samples.begin(), samples.end());
+        const auto capacity = static_cast<std::size_t>(std::min<std::uint64_t>(RecordCodec::MAX_DICTIONARY_SIZE, report.sampleBytes / 10));
+        std::tie(report.id, report.size) = m_codec.train(spans, capacity);
     } catch (...) {
-        // dont failt the add if manifest update fails - just log
+        wipeSamples();
+        throw;
     }
+    wipeSamples();
+
+    if (report.id != 0) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_manifestChanges.replaced.insert(std::string("vault_store/") + RecordCodec::FILE_NAME);
+        }
+        updateManifest("dictionary training");
+    }
+
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+        "Dictionary training: " + (report.id != 0 ? "dictionary " + std::to_string(report.id) + " of " + std::to_string(report.size) + " bytes"
+            : std::string("no dictionary")) + " from " + std::to_string(report.samples) + " record(s) ("
+        + std::to_string(report.sampleBytes) + " bytes) in " + std::to_string(report.elapsed.count()) + " ms.");
+
+    return report;
+}
+
+void EncryptedVaultStorage::setAutoCompaction(std::optional<CompactionOptions> options) {
+    std::lock_guard lock(m_mutex);
+    m_autoCompaction = std::move(options);
+}
+
+void EncryptedVaultStorage::maybeAutoCompact() {
+    std::optional<CompactionOptions> options;
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_autoCompaction || m_deadSinceCompaction < m_autoCompaction->minDeadBytes) {
+            return;
+        }
+        options = m_autoCompaction;
+    }
+
+    try {
+        (void) compact(*options);
+    } catch (const std::exception &e) {
+        // The commit itself succeeded; compaction is retried after later commits.
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("Incremental compaction failed: ") + e.what());
+    }
+}
+
+void EncryptedVaultStorage::setAutoGc(std::optional<double> deadFraction) {
+    std::lock_guard lock(m_mutex);
+    m_autoGc = deadFraction;
+}
+
+void EncryptedVaultStorage::maybeAutoGc() {
+    std::optional<double> threshold;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_autoGcChecked || !m_autoGc) {
+            return;
+        }
+        m_autoGcChecked = true;
+        threshold = m_autoGc;
+    }
+
+    try {
+        const auto report = collectGarbage(GcOptions {true, false});
+        if (report.space.deadFraction() < *threshold) {
+            return;
+        }
+
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+            "Store is " + std::to_string(static_cast<int>(report.space.deadFraction() * 100)) + "% dead, collecting garbage.");
+        (void) collectGarbage(GcOptions {});
+        if (report.space.deadBytes > 0) {
+            (void) compact(CompactionOptions {});
+        }
+    } catch (const std::exception &e) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn, std::string("Automatic garbage collection failed: ") + e.what());
+    }
+}
+
+GcReport EncryptedVaultStorage::collectGarbage(const GcOptions &options) {
+    const auto started = std::chrono::steady_clock::now();
+    awaitIntegrity();
+    GcReport report;
+    {
+        std::unique_lock lock(m_mutex);
+        // Records sealed by transactions not yet applied look unreferenced: let them land first.
+        awaitApplied(lock);
+        m_log.flush();
+
+        StorageIndex live;
+        m_log.snapshot(live);
+        report.space = GarbageCollector::scan("data/vault_store", live, m_segments.openSegments());
+
+        if (!options.dryRun && !report.space.orphans.empty()) {
+            if (options.quarantine) {
+                report.quarantineDir = "data/quarantine/" + std::to_string(std::time(nullptr));
+            }
+            report.bytesRemoved = GarbageCollector::sweep("data/vault_store", report.space, report.quarantineDir, report.filesRemoved);
+            for (const auto &orphan : report.space.orphans) {
+                m_manifestChanges.replaced.insert("vault_store/" + orphan.name);
+            }
+        }
+    }
+
+    updateManifest("garbage collection");
+
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    if (!options.dryRun) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+            "GC: " + std::to_string(report.filesRemoved) + " orphan file(s) " + (options.quarantine ? "quarantined" : "removed")
+            + ", " + std::to_string(report.space.liveBytes) + " bytes live, " + std::to_string(report.space.deadBytes)
+            + " bytes dead in segments, in " + std::to_string(report.elapsed.count()) + " ms.");
+    }
+
+    return report;
+}
+
+std::map<std::uint32_t, EncryptedVaultStorage::SegmentUsage> EncryptedVaultStorage::segmentUsage(const StorageIndex &index) const {
+    std::map<std::uint32_t, SegmentUsage> usage;
+    for (const auto id : m_segments.segmentIds()) {
+        std::error_code ec;
+        const auto size = fs::file_size(m_segments.segmentPath(id), ec);
+        usage[id].fileBytes = ec ? 0 : size;
+    }
+
+    for (const auto &entry : index.entries()) {
+        if (entry.location.segment != 0) {
+            usage[entry.location.segment].liveBytes += SegmentStore::RECORD_HEADER_SIZE + entry.location.length;
+        }
+    }
+
+    return usage;
+}
+
+CompactionReport EncryptedVaultStorage::compact(const CompactionOptions &options) {
+    const auto started = std::chrono::steady_clock::now();
+    awaitIntegrity();
+    CompactionReport report;
+
+    // 1. Pick segments and copy their live records forward.
+    std::vector<std::uint32_t> victims;
+    std::vector<WriteAheadLog::Operation> ops;
+    std::uint64_t victimBytes = 0;
+    std::uint64_t movedBytes = 0;
+    std::uint64_t indexBefore = 0;
+    std::uint64_t seq = 0;
+    {
+        std::unique_lock lock(m_mutex);
+        // Relocations must not overtake transactions still waiting to be applied.
+        awaitApplied(lock);
+        m_log.flush();
+        std::error_code ec;
+        indexBefore = fs::file_size(indexPath(), ec);
+
+        StorageIndex live;
+        m_log.snapshot(live);
+        // Chunks nothing references or holds any more go first: their bytes are dead from here on.
+        if (m_hasChunks) {
+            if (!m_chunks.counted()) {
+                countChunks();
+            }
+            std::vector<std::string> dropped;
+            for (const auto &entry : live.entries()) {
+                if (ChunkStore::isChunkName(entry.name) && !m_chunks.inUse(ChunkStore::idOf(entry.name))) {
+                    dropped.emplace_back(entry.name);
+                }
+            }
+            for (const auto &name : dropped) {
+                (void) live.erase(name);
+                WriteAheadLog::Operation remove;
+                remove.kind = WriteAheadLog::Operation::Kind::Remove;
+                remove.name = name;
+                ops.push_back(std::move(remove));
+            }
+            report.chunksDropped = dropped.size();
+        }
+
+        for (const auto &[id, usage] : segmentUsage(live)) {
+            // A record is still being streamed in; it is referenced once its transaction commits.
+            if (m_segments.isStreaming(id)) continue;
+            const std::uint64_t payload = usage.fileBytes > SegmentStore::HEADER_SIZE ? usage.fileBytes - SegmentStore::HEADER_SIZE : 0;
+            const std::uint64_t dead = payload > usage.liveBytes ? payload - usage.liveBytes : 0;
+            if (dead == 0 || dead < options.minDeadBytes || static_cast<double>(dead) < options.minDeadRatio * static_cast<double>(payload)) {
+                continue;
+            }
+
+            victims.push_back(id);
+            victimBytes += usage.fileBytes;
+            if (options.maxSegments != 0 && victims.size() >= options.maxSegments) break;
+        }
+
+        std::vector<const StorageIndex::Entry *> moving;
+        for (const auto &entry : live.entries()) {
+            if (std::find(victims.begin(), victims.end(), entry.location.segment) != victims.end()) {
+                moving.push_back(&entry);
+            }
+        }
+
+        // Victims without live records are just deleted; a fresh segment would stay behind empty.
+        if (!moving.empty()) {
+            // Never copy records into a segment that is about to be deleted.
+            if (std::find(victims.begin(), victims.end(), m_segments.activeId()) != victims.end()
+                || m_segments.activeId() == 0) {
+                m_segments.rollover();
+            }
+
+            for (const auto *const moved : moving) {
+                const auto &entry = *moved;
+                WriteAheadLog::Operation op;
+                op.kind = WriteAheadLog::Operation::Kind::Put;
+                op.name = entry.name;
+                op.id = entry.id;
+                op.type = entry.type;
+                op.salt = entry.salt;
+                op.createdAt = entry.createdAt;
+                op.location = m_segments.copy(entry.location);
+                m_manifestChanges.appended.insert(segmentManifestPath(op.location.segment));
+                movedBytes += SegmentStore::RECORD_HEADER_SIZE + op.location.length;
+                ops.push_back(std::move(op));
+            }
+        }
+
+        if (!ops.empty()) {
+            seq = m_wal.enqueue(ops);
+        }
+    }
+
+    // 2. Commit the new locations like any other transaction.
+    if (!ops.empty()) {
+        m_wal.waitDurable(seq);
+        applyCommitted(seq, ops);
+    }
+
+    // 3. Old segments are unreferenced now (and the WAL can redo the move): delete them.
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto id : victims) {
+            m_segments.removeSegment(id);
+            m_manifestChanges.replaced.insert(segmentManifestPath(id));
+        }
+        report.segmentsRewritten = victims.size();
+        report.recordsMoved = ops.size() - report.chunksDropped;
+        report.storeBytesReclaimed = victimBytes > movedBytes ? victimBytes - movedBytes : 0;
+
+        if (options.compactIndex) {
+            m_log.compact();
+            m_manifestChanges.replaced.insert("vault_store/index.log");
+            std::error_code ec;
+            const auto after = fs::file_size(indexPath(), ec);
+            report.indexBytesReclaimed = indexBefore > after ? indexBefore - after : 0;
+        }
+
+        m_deadSinceCompaction = 0;
+    }
+
+    // index.log is rewritten (new nonces) even when it does not shrink.
+    updateManifest("compaction");
+
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+        "Compaction: " + std::to_string(report.segmentsRewritten) + " segment(s), " + std::to_string(report.recordsMoved)
+        + " record(s) moved, " + std::to_string(report.chunksDropped) + " chunk(s) dropped, " + std::to_string(report.reclaimedBytes()) + " bytes reclaimed in "
+        + std::to_string(report.elapsed.count()) + " ms.");
+
+    return report;
+}
+
+std::size_t EncryptedVaultStorage::addRecords(const std::span<const NewRecord> records) {
+    Transaction tx;
+    for (const auto &record : records) {
+        tx.add(record.name, record.type, record.data);
+    }
+    commit(tx);
+
+    return records.size();
+}
+
+std::size_t EncryptedVaultStorage::removeRecords(const std::span<const std::string> names) {
+    Transaction tx;
+    for (const auto &name : names) {
+        tx.remove(name);
+    }
+    commit(tx);
+
+    return names.size();
+}
+
+bool EncryptedVaultStorage::addRecord(const std::string &name, const std::string &type, std::vector<unsigned char> &data) {
+    Transaction tx;
+    tx.add(name, type, data);
+    commit(tx);
 
     return true;
 }
 
+std::uint64_t EncryptedVaultStorage::addRecordFrom(const std::string &name, const std::string &type, std::istream &in) {
+    return addStreamed(name, type, [&in](const std::span<unsigned char> buffer) {
+        in.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (in.bad()) {
+            throw std::runtime_error("Read failed.");
+        }
+        return static_cast<std::size_t>(in.gcount());
+    });
+}
+
+std::uint64_t EncryptedVaultStorage::addRecordFrom(const std::string &name, const std::string &type, const int fd) {
+    return addStreamed(name, type, [fd](const std::span<unsigned char> buffer) {
+        return readFd(fd, buffer);
+    });
+}
+
+std::uint64_t EncryptedVaultStorage::addStreamed(const std::string &name, const std::string &type,
+    const std::function<std::size_t(std::span<unsigned char>)> &read) {
+    checkRecordName(name);
+    awaitIntegrity();
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_deduplication) {
+            const auto minSize = *m_deduplication;
+            const auto compression = m_compression;
+            lock.unlock();
+            return addDeduplicated(name, type, read, minSize, compression);
+        }
+    }
+
+    // 1. Per-record salt and key, as for sealed records.
+    StorageIndex::Salt salt {};
+    randombytes_buf(salt.data(), salt.size());
+    auto recordKey = deriveRecordKey(m_vmk, std::vector<unsigned char>(salt.begin(), salt.end()));
+    const auto header = ChunkedAead::newHeader();
+    const ChunkedAead aead(recordKey, header);
+    sodium_memzero(recordKey.data(), recordKey.size());
+
+    // 2. Seal batches of chunks on all cores into a segment of their own, without the lock.
+    SegmentStore::StreamWriter writer;
+    {
+        std::lock_guard lock(m_mutex);
+        writer = m_segments.beginStream(formatWord(RecordFormat::RandomAccess, aead.suite()));
+    }
+
+    std::vector<unsigned char> plain(STREAM_BATCH_CHUNKS * ChunkedAead::CHUNK_SIZE);
+    std::vector<unsigned char> sealed(STREAM_BATCH_CHUNKS * ChunkedAead::SEALED_CHUNK_SIZE);
+    std::uint64_t total = 0;
+    RecordLocation location;
+    try {
+        writer.write(header);
+        for (bool last = false; !last;) {
+            // A short batch (possibly empty) ends the record.
+            std::size_t filled = 0;
+            while (filled < plain.size()) {
+                const auto got = read(std::span(plain).subspan(filled));
+                if (got == 0) break;
+                filled += got;
+            }
+            last = filled < plain.size();
+
+            const auto sealedBytes = aead.seal(total / ChunkedAead::CHUNK_SIZE, std::span(plain.data(), filled), last, sealed);
+            writer.write(std::span(sealed.data(), sealedBytes));
+            total += filled;
+        }
+        location = writer.finish();
+    } catch (...) {
+        sodium_memzero(plain.data(), plain.size());
+        std::lock_guard lock(m_mutex);
+        m_segments.endStream(writer.segment(), true);
+        throw;
+    }
+    sodium_memzero(plain.data(), plain.size());
+
+    // 3. Commit it like a one-record transaction.
+    const std::vector ops {putOperation(name, type, salt, location)};
+    std::uint64_t seq = 0;
+    {
+        std::lock_guard lock(m_mutex);
+        m_manifestChanges.appended.insert(segmentManifestPath(location.segment));
+        seq = m_wal.enqueue(ops);
+        // Referenced by a queued transaction now: GC and compaction wait for it to apply.
+        m_segments.endStream(location.segment, false);
+    }
+    finishCommit(seq, ops);
+
+    return total;
+}
+
+std::uint64_t EncryptedVaultStorage::addDeduplicated(const std::string &name, const std::string &type,
+    const std::function<std::size_t(std::span<unsigned char>)> &read, const std::size_t minSize,
+    const std::optional<CompressionOptions> &compression) {
+    std::vector<unsigned char> buffer(STREAM_BATCH_CHUNKS * ChunkedAead::CHUNK_SIZE);
+    // Fill 'buffer' past its first 'filled' bytes, up to its end or the end of input.
+    const auto fill = [&](std::size_t filled) {
+        while (filled < buffer.size()) {
+            const auto got = read(std::span(buffer).subspan(filled));
+            if (got == 0) break;
+            filled += got;
+        }
+        return filled;
+    };
+
+    // 1. Input shorter than the threshold is an ordinary record.
+    std::size_t filled = 0;
+    try {
+        filled = fill(0);
+    } catch (...) {
+        sodium_memzero(buffer.data(), buffer.size());
+        throw;
+    }
+    bool last = filled < buffer.size();
+    if (last && filled < minSize) {
+        Transaction tx;
+        tx.add(name, type, std::vector(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(filled)));
+        sodium_memzero(buffer.data(), buffer.size());
+        commit(tx);
+        return filled;
+    }
+
+    // 2. Cut chunks as the input comes, without the lock: new ones go to a segment of their own, known ones are held.
+    StorageIndex::Salt salt {};
+    randombytes_buf(salt.data(), salt.size());
+    SegmentStore::StreamWriter writer;
+    {
+        std::lock_guard lock(m_mutex);
+        writer = m_segments.beginStream(formatWord(RecordFormat::Sealed, CryptoEngine::preferred(), RecordCodec::Codec::None,
+            RecordContent::ChunkList));
+    }
+
+    std::vector<ChunkStore::ChunkRef> refs;
+    std::vector<WriteAheadLog::Operation> ops;
+    std::unordered_set<std::string> seen;
+    std::unordered_set<std::string> sealedChunks;
+    std::vector<ChunkStore::ChunkId> held;
+    const auto unhold = [&] {
+        for (const auto &id : held) {
+            m_chunks.unhold(id);
+        }
+    };
+    std::uint64_t total = 0;
+    RecordLocation location;
+    try {
+        for (;;) {
+            // First sight of a chunk in this record: where it starts in 'buffer', its ref and name.
+            struct Cut {
+                std::size_t at;
+                ChunkStore::ChunkRef ref;
+                std::string name;
+                bool fresh = false;
+            };
+            std::vector<Cut> cuts;
+            std::size_t at = 0;
+            // A chunk may only end short of MAX_CHUNK where the input does.
+            while (filled - at >= ChunkStore::MAX_CHUNK || (last && at < filled)) {
+                const auto rest = std::span(buffer).subspan(at, filled - at);
+                const auto ref = m_chunks.refOf(rest.first(ChunkStore::cut(rest)));
+                if (auto chunkName = ChunkStore::nameOf(ref.id); seen.insert(chunkName).second) {
+                    cuts.push_back({at, ref, std::move(chunkName)});
+                }
+                refs.push_back(ref);
+                at += ref.size;
+            }
+
+            {
+                std::lock_guard lock(m_mutex);
+                for (auto &cut : cuts) {
+                    cut.fresh = !m_log.find(cut.name) && !m_pendingChunks.contains(cut.name);
+                    if (!cut.fresh) {
+                        m_chunks.hold(cut.ref.id);
+                        held.push_back(cut.ref.id);
+                    }
+                }
+            }
+            for (const auto &cut : cuts) {
+                if (!cut.fresh) continue;
+                const auto [sealed, format] = sealPayload(cut.ref.id, std::span(buffer).subspan(cut.at, cut.ref.size), compression,
+                    RecordContent::Data);
+                writer.write(sealed);
+                ops.push_back(putOperation(cut.name, ChunkStore::TYPE, cut.ref.id, writer.next(format)));
+                sealedChunks.insert(cut.name);
+            }
+
+            // The uncut tail goes in front of the next batch.
+            total += at;
+            std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(at), buffer.begin() + static_cast<std::ptrdiff_t>(filled), buffer.begin());
+            filled -= at;
+            if (last) break;
+            filled = fill(filled);
+            last = filled < buffer.size();
+        }
+
+        const auto [sealed, format] = sealPayload(salt, ChunkStore::encode(refs), std::nullopt, RecordContent::ChunkList);
+        writer.write(sealed);
+        location = writer.finish(format);
+    } catch (...) {
+        sodium_memzero(buffer.data(), buffer.size());
+        std::lock_guard lock(m_mutex);
+        unhold();
+        m_segments.endStream(writer.segment(), true);
+        throw;
+    }
+    sodium_memzero(buffer.data(), buffer.size());
+
+    // 3. Commit the new chunks and the record as one transaction.
+    ops.push_back(putOperation(name, type, salt, location));
+    std::uint64_t seq = 0;
+    {
+        std::lock_guard lock(m_mutex);
+        m_manifestChanges.appended.insert(segmentManifestPath(location.segment));
+        seq = m_wal.enqueue(ops);
+        m_pendingChunks.insert(sealedChunks.begin(), sealedChunks.end());
+        // Referenced by a queued transaction now: GC and compaction wait for it to apply.
+        unhold();
+        m_segments.endStream(location.segment, false);
+    }
+    finishCommit(seq, ops);
+
+    return total;
+}
+
 std::vector<unsigned char> EncryptedVaultStorage::loadRecord(const std::string &name) {
-    std::ifstream idx("data/vault_store/index.json");
-    if (!idx.is_open()) {
-        throw std::runtime_error("Index file not found.");
+    const auto record = mapRecord(name);
+    if (record.content == RecordContent::ChunkList) {
+        const auto refs = chunkList(record);
+        std::vector<unsigned char> plain(static_cast<std::size_t>(ChunkStore::totalSize(refs)));
+        loadChunks(refs, plain);
+        return plain;
     }
-    std::string line;
-    std::string id;
-    std::vector<unsigned char> recordSalt;
-
-    while (std::getline(idx, line)) {
-        strip_cr(line);
-        json j;
-        if (!safeParseLine(line, j)) continue;
-
-        // Safely read name and compare
-        if (const auto n = j.value("name", std::string{}); n == name) {
-            id = j.value("id", std::string{});
-            if (j.contains("salt_b64")) {
-                recordSalt = base64Decode(j.value("salt_b64", std::string{}));
-            } else {
-                // backward compatibility: if old record (no salt), treat as error
-                throw std::runtime_error("Record has no salt (old format).");
+
+    std::vector<unsigned char> plain(static_cast<std::size_t>(record.size));
+    decryptMapped(name, record, plain);
+
+    return plain;
+}
+
+std::uint64_t EncryptedVaultStorage::recordSize(const std::string &name) const {
+    {
+        std::lock_guard lock(m_mutex);
+        const auto entry = m_log.find(name);
+        if (!entry) {
+            throw std::runtime_error("Record does not exist.");
+        }
+
+        if (entry->location.segment == 0) {
+            // Record written before segments existed: Sealed, XChaCha20-Poly1305.
+            const auto file = path(std::string(entry->id));
+            std::error_code ec;
+            const auto size = fs::file_size(file, ec);
+            if (ec) {
+                throw std::runtime_error("Cannot open record file. Not found: " + file);
             }
-            break;
+            return plainSizeOf(size, RecordFormat::Sealed, CipherSuite::XChaCha20Poly1305);
+        }
+
+        RecordFormat format = RecordFormat::Sealed;
+        CipherSuite suite = CipherSuite::XChaCha20Poly1305;
+        RecordCodec::Codec codec = RecordCodec::Codec::None;
+        RecordContent content = RecordContent::Data;
+        parseFormat(m_segments.format(entry->location), format, suite, codec, content);
+        if (codec != RecordCodec::Codec::None) {
+            // Compressed: the size is in the header in front of the sealed bytes.
+            const auto &location = entry->location;
+            const auto file = m_segments.map(location.segment, location.offset + RecordCodec::Header::SIZE);
+            return codecHeaderOf(std::span(file->data() + location.offset, std::min<std::size_t>(location.length, RecordCodec::Header::SIZE)),
+                codec).size;
+        }
+        if (content == RecordContent::Data) {
+            return plainSizeOf(entry->location.length, format, suite);
         }
     }
 
-    idx.close();
+    // Deduplicated: the sum of its chunks, from the decrypted list.
+    return ChunkStore::totalSize(chunkList(mapRecord(name)));
+}
 
-    if (id.empty()) {
-        throw std::runtime_error("Record does not exist.");
+std::size_t EncryptedVaultStorage::loadRecordInto(const std::string &name, const std::span<unsigned char> out) {
+    const auto record = mapRecord(name);
+    std::vector<ChunkStore::ChunkRef> refs;
+    if (record.content == RecordContent::ChunkList) {
+        refs = chunkList(record);
+    }
+    const auto size = record.content == RecordContent::ChunkList ? ChunkStore::totalSize(refs) : record.size;
+    if (out.size() < size) {
+        throw std::invalid_argument("loadRecordInto: buffer of " + std::to_string(out.size()) + " bytes for a record of "
+            + std::to_string(size) + ".");
     }
 
-    // Derive record key
-    auto recordKey = deriveRecordKey(m_vmk, recordSalt);
-    // Open record file
-    std::ifstream ifs(path(id), std::ios::binary);
-    if (!ifs.is_open()) {
-        throw std::runtime_error("Cannot open record file. Not found: " + path(id));
+    const auto plain = out.first(static_cast<std::size_t>(size));
+    if (record.content == RecordContent::ChunkList) {
+        loadChunks(refs, plain);
+    } else {
+        decryptMapped(name, record, plain);
     }
+    return plain.size();
+}
 
-    ifs.seekg(0, std::ios::end);
-    const auto sz = static_cast<size_t>(ifs.tellg());
-    ifs.seekg(0);
-    if (sz < crypto_aead_xchacha20poly1305_ietf_NPUBBYTES) {
-        throw std::runtime_error("Record file corrupted: too small.");
+std::vector<unsigned char> EncryptedVaultStorage::loadRecordRange(const std::string &name, const std::uint64_t offset,
+    const std::size_t length) {
+    const std::uint64_t end = length > UINT64_MAX - offset ? UINT64_MAX : offset + length;
+    auto record = openRecord(name);
+    std::vector<unsigned char> range;
+    (void) decryptRecord(record, offset, end, [&](const std::uint64_t at, const std::span<const unsigned char> piece) {
+        const auto from = std::max(at, offset);
+        const auto to = std::min(at + piece.size(), end);
+        if (from < to) {
+            range.insert(range.end(), piece.begin() + static_cast<std::ptrdiff_t>(from - at),
+                piece.begin() + static_cast<std::ptrdiff_t>(to - at));
+        }
+    });
+
+    return range;
+}
+
+std::uint64_t EncryptedVaultStorage::loadRecordTo(const std::string &name, std::ostream &out) {
+    auto record = openRecord(name);
+    return decryptRecord(record, 0, UINT64_MAX, [&out](std::uint64_t, const std::span<const unsigned char> piece) {
+        if (!out.write(reinterpret_cast<const char *>(piece.data()), static_cast<std::streamsize>(piece.size()))) {
+            throw std::runtime_error("Write failed.");
+        }
+    });
+}
+
+std::uint64_t EncryptedVaultStorage::loadRecordTo(const std::string &name, const int fd) {
+    auto record = openRecord(name);
+    return decryptRecord(record, 0, UINT64_MAX, [fd](std::uint64_t, const std::span<const unsigned char> piece) {
+        writeFd(fd, piece);
+    });
+}
+
+EncryptedVaultStorage::MappedRecord EncryptedVaultStorage::mapRecord(const std::string &name) const {
+    MappedRecord record;
+    RecordLocation location;
+    std::string legacyId;
+    {
+        std::lock_guard lock(m_mutex);
+        const auto entry = m_log.find(name);
+        if (!entry) {
+            throw std::runtime_error("Record does not exist.");
+        }
+        std::copy(entry->salt.begin(), entry->salt.end(), record.salt.begin());
+        location = entry->location;
+        if (location.segment == 0) {
+            legacyId.assign(entry->id);
+        }
+    }
+    verifyRecordFile(legacyId, location);
+
+    if (location.segment == 0) {
+        // Record written before segments existed: Sealed, XChaCha20-Poly1305.
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(path(legacyId))) {
+            throw std::runtime_error("Cannot open record file. Not found: " + path(legacyId));
+        }
+        record.sealed = std::span(file->data(), file->size());
+        record.size = plainSizeOf(record.sealed.size(), record.format, record.suite);
+        record.file = std::move(file);
+        return record;
     }
 
-    std::vector<unsigned char> nonce(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
-    ifs.read(reinterpret_cast<char*>(nonce.data()), nonce.size());
-    std::vector<unsigned char> cipherText((std::istreambuf_iterator<char>(ifs)), {});
-    ifs.close();
+    std::lock_guard lock(m_mutex);
+    return mapLocation(record.salt, location);
+}
 
-    std::vector<unsigned char> decrypted(cipherText.size());
-    unsigned long long decryptedLength = 0;
-    if (crypto_aead_xchacha20poly1305_ietf_decrypt(
-        decrypted.data(),
-        &decryptedLength,
-        nullptr,
-        cipherText.data(),
-        cipherText.size(),
-        nullptr,
-        0 ,
-        nonce.data(),
-        recordKey.data()
-        ) != 0) {
-        throw std::runtime_error("Failed to decrypt record.");
+EncryptedVaultStorage::MappedRecord EncryptedVaultStorage::mapLocation(const StorageIndex::Salt &salt, const RecordLocation &location) const {
+    MappedRecord record;
+    record.salt = salt;
+    RecordCodec::Codec codec = RecordCodec::Codec::None;
+    parseFormat(m_segments.format(location), record.format, record.suite, codec, record.content);
+    record.file = m_segments.map(location.segment, location.offset + location.length);
+    record.sealed = std::span(record.file->data() + location.offset, static_cast<std::size_t>(location.length));
+    if (codec != RecordCodec::Codec::None) {
+        record.codec = codecHeaderOf(record.sealed, codec);
+        record.sealed = record.sealed.subspan(RecordCodec::Header::SIZE);
+        record.size = record.codec.size;
+    } else {
+        record.size = plainSizeOf(record.sealed.size(), record.format, record.suite);
     }
 
-    decrypted.resize(decryptedLength);
-    return decrypted;
+    return record;
 }
 
-std::vector<std::string> EncryptedVaultStorage::list() const {
-    std::vector<std::string> records;
-    std::ifstream idx("data/vault_store/index.json");
-    if (!idx.is_open()) return records;
-    std::string line;
-    while (std::getline(idx, line)) {
-        strip_cr(line);
-        json j;
-        if (!safeParseLine(line, j)) continue;
+EncryptedVaultStorage::MappedRecord EncryptedVaultStorage::mapChunk(const ChunkStore::ChunkRef &ref) const {
+    auto chunk = mapRecord(ChunkStore::nameOf(ref.id));
+    if (chunk.content != RecordContent::Data || chunk.size != ref.size) {
+        throw std::runtime_error("Record has a corrupted chunk.");
+    }
 
-        // There is no name or be as string
-        if (j.contains("name") && j["name"].is_string()) {
-            records.push_back(j["name"].get<std::string>());
+    return chunk;
+}
+
+std::vector<ChunkStore::ChunkRef> EncryptedVaultStorage::chunkList(const MappedRecord &record) const {
+    std::vector<unsigned char> list(static_cast<std::size_t>(record.size));
+    openMapped(record, list);
+
+    return ChunkStore::decode(list);
+}
+
+std::vector<ChunkStore::ChunkRef> EncryptedVaultStorage::chunkList(const OpenRecord &record) const {
+    std::vector<unsigned char> list;
+    (void) decryptBody(record, 0, UINT64_MAX, [&list](std::uint64_t, const std::span<const unsigned char> piece) {
+        list.insert(list.end(), piece.begin(), piece.end());
+    });
+
+    return ChunkStore::decode(list);
+}
+
+std::vector<ChunkStore::ChunkRef> EncryptedVaultStorage::chunksAt(const StorageIndex::Salt &salt, const RecordLocation &location) const {
+    if (location.segment == 0) {
+        return {};
+    }
+    RecordFormat format = RecordFormat::Sealed;
+    CipherSuite suite = CipherSuite::XChaCha20Poly1305;
+    RecordCodec::Codec codec = RecordCodec::Codec::None;
+    RecordContent content = RecordContent::Data;
+    parseFormat(m_segments.format(location), format, suite, codec, content);
+    if (content != RecordContent::ChunkList) {
+        return {};
+    }
+
+    return chunkList(mapLocation(salt, location));
+}
+
+void EncryptedVaultStorage::countChunks() {
+    StorageIndex live;
+    m_log.snapshot(live);
+    std::vector<std::vector<ChunkStore::ChunkRef>> lists;
+    for (const auto &entry : live.entries()) {
+        if (ChunkStore::isChunkName(entry.name)) continue;
+        if (auto refs = chunksAt(entry.salt, entry.location); !refs.empty()) {
+            lists.push_back(std::move(refs));
         }
     }
+    m_chunks.count(lists);
+}
 
-    return records;
+void EncryptedVaultStorage::loadChunks(const std::span<const ChunkStore::ChunkRef> refs, const std::span<unsigned char> plain) const {
+    std::size_t at = 0;
+    try {
+        for (const auto &ref : refs) {
+            decryptMapped(ChunkStore::nameOf(ref.id), mapChunk(ref), plain.subspan(at, ref.size));
+            at += ref.size;
+        }
+    } catch (...) {
+        sodium_memzero(plain.data(), plain.size());
+        throw;
+    }
 }
 
-bool EncryptedVaultStorage::remove(const std::string &name) {
-    // 1. Read all lines, find record by name
-    const std::string idxPath = "data/vault_store/index.json";
-    std::ifstream idx(idxPath);
-    if (!idx.is_open()) {
-        throw std::runtime_error("Index file not found.");
+std::uint64_t EncryptedVaultStorage::decryptChunks(const std::span<const ChunkStore::ChunkRef> refs, const std::uint64_t from,
+    const std::uint64_t to, const PlainSink &write) const {
+    std::vector<unsigned char> plain(ChunkStore::MAX_CHUNK);
+    std::uint64_t at = 0;
+    std::uint64_t total = 0;
+    try {
+        for (const auto &ref : refs) {
+            if (at >= to) break;
+            if (at + ref.size > from) {
+                const auto piece = std::span(plain).first(ref.size);
+                decryptMapped(ChunkStore::nameOf(ref.id), mapChunk(ref), piece);
+                write(at, piece);
+                total += ref.size;
+            }
+            at += ref.size;
+        }
+    } catch (...) {
+        sodium_memzero(plain.data(), plain.size());
+        throw;
     }
+    sodium_memzero(plain.data(), plain.size());
+
+    return total;
+}
 
-    std::vector<json> records;
-    std::string line;
-    std::string targetId;
-    while (std::getline(idx, line)) {
-        if (line.empty()) continue;
-        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-        auto j = json::parse(line);
-        if (j["name"] == name) {
-            targetId = j["id"];
-            continue; // skip to delete
+void EncryptedVaultStorage::decryptMapped(const std::string &name, const MappedRecord &record, const std::span<unsigned char> plain) const {
+    if (record.format == RecordFormat::Chunked) {
+        // secretstream records only open front to back, through the streaming path.
+        try {
+            (void) decryptRecord(openRecord(name), 0, UINT64_MAX, [plain](const std::uint64_t at, const std::span<const unsigned char> piece) {
+                if (at + piece.size() > plain.size()) {
+                    throw std::runtime_error("Record file corrupted: longer than its size.");
+                }
+                std::copy(piece.begin(), piece.end(), plain.begin() + static_cast<std::ptrdiff_t>(at));
+            });
+        } catch (...) {
+            sodium_memzero(plain.data(), plain.size());
+            throw;
         }
-        records.push_back(j);
+        return;
+    }
+
+    if (record.codec.codec == RecordCodec::Codec::None) {
+        openMapped(record, plain);
+        return;
+    }
+
+    // Compressed: opened into a buffer of this thread, kept for its next record unless big and
+    // wiped after each use, then decompressed into 'plain'.
+    thread_local std::vector<unsigned char> scratch;
+    std::vector<unsigned char> large;
+    const auto compressedSize = static_cast<std::size_t>(plainSizeOf(record.sealed.size(), record.format, record.suite));
+    auto &compressed = compressedSize <= PARALLEL_SEAL_SIZE ? scratch : large;
+    compressed.resize(compressedSize);
+    try {
+        openMapped(record, compressed);
+        m_codec.decompress(record.codec, compressed, plain);
+    } catch (...) {
+        sodium_memzero(compressed.data(), compressed.size());
+        sodium_memzero(plain.data(), plain.size());
+        throw;
     }
+    sodium_memzero(compressed.data(), compressed.size());
+}
 
-    idx.close();
+void EncryptedVaultStorage::openMapped(const MappedRecord &record, const std::span<unsigned char> plain) const {
+    // Straight from the mapping into 'plain': nothing else is allocated for a Sealed record.
+    std::array<unsigned char, crypto_auth_hmacsha256_BYTES> recordKey {};
+    recordKeyOf(m_vmk, record.salt, record.codec, recordKey);
+    bool authentic = true;
+    try {
+        if (record.format == RecordFormat::Sealed) {
+            const CryptoEngine engine(recordKey, record.suite);
+            const auto nonceSize = engine.nonceSize();
+            authentic = engine.decrypt(plain, record.sealed.subspan(nonceSize), record.sealed.first(nonceSize));
+        } else {
+            ChunkedAead::Header header {};
+            std::copy_n(record.sealed.begin(), header.size(), header.begin());
+            (void) ChunkedAead(recordKey, header).open(0, record.sealed.subspan(ChunkedAead::HEADER_SIZE), true, plain);
+        }
+    } catch (...) {
+        sodium_memzero(recordKey.data(), recordKey.size());
+        sodium_memzero(plain.data(), plain.size());
+        throw;
+    }
+    sodium_memzero(recordKey.data(), recordKey.size());
 
-    if (targetId.empty()) {
-        throw std::runtime_error("Record does not exist: " + name);
+    if (!authentic) {
+        sodium_memzero(plain.data(), plain.size());
+        throw std::runtime_error("Failed to decrypt record.");
     }
+}
 
-    // 2. Rewrite index.json
+EncryptedVaultStorage::OpenRecord EncryptedVaultStorage::openRecord(const std::string &name) const {
+    OpenRecord record;
+    std::string id;
     {
-        std::ofstream idxOut("data/vault_store/index.json", std::ios::binary | std::ios::trunc);
-        for (auto &l : records) {
-            idxOut << l << "\n";
+        std::lock_guard lock(m_mutex);
+        if (!lookup(name, id, record.salt, record.location)) {
+            throw std::runtime_error("Record does not exist.");
         }
     }
+    // Outside the lock: a segment can take a while to hash. Writers wait for the pass,
+    // so the file cannot change in between.
+    verifyRecordFile(id, record.location);
 
-    // 3. Delete corresponding encrypted file
-    if (std::string recordPath = path(targetId); fs::exists(recordPath)) {
-        fs::remove(recordPath);
+    std::lock_guard lock(m_mutex);
+    if (record.location.segment != 0) {
+        RecordCodec::Codec codec = RecordCodec::Codec::None;
+        parseFormat(m_segments.format(record.location), record.format, record.suite, codec, record.content);
+        if (codec != RecordCodec::Codec::None) {
+            // From here on 'location' covers the sealed bytes after the header.
+            RecordLocation header = record.location;
+            header.length = std::min<std::uint32_t>(header.length, RecordCodec::Header::SIZE);
+            record.codec = codecHeaderOf(m_segments.read(header), codec);
+            record.location.offset += RecordCodec::Header::SIZE;
+            record.location.length -= static_cast<std::uint32_t>(RecordCodec::Header::SIZE);
+        }
     }
 
+    if (record.format == RecordFormat::Sealed) {
+        // Read sealed record: nonce || ciphertext
+        record.sealed = readSealed(id, record.location);
+    } else {
+        // Read piece by piece through a handle of our own, without holding the lock.
+        record.segment = m_segments.openSegment(record.location.segment);
+        record.segment.adviseSequential();
+    }
+
+    return record;
+}
+
+std::uint64_t EncryptedVaultStorage::decryptRecord(const OpenRecord &record, const std::uint64_t from, const std::uint64_t to,
+    const PlainSink &write) const {
+    if (record.content == RecordContent::ChunkList) {
+        return decryptChunks(chunkList(record), from, to, write);
+    }
+    if (record.codec.codec == RecordCodec::Codec::None) {
+        return decryptBody(record, from, to, write);
+    }
+
+    // Compressed: decrypted and decompressed whole, whatever the range.
+    std::vector<unsigned char> compressed(static_cast<std::size_t>(plainSizeOf(record.location.length, record.format, record.suite)));
+    std::vector<unsigned char> plain;
     try {
-        // // Remove index.json without deleted record
-        // std::ofstream idxOut(idxPath, std::ios::trunc);
-        // for (const auto &rec : records) {
-        //     idxOut << rec.dump() << std::endl;
-        // }
-        // idxOut.close();
-        std::string err;
-        if (!ManifestWriter::update("data", m_vmk, err)) {
-            EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Manifest update after remove failed: " + err);
+        (void) decryptBody(record, 0, UINT64_MAX, [&compressed](const std::uint64_t at, const std::span<const unsigned char> piece) {
+            if (at + piece.size() > compressed.size()) {
+                throw std::runtime_error("Record file corrupted: longer than its size.");
+            }
+            std::copy(piece.begin(), piece.end(), compressed.begin() + static_cast<std::ptrdiff_t>(at));
+        });
+        // Authentic now, header included: its size can be trusted.
+        plain.resize(static_cast<std::size_t>(record.codec.size));
+        m_codec.decompress(record.codec, compressed, plain);
+        write(0, plain);
+    } catch (...) {
+        sodium_memzero(compressed.data(), compressed.size());
+        sodium_memzero(plain.data(), plain.size());
+        throw;
+    }
+    sodium_memzero(compressed.data(), compressed.size());
+    sodium_memzero(plain.data(), plain.size());
+
+    return plain.size();
+}
+
+std::uint64_t EncryptedVaultStorage::decryptBody(const OpenRecord &record, const std::uint64_t from, const std::uint64_t to,
+    const PlainSink &write) const {
+    // Derive record key
+    auto recordKey = deriveRecordKey(m_vmk, record.salt, record.codec);
+    std::uint64_t total = 0;
+    try {
+        switch (record.format) {
+            case RecordFormat::Sealed:
+                total = openSealed(record.sealed, recordKey, record.suite, write);
+                break;
+            case RecordFormat::Chunked:
+                total = openStream(record.segment, record.location, recordKey, write);
+                break;
+            case RecordFormat::RandomAccess:
+                total = openChunks(record.segment, record.location, recordKey, from, to, write);
+                break;
         }
     } catch (...) {
+        sodium_memzero(recordKey.data(), recordKey.size());
+        throw;
     }
+    sodium_memzero(recordKey.data(), recordKey.size());
+
+    return total;
+}
+
+std::vector<std::string> EncryptedVaultStorage::list() const {
+    return list(std::string{});
+}
+
+std::vector<std::string> EncryptedVaultStorage::list(const std::string &prefix) const {
+    std::lock_guard lock(m_mutex);
+    auto names = m_log.names(prefix);
+    // Chunks of deduplicated records are not records of the vault's own.
+    std::erase_if(names, [](const std::string &name) { return ChunkStore::isChunkName(name); });
+    return names;
+}
+
+bool EncryptedVaultStorage::remove(const std::string &name) {
+    Transaction tx;
+    tx.remove(name);
+    commit(tx);
 
     return true;
 }
 
+void EncryptedVaultStorage::setIntegrityVerification(std::shared_ptr<IntegrityVerification> verification) {
+    m_integrity = std::move(verification);
+}
+
+void EncryptedVaultStorage::awaitIntegrity() const {
+    if (m_integrity) {
+        (void) m_integrity->wait();
+    }
+}
+
+void EncryptedVaultStorage::verifyRecordFile(const std::string &id, const RecordLocation &location) const {
+    // Once the whole pass has come out clean there is nothing left to check.
+    if (!m_integrity || m_integrity->status() == IntegrityStatus::OK) {
+        return;
+    }
+
+    const auto file = location.segment != 0 ? segmentManifestPath(location.segment) : "vault_store/" + fs::path(path(id)).filename().string();
+    const auto report = m_integrity->verifyFile(file);
+    if (report.status != IntegrityStatus::OK) {
+        throw StorageError("Integrity check failed for " + file + ": " + report.message);
+    }
+}
+
+std::string EncryptedVaultStorage::segmentManifestPath(const std::uint32_t id) const {
+    return "vault_store/" + fs::path(m_segments.segmentPath(id)).filename().string();
+}
+
+void EncryptedVaultStorage::updateManifest(const std::string &after, const bool rebuild) {
+    std::lock_guard lock(m_manifestMutex);
+    try {
+        // Take what changed so far; later changes go to the next update.
+        ManifestWriter::Changes changes;
+        {
+            std::lock_guard storageLock(m_mutex);
+            std::swap(changes, m_manifestChanges);
+        }
+        if (changes.empty() && !rebuild) {
+            return;
+        }
+
+        std::string err;
+        if (!(rebuild ? m_manifest.rebuild(err) : m_manifest.update(changes, err))) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "Manifest update after " + after + " failed: " + err);
+        }
+    } catch (...) {
+        // dont fail the operation if manifest update fails - just log
+    }
+}
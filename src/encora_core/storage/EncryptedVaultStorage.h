@@ -1,29 +1,406 @@
 #ifndef CORE_STORAGE_ENCRYPTED_VAULT_STORAGE_H
 #define CORE_STORAGE_ENCRYPTED_VAULT_STORAGE_H
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "ChunkStore.h"
+#include "CryptoEngine.h"
+#include "GarbageCollector.h"
+#include "IndexLog.h"
+#include "RecordCodec.h"
+#include "SegmentStore.h"
+#include "WriteAheadLog.h"
+#include "security/IntegrityChecker.h"
+#include "security/ManifestWriter.h"
+
+// Thresholds for EncryptedVaultStorage::compact().
+struct CompactionOptions {
+    // Rewrite a segment when at least this fraction of it is dead...
+    double minDeadRatio = 0.5;
+    // ...and at least this many bytes of it are dead. For auto compaction this is also
+    // the amount of newly dead bytes that triggers a pass.
+    std::uint64_t minDeadBytes = 64 * 1024;
+    // Segments to rewrite per pass (0 = all eligible).
+    std::size_t maxSegments = 0;
+    // Also rewrite index.log as a single checkpoint.
+    bool compactIndex = true;
+};
+
+// Outcome of EncryptedVaultStorage::compact().
+struct CompactionReport {
+    std::size_t segmentsRewritten = 0;
+    std::size_t recordsMoved = 0;
+    // Chunks of deduplicated records nothing referenced any more.
+    std::size_t chunksDropped = 0;
+    std::uint64_t storeBytesReclaimed = 0;
+    std::uint64_t indexBytesReclaimed = 0;
+    std::chrono::milliseconds elapsed {0};
+
+    [[nodiscard]]
+    std::uint64_t reclaimedBytes() const { return storeBytesReclaimed + indexBytesReclaimed; }
+};
+
+// Options for EncryptedVaultStorage::collectGarbage().
+struct GcOptions {
+    // Only report, touch nothing.
+    bool dryRun = false;
+    // Move orphans to data/quarantine/<timestamp>/ instead of deleting them.
+    bool quarantine = false;
+};
+
+// Outcome of EncryptedVaultStorage::collectGarbage().
+struct GcReport {
+    // Space accounting before the sweep.
+    SpaceReport space;
+    std::size_t filesRemoved = 0;
+    std::uint64_t bytesRemoved = 0;
+    // Where orphans went, if quarantined.
+    std::string quarantineDir;
+    std::chrono::milliseconds elapsed {0};
+};
+
+// Outcome of EncryptedVaultStorage::trainDictionary().
+struct DictionaryReport {
+    // Id of the new dictionary; 0 if there was too little to train on.
+    std::uint32_t id = 0;
+    std::size_t size = 0;
+    std::size_t samples = 0;
+    std::uint64_t sampleBytes = 0;
+    std::chrono::milliseconds elapsed {0};
+};
+
+/**
+ * EncryptedVaultStorage
+ *
+ * Record store of an unlocked vault (data/vault_store). Thread-safe. Every change is a
+ * transaction, applied all or nothing: records are sealed into segments (SegmentStore),
+ * committed to the WAL (WriteAheadLog), then applied to index.log (IndexLog) and the manifest.
+ *
+ * Record layouts: RecordFormat, ChunkedAead. Compression: RecordCodec. Deduplication:
+ * ChunkStore. Reclaiming space: compact(), collectGarbage() (GarbageCollector).
+ */
 class EncryptedVaultStorage {
 public:
-    explicit EncryptedVaultStorage(const std::vector<unsigned char> &vmk);
+    // A batch of changes committed atomically by commit().
+    class Transaction {
+    public:
+        Transaction() = default;
+        ~Transaction();
+
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+
+        // Add a record, replacing any record with the same name.
+        void add(const std::string &name, const std::string &type, std::vector<unsigned char> data);
+        // Remove a record; commit fails if it does not exist.
+        void remove(const std::string &name);
+
+        [[nodiscard]]
+        bool empty() const { return m_ops.empty(); }
+        [[nodiscard]]
+        std::size_t size() const { return m_ops.size(); }
+
+    private:
+        friend class EncryptedVaultStorage;
+
+        struct Op {
+            bool isRemove = false;
+            std::string name;
+            std::string type;
+            std::vector<unsigned char> data;
+        };
+
+        std::vector<Op> m_ops;
+        // Drop all operations, wiping plaintext.
+        void clear();
+    };
+
+    // Plaintext record for addRecords().
+    struct NewRecord {
+        std::string name;
+        std::string type;
+        std::vector<unsigned char> data;
+    };
+
+    // Incremental pass run after commits: one segment at a time, once 4 MiB have died.
+    static constexpr CompactionOptions AUTO_COMPACTION {0.5, 4ULL * 1024 * 1024, 1, false};
+
+    // Dead fraction of the store that triggers garbage collection + compaction after the first commit.
+    static constexpr double AUTO_GC_DEAD_FRACTION = 0.5;
+
+    // Layout of a record's sealed bytes.
+    enum class RecordFormat : std::uint32_t {
+        // nonce || ciphertext of the whole record
+        Sealed = 0,
+        // secretstream header || chunks of STREAM_CHUNK_SIZE bytes + tag; the last (shorter) chunk is tagged FINAL
+        Chunked = 1,
+        // ChunkedAead header || independently sealed chunks
+        RandomAccess = 2,
+    };
+
+    // What a record's plaintext is.
+    enum class RecordContent : std::uint32_t {
+        // the record's bytes
+        Data = 0,
+        // the list of a deduplicated record's chunks (ChunkStore), never compressed
+        ChunkList = 1,
+    };
+
+    // Plaintext bytes per chunk of a Chunked record.
+    static constexpr std::size_t STREAM_CHUNK_SIZE = 64 * 1024;
+    // Records at least this big are sealed as RandomAccess chunks, on all cores.
+    static constexpr std::size_t PARALLEL_SEAL_SIZE = 1024 * 1024;
+    // RandomAccess chunks sealed / opened per batch when streaming (8 MiB of plaintext).
+    static constexpr std::size_t STREAM_BATCH_CHUNKS = 128;
+
+    // Records at least this big are deduplicated, unless setDeduplication says otherwise.
+    static constexpr std::size_t DEDUPLICATION_MIN_SIZE = 32 * 1024;
+
+    // Plaintext of small records trainDictionary() samples at most.
+    static constexpr std::uint64_t TRAINING_SAMPLE_BYTES = 8ULL * 1024 * 1024;
+
+    // WAL size at which it is folded into index.log and emptied.
+    static constexpr std::uint64_t WAL_TRIM_SIZE = 4ULL * 1024 * 1024;
+
+    explicit EncryptedVaultStorage(const std::vector<unsigned char> &vmk, std::uint64_t segmentSize = SegmentStore::DEFAULT_SEGMENT_SIZE);
+    ~EncryptedVaultStorage();
+
+    EncryptedVaultStorage(const EncryptedVaultStorage &) = delete;
+    EncryptedVaultStorage &operator=(const EncryptedVaultStorage &) = delete;
+
+    // Durably apply all operations of 'tx', or none. Empties 'tx'.
+    // Throws if a removed record does not exist.
+    void commit(Transaction &tx);
+    // Add (or replace) many records in one transaction: one WAL commit, one manifest update.
+    // Returns the number of records added.
+    std::size_t addRecords(std::span<const NewRecord> records);
+    // Remove many records in one transaction. Throws, removing nothing, if any name does not exist.
+    std::size_t removeRecords(std::span<const std::string> names);
     // Add new record
     bool addRecord(const std::string &name, const std::string &type, std::vector<unsigned char> &data);
+    // Add (or replace) a record read from 'in' up to EOF, in bounded memory. Returns the bytes stored.
+    std::uint64_t addRecordFrom(const std::string &name, const std::string &type, std::istream &in);
+    // Same, reading file descriptor 'fd' up to EOF.
+    std::uint64_t addRecordFrom(const std::string &name, const std::string &type, int fd);
     // Load record by name
     std::vector<unsigned char> loadRecord(const std::string &name);
-    // List of all records
+    // Plaintext size of a record, without decrypting it.
+    [[nodiscard]]
+    std::uint64_t recordSize(const std::string &name) const;
+    // Decrypt a record into 'out' and return its size (no heap allocation for a Sealed record).
+    // Throws std::invalid_argument if 'out' is too small.
+    std::size_t loadRecordInto(const std::string &name, std::span<unsigned char> out);
+    // Bytes [offset, offset + length) of a record, cut short at its end.
+    std::vector<unsigned char> loadRecordRange(const std::string &name, std::uint64_t offset, std::size_t length);
+    // Decrypt a record into 'out' a batch of chunks at a time; a corrupt record throws after a prefix.
+    // Returns the bytes written.
+    std::uint64_t loadRecordTo(const std::string &name, std::ostream &out);
+    // Same, writing to file descriptor 'fd'.
+    std::uint64_t loadRecordTo(const std::string &name, int fd);
+    // List of all records (sorted by name)
     [[nodiscard]]
     std::vector<std::string> list() const;
+    // List of records whose name starts with prefix (sorted by name)
+    [[nodiscard]]
+    std::vector<std::string> list(const std::string &prefix) const;
     // Remove record
     bool remove(const std::string &name);
 
+    // Reclaim space held by removed and replaced records.
+    CompactionReport compact(const CompactionOptions &options);
+    // Options for the incremental pass after commits; std::nullopt disables it.
+    void setAutoCompaction(std::optional<CompactionOptions> options);
+    // Delete (or quarantine) unreferenced files in the store and report live vs dead bytes.
+    GcReport collectGarbage(const GcOptions &options);
+    // Dead fraction that triggers the automatic pass; std::nullopt disables it.
+    void setAutoGc(std::optional<double> deadFraction);
+    // Compression of records added from now on; std::nullopt stores them as they are.
+    void setCompression(std::optional<CompressionOptions> options);
+    // Size from which records added from now on are deduplicated; std::nullopt stores them whole.
+    void setDeduplication(std::optional<std::size_t> minSize);
+    // Train a compression dictionary on the small records and compress new ones with it.
+    DictionaryReport trainDictionary();
+    // Background integrity pass of the unlock: reads check their file first, writes wait for it. nullptr disables it.
+    void setIntegrityVerification(std::shared_ptr<IntegrityVerification> verification);
+
 private:
     std::vector<unsigned char> m_vmk;
+    // Encrypted record index (index.log), replayed once on construction.
+    IndexLog m_log;
+    // Sealed records, packed into segment_*.dat files.
+    SegmentStore m_segments;
+    // Committed transactions not yet known to be durable in index.log.
+    WriteAheadLog m_wal;
+    // Compression dictionaries (dictionaries.bin).
+    RecordCodec m_codec;
+    // Chunk ids and reference counts of deduplicated records (guarded by m_mutex).
+    ChunkStore m_chunks;
+
+    // Guards index, segments and apply order.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_applyCv;
+    // WAL sequence of the next transaction to apply to the index.
+    std::uint64_t m_nextApply = 0;
+    // Serializes MANIFEST.* rewrites; taken before m_mutex.
+    std::mutex m_manifestMutex;
+    ManifestWriter m_manifest;
+    // Files touched since the last manifest update (guarded by m_mutex).
+    ManifestWriter::Changes m_manifestChanges;
+
+    std::optional<CompressionOptions> m_compression = CompressionOptions {};
+    std::optional<std::size_t> m_deduplication = DEDUPLICATION_MIN_SIZE;
+    // Whether chunk reference counts are kept: the index has chunks, and their lists could be read.
+    bool m_hasChunks = false;
+    // Chunks sealed by transactions queued but not applied yet; new records use them as they are.
+    std::unordered_set<std::string> m_pendingChunks;
+    std::optional<CompactionOptions> m_autoCompaction = AUTO_COMPACTION;
+    // Segment bytes superseded by this instance since the last compaction.
+    std::uint64_t m_deadSinceCompaction = 0;
+    std::optional<double> m_autoGc = AUTO_GC_DEAD_FRACTION;
+    bool m_autoGcChecked = false;
+    std::shared_ptr<IntegrityVerification> m_integrity;
+
+    struct SegmentUsage {
+        std::uint64_t fileBytes = 0;
+        std::uint64_t liveBytes = 0;   // record headers included
+    };
+
+    // Legacy one-file-per-record path (record_<id>.bin), still readable.
     [[nodiscard]]
     std::string path(const std::string &id) const;
+    [[nodiscard]]
+    std::string indexPath() const;
+    [[nodiscard]]
+    std::string walPath() const;
     void ensureStorageDir() const;
-    // derive per-record key using VMK + record salt (HMAC-SHA256)
-    static std::vector<unsigned char> deriveRecordKey(const std::vector<unsigned char> &vmk, const std::vector<unsigned char> &salt);
+    // Open index.log, migrating a plaintext index.bin / index.json first if needed.
+    void openIndex();
+    // Open the WAL and redo transactions a crash left out of index.log.
+    void recover();
+    // Seal 'data' under the key of 'salt', compressed first if 'compression' says that pays: the bytes
+    // to store and their format word.
+    std::pair<std::vector<unsigned char>, std::uint32_t> sealPayload(const StorageIndex::Salt &salt, std::span<const unsigned char> data,
+        const std::optional<CompressionOptions> &compression, RecordContent content) const;
+    // Encrypt a record into the active segment; returns the Put operation for it.
+    WriteAheadLog::Operation sealRecord(const std::string &name, const std::string &type, const StorageIndex::Salt &salt,
+        std::span<const unsigned char> data, RecordContent content);
+    // Seal a record added by a transaction, deduplicated if it is big enough: its operations (new chunks
+    // first) go to 'ops', the chunks it sealed to 'sealedChunks'.
+    void stageRecord(const std::string &name, const std::string &type, const std::vector<unsigned char> &data,
+        std::vector<WriteAheadLog::Operation> &ops, std::unordered_set<std::string> &sealedChunks);
+    // Put operation for a record sealed with 'salt' and stored at 'location'.
+    static WriteAheadLog::Operation putOperation(const std::string &name, const std::string &type, const StorageIndex::Salt &salt,
+        const RecordLocation &location);
+    // Encrypt everything 'read' returns (0 = end of input) as one chunked record and commit it.
+    std::uint64_t addStreamed(const std::string &name, const std::string &type,
+        const std::function<std::size_t(std::span<unsigned char>)> &read);
+    // addStreamed with deduplication: new chunks and the chunk list stream into a segment of their own.
+    std::uint64_t addDeduplicated(const std::string &name, const std::string &type,
+        const std::function<std::size_t(std::span<unsigned char>)> &read, std::size_t minSize,
+        const std::optional<CompressionOptions> &compression);
+    // A record looked up, its file verified, ready to decrypt without the lock.
+    struct OpenRecord {
+        std::vector<unsigned char> salt;
+        RecordLocation location;
+        RecordFormat format = RecordFormat::Sealed;
+        CipherSuite suite = CipherSuite::XChaCha20Poly1305;
+        RecordContent content = RecordContent::Data;
+        // Compressed records: their header; 'location' covers the sealed bytes after it.
+        RecordCodec::Header codec;
+        // Sealed: the sealed bytes. Other formats: a read handle of our own on the segment.
+        std::vector<unsigned char> sealed;
+        FileHandle segment;
+    };
+    // A record looked up, its file verified and mapped.
+    struct MappedRecord {
+        StorageIndex::Salt salt {};
+        RecordFormat format = RecordFormat::Sealed;
+        CipherSuite suite = CipherSuite::XChaCha20Poly1305;
+        RecordContent content = RecordContent::Data;
+        RecordCodec::Header codec;
+        // Plaintext size.
+        std::uint64_t size = 0;
+        // Keeps 'sealed' mapped.
+        std::shared_ptr<const MappedFile> file;
+        std::span<const unsigned char> sealed;
+    };
+    // Receives plaintext pieces in order, with the record offset of each.
+    using PlainSink = std::function<void(std::uint64_t, std::span<const unsigned char>)>;
+
+    // Look up 'name' and get it ready for decryptRecord. Throws if it does not exist.
+    OpenRecord openRecord(const std::string &name) const;
+    // Look up 'name' and map its sealed bytes. Throws if it does not exist.
+    MappedRecord mapRecord(const std::string &name) const;
+    // Map the record sealed with 'salt' at segment location 'location' (under m_mutex).
+    MappedRecord mapLocation(const StorageIndex::Salt &salt, const RecordLocation &location) const;
+    // Map the chunk 'ref' names; throws if it is missing or not what the list says.
+    MappedRecord mapChunk(const ChunkStore::ChunkRef &ref) const;
+    // Decrypt the chunk list a ChunkList record holds.
+    std::vector<ChunkStore::ChunkRef> chunkList(const MappedRecord &record) const;
+    std::vector<ChunkStore::ChunkRef> chunkList(const OpenRecord &record) const;
+    // Chunks of the record sealed with 'salt' at 'location'; none if it is not a deduplicated record (under m_mutex).
+    std::vector<ChunkStore::ChunkRef> chunksAt(const StorageIndex::Salt &salt, const RecordLocation &location) const;
+    // Decrypt the chunks of 'refs' into 'plain', which has exactly their total size.
+    void loadChunks(std::span<const ChunkStore::ChunkRef> refs, std::span<unsigned char> plain) const;
+    // Decrypt the chunks of 'refs' holding plaintext bytes [from, to) into 'write'. Returns the bytes passed on.
+    std::uint64_t decryptChunks(std::span<const ChunkStore::ChunkRef> refs, std::uint64_t from, std::uint64_t to,
+        const PlainSink &write) const;
+    // Start keeping chunk reference counts, from the chunk lists of all records (under m_mutex).
+    void countChunks();
+    // Decrypt (and decompress) all of 'record' into 'plain', which has exactly its plaintext size.
+    void decryptMapped(const std::string &name, const MappedRecord &record, std::span<unsigned char> plain) const;
+    // Decrypt the sealed bytes of a Sealed or RandomAccess 'record' into 'out', without decompressing.
+    void openMapped(const MappedRecord &record, std::span<unsigned char> out) const;
+    // Decrypt the part of 'record' holding plaintext bytes [from, to) into 'write'. Only uncompressed
+    // RandomAccess and deduplicated records skip what lies outside; the others are decrypted whole.
+    // Returns the bytes passed on.
+    std::uint64_t decryptRecord(const OpenRecord &record, std::uint64_t from, std::uint64_t to, const PlainSink &write) const;
+    // decryptRecord without decompressing: 'write' gets the sealed bytes' plaintext.
+    std::uint64_t decryptBody(const OpenRecord &record, std::uint64_t from, std::uint64_t to, const PlainSink &write) const;
+    // Steps after a transaction is queued in the WAL: wait for durability, apply, update the manifest.
+    void finishCommit(std::uint64_t seq, const std::vector<WriteAheadLog::Operation> &ops);
+    // Apply committed operations to the index.
+    void applyOperations(const std::vector<WriteAheadLog::Operation> &ops);
+    // Wait for the turn of WAL transaction 'seq', then apply it to the index.
+    void applyCommitted(std::uint64_t seq, const std::vector<WriteAheadLog::Operation> &ops);
+    // With m_mutex held by 'lock': wait until every queued transaction is applied. Throws StorageError
+    // if the WAL failed, as the failed ones never will be.
+    void awaitApplied(std::unique_lock<std::mutex> &lock);
+    void maybeAutoCompact();
+    void maybeAutoGc();
+    // Let the integrity pass finish before files change under it.
+    void awaitIntegrity() const;
+    // Check the file holding a record against the manifest; throws StorageError on a mismatch.
+    void verifyRecordFile(const std::string &id, const RecordLocation &location) const;
+    // Size and live bytes of every segment on disk, according to 'index'.
+    [[nodiscard]]
+    std::map<std::uint32_t, SegmentUsage> segmentUsage(const StorageIndex &index) const;
+    // "vault_store/segment_NNNNNN.dat", as listed in the manifest.
+    [[nodiscard]]
+    std::string segmentManifestPath(std::uint32_t id) const;
+    // Patch the manifest with m_manifestChanges, or rehash everything if 'rebuild'.
+    void updateManifest(const std::string &after, bool rebuild = false);
+    // Find record id, salt and location by name. Returns false if there is no such record.
+    bool lookup(const std::string &name, std::string &id, std::vector<unsigned char> &salt, RecordLocation &location) const;
+    // Read sealed record bytes (nonce || ciphertext) from its segment or legacy file.
+    [[nodiscard]]
+    std::vector<unsigned char> readSealed(const std::string &id, const RecordLocation &location) const;
+    // derive per-record key using VMK + record salt (HMAC-SHA256), + the compression header of compressed records
+    static std::vector<unsigned char> deriveRecordKey(const std::vector<unsigned char> &vmk, const std::vector<unsigned char> &salt,
+        const RecordCodec::Header &codec = {});
     static std::string base64Encode(const std::vector<unsigned char> &data);
     static std::vector<unsigned char> base64Decode(const std::string &data);
 };
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "GarbageCollector.h"
+
+#include "SegmentStore.h"
+#include "StorageError.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+static constexpr std::string_view RECORD_PREFIX = "record_";
+static constexpr std::string_view RECORD_SUFFIX = ".bin";
+static constexpr std::string_view SEGMENT_PREFIX = "segment_";
+
+static bool isLegacyRecordFile(const std::string &name) {
+    return name.size() > RECORD_PREFIX.size() + RECORD_SUFFIX.size()
+        && name.starts_with(RECORD_PREFIX) && name.ends_with(RECORD_SUFFIX);
+}
+
+SpaceReport GarbageCollector::scan(const std::string &storeDir, const StorageIndex &index, const std::vector<std::uint32_t> &openSegments) {
+    SpaceReport report;
+
+    // What the index references: live bytes per segment, ids of legacy files.
+    std::unordered_map<std::uint32_t, std::uint64_t> segmentLive;
+    std::unordered_set<std::string_view> legacyIds;
+    for (const auto &entry : index.entries()) {
+        if (entry.location.segment == 0) {
+            legacyIds.insert(entry.id);
+        } else {
+            segmentLive[entry.location.segment] += SegmentStore::RECORD_HEADER_SIZE + entry.location.length;
+        }
+    }
+    report.liveRecords = index.size();
+
+    // One pass over the store.
+    std::error_code ec;
+    for (fs::directory_iterator it(storeDir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file()) continue;
+
+        const auto name = it->path().filename().string();
+        std::error_code sizeEc;
+        const std::uint64_t size = it->file_size(sizeEc);
+        if (sizeEc) continue;
+
+        if (SegmentStore::isSegmentFile(name)) {
+            const auto id = static_cast<std::uint32_t>(std::stoul(name.substr(SEGMENT_PREFIX.size())));
+            const auto live = segmentLive.find(id);
+            if (live == segmentLive.end()) {
+                if (std::find(openSegments.begin(), openSegments.end(), id) == openSegments.end()) {
+                    report.orphans.push_back({name, size});
+                    report.orphanBytes += size;
+                }
+                continue;
+            }
+
+            const std::uint64_t payload = size > SegmentStore::HEADER_SIZE ? size - SegmentStore::HEADER_SIZE : 0;
+            report.liveBytes += live->second;
+            report.deadBytes += payload > live->second ? payload - live->second : 0;
+        } else if (isLegacyRecordFile(name)) {
+            const auto id = std::string_view(name).substr(RECORD_PREFIX.size(), name.size() - RECORD_PREFIX.size() - RECORD_SUFFIX.size());
+            if (legacyIds.contains(id)) {
+                report.liveBytes += size;
+            } else {
+                report.orphans.push_back({name, size});
+                report.orphanBytes += size;
+            }
+        } else if (name.ends_with(".tmp")) {
+            report.orphans.push_back({name, size});
+            report.orphanBytes += size;
+        } else if (name == "index.log") {
+            report.indexBytes = size;
+        }
+        // Anything else is not ours to judge and is left alone.
+    }
+
+    if (ec) {
+        throw StorageError("GarbageCollector: cannot list " + storeDir + ": " + ec.message());
+    }
+
+    return report;
+}
+
+std::uint64_t GarbageCollector::sweep(const std::string &storeDir, const SpaceReport &report, const std::string &quarantineDir,
+    std::size_t &filesHandled) {
+    filesHandled = 0;
+    if (report.orphans.empty()) {
+        return 0;
+    }
+
+    if (!quarantineDir.empty()) {
+        fs::create_directories(quarantineDir);
+    }
+
+    std::uint64_t reclaimed = 0;
+    for (const auto &[name, size] : report.orphans) {
+        const auto source = fs::path(storeDir) / name;
+        std::error_code ec;
+        if (quarantineDir.empty()) {
+            fs::remove(source, ec);
+        } else {
+            fs::rename(source, fs::path(quarantineDir) / name, ec);
+        }
+
+        if (ec) {
+            EncoraLogger::Logger::log(EncoraLogger::Level::Warn, "GC: cannot " + std::string(quarantineDir.empty() ? "delete " : "quarantine ")
+                + source.string() + ": " + ec.message());
+            continue;
+        }
+        ++filesHandled;
+        reclaimed += size;
+    }
+
+    return reclaimed;
+}
@@ -0,0 +1,62 @@
+#ifndef CORE_STORAGE_GARBAGE_COLLECTOR_H
+#define CORE_STORAGE_GARBAGE_COLLECTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "StorageIndex.h"
+
+// Where the bytes under vault_store go, as seen by GarbageCollector::scan().
+struct SpaceReport {
+    struct Orphan {
+        std::string name;   // file name in the store directory
+        std::uint64_t size = 0;
+    };
+
+    // Records reachable from the index and the bytes they occupy
+    // (segment framing included; whole file for legacy record_<id>.bin).
+    std::uint64_t liveRecords = 0;
+    std::uint64_t liveBytes = 0;
+    // Superseded bytes inside segments that still hold live records (reclaimed by compaction).
+    std::uint64_t deadBytes = 0;
+    // Files nothing references (reclaimed by sweep).
+    std::vector<Orphan> orphans;
+    std::uint64_t orphanBytes = 0;
+    // index.log
+    std::uint64_t indexBytes = 0;
+
+    // Share of record storage that is not live.
+    [[nodiscard]]
+    double deadFraction() const {
+        const auto total = liveBytes + deadBytes + orphanBytes;
+        return total == 0 ? 0.0 : static_cast<double>(deadBytes + orphanBytes) / static_cast<double>(total);
+    }
+};
+
+/**
+ * GarbageCollector
+ *
+ * Finds and removes files in vault_store that the index no longer references:
+ *  - record_<id>.bin whose id is not in the index (left behind by overwrites in older versions)
+ *  - segment_*.dat without a single live record (e.g. a crash between a compaction commit and its delete)
+ *  - *.tmp left over from an interrupted index rewrite
+ *
+ * scan() cross-references the index with one pass over the directory; sweep() deletes
+ * the orphans, or moves them into a quarantine directory outside vault_store (so the
+ * manifest and exports stop covering them, but nothing is lost).
+ *
+ * Callers must hold off writers while scanning and sweeping.
+ */
+class GarbageCollector {
+public:
+    // 'openSegments' are never reported as orphans: records are still being written to them
+    // (SegmentStore::openSegments()).
+    static SpaceReport scan(const std::string &storeDir, const StorageIndex &index, const std::vector<std::uint32_t> &openSegments);
+    // Delete the orphans of 'report' (or move them to 'quarantineDir' if not empty).
+    // Files that cannot be handled are logged and skipped. Returns the bytes reclaimed.
+    static std::uint64_t sweep(const std::string &storeDir, const SpaceReport &report, const std::string &quarantineDir,
+        std::size_t &filesHandled);
+};
+
+#endif //CORE_STORAGE_GARBAGE_COLLECTOR_H
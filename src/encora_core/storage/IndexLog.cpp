@@ -0,0 +1,483 @@
+#include <sodium.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+
+#include "IndexLog.h"
+#include "StorageError.h"
+
+#include "platform/FileHandle.h"
+#include "platform/MappedFile.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+static_assert(std::endian::native == std::endian::little, "index.log is stored little-endian");
+
+namespace {
+    constexpr char MAGIC[8] = {'E', 'N', 'C', 'L', 'O', 'G', '\0', '\0'};
+    constexpr std::size_t FILE_HEADER_SIZE = 16;
+    constexpr std::size_t FRAME_HEADER_SIZE = 8;
+    constexpr std::size_t NONCE_SIZE = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    constexpr std::size_t TAG_SIZE = crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    constexpr std::uint64_t SUBKEY_ID = 1;
+    constexpr char SUBKEY_CONTEXT[crypto_kdf_CONTEXTBYTES] = {'E', 'n', 'c', 'I', 'n', 'd', 'e', 'x'};
+
+    template<typename T>
+    void putInt(std::vector<unsigned char> &out, const T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putString(std::vector<unsigned char> &out, const std::string_view str) {
+        if (str.size() > UINT16_MAX) {
+            throw StorageError("IndexLog: field too long (max 65535 bytes).");
+        }
+        putInt(out, static_cast<std::uint16_t>(str.size()));
+        out.insert(out.end(), str.begin(), str.end());
+    }
+
+    // Bounds-checked reader over a decrypted payload.
+    class PayloadReader {
+    public:
+        explicit PayloadReader(const std::vector<unsigned char> &buffer) : m_data(buffer.data()), m_left(buffer.size()) {}
+
+        template<typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string_view string() {
+            const auto length = get<std::uint16_t>();
+            return {reinterpret_cast<const char *>(take(length)), length};
+        }
+
+        [[nodiscard]]
+        bool atEnd() const { return m_left == 0; }
+
+        const unsigned char *take(const std::size_t n) {
+            if (n > m_left) {
+                throw StorageError("IndexLog: truncated frame payload.");
+            }
+            const unsigned char *p = m_data;
+            m_data += n;
+            m_left -= n;
+            return p;
+        }
+
+    private:
+        const unsigned char *m_data;
+        std::size_t m_left;
+    };
+
+    struct FrameHeader {
+        std::uint32_t sealedLength = 0;
+        std::uint8_t kind = 0;
+    };
+
+    FrameHeader readFrameHeader(const unsigned char *p) {
+        FrameHeader header;
+        std::memcpy(&header.sealedLength, p, sizeof(header.sealedLength));
+        header.kind = p[4];
+        return header;
+    }
+
+    void wipe(std::vector<unsigned char> &buffer) {
+        if (!buffer.empty()) {
+            sodium_memzero(buffer.data(), buffer.size());
+        }
+        buffer.clear();
+    }
+}
+
+IndexLog::IndexLog(const std::vector<unsigned char> &vmk) : m_key(crypto_aead_xchacha20poly1305_ietf_KEYBYTES) {
+    if (vmk.size() != crypto_kdf_KEYBYTES) {
+        throw StorageError("IndexLog: VMK has unexpected size.");
+    }
+
+    crypto_kdf_derive_from_key(m_key.data(), m_key.size(), SUBKEY_ID, SUBKEY_CONTEXT, vmk.data());
+}
+
+IndexLog::~IndexLog() {
+    wipe(m_key);
+    wipe(m_checkpointImage);
+}
+
+void IndexLog::resetView() {
+    m_base.close();
+    wipe(m_checkpointImage);
+    m_overlay.clear();
+    m_removed.clear();
+}
+
+void IndexLog::open(const std::string &path) {
+    m_out.close();
+    m_path = path;
+    m_nextSeq = 0;
+    m_framesSinceCheckpoint = 0;
+    resetView();
+
+    MappedFile file;
+    if (!file.open(path)) {
+        return;
+    }
+
+    const unsigned char *data = file.data();
+    const std::size_t size = file.size();
+    std::size_t validEnd = 0;
+
+    if (size >= FILE_HEADER_SIZE) {
+        std::uint32_t version = 0;
+        std::memcpy(&version, data + sizeof(MAGIC), sizeof(version));
+        if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+            throw StorageError("IndexLog: bad magic in " + path);
+        }
+        if (version == 0 || version > VERSION) {
+            throw StorageError("IndexLog: unsupported version " + std::to_string(version) + ".");
+        }
+
+        // Pass 1: walk plaintext frame headers, remember the last checkpoint.
+        std::size_t offset = FILE_HEADER_SIZE;
+        std::uint64_t seq = 0;
+        std::size_t replayFrom = FILE_HEADER_SIZE;
+        std::uint64_t replaySeq = 0;
+        while (size - offset >= FRAME_HEADER_SIZE) {
+            const auto header = readFrameHeader(data + offset);
+            if (header.kind < static_cast<std::uint8_t>(FrameKind::Put) || header.kind > static_cast<std::uint8_t>(FrameKind::Checkpoint)) {
+                throw StorageError("IndexLog: unknown frame kind at offset " + std::to_string(offset) + ".");
+            }
+
+            const std::size_t frameSize = FRAME_HEADER_SIZE + NONCE_SIZE + header.sealedLength;
+            if (header.sealedLength < TAG_SIZE || size - offset < frameSize) {
+                break; // torn tail
+            }
+
+            if (header.kind == static_cast<std::uint8_t>(FrameKind::Checkpoint)) {
+                replayFrom = offset;
+                replaySeq = seq;
+            }
+
+            offset += frameSize;
+            ++seq;
+        }
+        validEnd = offset;
+        m_nextSeq = seq;
+
+        // Pass 2: decrypt and apply from the last checkpoint on.
+        std::vector<unsigned char> payload;
+        for (offset = replayFrom, seq = replaySeq; offset < validEnd; ++seq) {
+            const auto header = readFrameHeader(data + offset);
+            if (!openFrame(data + offset, header.sealedLength, seq, payload)) {
+                throw StorageError("IndexLog: frame " + std::to_string(seq) + " failed authentication.");
+            }
+
+            applyFrame(static_cast<FrameKind>(header.kind), payload);
+            if (static_cast<FrameKind>(header.kind) != FrameKind::Checkpoint) {
+                ++m_framesSinceCheckpoint;
+            }
+            offset += FRAME_HEADER_SIZE + NONCE_SIZE + header.sealedLength;
+        }
+        wipe(payload);
+    }
+
+    file.close();
+    if (validEnd < size) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn,
+            "IndexLog: truncating torn tail (" + std::to_string(size - validEnd) + " bytes) in " + path);
+        fs::resize_file(path, validEnd);
+    }
+}
+
+void IndexLog::create(const std::string &path, const StorageIndex &index) {
+    m_out.close();
+
+    auto image = BinaryIndex::serialize(index);
+    const auto frame = sealFrame(FrameKind::Checkpoint, 0, image);
+    wipe(image);
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            throw StorageError("IndexLog: cannot write: " + tmpPath);
+        }
+
+        char fileHeader[FILE_HEADER_SIZE] = {};
+        std::memcpy(fileHeader, MAGIC, sizeof(MAGIC));
+        std::memcpy(fileHeader + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+        ofs.write(fileHeader, sizeof(fileHeader));
+        ofs.write(reinterpret_cast<const char *>(frame.data()), static_cast<std::streamsize>(frame.size()));
+        if (!ofs.good()) {
+            throw StorageError("IndexLog: write failed: " + tmpPath);
+        }
+    }
+
+    // The replacement must be on disk before it takes the old log's place.
+    if (FileHandle tmp; !tmp.open(tmpPath, true)) {
+        throw StorageError("IndexLog: cannot open for sync: " + tmpPath);
+    } else {
+        tmp.sync();
+    }
+
+    fs::rename(tmpPath, path);
+    open(path);
+}
+
+void IndexLog::compact() {
+    StorageIndex merged;
+    snapshot(merged);
+    create(m_path, merged);
+}
+
+std::optional<BinaryIndex::EntryView> IndexLog::find(const std::string_view name) const {
+    if (const auto *entry = m_overlay.find(name)) {
+        return BinaryIndex::EntryView{entry->name, entry->id, entry->type, entry->salt, entry->createdAt, entry->location};
+    }
+
+    if (!m_removed.empty() && m_removed.contains(name)) {
+        return std::nullopt;
+    }
+
+    return m_base.find(name);
+}
+
+std::vector<std::string> IndexLog::names(const std::string_view prefix) const {
+    std::vector<std::string> out;
+    m_base.forEachWithPrefix(prefix, [&](const BinaryIndex::EntryView &entry) {
+        if (m_overlay.find(entry.name) != nullptr) return;
+        if (!m_removed.empty() && m_removed.contains(entry.name)) return;
+        out.emplace_back(entry.name);
+    });
+
+    const auto baseCount = out.size();
+    for (const auto &entry : m_overlay.entries()) {
+        if (entry.name.starts_with(prefix)) {
+            out.emplace_back(entry.name);
+        }
+    }
+
+    // Base part is already sorted; only the overlay part needs merging in.
+    std::sort(out.begin() + static_cast<std::ptrdiff_t>(baseCount), out.end());
+    std::inplace_merge(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(baseCount), out.end());
+
+    return out;
+}
+
+void IndexLog::snapshot(StorageIndex &out) const {
+    m_base.load(out);
+    for (const auto &name : m_removed) {
+        out.erase(name);
+    }
+    for (const auto &entry : m_overlay.entries()) {
+        out.upsert(entry.name, entry.id, entry.type, entry.salt, entry.createdAt, entry.location);
+    }
+}
+
+void IndexLog::put(const std::string_view name, const std::string_view id, const std::string_view type,
+    const StorageIndex::Salt &salt, const std::int64_t createdAt, const RecordLocation &location) {
+    std::vector<unsigned char> payload;
+    putString(payload, name);
+    putString(payload, id);
+    putString(payload, type);
+    payload.insert(payload.end(), salt.begin(), salt.end());
+    putInt(payload, createdAt);
+    putInt(payload, location.segment);
+    putInt(payload, location.length);
+    putInt(payload, location.offset);
+
+    appendFrame(FrameKind::Put, payload);
+    wipe(payload);
+    applyPut(name, id, type, salt, createdAt, location);
+
+    if (++m_framesSinceCheckpoint >= checkpointInterval()) {
+        checkpoint();
+    }
+}
+
+bool IndexLog::remove(const std::string_view name) {
+    if (!find(name)) {
+        return false;
+    }
+
+    std::vector<unsigned char> payload;
+    putString(payload, name);
+
+    appendFrame(FrameKind::Remove, payload);
+    wipe(payload);
+    applyRemove(name);
+
+    if (++m_framesSinceCheckpoint >= checkpointInterval()) {
+        checkpoint();
+    }
+
+    return true;
+}
+
+std::size_t IndexLog::checkpointInterval() const {
+    // A checkpoint costs a full image; spacing them by the index size keeps appends amortized O(1).
+    return std::max(CHECKPOINT_INTERVAL, m_base.size());
+}
+
+void IndexLog::checkpoint() {
+    StorageIndex merged;
+    snapshot(merged);
+    auto image = BinaryIndex::serialize(merged);
+
+    appendFrame(FrameKind::Checkpoint, image);
+    rebase(std::move(image));
+    m_framesSinceCheckpoint = 0;
+}
+
+void IndexLog::flush() {
+    if (m_out.is_open() && !m_out.flush()) {
+        throw StorageError("IndexLog: flush failed: " + m_path);
+    }
+}
+
+void IndexLog::sync() {
+    if (!m_out.is_open()) {
+        return;
+    }
+
+    flush();
+    // fsync through a second descriptor: std::ofstream does not expose its own.
+    FileHandle file;
+    if (!file.open(m_path, true)) {
+        throw StorageError("IndexLog: cannot open for sync: " + m_path);
+    }
+    file.sync();
+}
+
+void IndexLog::applyFrame(const FrameKind kind, std::vector<unsigned char> &payload) {
+    if (kind == FrameKind::Checkpoint) {
+        rebase(std::move(payload));
+        payload = {};
+        return;
+    }
+
+    PayloadReader reader(payload);
+    const auto name = reader.string();
+    if (kind == FrameKind::Remove) {
+        applyRemove(name);
+        return;
+    }
+
+    const auto id = reader.string();
+    const auto type = reader.string();
+    StorageIndex::Salt salt;
+    std::memcpy(salt.data(), reader.take(salt.size()), salt.size());
+    const auto createdAt = reader.get<std::int64_t>();
+    RecordLocation location;
+    if (!reader.atEnd()) { // frames written before segment storage carry no location
+        location.segment = reader.get<std::uint32_t>();
+        location.length = reader.get<std::uint32_t>();
+        location.offset = reader.get<std::uint64_t>();
+    }
+    applyPut(name, id, type, salt, createdAt, location);
+}
+
+void IndexLog::applyPut(const std::string_view name, const std::string_view id, const std::string_view type,
+    const StorageIndex::Salt &salt, const std::int64_t createdAt, const RecordLocation &location) {
+    m_overlay.upsert(name, id, type, salt, createdAt, location);
+    if (!m_removed.empty()) {
+        m_removed.erase(std::string(name));
+    }
+}
+
+void IndexLog::applyRemove(const std::string_view name) {
+    m_overlay.erase(name);
+    if (m_base.find(name)) {
+        m_removed.emplace(name);
+    }
+}
+
+void IndexLog::rebase(std::vector<unsigned char> image) {
+    resetView();
+    m_checkpointImage = std::move(image);
+    m_base.attach(m_checkpointImage);
+}
+
+void IndexLog::appendFrame(const FrameKind kind, const std::vector<unsigned char> &payload) {
+    if (!m_out.is_open()) {
+        const bool fresh = !fs::exists(m_path) || fs::file_size(m_path) == 0;
+        m_out.open(m_path, std::ios::binary | std::ios::app);
+        if (!m_out.is_open()) {
+            throw StorageError("IndexLog: cannot open for append: " + m_path);
+        }
+
+        if (fresh) {
+            char fileHeader[FILE_HEADER_SIZE] = {};
+            std::memcpy(fileHeader, MAGIC, sizeof(MAGIC));
+            std::memcpy(fileHeader + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+            m_out.write(fileHeader, sizeof(fileHeader));
+        }
+    }
+
+    const auto frame = sealFrame(kind, m_nextSeq, payload);
+    m_out.write(reinterpret_cast<const char *>(frame.data()), static_cast<std::streamsize>(frame.size()));
+    if (!m_out.good()) {
+        throw StorageError("IndexLog: append failed: " + m_path);
+    }
+
+    ++m_nextSeq;
+}
+
+std::vector<unsigned char> IndexLog::sealFrame(const FrameKind kind, const std::uint64_t seq, const std::vector<unsigned char> &payload) const {
+    if (payload.size() > UINT32_MAX - TAG_SIZE) {
+        throw StorageError("IndexLog: frame too large.");
+    }
+
+    const auto sealedLength = static_cast<std::uint32_t>(payload.size() + TAG_SIZE);
+    std::vector<unsigned char> frame(FRAME_HEADER_SIZE + NONCE_SIZE + sealedLength);
+    std::memcpy(frame.data(), &sealedLength, sizeof(sealedLength));
+    frame[4] = static_cast<unsigned char>(kind);
+    randombytes_buf(frame.data() + FRAME_HEADER_SIZE, NONCE_SIZE);
+
+    unsigned char aad[FRAME_HEADER_SIZE + sizeof(seq)];
+    std::memcpy(aad, frame.data(), FRAME_HEADER_SIZE);
+    std::memcpy(aad + FRAME_HEADER_SIZE, &seq, sizeof(seq));
+
+    unsigned long long sealedOut = 0;
+    if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+        frame.data() + FRAME_HEADER_SIZE + NONCE_SIZE,
+        &sealedOut,
+        payload.data(),
+        payload.size(),
+        aad,
+        sizeof(aad),
+        nullptr,
+        frame.data() + FRAME_HEADER_SIZE,
+        m_key.data()
+        ) != 0) {
+        throw StorageError("IndexLog: frame encryption failed.");
+    }
+
+    return frame;
+}
+
+bool IndexLog::openFrame(const unsigned char *frame, const std::size_t sealedLength, const std::uint64_t seq,
+    std::vector<unsigned char> &payload) const {
+    unsigned char aad[FRAME_HEADER_SIZE + sizeof(seq)];
+    std::memcpy(aad, frame, FRAME_HEADER_SIZE);
+    std::memcpy(aad + FRAME_HEADER_SIZE, &seq, sizeof(seq));
+
+    payload.resize(sealedLength - TAG_SIZE);
+    unsigned long long payloadLength = 0;
+    const int r = crypto_aead_xchacha20poly1305_ietf_decrypt(
+        payload.data(),
+        &payloadLength,
+        nullptr,
+        frame + FRAME_HEADER_SIZE + NONCE_SIZE,
+        sealedLength,
+        aad,
+        sizeof(aad),
+        frame + FRAME_HEADER_SIZE,
+        m_key.data()
+        );
+
+    return r == 0;
+}
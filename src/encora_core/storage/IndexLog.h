@@ -0,0 +1,128 @@
+#ifndef CORE_STORAGE_INDEX_LOG_H
+#define CORE_STORAGE_INDEX_LOG_H
+
+#include <cstdint>
+#include <functional>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "BinaryIndex.h"
+#include "StorageIndex.h"
+
+/**
+ * IndexLog (index.log, format v1)
+ *
+ * Encrypted, append-only record index. Replaces the plaintext index.json / index.bin:
+ * record names, ids and salts are never written to disk in the clear.
+ *
+ * Layout:
+ *  [File header: 16 bytes] magic "ENCLOG\0\0", version, reserved
+ *  [Frame]*
+ *      header: u32 sealed length, u8 kind, 3 reserved bytes   (plaintext)
+ *      nonce:  24 bytes
+ *      sealed: XChaCha20-Poly1305(payload), AAD = frame header || u64 frame sequence
+ *
+ * Frame kinds:
+ *  - Put:        one index entry (insert or replace), including its record location
+ *  - Remove:     record name
+ *  - Checkpoint: full index image in BinaryIndex format
+ *
+ * The key is a subkey of the VMK (crypto_kdf, context "EncIndex"), so the log
+ * cannot be read or forged without an unlocked vault. The frame sequence in
+ * the AAD stops frames from being reordered or dropped from the middle.
+ *
+ * Open scans plaintext frame headers (mmap, no decryption) to find the last
+ * checkpoint, decrypts it into memory and replays only the frames after it.
+ * Lookups hit the checkpoint image (binary search) under a small in-memory
+ * overlay of later changes. A new checkpoint is appended after
+ * max(CHECKPOINT_INTERVAL, entries in the last checkpoint) frames.
+ *
+ * A torn frame at the tail (crash during append) is truncated on open;
+ * any other damage fails with StorageError.
+ */
+class IndexLog {
+public:
+    static constexpr std::uint32_t VERSION = 1;
+    static constexpr std::size_t CHECKPOINT_INTERVAL = 256;
+
+    explicit IndexLog(const std::vector<unsigned char> &vmk);
+    ~IndexLog();
+
+    IndexLog(const IndexLog &) = delete;
+    IndexLog &operator=(const IndexLog &) = delete;
+
+    // Open the log at 'path' and replay it. A missing file is an empty index;
+    // the file is created on the first append.
+    void open(const std::string &path);
+    // Atomically replace the log at 'path' with a single checkpoint of 'index', then open it.
+    void create(const std::string &path, const StorageIndex &index);
+
+    [[nodiscard]]
+    std::optional<BinaryIndex::EntryView> find(std::string_view name) const;
+    // Names starting with 'prefix', sorted.
+    [[nodiscard]]
+    std::vector<std::string> names(std::string_view prefix) const;
+    // Current content as a plain StorageIndex.
+    void snapshot(StorageIndex &out) const;
+
+    // Append a Put frame and apply it.
+    void put(std::string_view name, std::string_view id, std::string_view type, const StorageIndex::Salt &salt, std::int64_t createdAt,
+        const RecordLocation &location = {});
+    // Append a Remove frame and apply it. Returns false if there is no such record.
+    bool remove(std::string_view name);
+    // Append a checkpoint of the current content.
+    void checkpoint();
+    // Replace the whole log with one checkpoint of the current content,
+    // dropping superseded puts and remove tombstones.
+    void compact();
+    // Hand buffered frames to the OS. Appends are buffered so a batch costs a few writes.
+    void flush();
+    // Flush appended frames to stable storage (fsync).
+    void sync();
+
+private:
+    enum class FrameKind : std::uint8_t {
+        Put = 1,
+        Remove = 2,
+        Checkpoint = 3,
+    };
+
+    std::vector<unsigned char> m_key;
+    std::string m_path;
+    std::ofstream m_out;
+    std::uint64_t m_nextSeq = 0;
+    std::size_t m_framesSinceCheckpoint = 0;
+
+    // Decrypted image of the last checkpoint and a view over it.
+    std::vector<unsigned char> m_checkpointImage;
+    BinaryIndex m_base;
+    // Changes after the last checkpoint.
+    StorageIndex m_overlay;
+    // Transparent, so lookups by name do not build a std::string.
+    struct NameHash {
+        using is_transparent = void;
+        std::size_t operator()(const std::string_view name) const { return std::hash<std::string_view> {}(name); }
+    };
+    std::unordered_set<std::string, NameHash, std::equal_to<>> m_removed;
+
+    void resetView();
+    [[nodiscard]]
+    std::size_t checkpointInterval() const;
+    void applyFrame(FrameKind kind, std::vector<unsigned char> &payload);
+    void applyPut(std::string_view name, std::string_view id, std::string_view type, const StorageIndex::Salt &salt, std::int64_t createdAt,
+        const RecordLocation &location);
+    void applyRemove(std::string_view name);
+    void rebase(std::vector<unsigned char> image);
+
+    void appendFrame(FrameKind kind, const std::vector<unsigned char> &payload);
+    [[nodiscard]]
+    std::vector<unsigned char> sealFrame(FrameKind kind, std::uint64_t seq, const std::vector<unsigned char> &payload) const;
+    [[nodiscard]]
+    bool openFrame(const unsigned char *frame, std::size_t sealedLength, std::uint64_t seq, std::vector<unsigned char> &payload) const;
+};
+
+#endif //CORE_STORAGE_INDEX_LOG_H
@@ -0,0 +1,342 @@
+#include <sodium.h>
+#include <zdict.h>
+#include <zstd.h>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "RecordCodec.h"
+#include "StorageError.h"
+
+#include "CryptoEngine.h"
+#include "platform/FileHandle.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+static_assert(std::endian::native == std::endian::little, "record headers and dictionaries.bin are stored little-endian");
+
+namespace {
+    constexpr char MAGIC[8] = {'E', 'N', 'C', 'D', 'I', 'C', 'T', 'S'};
+    constexpr unsigned char VERSION = 1;
+    constexpr std::size_t FILE_HEADER_SIZE = 12;
+    constexpr std::uint64_t SUBKEY_ID = 1;
+    constexpr char SUBKEY_CONTEXT[crypto_kdf_CONTEXTBYTES] = {'E', 'n', 'c', 'D', 'i', 'c', 't', 's'};
+
+    template<typename T>
+    void putInt(std::vector<unsigned char> &out, const T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    T getInt(const unsigned char *in) {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        return value;
+    }
+
+    struct ContextDeleter {
+        void operator()(ZSTD_CCtx *context) const { ZSTD_freeCCtx(context); }
+        void operator()(ZSTD_DCtx *context) const { ZSTD_freeDCtx(context); }
+    };
+
+    // One context per thread, reused for every record it handles.
+    ZSTD_CCtx *compressionContext() {
+        thread_local const std::unique_ptr<ZSTD_CCtx, ContextDeleter> context(ZSTD_createCCtx());
+        if (!context) {
+            throw std::bad_alloc();
+        }
+        return context.get();
+    }
+
+    ZSTD_DCtx *decompressionContext() {
+        thread_local const std::unique_ptr<ZSTD_DCtx, ContextDeleter> context(ZSTD_createDCtx());
+        if (!context) {
+            throw std::bad_alloc();
+        }
+        return context.get();
+    }
+
+    void wipe(std::vector<unsigned char> &buffer) {
+        if (!buffer.empty()) {
+            sodium_memzero(buffer.data(), buffer.size());
+        }
+    }
+}
+
+// A dictionary with its digested forms: zstd prepares them once, not per record.
+struct RecordCodec::Dictionary {
+    std::vector<unsigned char> bytes;
+    ZSTD_CDict *compress = nullptr;
+    ZSTD_DDict *decompress = nullptr;
+
+    explicit Dictionary(std::vector<unsigned char> content) : bytes(std::move(content)) {
+        compress = ZSTD_createCDict(bytes.data(), bytes.size(), DICTIONARY_LEVEL);
+        decompress = ZSTD_createDDict(bytes.data(), bytes.size());
+        if (!compress || !decompress) {
+            ZSTD_freeCDict(compress);
+            ZSTD_freeDDict(decompress);
+            wipe(bytes);
+            throw std::runtime_error("RecordCodec: cannot load a dictionary.");
+        }
+    }
+
+    ~Dictionary() {
+        ZSTD_freeCDict(compress);
+        ZSTD_freeDDict(decompress);
+        wipe(bytes);
+    }
+
+    Dictionary(const Dictionary &) = delete;
+    Dictionary &operator=(const Dictionary &) = delete;
+};
+
+RecordCodec::Header::Bytes RecordCodec::Header::bytes() const {
+    Bytes bytes {};
+    bytes[0] = static_cast<unsigned char>(codec);
+    std::memcpy(bytes.data() + 4, &dictionary, sizeof(dictionary));
+    std::memcpy(bytes.data() + 8, &size, sizeof(size));
+    return bytes;
+}
+
+RecordCodec::Header RecordCodec::Header::parse(const std::span<const unsigned char> bytes) {
+    if (bytes.size() < SIZE || bytes[1] != 0 || bytes[2] != 0 || bytes[3] != 0) {
+        throw std::runtime_error("Record has a corrupted compression header.");
+    }
+
+    Header header;
+    header.codec = codecOf(bytes[0]);
+    header.dictionary = getInt<std::uint32_t>(bytes.data() + 4);
+    header.size = getInt<std::uint64_t>(bytes.data() + 8);
+    if (header.codec == Codec::None || (header.codec == Codec::ZstdDictionary) != (header.dictionary != 0)) {
+        throw std::runtime_error("Record has a corrupted compression header.");
+    }
+    return header;
+}
+
+RecordCodec::Codec RecordCodec::codecOf(const unsigned id) {
+    if (id > static_cast<unsigned>(Codec::ZstdDictionary)) {
+        throw std::runtime_error("Record has an unknown codec: " + std::to_string(id));
+    }
+    return static_cast<Codec>(id);
+}
+
+RecordCodec::RecordCodec(const std::string &storeDir, const std::vector<unsigned char> &vmk)
+    : m_path((fs::path(storeDir) / FILE_NAME).string()), m_key(CryptoEngine::KEY_SIZE) {
+    if (vmk.size() != crypto_kdf_KEYBYTES) {
+        throw StorageError("RecordCodec: VMK has unexpected size.");
+    }
+
+    crypto_kdf_derive_from_key(m_key.data(), m_key.size(), SUBKEY_ID, SUBKEY_CONTEXT, vmk.data());
+    load();
+}
+
+RecordCodec::~RecordCodec() {
+    wipe(m_key);
+}
+
+std::uint32_t RecordCodec::current() const {
+    std::lock_guard lock(m_mutex);
+    return m_dictionaries.empty() ? 0 : m_dictionaries.rbegin()->first;
+}
+
+const RecordCodec::Dictionary &RecordCodec::find(const std::uint32_t id) const {
+    std::lock_guard lock(m_mutex);
+    const auto it = m_dictionaries.find(id);
+    if (it == m_dictionaries.end()) {
+        throw std::runtime_error("Record needs compression dictionary " + std::to_string(id) + ", which the vault does not have.");
+    }
+    return *it->second;
+}
+
+std::vector<unsigned char> RecordCodec::compress(const std::span<const unsigned char> plain, const CompressionOptions &options,
+    Header &header) const {
+    header = {};
+    if (plain.size() < options.minSize) {
+        return {};
+    }
+
+    std::uint32_t id = 0;
+    const Dictionary *dictionary = nullptr;
+    if (plain.size() <= options.dictionaryMaxSize) {
+        std::lock_guard lock(m_mutex);
+        if (!m_dictionaries.empty()) {
+            id = m_dictionaries.rbegin()->first;
+            dictionary = m_dictionaries.rbegin()->second.get();
+        }
+    }
+
+    std::vector<unsigned char> out(ZSTD_compressBound(plain.size()));
+    const auto size = dictionary
+        ? ZSTD_compress_usingCDict(compressionContext(), out.data(), out.size(), plain.data(), plain.size(), dictionary->compress)
+        : ZSTD_compressCCtx(compressionContext(), out.data(), out.size(), plain.data(), plain.size(), options.level);
+
+    // Every read pays for decompression: only worth it if it saves at least 1/16.
+    if (ZSTD_isError(size) || size + Header::SIZE > plain.size() - plain.size() / 16) {
+        wipe(out);
+        return {};
+    }
+
+    sodium_memzero(out.data() + size, out.size() - size);
+    out.resize(size);
+    header = {dictionary ? Codec::ZstdDictionary : Codec::Zstd, id, plain.size()};
+    return out;
+}
+
+void RecordCodec::decompress(const Header &header, const std::span<const unsigned char> compressed, const std::span<unsigned char> plain) const {
+    if (plain.size() != header.size) {
+        throw std::invalid_argument("RecordCodec::decompress: output is not the record's size.");
+    }
+
+    std::size_t size = 0;
+    switch (header.codec) {
+        case Codec::None:
+            throw std::invalid_argument("RecordCodec::decompress: record is not compressed.");
+        case Codec::Zstd:
+            size = ZSTD_decompressDCtx(decompressionContext(), plain.data(), plain.size(), compressed.data(), compressed.size());
+            break;
+        case Codec::ZstdDictionary:
+            size = ZSTD_decompress_usingDDict(decompressionContext(), plain.data(), plain.size(), compressed.data(), compressed.size(),
+                find(header.dictionary).decompress);
+            break;
+    }
+
+    if (ZSTD_isError(size)) {
+        throw std::runtime_error(std::string("Failed to decompress record: ") + ZSTD_getErrorName(size));
+    }
+    if (size != header.size) {
+        throw std::runtime_error("Failed to decompress record: wrong size.");
+    }
+}
+
+std::pair<std::uint32_t, std::size_t> RecordCodec::train(const std::span<const std::span<const unsigned char>> samples,
+    const std::size_t capacity) {
+    std::vector<unsigned char> joined;
+    std::vector<std::size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto sample : samples) {
+        joined.insert(joined.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    std::vector<unsigned char> dictionary(capacity);
+    const auto size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), joined.data(), sizes.data(),
+        static_cast<unsigned>(sizes.size()));
+    wipe(joined);
+    if (ZDICT_isError(size)) {
+        wipe(dictionary);
+        EncoraLogger::Logger::log(EncoraLogger::Level::Info,
+            std::string("No compression dictionary trained: ") + ZDICT_getErrorName(size));
+        return {0, 0};
+    }
+    sodium_memzero(dictionary.data() + size, dictionary.size() - size);
+    dictionary.resize(size);
+
+    std::lock_guard lock(m_mutex);
+    const std::uint32_t id = m_dictionaries.empty() ? 1 : m_dictionaries.rbegin()->first + 1;
+    m_dictionaries.emplace(id, std::make_unique<Dictionary>(std::move(dictionary)));
+    try {
+        save();
+    } catch (...) {
+        // Nobody has seen it yet: the lock was held since it was added.
+        m_dictionaries.erase(id);
+        throw;
+    }
+
+    return {id, size};
+}
+
+void RecordCodec::load() {
+    std::ifstream ifs(m_path, std::ios::binary);
+    if (!ifs.is_open()) {
+        // No dictionary trained yet.
+        return;
+    }
+
+    std::vector<unsigned char> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (file.size() < FILE_HEADER_SIZE || std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0 || file[8] != VERSION
+        || file[10] != 0 || file[11] != 0) {
+        throw StorageError("RecordCodec: not a dictionary file: " + m_path);
+    }
+
+    const CryptoEngine engine(m_key, CryptoEngine::suiteOf(file[9]));
+    const auto nonceSize = engine.nonceSize();
+    if (file.size() < FILE_HEADER_SIZE + nonceSize + CryptoEngine::TAG_SIZE) {
+        throw StorageError("RecordCodec: dictionary file truncated: " + m_path);
+    }
+
+    const auto all = std::span<const unsigned char>(file);
+    std::vector<unsigned char> payload(file.size() - FILE_HEADER_SIZE - nonceSize - CryptoEngine::TAG_SIZE);
+    if (!engine.decrypt(payload, all.subspan(FILE_HEADER_SIZE + nonceSize), all.subspan(FILE_HEADER_SIZE, nonceSize),
+            all.first(FILE_HEADER_SIZE))) {
+        throw StorageError("RecordCodec: dictionary file does not authenticate: " + m_path);
+    }
+
+    try {
+        for (std::size_t at = 0; at < payload.size();) {
+            if (payload.size() - at < 8) {
+                throw StorageError("RecordCodec: dictionary file corrupted: " + m_path);
+            }
+            const auto id = getInt<std::uint32_t>(payload.data() + at);
+            const auto size = getInt<std::uint32_t>(payload.data() + at + 4);
+            at += 8;
+            if (id == 0 || payload.size() - at < size || m_dictionaries.contains(id)) {
+                throw StorageError("RecordCodec: dictionary file corrupted: " + m_path);
+            }
+
+            const auto begin = payload.begin() + static_cast<std::ptrdiff_t>(at);
+            m_dictionaries.emplace(id, std::make_unique<Dictionary>(std::vector<unsigned char>(begin, begin + size)));
+            at += size;
+        }
+    } catch (...) {
+        wipe(payload);
+        throw;
+    }
+    wipe(payload);
+}
+
+void RecordCodec::save() const {
+    std::vector<unsigned char> payload;
+    for (const auto &[id, dictionary] : m_dictionaries) {
+        putInt(payload, id);
+        putInt(payload, static_cast<std::uint32_t>(dictionary->bytes.size()));
+        payload.insert(payload.end(), dictionary->bytes.begin(), dictionary->bytes.end());
+    }
+
+    const CryptoEngine engine(m_key);
+    const auto nonceSize = engine.nonceSize();
+    std::vector<unsigned char> file(FILE_HEADER_SIZE + nonceSize + payload.size() + CryptoEngine::TAG_SIZE);
+    std::memcpy(file.data(), MAGIC, sizeof(MAGIC));
+    file[8] = VERSION;
+    file[9] = static_cast<unsigned char>(engine.suite());
+    randombytes_buf(file.data() + FILE_HEADER_SIZE, nonceSize);
+    const auto all = std::span(file);
+    engine.encrypt(all.subspan(FILE_HEADER_SIZE + nonceSize), payload, all.subspan(FILE_HEADER_SIZE, nonceSize), all.first(FILE_HEADER_SIZE));
+    wipe(payload);
+
+    const std::string tmpPath = m_path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            throw StorageError("RecordCodec: cannot write: " + tmpPath);
+        }
+        ofs.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!ofs.good()) {
+            throw StorageError("RecordCodec: write failed: " + tmpPath);
+        }
+    }
+
+    // Records compressed with a new dictionary must never reach the disk before it does.
+    if (FileHandle tmp; !tmp.open(tmpPath, true)) {
+        throw StorageError("RecordCodec: cannot open for sync: " + tmpPath);
+    } else {
+        tmp.sync();
+    }
+
+    fs::rename(tmpPath, m_path);
+}
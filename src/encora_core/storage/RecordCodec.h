@@ -0,0 +1,120 @@
+#ifndef CORE_STORAGE_RECORD_CODEC_H
+#define CORE_STORAGE_RECORD_CODEC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Thresholds for compressing records before they are sealed (EncryptedVaultStorage::setCompression).
+struct CompressionOptions {
+    // Smaller records are stored as they are.
+    std::size_t minSize = 64;
+    // Records up to this size are compressed against the newest dictionary, once there is one.
+    std::size_t dictionaryMaxSize = 16 * 1024;
+    // zstd level of records compressed on their own; the fast end, big records go through it.
+    int level = 1;
+};
+
+/**
+ * RecordCodec
+ *
+ * Compression of record plaintext before it is sealed (zstd):
+ *      Zstd            - on its own, at CompressionOptions::level
+ *      ZstdDictionary  - against a dictionary trained on the vault's own small records: a
+ *                        record of a few hundred bytes has too little history of its own
+ * The result is kept only if it saves at least 1/16 of the record; otherwise the record is
+ * stored as it is (None).
+ *
+ * A compressed record's stored bytes start with a Header (codec, dictionary id, plaintext
+ * size) in plaintext; EncryptedVaultStorage binds it into the record key, so it cannot be
+ * changed without the record failing to decrypt.
+ *
+ * Dictionaries live in vault_store/dictionaries.bin, sealed with CryptoEngine under a subkey
+ * of the VMK (crypto_kdf, context "EncDicts"):
+ *      magic "ENCDICTS" | version (u8) | suite (u8) | 2 reserved bytes | nonce | sealed (id, size, bytes)*
+ * the first 12 bytes authenticated as associated data. Dictionaries are only ever added, the
+ * file being rewritten atomically; ids count up from 1 and the newest is used for new
+ * records. Dictionaries are derived from plaintext and are wiped when the codec goes away.
+ *
+ * Thread-safe; zstd contexts are kept per thread.
+ */
+class RecordCodec {
+public:
+    enum class Codec : unsigned char {
+        None = 0,
+        Zstd = 1,
+        ZstdDictionary = 2,
+    };
+
+    // Stored in front of a compressed record's sealed bytes:
+    //      codec (u8) | 3 reserved bytes | dictionary id (u32 LE) | plaintext size (u64 LE)
+    struct Header {
+        static constexpr std::size_t SIZE = 16;
+        using Bytes = std::array<unsigned char, SIZE>;
+
+        Codec codec = Codec::None;
+        // ZstdDictionary: the dictionary's id.
+        std::uint32_t dictionary = 0;
+        std::uint64_t size = 0;
+
+        [[nodiscard]]
+        Bytes bytes() const;
+        // Throws std::runtime_error if 'bytes' is not a valid header.
+        static Header parse(std::span<const unsigned char> bytes);
+    };
+
+    static constexpr const char *FILE_NAME = "dictionaries.bin";
+    // Upper bound of a trained dictionary.
+    static constexpr std::size_t MAX_DICTIONARY_SIZE = 64 * 1024;
+    // zstd level of records compressed with a dictionary (small inputs: cheap either way).
+    static constexpr int DICTIONARY_LEVEL = 3;
+
+    // Codec with id 'id'. Throws std::runtime_error if there is none.
+    static Codec codecOf(unsigned id);
+
+    // Loads storeDir/dictionaries.bin if there is one; throws StorageError if it does not authenticate.
+    RecordCodec(const std::string &storeDir, const std::vector<unsigned char> &vmk);
+    ~RecordCodec();
+
+    RecordCodec(const RecordCodec &) = delete;
+    RecordCodec &operator=(const RecordCodec &) = delete;
+
+    // Compress 'plain' per 'options' and describe the result in 'header'. Returns nothing (and
+    // header.codec None) if the record is better stored as it is.
+    std::vector<unsigned char> compress(std::span<const unsigned char> plain, const CompressionOptions &options, Header &header) const;
+    // Decompress 'compressed' into 'plain', which has header.size bytes. Throws std::runtime_error
+    // if it does not decompress to exactly that.
+    void decompress(const Header &header, std::span<const unsigned char> compressed, std::span<unsigned char> plain) const;
+
+    // Train a dictionary of at most 'capacity' bytes on 'samples', store it and compress new
+    // records with it. Returns its id and size, or {0, 0} if zstd finds too little to train on.
+    std::pair<std::uint32_t, std::size_t> train(std::span<const std::span<const unsigned char>> samples,
+        std::size_t capacity = MAX_DICTIONARY_SIZE);
+    // Id of the dictionary new records use (0 = none yet).
+    [[nodiscard]]
+    std::uint32_t current() const;
+
+private:
+    struct Dictionary;
+
+    std::string m_path;
+    std::vector<unsigned char> m_key;
+    mutable std::mutex m_mutex;
+    // Never erased: a Dictionary stays put once it is found.
+    std::map<std::uint32_t, std::unique_ptr<Dictionary>> m_dictionaries;
+
+    void load();
+    // Rewrite the file with every dictionary (under m_mutex).
+    void save() const;
+    // Throws std::runtime_error if there is no dictionary 'id'.
+    const Dictionary &find(std::uint32_t id) const;
+};
+
+#endif //CORE_STORAGE_RECORD_CODEC_H
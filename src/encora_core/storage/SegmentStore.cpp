@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+#include "SegmentStore.h"
+#include "StorageError.h"
+
+namespace fs = std::filesystem;
+
+static_assert(std::endian::native == std::endian::little, "segments are stored little-endian");
+
+namespace {
+    constexpr char MAGIC[8] = {'E', 'N', 'C', 'S', 'E', 'G', '\0', '\0'};
+    constexpr std::uint32_t VERSION = 1;
+    constexpr std::string_view FILE_PREFIX = "segment_";
+    constexpr std::string_view FILE_SUFFIX = ".dat";
+    // Piece size for copy().
+    constexpr std::size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+    void writeSegmentHeader(FileHandle &file) {
+        unsigned char header[SegmentStore::HEADER_SIZE] = {};
+        std::memcpy(header, MAGIC, sizeof(MAGIC));
+        std::memcpy(header + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+        file.truncate(0);
+        file.append(header, sizeof(header));
+    }
+
+    void encodeRecordHeader(unsigned char (&header)[SegmentStore::RECORD_HEADER_SIZE], const std::uint32_t length,
+        const std::uint32_t format) {
+        std::memcpy(header, &length, sizeof(length));
+        std::memcpy(header + sizeof(length), &format, sizeof(format));
+    }
+}
+
+SegmentStore::SegmentStore(std::string dir, const std::uint64_t segmentSize)
+    : m_dir(std::move(dir)), m_segmentSize(std::max<std::uint64_t>(segmentSize, HEADER_SIZE + RECORD_HEADER_SIZE)) {
+    fs::create_directories(m_dir);
+}
+
+bool SegmentStore::isSegmentFile(const std::string &fileName) {
+    if (fileName.size() <= FILE_PREFIX.size() + FILE_SUFFIX.size()
+        || !fileName.starts_with(FILE_PREFIX) || !fileName.ends_with(FILE_SUFFIX)) {
+        return false;
+    }
+
+    const auto digits = std::string_view(fileName).substr(FILE_PREFIX.size(), fileName.size() - FILE_PREFIX.size() - FILE_SUFFIX.size());
+    return std::all_of(digits.begin(), digits.end(), [](const char c) { return c >= '0' && c <= '9'; });
+}
+
+std::string SegmentStore::segmentPath(const std::uint32_t id) const {
+    std::ostringstream oss;
+    oss << m_dir << "/" << FILE_PREFIX << std::setw(6) << std::setfill('0') << id << FILE_SUFFIX;
+    return oss.str();
+}
+
+std::vector<std::uint32_t> SegmentStore::segmentIds() const {
+    std::vector<std::uint32_t> ids;
+    if (!fs::exists(m_dir)) {
+        return ids;
+    }
+
+    for (const auto &entry : fs::directory_iterator(m_dir)) {
+        if (!entry.is_regular_file()) continue;
+        const auto name = entry.path().filename().string();
+        if (!isSegmentFile(name)) continue;
+        ids.push_back(static_cast<std::uint32_t>(std::stoul(name.substr(FILE_PREFIX.size()))));
+    }
+    std::sort(ids.begin(), ids.end());
+
+    return ids;
+}
+
+void SegmentStore::openActive(const std::uint32_t id) {
+    if (!m_active.open(segmentPath(id), true)) {
+        throw StorageError("SegmentStore: cannot open segment: " + segmentPath(id));
+    }
+
+    if (m_active.size() < HEADER_SIZE) {
+        // New segment (or a header torn by a crash): start it over.
+        writeSegmentHeader(m_active);
+    }
+
+    m_activeId = id;
+    m_lastId = std::max(m_lastId, id);
+}
+
+std::uint32_t SegmentStore::nextId() {
+    if (!m_lastIdKnown) {
+        const auto ids = segmentIds();
+        m_lastId = std::max(m_lastId, ids.empty() ? 0 : ids.back());
+        m_lastIdKnown = true;
+    }
+
+    return ++m_lastId;
+}
+
+void SegmentStore::ensureActive() {
+    if (m_active.isOpen()) {
+        return;
+    }
+
+    // Keep filling the newest segment, unless a stream is still writing it.
+    const auto ids = segmentIds();
+    openActive(!ids.empty() && !isStreaming(ids.back()) ? ids.back() : nextId());
+}
+
+void SegmentStore::reserve(const std::uint64_t bytes) {
+    ensureActive();
+    if (m_active.size() > HEADER_SIZE && m_active.size() + RECORD_HEADER_SIZE + bytes > m_segmentSize) {
+        m_active.sync();
+        openActive(nextId());
+    }
+}
+
+RecordLocation SegmentStore::append(const std::span<const unsigned char> record, const std::uint32_t format) {
+    if (record.size() > UINT32_MAX) {
+        throw StorageError("SegmentStore: record too large.");
+    }
+    reserve(record.size());
+
+    const auto length = static_cast<std::uint32_t>(record.size());
+    unsigned char header[RECORD_HEADER_SIZE];
+    encodeRecordHeader(header, length, format);
+
+    const auto at = m_active.append(header, sizeof(header));
+    if (!record.empty()) {
+        m_active.append(record.data(), record.size());
+    }
+
+    return {m_activeId, length, at + RECORD_HEADER_SIZE};
+}
+
+RecordLocation SegmentStore::copy(const RecordLocation &from) {
+    if (from.length <= COPY_BUFFER_SIZE) {
+        return append(read(from), format(from));
+    }
+
+    const auto &source = reader(from.segment);
+    reserve(from.length);
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    encodeRecordHeader(header, from.length, format(from));
+    const auto at = m_active.append(header, sizeof(header));
+
+    std::vector<unsigned char> buffer(COPY_BUFFER_SIZE);
+    for (std::uint64_t done = 0; done < from.length;) {
+        const auto piece = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), from.length - done));
+        try {
+            source.readAt(from.offset + done, buffer.data(), piece);
+        } catch (const std::exception &e) {
+            throw StorageError(std::string("SegmentStore: ") + e.what());
+        }
+        m_active.append(buffer.data(), piece);
+        done += piece;
+    }
+
+    return {m_activeId, from.length, at + RECORD_HEADER_SIZE};
+}
+
+const FileHandle &SegmentStore::reader(const std::uint32_t id) const {
+    auto it = m_readers.find(id);
+    if (it == m_readers.end()) {
+        auto handle = std::make_unique<FileHandle>();
+        if (!handle->open(segmentPath(id), false)) {
+            throw StorageError("SegmentStore: segment not found: " + segmentPath(id));
+        }
+        it = m_readers.emplace(id, std::move(handle)).first;
+    }
+
+    return *it->second;
+}
+
+std::vector<unsigned char> SegmentStore::read(const RecordLocation &location) const {
+    if (location.segment == 0) {
+        throw StorageError("SegmentStore: record is not stored in a segment.");
+    }
+
+    std::vector<unsigned char> out(location.length);
+    try {
+        reader(location.segment).readAt(location.offset, out.data(), out.size());
+    } catch (const StorageError &) {
+        throw;
+    } catch (const std::exception &e) {
+        throw StorageError(std::string("SegmentStore: ") + e.what());
+    }
+
+    return out;
+}
+
+std::uint32_t SegmentStore::format(const RecordLocation &location) const {
+    if (location.segment == 0 || location.offset < HEADER_SIZE + RECORD_HEADER_SIZE) {
+        throw StorageError("SegmentStore: record is not stored in a segment.");
+    }
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    try {
+        reader(location.segment).readAt(location.offset - RECORD_HEADER_SIZE, header, sizeof(header));
+    } catch (const StorageError &) {
+        throw;
+    } catch (const std::exception &e) {
+        throw StorageError(std::string("SegmentStore: ") + e.what());
+    }
+
+    std::uint32_t format = 0;
+    std::memcpy(&format, header + sizeof(std::uint32_t), sizeof(format));
+    return format;
+}
+
+FileHandle SegmentStore::openSegment(const std::uint32_t id) const {
+    FileHandle handle;
+    if (!handle.open(segmentPath(id), false)) {
+        throw StorageError("SegmentStore: segment not found: " + segmentPath(id));
+    }
+
+    return handle;
+}
+
+SegmentStore::StreamWriter SegmentStore::beginStream(const std::uint32_t format) {
+    StreamWriter writer;
+    writer.m_segment = nextId();
+    writer.m_format = format;
+    if (!writer.m_file.open(segmentPath(writer.m_segment), true)) {
+        throw StorageError("SegmentStore: cannot create segment: " + segmentPath(writer.m_segment));
+    }
+    m_streaming.insert(writer.m_segment);
+
+    // Length is filled in by finish(); a crash before that leaves an unreferenced segment for GC.
+    writeSegmentHeader(writer.m_file);
+    unsigned char header[RECORD_HEADER_SIZE];
+    encodeRecordHeader(header, 0, format);
+    writer.m_file.append(header, sizeof(header));
+
+    return writer;
+}
+
+void SegmentStore::StreamWriter::write(const std::span<const unsigned char> bytes) {
+    if (m_length + bytes.size() > UINT32_MAX) {
+        throw StorageError("SegmentStore: record too large.");
+    }
+
+    m_file.append(bytes.data(), bytes.size());
+    m_length += bytes.size();
+}
+
+RecordLocation SegmentStore::StreamWriter::close(const std::uint32_t format) {
+    const auto length = static_cast<std::uint32_t>(m_length);
+    unsigned char header[RECORD_HEADER_SIZE];
+    encodeRecordHeader(header, length, format);
+    m_file.writeAt(m_start - RECORD_HEADER_SIZE, header, sizeof(header));
+
+    return {m_segment, length, m_start};
+}
+
+RecordLocation SegmentStore::StreamWriter::next(const std::uint32_t format) {
+    const auto closed = close(format);
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    encodeRecordHeader(header, 0, m_format);
+    m_file.append(header, sizeof(header));
+    m_start += m_length + RECORD_HEADER_SIZE;
+    m_length = 0;
+
+    return closed;
+}
+
+RecordLocation SegmentStore::StreamWriter::finish() {
+    return finish(m_format);
+}
+
+RecordLocation SegmentStore::StreamWriter::finish(const std::uint32_t format) {
+    const auto location = close(format);
+    m_file.sync();
+    m_file.close();
+
+    return location;
+}
+
+void SegmentStore::endStream(const std::uint32_t segment, const bool discard) {
+    m_streaming.erase(segment);
+    if (discard) {
+        removeSegment(segment);
+    }
+}
+
+std::vector<std::uint32_t> SegmentStore::openSegments() const {
+    std::vector<std::uint32_t> ids(m_streaming.begin(), m_streaming.end());
+    if (m_activeId != 0) {
+        ids.push_back(m_activeId);
+    }
+
+    return ids;
+}
+
+void SegmentStore::sync() {
+    if (m_active.isOpen()) {
+        m_active.sync();
+    }
+}
+std::shared_ptr<const MappedFile> SegmentStore::map(const std::uint32_t id, const std::uint64_t end) const {
+    auto &mapping = m_mappings[id];
+    if (!mapping || mapping->size() < end) {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(segmentPath(id))) {
+            throw StorageError("SegmentStore: cannot map segment: " + segmentPath(id));
+        }
+        if (file->size() < end) {
+            throw StorageError("SegmentStore: record past the end of " + segmentPath(id));
+        }
+        mapping = std::move(file);
+    }
+
+    return mapping;
+}
+
+void SegmentStore::rollover() {
+    if (m_active.isOpen()) {
+        m_active.sync();
+    }
+
+    openActive(nextId());
+}
+
+void SegmentStore::removeSegment(const std::uint32_t id) {
+    m_readers.erase(id);
+    m_mappings.erase(id);
+    if (m_active.isOpen() && id == m_activeId) {
+        m_active.close();
+        m_activeId = 0;
+    }
+
+    std::error_code ec;
+    fs::remove(segmentPath(id), ec);
+    if (ec) {
+        throw StorageError("SegmentStore: cannot delete segment: " + segmentPath(id) + ": " + ec.message());
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef CORE_STORAGE_SEGMENT_STORE_H
+#define CORE_STORAGE_SEGMENT_STORE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "StorageIndex.h"
+#include "platform/FileHandle.h"
+#include "platform/MappedFile.h"
+
+/**
+ * SegmentStore
+ *
+ * Packs many sealed records into a few large append-only files instead of one
+ * record_<id>.bin per secret:
+ *      vault_store/
+ *          segment_000001.dat
+ *          segment_000002.dat
+ *          ...
+ *
+ * Segment layout:
+ *  [Header: 16 bytes] magic "ENCSEG\0\0", version, reserved
+ *  [Record]*
+ *      u32 length, u32 format        (plaintext framing, lets tools walk a segment)
+ *      length bytes of sealed record (layout given by 'format', opaque to the store;
+ *                                     0 in segments written before the field was used)
+ *
+ * Records are addressed by RecordLocation {segment, offset of the sealed bytes, length}
+ * kept in the index, so a read is a single pread. Appends go to the newest segment
+ * until it reaches the configured size; a record bigger than that gets a segment of its own.
+ *
+ * A record too big to buffer is streamed into a new segment of its own instead
+ * (beginStream); a stream may also close records as it goes (StreamWriter::next) and
+ * end with a last one. Until the caller releases it with endStream the segment is "open":
+ * appends never go there, and it is not garbage even though nothing references it yet.
+ *
+ * Bytes of replaced or removed records stay in their segment until compaction
+ * copies the live records of a segment forward and deletes it.
+ *
+ * Not thread-safe, except StreamWriter::write / next / finish and reads through openSegment().
+ */
+class SegmentStore {
+public:
+    static constexpr std::uint64_t DEFAULT_SEGMENT_SIZE = 64ULL * 1024 * 1024;
+    static constexpr std::size_t HEADER_SIZE = 16;
+    static constexpr std::size_t RECORD_HEADER_SIZE = 8;
+
+    // Records written piece by piece into a segment of their own (see beginStream).
+    class StreamWriter {
+    public:
+        // Append the next bytes of the current record.
+        void write(std::span<const unsigned char> bytes);
+        // Close the current record as a record of 'format' and start another; returns the closed
+        // record's location. Nothing is flushed until finish().
+        RecordLocation next(std::uint32_t format);
+        // Fill in the record header and flush the segment; the record is complete at the returned location.
+        RecordLocation finish();
+        // Same, for a last record of 'format' rather than the format the stream began with.
+        RecordLocation finish(std::uint32_t format);
+
+        [[nodiscard]]
+        std::uint32_t segment() const { return m_segment; }
+        // Bytes of the current record written so far.
+        [[nodiscard]]
+        std::uint64_t size() const { return m_length; }
+
+    private:
+        friend class SegmentStore;
+
+        FileHandle m_file;
+        std::uint32_t m_segment = 0;
+        std::uint32_t m_format = 0;
+        // Where the current record's bytes begin.
+        std::uint64_t m_start = HEADER_SIZE + RECORD_HEADER_SIZE;
+        std::uint64_t m_length = 0;
+
+        // Fill in the current record's header.
+        RecordLocation close(std::uint32_t format);
+    };
+
+    explicit SegmentStore(std::string dir, std::uint64_t segmentSize = DEFAULT_SEGMENT_SIZE);
+
+    // Append one sealed record to the active segment.
+    RecordLocation append(std::span<const unsigned char> record, std::uint32_t format = 0);
+    // Append a copy of the record at 'from' (format included), in bounded pieces.
+    RecordLocation copy(const RecordLocation &from);
+    // Read a whole sealed record (one pread).
+    [[nodiscard]]
+    std::vector<unsigned char> read(const RecordLocation &location) const;
+    // Format word stored with the record.
+    [[nodiscard]]
+    std::uint32_t format(const RecordLocation &location) const;
+    // A read handle of its own on a segment, for long reads without the caller's lock.
+    // On POSIX it stays readable even if the segment is deleted meanwhile.
+    [[nodiscard]]
+    FileHandle openSegment(std::uint32_t id) const;
+    // Read-only mapping of a segment covering at least its first 'end' bytes. Mappings are cached
+    // and only remapped once a record past the mapped end is asked for, so repeated reads map
+    // nothing. The caller's reference stays valid after the segment is removed.
+    [[nodiscard]]
+    std::shared_ptr<const MappedFile> map(std::uint32_t id, std::uint64_t end) const;
+
+    // Create a new segment and start streaming a record of 'format' into it.
+    StreamWriter beginStream(std::uint32_t format);
+    // The record of 'segment' is referenced now (or 'discard': it never will be, delete the segment).
+    void endStream(std::uint32_t segment, bool discard);
+    // Segments still being written to: the active one and those of unfinished streams.
+    [[nodiscard]]
+    std::vector<std::uint32_t> openSegments() const;
+    [[nodiscard]]
+    bool isStreaming(std::uint32_t id) const { return m_streaming.contains(id); }
+    // Flush the active segment to stable storage.
+    void sync();
+    // Start a new active segment; later appends go there.
+    void rollover();
+    // Close and delete a segment. Its records must no longer be referenced.
+    void removeSegment(std::uint32_t id);
+
+    // Ids of all segment files on disk, ascending.
+    [[nodiscard]]
+    std::vector<std::uint32_t> segmentIds() const;
+    [[nodiscard]]
+    std::string segmentPath(std::uint32_t id) const;
+    [[nodiscard]]
+    std::uint64_t segmentSize() const { return m_segmentSize; }
+    // Segment new records go to (0 before the first append).
+    [[nodiscard]]
+    std::uint32_t activeId() const { return m_activeId; }
+    // True for "segment_<n>.dat" file names.
+    static bool isSegmentFile(const std::string &fileName);
+
+private:
+    std::string m_dir;
+    std::uint64_t m_segmentSize;
+
+    FileHandle m_active;
+    std::uint32_t m_activeId = 0;
+    // Highest segment id handed out or found on disk (once m_lastIdKnown).
+    std::uint32_t m_lastId = 0;
+    bool m_lastIdKnown = false;
+    // Segments of unfinished streams.
+    std::set<std::uint32_t> m_streaming;
+    // Read handles, opened on first use.
+    mutable std::map<std::uint32_t, std::unique_ptr<FileHandle>> m_readers;
+    // Mappings, made on first use.
+    mutable std::map<std::uint32_t, std::shared_ptr<const MappedFile>> m_mappings;
+
+    void openActive(std::uint32_t id);
+    // Open the newest segment for appends, or a new one, if no segment is active yet.
+    void ensureActive();
+    // Id for a new segment.
+    std::uint32_t nextId();
+    // Room for 'bytes' more in the active segment, rolling over if it is full.
+    void reserve(std::uint64_t bytes);
+    [[nodiscard]]
+    const FileHandle &reader(std::uint32_t id) const;
+};
+
+#endif //CORE_STORAGE_SEGMENT_STORE_H
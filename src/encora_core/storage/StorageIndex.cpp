@@ -1 +1,254 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <nlohmann/json.hpp>
+
 #include "StorageIndex.h"
+
+#include "utils/Base64.h"
+#include "utils/Logger.h"
+
+using json = nlohmann::json;
+
+static constexpr std::size_t NPOS = std::numeric_limits<std::size_t>::max();
+static constexpr std::size_t MIN_CAPACITY = 16;
+
+static json toJson(const StorageIndex::Entry &entry) {
+    return {
+        {"id", entry.id},
+        {"name", entry.name},
+        {"type", entry.type},
+        {"created_at", entry.createdAt},
+        {"salt_b64", Base64::encode(std::vector<unsigned char>(entry.salt.begin(), entry.salt.end()))}
+    };
+}
+
+std::string_view StorageIndex::StringArena::intern(const std::string_view str) {
+    if (str.size() > CHUNK_SIZE) {
+        auto chunk = std::make_unique<char[]>(str.size());
+        std::memcpy(chunk.get(), str.data(), str.size());
+        const std::string_view view(chunk.get(), str.size());
+        // Dedicated chunk goes in front of the current one, which stays open for small strings.
+        m_chunks.insert(m_chunks.empty() ? m_chunks.end() : m_chunks.end() - 1, std::move(chunk));
+        return view;
+    }
+
+    if (m_used + str.size() > CHUNK_SIZE) {
+        m_chunks.emplace_back(std::make_unique<char[]>(CHUNK_SIZE));
+        m_used = 0;
+    }
+
+    char *dst = m_chunks.back().get() + m_used;
+    if (!str.empty()) {
+        std::memcpy(dst, str.data(), str.size());
+    }
+    m_used += str.size();
+
+    return {dst, str.size()};
+}
+
+void StorageIndex::StringArena::clear() {
+    m_chunks.clear();
+    m_used = CHUNK_SIZE;
+}
+
+StorageIndex::StorageIndex() : m_slots(MIN_CAPACITY), m_mask(MIN_CAPACITY - 1) {}
+
+std::uint64_t StorageIndex::hash(const std::string_view str) {
+    // FNV-1a, 64 bit
+    std::uint64_t h = 14695981039346656037ULL;
+    for (const char c : str) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+std::uint32_t StorageIndex::tagOf(const std::uint64_t h) {
+    // Never 0, so 0 can mark an empty slot.
+    return static_cast<std::uint32_t>(h >> 32) | 1U;
+}
+
+std::size_t StorageIndex::findSlot(const std::string_view name, const std::uint64_t h) const {
+    const auto tag = tagOf(h);
+    for (std::size_t i = h & m_mask;; i = (i + 1) & m_mask) {
+        const Slot &slot = m_slots[i];
+        if (slot.tag == 0) {
+            return NPOS;
+        }
+
+        if (slot.tag == tag && m_entries[slot.pos].name == name) {
+            return i;
+        }
+    }
+}
+
+void StorageIndex::insertSlot(const std::uint64_t h, const std::uint32_t pos) {
+    std::size_t i = h & m_mask;
+    while (m_slots[i].tag != 0) {
+        i = (i + 1) & m_mask;
+    }
+
+    m_slots[i] = {tagOf(h), pos};
+}
+
+void StorageIndex::eraseSlot(std::size_t slot) {
+    // Backward-shift deletion: keeps probe sequences intact without tombstones.
+    std::size_t next = slot;
+    for (;;) {
+        next = (next + 1) & m_mask;
+        if (m_slots[next].tag == 0) break;
+
+        const std::size_t home = hash(m_entries[m_slots[next].pos].name) & m_mask;
+        // Move 'next' into the hole unless its home lies cyclically in (slot, next].
+        const bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+        if (!stays) {
+            m_slots[slot] = m_slots[next];
+            slot = next;
+        }
+    }
+
+    m_slots[slot] = {};
+}
+
+void StorageIndex::grow() {
+    const std::size_t capacity = m_slots.size() * 2;
+    m_slots.assign(capacity, Slot{});
+    m_mask = capacity - 1;
+
+    for (std::size_t pos = 0; pos < m_entries.size(); ++pos) {
+        insertSlot(hash(m_entries[pos].name), static_cast<std::uint32_t>(pos));
+    }
+}
+
+const StorageIndex::Entry *StorageIndex::find(const std::string_view name) const {
+    const auto slot = findSlot(name, hash(name));
+    if (slot == NPOS) {
+        return nullptr;
+    }
+
+    return &m_entries[m_slots[slot].pos];
+}
+
+void StorageIndex::upsert(const std::string_view name, const std::string_view id, const std::string_view type,
+    const Salt &salt, const std::int64_t createdAt, const RecordLocation &location) {
+    const auto h = hash(name);
+    if (const auto slot = findSlot(name, h); slot != NPOS) {
+        Entry &entry = m_entries[m_slots[slot].pos];
+        entry.id = m_arena.intern(id);
+        entry.type = entry.type == type ? entry.type : m_arena.intern(type);
+        entry.salt = salt;
+        entry.createdAt = createdAt;
+        entry.location = location;
+        return;
+    }
+
+    // Keep load factor <= 0.7 so linear probing stays short.
+    if ((m_entries.size() + 1) * 10 > m_slots.size() * 7) {
+        grow();
+    }
+
+    const auto pos = static_cast<std::uint32_t>(m_entries.size());
+    m_entries.push_back({m_arena.intern(name), m_arena.intern(id), m_arena.intern(type), salt, createdAt, location});
+    insertSlot(h, pos);
+}
+
+bool StorageIndex::erase(const std::string_view name) {
+    const auto slot = findSlot(name, hash(name));
+    if (slot == NPOS) {
+        return false;
+    }
+
+    const auto pos = m_slots[slot].pos;
+    eraseSlot(slot);
+
+    // Keep entries dense: move the last entry into the freed position.
+    const auto last = static_cast<std::uint32_t>(m_entries.size() - 1);
+    if (pos != last) {
+        m_entries[pos] = m_entries[last];
+        const auto moved = findSlot(m_entries[pos].name, hash(m_entries[pos].name));
+        m_slots[moved].pos = pos;
+    }
+
+    m_entries.pop_back();
+    return true;
+}
+
+void StorageIndex::clear() {
+    m_entries.clear();
+    m_slots.assign(MIN_CAPACITY, Slot{});
+    m_mask = MIN_CAPACITY - 1;
+    m_arena.clear();
+}
+
+std::vector<std::string> StorageIndex::names() const {
+    std::vector<std::string> out;
+    out.reserve(m_entries.size());
+    for (const auto &entry : m_entries) {
+        out.emplace_back(entry.name);
+    }
+
+    return out;
+}
+
+void StorageIndex::loadJsonLines(const std::string &path) {
+    clear();
+
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+        return;
+    }
+
+    std::string line;
+    std::size_t skipped = 0;
+    while (std::getline(ifs, line)) {
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        if (line.empty()) continue;
+
+        const auto j = json::parse(line, nullptr, false);
+        if (j.is_discarded() || !j.is_object()) {
+            ++skipped;
+            continue;
+        }
+
+        const auto name = j.value("name", std::string{});
+        const auto id = j.value("id", std::string{});
+        const auto saltBytes = Base64::decode(j.value("salt_b64", std::string{}));
+        if (name.empty() || id.empty() || saltBytes.size() != SALT_SIZE) {
+            // Old format (no salt) or damaged line: record is not usable.
+            ++skipped;
+            continue;
+        }
+
+        Salt salt;
+        std::copy(saltBytes.begin(), saltBytes.end(), salt.begin());
+        upsert(name, id, j.value("type", std::string{}), salt, j.value("created_at", std::int64_t{0}));
+    }
+
+    if (skipped > 0) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn,
+            "StorageIndex: skipped " + std::to_string(skipped) + " malformed index line(s) in " + path);
+    }
+}
+
+void StorageIndex::saveJsonLines(const std::string &path) const {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("StorageIndex: cannot write index: " + path);
+    }
+
+    for (const auto &entry : m_entries) {
+        ofs << toJson(entry).dump() << "\n";
+    }
+}
+
+void StorageIndex::appendJsonLine(const std::string &path, const Entry &entry) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::app);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("Cannot open index for append.");
+    }
+
+    ofs << toJson(entry).dump() << "\n";
+}
@@ -1,8 +1,114 @@
 #ifndef CORE_STORAGE_STORAGE_INDEX_H
 #define CORE_STORAGE_STORAGE_INDEX_H
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Where a sealed record lives. segment == 0 means a legacy per-record file
+ * (record_<id>.bin); otherwise the record is 'length' bytes at 'offset' in
+ * segment file 'segment' (see SegmentStore).
+ */
+struct RecordLocation {
+    std::uint32_t segment = 0;
+    std::uint32_t length = 0;
+    std::uint64_t offset = 0;
+};
+
+/**
+ * StorageIndex
+ *
+ * In-memory index of vault records: name -> (id, type, salt, created_at, location).
+ * Loaded once per storage instance, then every lookup is served from memory.
+ *
+ * Layout:
+ *  - strings (name, id, type) are interned in an append-only arena, so entries
+ *    hold stable string_views and no per-entry heap allocation happens;
+ *  - entries live in one contiguous vector;
+ *  - lookup goes through an open-addressing table (linear probing) of
+ *    {hash tag, entry position} slots, 8 bytes each.
+ *
+ * Not thread-safe: owned by a single EncryptedVaultStorage.
+ */
 class StorageIndex {
+public:
+    static constexpr std::size_t SALT_SIZE = 32;
+    using Salt = std::array<unsigned char, SALT_SIZE>;
+
+    struct Entry {
+        std::string_view name;
+        std::string_view id;
+        std::string_view type;
+        Salt salt {};
+        std::int64_t createdAt = 0;
+        RecordLocation location;
+    };
+
+    StorageIndex();
+
+    // Replace content with the JSON-lines index at 'path'. Missing file = empty index.
+    // Malformed lines are skipped; later lines win over earlier ones with the same name.
+    void loadJsonLines(const std::string &path);
+    // Write the whole index as JSON lines to 'path' (truncates).
+    void saveJsonLines(const std::string &path) const;
+    // Append a single entry as one JSON line to 'path'.
+    static void appendJsonLine(const std::string &path, const Entry &entry);
+
+    // Lookup by name. Returned pointer is valid until the next mutation.
+    [[nodiscard]]
+    const Entry *find(std::string_view name) const;
+    // Insert or replace the entry for 'name'.
+    void upsert(std::string_view name, std::string_view id, std::string_view type, const Salt &salt, std::int64_t createdAt,
+        const RecordLocation &location = {});
+    // Remove entry by name. Returns false if it does not exist.
+    bool erase(std::string_view name);
+    void clear();
+
+    [[nodiscard]]
+    std::size_t size() const { return m_entries.size(); }
+    [[nodiscard]]
+    const std::vector<Entry> &entries() const { return m_entries; }
+    [[nodiscard]]
+    std::vector<std::string> names() const;
+
+private:
+    /**
+     * Chunked bump allocator for strings. Chunks are never moved, so views stay valid.
+     * Space of erased strings is reclaimed only on clear().
+     */
+    class StringArena {
+    public:
+        std::string_view intern(std::string_view str);
+        void clear();
+
+    private:
+        static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+        std::vector<std::unique_ptr<char[]>> m_chunks;
+        std::size_t m_used = CHUNK_SIZE;
+    };
+
+    struct Slot {
+        std::uint32_t tag = 0; // upper bits of the hash, 0 = empty slot
+        std::uint32_t pos = 0; // position in m_entries
+    };
+
+    static std::uint64_t hash(std::string_view str);
+    static std::uint32_t tagOf(std::uint64_t h);
+
+    [[nodiscard]]
+    std::size_t findSlot(std::string_view name, std::uint64_t h) const;
+    void insertSlot(std::uint64_t h, std::uint32_t pos);
+    void eraseSlot(std::size_t slot);
+    void grow();
 
+    StringArena m_arena;
+    std::vector<Entry> m_entries;
+    std::vector<Slot> m_slots;
+    std::size_t m_mask = 0;
 };
 
 #endif //CORE_STORAGE_STORAGE_INDEX_H
@@ -10,22 +10,24 @@
  * Exports the current on-disk vault into a reproducible directory "archive":
  *  <dst>/
  *      vault.meta
- *      store/
- *          index.json
- *          record_*.bin
+ *      vault_store/
+ *          index.log
+ *          segment_*.dat
+ *          record_*.bin      (legacy, if exist)
  *      MANIFEST.json
  *      MANIFEST.hmac
  *
  * Integrity:
  *  - MANIFEST.json contains per-file SHA256 (hex) over bytes
- *  - MANIFEST.hmac = HMAC-SHA256(MANIFEST.json, key = VMK)
+ *  - MANIFEST.hmac signs it with the VMK (manifest v2: Merkle root, see ManifestWriter)
  *
+ * The export mirrors the live layout, so the manifest stays valid after import.
  * Import will verify both hashes before copying back.
  */
 class VaultExporter {
 public:
     // Export current vault from ./data -> <dst>
-    // vmk is used ONLY for HMAC over MANIFEST.json (does not re-encrypt files).
+    // vmk is used ONLY to sign MANIFEST.json (does not re-encrypt files).
     static bool out(const std::string &dst, const std::vector<unsigned char> &vmk, std::string &errorMsg);
     // Import vault from <src> into ./data (overwriting existing files).
     // vmk is required to verify MANIFEST.hmac before trusting contents.
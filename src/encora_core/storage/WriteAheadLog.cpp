@@ -0,0 +1,386 @@
+#include <sodium.h>
+#include <bit>
+#include <cstring>
+
+#include "WriteAheadLog.h"
+#include "StorageError.h"
+
+#include "platform/MappedFile.h"
+#include "utils/Logger.h"
+
+static_assert(std::endian::native == std::endian::little, "vault.wal is stored little-endian");
+
+namespace {
+    constexpr char MAGIC[8] = {'E', 'N', 'C', 'W', 'A', 'L', '\0', '\0'};
+    constexpr std::size_t FILE_HEADER_SIZE = 24;
+    constexpr std::size_t FRAME_HEADER_SIZE = 8;
+    constexpr std::size_t NONCE_SIZE = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    constexpr std::size_t TAG_SIZE = crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    constexpr std::uint64_t SUBKEY_ID = 1;
+    constexpr char SUBKEY_CONTEXT[crypto_kdf_CONTEXTBYTES] = {'E', 'n', 'c', 'W', 'r', 'L', 'o', 'g'};
+
+    template<typename T>
+    void putInt(std::vector<unsigned char> &out, const T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putString(std::vector<unsigned char> &out, const std::string_view str) {
+        if (str.size() > UINT16_MAX) {
+            throw StorageError("WriteAheadLog: field too long (max 65535 bytes).");
+        }
+        putInt(out, static_cast<std::uint16_t>(str.size()));
+        out.insert(out.end(), str.begin(), str.end());
+    }
+
+    // Bounds-checked reader over a decrypted payload.
+    class PayloadReader {
+    public:
+        explicit PayloadReader(const std::vector<unsigned char> &buffer) : m_data(buffer.data()), m_left(buffer.size()) {}
+
+        template<typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string string() {
+            const auto length = get<std::uint16_t>();
+            return {reinterpret_cast<const char *>(take(length)), length};
+        }
+
+        const unsigned char *take(const std::size_t n) {
+            if (n > m_left) {
+                throw StorageError("WriteAheadLog: truncated frame payload.");
+            }
+            const unsigned char *p = m_data;
+            m_data += n;
+            m_left -= n;
+            return p;
+        }
+
+    private:
+        const unsigned char *m_data;
+        std::size_t m_left;
+    };
+
+    void wipe(std::vector<unsigned char> &buffer) {
+        if (!buffer.empty()) {
+            sodium_memzero(buffer.data(), buffer.size());
+        }
+        buffer.clear();
+    }
+}
+
+WriteAheadLog::WriteAheadLog(const std::vector<unsigned char> &vmk) : m_key(crypto_aead_xchacha20poly1305_ietf_KEYBYTES) {
+    if (vmk.size() != crypto_kdf_KEYBYTES) {
+        throw StorageError("WriteAheadLog: VMK has unexpected size.");
+    }
+
+    crypto_kdf_derive_from_key(m_key.data(), m_key.size(), SUBKEY_ID, SUBKEY_CONTEXT, vmk.data());
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    wipe(m_key);
+}
+
+void WriteAheadLog::setBeforeSync(std::function<void()> hook) {
+    std::lock_guard lock(m_mutex);
+    m_beforeSync = std::move(hook);
+}
+
+std::size_t WriteAheadLog::open(const std::string &path, const ReplayFn &replay) {
+    std::lock_guard lock(m_mutex);
+    m_file.close();
+    m_path = path;
+    m_pending.clear();
+    m_nextSeq = 0;
+    m_durableSeq = 0;
+    m_flushing = false;
+    m_failed = false;
+
+    std::size_t replayed = 0;
+    std::size_t validEnd = 0;
+    std::size_t size = 0;
+    {
+        MappedFile file;
+        if (file.open(path) && file.size() >= FILE_HEADER_SIZE) {
+            const unsigned char *data = file.data();
+            size = file.size();
+
+            std::uint32_t version = 0;
+            std::memcpy(&version, data + sizeof(MAGIC), sizeof(version));
+            if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+                throw StorageError("WriteAheadLog: bad magic in " + path);
+            }
+            if (version == 0 || version > VERSION) {
+                throw StorageError("WriteAheadLog: unsupported version " + std::to_string(version) + ".");
+            }
+
+            std::uint64_t seq = 0;
+            std::memcpy(&seq, data + 16, sizeof(seq));
+
+            // Every frame is authenticated before any is replayed: a corrupt log replays nothing.
+            const std::uint64_t firstSeq = seq;
+            std::vector<std::vector<Operation>> transactions;
+            std::size_t offset = FILE_HEADER_SIZE;
+            while (size - offset >= FRAME_HEADER_SIZE) {
+                std::uint32_t sealedLength = 0;
+                std::memcpy(&sealedLength, data + offset, sizeof(sealedLength));
+                const std::size_t frameSize = FRAME_HEADER_SIZE + NONCE_SIZE + sealedLength;
+                if (sealedLength < TAG_SIZE || size - offset < frameSize) {
+                    break; // torn tail
+                }
+                std::vector<Operation> ops;
+                if (!openFrame(data + offset, sealedLength, seq, ops)) {
+                    // Only the last frame can be a torn write; committed transactions follow any other.
+                    if (offset + frameSize == size) {
+                        break;
+                    }
+                    throw StorageError("WriteAheadLog: frame " + std::to_string(seq) + " failed authentication in " + path + ".");
+                }
+
+                transactions.push_back(std::move(ops));
+                ++seq;
+                offset += frameSize;
+            }
+
+            for (std::size_t i = 0; i < transactions.size(); ++i) {
+                replay(firstSeq + i, transactions[i]);
+                ++replayed;
+            }
+
+            validEnd = offset;
+            m_nextSeq = seq;
+            m_durableSeq = seq;
+        }
+    }
+
+    if (!m_file.open(path, true)) {
+        throw StorageError("WriteAheadLog: cannot open: " + path);
+    }
+
+    if (validEnd == 0) {
+        writeHeader(m_nextSeq);
+    } else if (validEnd < size) {
+        EncoraLogger::Logger::log(EncoraLogger::Level::Warn,
+            "WriteAheadLog: dropping uncommitted tail (" + std::to_string(size - validEnd) + " bytes) in " + path);
+        m_file.truncate(validEnd);
+        m_file.sync();
+    }
+    m_fileSize = m_file.size();
+
+    return replayed;
+}
+
+void WriteAheadLog::writeHeader(const std::uint64_t firstSeq) {
+    unsigned char header[FILE_HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    std::memcpy(header + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+    std::memcpy(header + 16, &firstSeq, sizeof(firstSeq));
+
+    m_file.truncate(0);
+    m_file.append(header, sizeof(header));
+    m_file.sync();
+    m_fileSize = m_file.size();
+}
+
+std::uint64_t WriteAheadLog::enqueue(const std::vector<Operation> &ops) {
+    std::lock_guard lock(m_mutex);
+    if (!m_file.isOpen()) {
+        throw StorageError("WriteAheadLog: not open.");
+    }
+    if (m_failed) {
+        throw StorageError("WriteAheadLog: a previous commit failed; reopen the vault.");
+    }
+
+    auto frame = sealFrame(m_nextSeq, ops);
+    m_pending.insert(m_pending.end(), frame.begin(), frame.end());
+
+    return m_nextSeq++;
+}
+
+void WriteAheadLog::waitDurable(const std::uint64_t seq) {
+    std::unique_lock lock(m_mutex);
+    while (m_durableSeq <= seq) {
+        if (m_failed) {
+            throw StorageError("WriteAheadLog: commit failed: " + m_path);
+        }
+        if (m_flushing) {
+            m_durableCv.wait(lock);
+            continue;
+        }
+
+        // Become the group leader: write and sync everything queued so far.
+        m_flushing = true;
+        std::vector<unsigned char> group;
+        group.swap(m_pending);
+        const std::uint64_t groupEnd = m_nextSeq;
+        lock.unlock();
+
+        bool ok = true;
+        try {
+            if (m_beforeSync) {
+                m_beforeSync();
+            }
+            m_file.append(group.data(), group.size());
+            m_file.sync();
+        } catch (const std::exception &e) {
+            ok = false;
+            EncoraLogger::Logger::log(EncoraLogger::Level::Error, std::string("WriteAheadLog: group commit failed: ") + e.what());
+        }
+
+        lock.lock();
+        m_flushing = false;
+        if (ok) {
+            m_durableSeq = groupEnd;
+            m_fileSize += group.size();
+        } else {
+            m_failed = true;
+        }
+        m_durableCv.notify_all();
+    }
+}
+
+std::uint64_t WriteAheadLog::commit(const std::vector<Operation> &ops) {
+    const auto seq = enqueue(ops);
+    waitDurable(seq);
+    return seq;
+}
+
+void WriteAheadLog::reset() {
+    std::lock_guard lock(m_mutex);
+    if (m_flushing || !m_pending.empty() || m_durableSeq != m_nextSeq) {
+        throw StorageError("WriteAheadLog: reset with transactions in flight.");
+    }
+
+    writeHeader(m_nextSeq);
+}
+
+std::uint64_t WriteAheadLog::nextSeq() const {
+    std::lock_guard lock(m_mutex);
+    return m_nextSeq;
+}
+
+std::uint64_t WriteAheadLog::size() const {
+    std::lock_guard lock(m_mutex);
+    return m_fileSize;
+}
+
+bool WriteAheadLog::failed() const {
+    std::lock_guard lock(m_mutex);
+    return m_failed;
+}
+
+bool WriteAheadLog::empty() const {
+    std::lock_guard lock(m_mutex);
+    return m_pending.empty() && m_fileSize <= FILE_HEADER_SIZE;
+}
+
+std::vector<unsigned char> WriteAheadLog::sealFrame(const std::uint64_t seq, const std::vector<Operation> &ops) const {
+    if (ops.size() > UINT32_MAX) {
+        throw StorageError("WriteAheadLog: too many operations in one transaction.");
+    }
+
+    std::vector<unsigned char> payload;
+    for (const auto &op : ops) {
+        putInt(payload, static_cast<std::uint8_t>(op.kind));
+        putString(payload, op.name);
+        if (op.kind == Operation::Kind::Put) {
+            putString(payload, op.id);
+            putString(payload, op.type);
+            payload.insert(payload.end(), op.salt.begin(), op.salt.end());
+            putInt(payload, op.createdAt);
+            putInt(payload, op.location.segment);
+            putInt(payload, op.location.length);
+            putInt(payload, op.location.offset);
+        }
+    }
+    if (payload.size() > UINT32_MAX - TAG_SIZE) {
+        throw StorageError("WriteAheadLog: transaction too large.");
+    }
+
+    const auto sealedLength = static_cast<std::uint32_t>(payload.size() + TAG_SIZE);
+    const auto opCount = static_cast<std::uint32_t>(ops.size());
+    std::vector<unsigned char> frame(FRAME_HEADER_SIZE + NONCE_SIZE + sealedLength);
+    std::memcpy(frame.data(), &sealedLength, sizeof(sealedLength));
+    std::memcpy(frame.data() + 4, &opCount, sizeof(opCount));
+    randombytes_buf(frame.data() + FRAME_HEADER_SIZE, NONCE_SIZE);
+
+    unsigned char aad[FRAME_HEADER_SIZE + sizeof(seq)];
+    std::memcpy(aad, frame.data(), FRAME_HEADER_SIZE);
+    std::memcpy(aad + FRAME_HEADER_SIZE, &seq, sizeof(seq));
+
+    unsigned long long sealedOut = 0;
+    const int r = crypto_aead_xchacha20poly1305_ietf_encrypt(
+        frame.data() + FRAME_HEADER_SIZE + NONCE_SIZE,
+        &sealedOut,
+        payload.data(),
+        payload.size(),
+        aad,
+        sizeof(aad),
+        nullptr,
+        frame.data() + FRAME_HEADER_SIZE,
+        m_key.data()
+        );
+    wipe(payload);
+    if (r != 0) {
+        throw StorageError("WriteAheadLog: frame encryption failed.");
+    }
+
+    return frame;
+}
+
+bool WriteAheadLog::openFrame(const unsigned char *frame, const std::size_t sealedLength, const std::uint64_t seq,
+    std::vector<Operation> &ops) const {
+    unsigned char aad[FRAME_HEADER_SIZE + sizeof(seq)];
+    std::memcpy(aad, frame, FRAME_HEADER_SIZE);
+    std::memcpy(aad + FRAME_HEADER_SIZE, &seq, sizeof(seq));
+
+    std::vector<unsigned char> payload(sealedLength - TAG_SIZE);
+    unsigned long long payloadLength = 0;
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+        payload.data(),
+        &payloadLength,
+        nullptr,
+        frame + FRAME_HEADER_SIZE + NONCE_SIZE,
+        sealedLength,
+        aad,
+        sizeof(aad),
+        frame + FRAME_HEADER_SIZE,
+        m_key.data()
+        ) != 0) {
+        return false;
+    }
+
+    std::uint32_t opCount = 0;
+    std::memcpy(&opCount, frame + 4, sizeof(opCount));
+
+    ops.clear();
+    ops.reserve(opCount);
+    PayloadReader reader(payload);
+    for (std::uint32_t i = 0; i < opCount; ++i) {
+        Operation op;
+        const auto kind = reader.get<std::uint8_t>();
+        if (kind != static_cast<std::uint8_t>(Operation::Kind::Put) && kind != static_cast<std::uint8_t>(Operation::Kind::Remove)) {
+            throw StorageError("WriteAheadLog: unknown operation kind in frame " + std::to_string(seq) + ".");
+        }
+        op.kind = static_cast<Operation::Kind>(kind);
+        op.name = reader.string();
+        if (op.kind == Operation::Kind::Put) {
+            op.id = reader.string();
+            op.type = reader.string();
+            std::memcpy(op.salt.data(), reader.take(op.salt.size()), op.salt.size());
+            op.createdAt = reader.get<std::int64_t>();
+            op.location.segment = reader.get<std::uint32_t>();
+            op.location.length = reader.get<std::uint32_t>();
+            op.location.offset = reader.get<std::uint64_t>();
+        }
+        ops.push_back(std::move(op));
+    }
+    wipe(payload);
+
+    return true;
+}
@@ -0,0 +1,124 @@
+#ifndef CORE_STORAGE_WRITE_AHEAD_LOG_H
+#define CORE_STORAGE_WRITE_AHEAD_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "StorageIndex.h"
+#include "platform/FileHandle.h"
+
+/**
+ * WriteAheadLog (data/vault.wal, format v1)
+ *
+ * Redo log for vault transactions. A transaction is a list of index operations
+ * (put / remove) sealed into a single frame, so it is applied all-or-nothing:
+ * a frame is either fully readable and authentic, or it is dropped.
+ *
+ * Layout:
+ *  [File header: 24 bytes] magic "ENCWAL\0\0", version, reserved, u64 sequence of the first frame
+ *  [Frame]*
+ *      header: u32 sealed length, u32 operation count    (plaintext)
+ *      nonce:  24 bytes
+ *      sealed: XChaCha20-Poly1305(operations), AAD = frame header || u64 frame sequence
+ *
+ * Group commit: enqueue() seals a transaction into the pending buffer, waitDurable()
+ * blocks until it is on disk. The first waiter writes everything pending with one
+ * write and one fsync; committers that queued meanwhile ride along on the same fsync.
+ * The before-sync hook runs ahead of each fsync, so data the operations point at
+ * (segment bytes) is durable before the transaction is.
+ *
+ * On open, committed transactions are handed to the replay callback in order, once every
+ * frame has been authenticated. An incomplete frame at the end, or an unauthentic last
+ * frame, was never acknowledged (a torn group write) and is truncated. An unauthentic
+ * frame with frames after it is corruption: open throws StorageError and replays nothing,
+ * rather than drop the committed transactions that follow. Once the effects of all transactions are
+ * durable elsewhere (index.log synced), reset() empties the log.
+ *
+ * The key is a subkey of the VMK (crypto_kdf, context "EncWrLog").
+ * Thread-safe.
+ */
+class WriteAheadLog {
+public:
+    static constexpr std::uint32_t VERSION = 1;
+
+    struct Operation {
+        enum class Kind : std::uint8_t {
+            Put = 1,
+            Remove = 2,
+        };
+
+        Kind kind = Kind::Put;
+        std::string name;
+        // Put only
+        std::string id;
+        std::string type;
+        StorageIndex::Salt salt {};
+        std::int64_t createdAt = 0;
+        RecordLocation location;
+    };
+
+    using ReplayFn = std::function<void(std::uint64_t seq, const std::vector<Operation> &ops)>;
+
+    explicit WriteAheadLog(const std::vector<unsigned char> &vmk);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // Open (or create) the log at 'path' and replay committed transactions.
+    // Returns the number of transactions replayed.
+    std::size_t open(const std::string &path, const ReplayFn &replay);
+    // Called by the group leader before every fsync.
+    void setBeforeSync(std::function<void()> hook);
+
+    // Seal a transaction into the pending group. Returns its sequence number; does not wait.
+    std::uint64_t enqueue(const std::vector<Operation> &ops);
+    // Block until transaction 'seq' is durable. Throws StorageError if the group write failed.
+    void waitDurable(std::uint64_t seq);
+    // enqueue + waitDurable
+    std::uint64_t commit(const std::vector<Operation> &ops);
+
+    // Drop all transactions. Only call once their effects are durable elsewhere
+    // and nothing is pending.
+    void reset();
+
+    // Sequence number the next transaction will get.
+    [[nodiscard]]
+    std::uint64_t nextSeq() const;
+    // Bytes on disk (header included).
+    [[nodiscard]]
+    std::uint64_t size() const;
+    // True once a group write failed: nothing more is accepted until the log is reopened.
+    [[nodiscard]]
+    bool failed() const;
+    // True if there is nothing on disk or pending to redo.
+    [[nodiscard]]
+    bool empty() const;
+
+private:
+    std::vector<unsigned char> m_key;
+    std::string m_path;
+    FileHandle m_file;
+    std::function<void()> m_beforeSync;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_durableCv;
+    std::vector<unsigned char> m_pending;   // sealed frames not yet written
+    std::uint64_t m_nextSeq = 0;
+    std::uint64_t m_durableSeq = 0;         // all seq below this are on disk
+    std::uint64_t m_fileSize = 0;
+    bool m_flushing = false;
+    bool m_failed = false;
+
+    void writeHeader(std::uint64_t firstSeq);
+    [[nodiscard]]
+    std::vector<unsigned char> sealFrame(std::uint64_t seq, const std::vector<Operation> &ops) const;
+    [[nodiscard]]
+    bool openFrame(const unsigned char *frame, std::size_t sealedLength, std::uint64_t seq, std::vector<Operation> &ops) const;
+};
+
+#endif //CORE_STORAGE_WRITE_AHEAD_LOG_H
@@ -0,0 +1,77 @@
+#include <catch2/catch_all.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "agent/AgentProtocol.h"
+
+// Both ends of a connected Unix socket, closed on scope exit.
+struct SocketPair {
+    int fds[2] = {-1, -1};
+
+    SocketPair() { REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0); }
+    ~SocketPair() {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+};
+
+TEST_CASE("AgentProtocol bodies round-trip and reject short reads") {
+    AgentProtocol::Writer writer;
+    writer.u8(7).u32(0xA1B2C3D4).u64(0x0102030405060708ULL).string("name").string("");
+
+    AgentProtocol::Reader reader(writer.bytes());
+    REQUIRE(reader.u8() == 7);
+    REQUIRE(reader.u32() == 0xA1B2C3D4);
+    REQUIRE(reader.u64() == 0x0102030405060708ULL);
+    REQUIRE(reader.string() == "name");
+    REQUIRE(reader.string().empty());
+    REQUIRE_NOTHROW(reader.end());
+    REQUIRE_THROWS_AS(reader.u8(), AgentError);
+
+    // Little-endian on the wire.
+    REQUIRE(writer.bytes()[1] == 0xD4);
+
+    // A string claiming more bytes than the body has.
+    AgentProtocol::Writer liar;
+    liar.u32(100).u8('x');
+    AgentProtocol::Reader short_(liar.bytes());
+    REQUIRE_THROWS_AS(short_.string(), AgentError);
+
+    AgentProtocol::Reader trailing(writer.bytes());
+    (void) trailing.u8();
+    REQUIRE_THROWS_AS(trailing.end(), AgentError);
+}
+
+TEST_CASE("AgentProtocol frames messages over a socket") {
+    SocketPair pair;
+    REQUIRE(AgentProtocol::peerIsSelf(pair.fds[0]));
+
+    const std::vector<unsigned char> first {1, 2, 3};
+    AgentProtocol::send(pair.fds[0], first);
+    AgentProtocol::send(pair.fds[0], {});
+
+    std::vector<unsigned char> body;
+    REQUIRE(AgentProtocol::receive(pair.fds[1], body));
+    REQUIRE(body == first);
+    REQUIRE(AgentProtocol::receive(pair.fds[1], body));
+    REQUIRE(body.empty());
+
+    // Oversized length prefix: refused before anything is allocated for it.
+    const unsigned char huge[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    REQUIRE(::write(pair.fds[0], huge, sizeof(huge)) == sizeof(huge));
+    REQUIRE_THROWS_AS(AgentProtocol::receive(pair.fds[1], body), AgentError);
+
+    // Closed cleanly between messages / midway through one.
+    SocketPair other;
+    const unsigned char partial[6] = {10, 0, 0, 0, 'a', 'b'};
+    REQUIRE(::write(other.fds[0], partial, sizeof(partial)) == sizeof(partial));
+    ::shutdown(other.fds[0], SHUT_WR);
+    REQUIRE_THROWS_AS(AgentProtocol::receive(other.fds[1], body), AgentError);
+
+    SocketPair closed;
+    ::shutdown(closed.fds[0], SHUT_WR);
+    REQUIRE_FALSE(AgentProtocol::receive(closed.fds[1], body));
+}
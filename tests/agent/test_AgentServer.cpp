@@ -0,0 +1,138 @@
+#include <catch2/catch_all.hpp>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../storage/ScratchVault.h"
+#include "agent/AgentClient.h"
+#include "agent/AgentServer.h"
+
+namespace fs = std::filesystem;
+
+using namespace std::chrono_literals;
+
+static const std::vector<unsigned char> VMK(32, 0x42);
+static const std::string PASSWORD = "correct horse";
+
+static std::string socketPath() {
+    return (fs::current_path() / "data" / "agent.sock").string();
+}
+
+// An agent serving the scratch vault on a thread of its own; stopped and joined on scope exit.
+struct RunningAgent {
+    AgentServer server;
+    std::future<void> running;
+
+    explicit RunningAgent(const AgentOptions &options = {}, std::function<bool(int)> peerCheck = nullptr)
+        : server(socketPath(), VMK, PASSWORD, options) {
+        if (peerCheck) {
+            server.setPeerCheck(std::move(peerCheck));
+        }
+        running = std::async(std::launch::async, [this] { server.run(); });
+    }
+    ~RunningAgent() {
+        server.stop();
+        running.wait();
+    }
+};
+
+static AgentClient connectAgent() {
+    auto client = AgentClient::connect(socketPath());
+    REQUIRE(client.has_value());
+    return std::move(*client);
+}
+
+// Send one request over a connection of our own and return the reply status.
+static AgentProtocol::Status rawStatus(const AgentProtocol::Writer &request) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    const auto path = socketPath();
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0);
+
+    AgentProtocol::send(fd, request.bytes());
+    std::vector<unsigned char> reply;
+    const bool received = AgentProtocol::receive(fd, reply);
+    ::close(fd);
+    REQUIRE(received);
+
+    AgentProtocol::Reader reader(reply);
+    return static_cast<AgentProtocol::Status>(reader.u8());
+}
+
+TEST_CASE("AgentServer denies requests without the unlock password, Stop included") {
+    ScratchVault scratch("encora_test_agent_password");
+    RunningAgent agent;
+
+    AgentProtocol::Writer list;
+    list.u8(static_cast<std::uint8_t>(AgentProtocol::Op::List)).string("wrong").string("");
+    REQUIRE(rawStatus(list) == AgentProtocol::Status::Denied);
+
+    AgentProtocol::Writer stop;
+    stop.u8(static_cast<std::uint8_t>(AgentProtocol::Op::Stop)).string("");
+    REQUIRE(rawStatus(stop) == AgentProtocol::Status::Denied);
+    REQUIRE(agent.running.wait_for(1500ms) == std::future_status::timeout);
+
+    auto client = connectAgent();
+    REQUIRE_NOTHROW(client.ping());
+    REQUIRE_THROWS_AS(client.list("wrong", ""), AgentError);
+    REQUIRE(client.list(PASSWORD, "").empty());
+
+    client.stop(PASSWORD);
+    REQUIRE(agent.running.wait_for(5s) == std::future_status::ready);
+}
+
+TEST_CASE("AgentServer drops connections whose peer fails the check") {
+    ScratchVault scratch("encora_test_agent_peer");
+    RunningAgent agent({}, [](int) { return false; });
+
+    auto client = connectAgent();
+    REQUIRE_THROWS_AS(client.ping(), AgentError);
+    REQUIRE(agent.running.wait_for(0ms) == std::future_status::timeout);
+}
+
+TEST_CASE("AgentServer locks the vault once idle") {
+    ScratchVault scratch("encora_test_agent_idle");
+    AgentOptions options;
+    options.idleTimeout = 1s;
+    RunningAgent agent(options);
+
+    REQUIRE(agent.running.wait_for(5s) == std::future_status::ready);
+}
+
+TEST_CASE("AgentServer streams records both ways and survives a failed Add") {
+    ScratchVault scratch("encora_test_agent_stream");
+    RunningAgent agent;
+    auto client = connectAgent();
+
+    // Several pieces, the last one short; and an empty record.
+    std::string big(3 * AgentProtocol::PIECE_SIZE + 123, '\0');
+    for (std::size_t i = 0; i < big.size(); ++i) {
+        big[i] = static_cast<char>(i * 31 + i / 7);
+    }
+    for (const auto &data : {big, std::string()}) {
+        std::istringstream in(data);
+        REQUIRE(client.add(PASSWORD, "record", "file", in) == data.size());
+        std::ostringstream out;
+        REQUIRE(client.get(PASSWORD, "record", out) == data.size());
+        REQUIRE(out.str() == data);
+    }
+
+    // Refused before anything is read: the agent drains the stream and the connection carries on.
+    std::istringstream in(big);
+    REQUIRE_THROWS_AS(client.add(PASSWORD, "\x01" "chunk:x", "file", in), AgentError);
+    REQUIRE(client.list(PASSWORD, "") == std::vector<std::string> {"record"});
+
+    std::ostringstream out;
+    REQUIRE_THROWS_AS(client.get(PASSWORD, "missing", out), AgentError);
+    REQUIRE_NOTHROW(client.ping());
+}
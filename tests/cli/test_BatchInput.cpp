@@ -0,0 +1,48 @@
+#include <catch2/catch_all.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "BatchInput.h"
+
+// The message of the std::runtime_error thrown by 'read' on 'input'.
+template <typename Read>
+static std::string errorOf(const std::string &input, Read read) {
+    std::istringstream in(input);
+    try {
+        (void) read(in);
+    } catch (const std::runtime_error &e) {
+        return e.what();
+    }
+    FAIL("no error for: " << input);
+    return {};
+}
+
+TEST_CASE("BatchInput parses NDJSON records and names") {
+    std::istringstream records("{\"name\": \"a\", \"type\": \"note\", \"data\": \"hello\"}\n"
+                               "\n"
+                               "{\"name\": \"b\", \"type\": \"bin\", \"data_b64\": \"AAEC\"}\r\n");
+    const auto parsed = BatchInput::readRecords(records);
+    REQUIRE(parsed.size() == 2);
+    REQUIRE(parsed[0].name == "a");
+    REQUIRE(parsed[0].data == std::vector<unsigned char>({'h', 'e', 'l', 'l', 'o'}));
+    REQUIRE(parsed[1].type == "bin");
+    REQUIRE(parsed[1].data == std::vector<unsigned char>({0, 1, 2}));
+
+    std::istringstream names("\"a\"\n{\"name\": \"b\"}\n");
+    REQUIRE(BatchInput::readNames(names) == std::vector<std::string>({"a", "b"}));
+}
+
+TEST_CASE("BatchInput rejects malformed lines by line number") {
+    const auto readRecords = [](std::istream &in) { return BatchInput::readRecords(in); };
+    const auto readNames = [](std::istream &in) { return BatchInput::readNames(in); };
+    const std::string good = "{\"name\": \"a\", \"type\": \"note\", \"data\": \"x\"}\n";
+
+    // Blank lines still count.
+    REQUIRE(errorOf(good + "\n{not json\n", readRecords).starts_with("line 3: invalid JSON"));
+    REQUIRE(errorOf(good + "{\"name\": \"b\", \"type\": \"note\"}\n", readRecords).starts_with("line 2: missing"));
+    REQUIRE(errorOf("{\"name\": \"b\", \"data\": \"x\"}\n", readRecords).starts_with("line 1: expected"));
+    REQUIRE(errorOf("{\"name\": \"\", \"type\": \"note\", \"data\": \"x\"}\n", readRecords).starts_with("line 1: name and data"));
+    REQUIRE(errorOf("\"a\"\n42\n", readNames).starts_with("line 2: expected"));
+}
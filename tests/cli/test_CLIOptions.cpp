@@ -0,0 +1,51 @@
+#include <catch2/catch_all.hpp>
+
+#include <string>
+#include <vector>
+
+#include "CLIOptions.h"
+
+// CLIOptions of "encora_cli <args...>".
+static CLIOptions parse(std::vector<std::string> args) {
+    args.insert(args.begin(), "encora_cli");
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(arg.data());
+    }
+    return CLIOptions(static_cast<int>(argv.size()), argv.data());
+}
+
+TEST_CASE("CLIOptions takes global options right after the command only") {
+    const auto options = parse({"add", "--paranoid", "--jobs", "4", "--session-cache", "60", "--session-keyring", "session",
+        "pw", "note", "text", "hello"});
+    REQUIRE(options.paranoid);
+    REQUIRE(options.jobs == "4");
+    REQUIRE(options.sessionCache == "60");
+    REQUIRE(options.sessionKeyring == "session");
+    REQUIRE(options.password == "pw");
+    REQUIRE(options.name == "note");
+    REQUIRE(options.dataInline == "hello");
+
+    // Past the first argument they are data.
+    const auto inline_ = parse({"add", "pw", "note", "text", "hello", "--paranoid", "world", "--jobs", "2"});
+    REQUIRE_FALSE(inline_.paranoid);
+    REQUIRE(inline_.jobs.empty());
+    REQUIRE(inline_.dataInline == "hello --paranoid world --jobs 2");
+
+    // '--' ends them: a password that looks like one.
+    const auto password = parse({"list", "--jobs", "0", "--", "--paranoid", "prefix"});
+    REQUIRE(password.jobs == "0");
+    REQUIRE_FALSE(password.paranoid);
+    REQUIRE(password.password == "--paranoid");
+    REQUIRE(password.prefix == "prefix");
+
+    // Command options still follow the password.
+    const auto compact = parse({"compact", "--paranoid", "pw", "--min-dead-ratio", "0.2"});
+    REQUIRE(compact.paranoid);
+    REQUIRE(compact.password == "pw");
+    REQUIRE(compact.minDeadRatio == "0.2");
+
+    const auto lock = parse({"lock", "--session-keyring", "user"});
+    REQUIRE(lock.sessionKeyring == "user");
+    REQUIRE(lock.args.empty());
+}
@@ -0,0 +1,91 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "core/CryptoEngine.h"
+
+// Every suite this CPU can run.
+static std::vector<CipherSuite> suites() {
+    std::vector<CipherSuite> out {CipherSuite::XChaCha20Poly1305};
+    if (CryptoEngine::available(CipherSuite::Aes256Gcm)) {
+        out.push_back(CipherSuite::Aes256Gcm);
+    }
+    return out;
+}
+
+TEST_CASE("CryptoEngine round-trips and authenticates with every available suite") {
+    const auto suite = GENERATE(from_range(suites()));
+    INFO("suite " << CryptoEngine::name(suite));
+    std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+    randombytes_buf(key.data(), key.size());
+    const CryptoEngine engine(key, suite);
+    REQUIRE(engine.suite() == suite);
+    REQUIRE(engine.nonceSize() == CryptoEngine::nonceSize(suite));
+
+    std::vector<unsigned char> nonce(engine.nonceSize());
+    randombytes_buf(nonce.data(), nonce.size());
+    const std::vector<unsigned char> aad {'h', 'd', 'r'};
+
+    for (const std::size_t size : {std::size_t {0}, std::size_t {1}, std::size_t {1000}}) {
+        INFO("size " << size);
+        std::vector<unsigned char> plain(size, 0x5A);
+        std::vector<unsigned char> sealed(size + CryptoEngine::TAG_SIZE);
+        engine.encrypt(sealed, plain, nonce, aad);
+
+        std::vector<unsigned char> opened(size);
+        REQUIRE(engine.decrypt(opened, sealed, nonce, aad));
+        REQUIRE(opened == plain);
+
+        // Altered ciphertext, another nonce, another AAD, another key.
+        auto altered = sealed;
+        altered[0] ^= 1;
+        REQUIRE_FALSE(engine.decrypt(opened, altered, nonce, aad));
+        auto otherNonce = nonce;
+        otherNonce[0] ^= 1;
+        REQUIRE_FALSE(engine.decrypt(opened, sealed, otherNonce, aad));
+        REQUIRE_FALSE(engine.decrypt(opened, sealed, nonce, {}));
+        auto otherKey = key;
+        otherKey[0] ^= 1;
+        REQUIRE_FALSE(CryptoEngine(otherKey, suite).decrypt(opened, sealed, nonce, aad));
+    }
+
+    std::vector<unsigned char> out(CryptoEngine::TAG_SIZE);
+    REQUIRE_THROWS_AS(engine.encrypt(out, {}, std::span(nonce).first(nonce.size() - 1)), std::invalid_argument);
+    REQUIRE_FALSE(engine.decrypt(out, std::span(out).first(CryptoEngine::TAG_SIZE - 1), nonce));
+}
+
+TEST_CASE("CryptoEngine resolves suites and rejects unusable ones") {
+    REQUIRE(CryptoEngine::available(CryptoEngine::preferred()));
+    REQUIRE(CryptoEngine::preferred() == (CryptoEngine::available(CipherSuite::Aes256Gcm)
+        ? CipherSuite::Aes256Gcm : CipherSuite::XChaCha20Poly1305));
+    REQUIRE(CryptoEngine::suiteOf(0) == CipherSuite::XChaCha20Poly1305);
+    REQUIRE(CryptoEngine::suiteOf(1) == CipherSuite::Aes256Gcm);
+    REQUIRE_THROWS_AS(CryptoEngine::suiteOf(2), std::runtime_error);
+    REQUIRE_THROWS_AS(CryptoEngine::suiteOf(256), std::runtime_error);
+
+    const std::vector<unsigned char> shortKey(CryptoEngine::KEY_SIZE - 1);
+    REQUIRE_THROWS_AS(CryptoEngine(shortKey), std::invalid_argument);
+    if (!CryptoEngine::available(CipherSuite::Aes256Gcm)) {
+        const std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+        REQUIRE_THROWS_AS(CryptoEngine(key, CipherSuite::Aes256Gcm), std::runtime_error);
+    }
+}
+
+TEST_CASE("CryptoEngine throughput per suite", "[!benchmark]") {
+    std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+    randombytes_buf(key.data(), key.size());
+    const std::vector<unsigned char> plain(1024 * 1024, 0x5A);
+    std::vector<unsigned char> sealed(plain.size() + CryptoEngine::TAG_SIZE);
+
+    for (const auto suite : suites()) {
+        const CryptoEngine engine(key, suite);
+        const std::vector<unsigned char> nonce(engine.nonceSize());
+        BENCHMARK("encrypt 1 MiB, " + std::string(CryptoEngine::name(suite))) {
+            engine.encrypt(sealed, plain, nonce);
+            return sealed[0];
+        };
+    }
+}
@@ -0,0 +1,80 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core/utils/FileHash.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<unsigned char> contentOf(const std::size_t length) {
+    std::vector<unsigned char> content(length);
+    for (std::size_t i = 0; i < length; ++i) {
+        content[i] = static_cast<unsigned char>(i * 131 + i / 7);
+    }
+    return content;
+}
+
+static FileHash::Digest oneShot(const std::vector<unsigned char> &content, const FileHash::Algorithm algorithm) {
+    FileHash::Digest digest {};
+    if (algorithm == FileHash::Algorithm::Sha256) {
+        crypto_hash_sha256(digest.data(), content.data(), content.size());
+    } else {
+        crypto_generichash(digest.data(), digest.size(), content.data(), content.size(), nullptr, 0);
+    }
+    return digest;
+}
+
+TEST_CASE("FileHash streams files to the same digest as one-shot hashing") {
+    REQUIRE(sodium_init() >= 0);
+    const auto dir = fs::temp_directory_path() / "encora_test_file_hash";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    // Empty, shorter than one read, exactly one read, several reads with a short tail.
+    const std::vector<std::size_t> lengths {0, 1000, FileHash::CHUNK_SIZE, 3 * FileHash::CHUNK_SIZE + 123};
+    std::vector<std::string> paths;
+    std::vector<std::vector<unsigned char>> contents;
+    for (const auto length : lengths) {
+        contents.push_back(contentOf(length));
+        paths.push_back((dir / ("file_" + std::to_string(length))).string());
+        std::ofstream(paths.back(), std::ios::binary)
+            .write(reinterpret_cast<const char *>(contents.back().data()), static_cast<std::streamsize>(length));
+    }
+
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        INFO("length " << lengths[i]);
+        for (const auto algorithm : {FileHash::Algorithm::Sha256, FileHash::Algorithm::Blake2b256}) {
+            REQUIRE(FileHash::digest(paths[i], algorithm) == oneShot(contents[i], algorithm));
+        }
+        REQUIRE(FileHash::sha256Hex(paths[i]) == FileHash::toHex(oneShot(contents[i], FileHash::Algorithm::Sha256)));
+
+        // Resuming from an offset reads exactly the rest.
+        const std::uint64_t offset = lengths[i] / 2;
+        std::vector<unsigned char> rest;
+        const auto read = FileHash::read(paths[i], offset, [&](const unsigned char *data, const std::size_t length) {
+            REQUIRE(length <= FileHash::CHUNK_SIZE);
+            rest.insert(rest.end(), data, data + length);
+        });
+        REQUIRE(read == lengths[i] - offset);
+        REQUIRE(rest == std::vector<unsigned char>(contents[i].begin() + static_cast<std::ptrdiff_t>(offset), contents[i].end()));
+    }
+
+    auto withMissing = paths;
+    withMissing.insert(withMissing.begin() + 1, (dir / "missing").string());
+    const auto batch = FileHash::sha256Files(withMissing);
+    REQUIRE(batch.size() == withMissing.size());
+    REQUIRE_FALSE(batch[1]);
+    for (std::size_t i = 0, j = 0; i < batch.size(); ++i) {
+        if (i == 1) continue;
+        REQUIRE(batch[i]);
+        REQUIRE(*batch[i] == oneShot(contents[j++], FileHash::Algorithm::Sha256));
+    }
+
+    REQUIRE_THROWS_AS(FileHash::digest((dir / "missing").string(), FileHash::Algorithm::Sha256), std::runtime_error);
+    REQUIRE_THROWS_AS(FileHash::read((dir / "missing").string(), 0, [](const unsigned char *, std::size_t) {}), std::runtime_error);
+}
@@ -0,0 +1,24 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <stdexcept>
+
+#include "secrets/KeyDerivation.h"
+
+TEST_CASE("KeyDerivation::calibrate stays within the memory budget") {
+    REQUIRE(sodium_init() >= 0);
+
+    // Small enough to run in a test; timings are left alone, they depend on the machine.
+    const std::size_t budget = 8 * 1024 * 1024;
+    const auto calibration = KeyDerivation::calibrate(KdfTarget {std::chrono::milliseconds(40), budget});
+    REQUIRE(calibration.params.memLimit <= budget);
+    REQUIRE(calibration.params.memLimit >= crypto_pwhash_MEMLIMIT_MIN);
+    REQUIRE(calibration.params.opsLimit >= crypto_pwhash_OPSLIMIT_MIN);
+
+    // What it picks derives keys.
+    const std::vector<unsigned char> salt(crypto_pwhash_SALTBYTES, 7);
+    REQUIRE(KeyDerivation::derive("pw", salt, calibration.params).size() == 32);
+
+    REQUIRE_THROWS_AS(KeyDerivation::calibrate(KdfTarget {std::chrono::milliseconds(0), budget}), std::invalid_argument);
+    REQUIRE_THROWS_AS(KeyDerivation::calibrate(KdfTarget {std::chrono::milliseconds(40), 1024}), std::invalid_argument);
+}
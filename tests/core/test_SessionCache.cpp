@@ -0,0 +1,68 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <array>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/keyctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "secrets/SessionCache.h"
+
+// KDF salt of a vault of our own: a fresh one keeps runs from seeing each other's keys.
+static std::vector<unsigned char> freshSalt() {
+    std::vector<unsigned char> salt(16);
+    randombytes_buf(salt.data(), salt.size());
+    return salt;
+}
+
+TEST_CASE("SessionCache hands the derived key back for the same vault only") {
+    REQUIRE(sodium_init() >= 0);
+    const std::vector<unsigned char> derived(32, 0x5A);
+    const auto salt = freshSalt();
+    const SessionCache cache(SessionCacheOptions {std::chrono::seconds(30), SessionCacheOptions::Keyring::User});
+
+    if (!SessionCache::available() || !cache.store(salt, derived)) {
+        WARN("No kernel keyring here: nothing to test.");
+        return;
+    }
+
+    const auto loaded = cache.load(salt);
+    REQUIRE(loaded);
+    REQUIRE(*loaded == derived);
+
+#ifdef __linux__
+    // KEYCTL_DESCRIBE gives "type;uid;gid;perm;description", perm in hex.
+    std::array<unsigned char, 16> id {};
+    crypto_generichash(id.data(), id.size(), salt.data(), salt.size(), nullptr, 0);
+    std::array<char, 33> hex {};
+    sodium_bin2hex(hex.data(), hex.size(), id.data(), id.size());
+    const std::string name = std::string("encora:kek:") + hex.data();
+    const auto key = ::syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING, "user", name.c_str(), 0);
+    REQUIRE(key >= 0);
+    std::array<char, 256> info {};
+    REQUIRE(::syscall(SYS_keyctl, KEYCTL_DESCRIBE, key, info.data(), info.size()) > 0);
+    std::string fields(info.data());
+    for (int i = 0; i < 3; ++i) {
+        fields.erase(0, fields.find(';') + 1);
+    }
+    const auto perm = std::stoul(fields.substr(0, fields.find(';')), nullptr, 16);
+    // view, read, write, search and setattr for the possessor; nothing for anyone else.
+    REQUIRE(perm == 0x2F000000UL);
+#endif
+
+    // Storing again replaces what the vault had cached.
+    const std::vector<unsigned char> rederived(32, 0xA5);
+    REQUIRE(cache.store(salt, rederived));
+    REQUIRE(cache.load(salt) == rederived);
+
+    // Another vault never finds it.
+    REQUIRE_FALSE(cache.load(freshSalt()));
+
+    cache.revoke(salt);
+    REQUIRE_FALSE(cache.load(salt));
+}
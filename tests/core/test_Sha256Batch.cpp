@@ -0,0 +1,69 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "core/utils/Sha256Batch.h"
+
+static std::vector<std::vector<unsigned char>> messagesOf(const std::vector<std::size_t> &lengths) {
+    std::vector<std::vector<unsigned char>> messages;
+    for (const auto length : lengths) {
+        std::vector<unsigned char> message(length);
+        for (std::size_t i = 0; i < length; ++i) {
+            message[i] = static_cast<unsigned char>(i * 31 + length);
+        }
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+static std::vector<FileHash::Digest> hashAll(const std::vector<std::vector<unsigned char>> &messages, const Sha256Batch::Kernel kernel) {
+    const std::vector<std::span<const unsigned char>> spans(messages.begin(), messages.end());
+    std::vector<FileHash::Digest> digests(messages.size());
+    Sha256Batch::hash(spans, digests, kernel);
+    return digests;
+}
+
+TEST_CASE("Sha256Batch matches crypto_hash_sha256 for every kernel") {
+    // Every padding case (tail of 0..63 bytes, one or two padding blocks), mixed in one batch.
+    std::vector<std::size_t> lengths;
+    for (std::size_t length = 0; length <= 200; ++length) {
+        lengths.push_back(length);
+    }
+    for (const auto length : std::vector<std::size_t> {511, 512, 1000, 4096, 65536}) {
+        lengths.push_back(length);
+    }
+    const auto messages = messagesOf(lengths);
+
+    for (const auto kernel : {Sha256Batch::Kernel::Scalar, Sha256Batch::Kernel::Avx2}) {
+        const auto digests = hashAll(messages, kernel);
+        for (std::size_t i = 0; i < messages.size(); ++i) {
+            FileHash::Digest expected {};
+            crypto_hash_sha256(expected.data(), messages[i].data(), messages[i].size());
+            INFO("kernel " << Sha256Batch::name(kernel) << ", length " << messages[i].size());
+            REQUIRE(digests[i] == expected);
+        }
+    }
+
+    REQUIRE(hashAll({}, Sha256Batch::kernel()).empty());
+}
+
+TEST_CASE("Sha256Batch throughput on small records", "[!benchmark]") {
+    const auto messages = messagesOf(std::vector<std::size_t>(4096, 700));
+    const std::vector<std::span<const unsigned char>> spans(messages.begin(), messages.end());
+    std::vector<FileHash::Digest> digests(messages.size());
+
+    BENCHMARK("crypto_hash_sha256, one message at a time") {
+        for (std::size_t i = 0; i < spans.size(); ++i) {
+            crypto_hash_sha256(digests[i].data(), spans[i].data(), spans[i].size());
+        }
+        return digests.back()[0];
+    };
+
+    BENCHMARK("Sha256Batch, " + std::string(Sha256Batch::name(Sha256Batch::kernel()))) {
+        Sha256Batch::hash(spans, digests);
+        return digests.back()[0];
+    };
+}
@@ -0,0 +1,124 @@
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "security/IntegrityChecker.h"
+#include "security/ManifestWriter.h"
+#include "security/StatCache.h"
+
+namespace fs = std::filesystem;
+
+static std::string recordName(int i) {
+    std::string digits = std::to_string(i);
+    return "vault_store/record_" + std::string(4 - digits.size(), '0') + digits + ".bin";
+}
+
+TEST_CASE("Parallel IntegrityChecker reports the first failure in manifest order") {
+    const auto root = (fs::temp_directory_path() / "encora_test_integrity").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    auto write = [&](const std::string &rel, const std::string &content) {
+        std::ofstream(root + "/" + rel, std::ios::binary) << content;
+    };
+
+    write("vault.meta", "meta");
+    for (int i = 0; i < 64; ++i) {
+        write(recordName(i), std::string(static_cast<std::size_t>(1000 + i), static_cast<char>('a' + i % 26)));
+    }
+    std::string err;
+    REQUIRE(ManifestWriter::update(root, vmk, err));
+
+    for (const unsigned jobs : {1u, 4u, 16u, 0u}) {
+        REQUIRE(IntegrityChecker::verify(root, vmk, VerifyOptions {jobs}).status == IntegrityStatus::OK);
+    }
+
+    write(recordName(50), "tampered");
+    write(recordName(17), "tampered");
+    const auto sequential = IntegrityChecker::verify(root, vmk);
+    REQUIRE(sequential.status == IntegrityStatus::HashMismatch);
+    REQUIRE(sequential.message.find("record_0017") != std::string::npos);
+    for (int run = 0; run < 20; ++run) {
+        const auto parallel = IntegrityChecker::verify(root, vmk, VerifyOptions {8});
+        REQUIRE(parallel.status == sequential.status);
+        REQUIRE(parallel.message == sequential.message);
+    }
+}
+
+TEST_CASE("Deferred IntegrityChecker checks files on demand and in the background") {
+    const auto root = (fs::temp_directory_path() / "encora_test_integrity_deferred").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    auto write = [&](const std::string &rel, const std::string &content) {
+        std::ofstream(root + "/" + rel, std::ios::binary) << content;
+    };
+
+    write("vault.meta", "meta");
+    for (int i = 0; i < 32; ++i) {
+        write(recordName(i), std::string(static_cast<std::size_t>(1000 + i), 'x'));
+    }
+    std::string err;
+    REQUIRE(ManifestWriter::update(root, vmk, err));
+
+    auto clean = IntegrityChecker::verifyDeferred(root, vmk, {"vault.meta"}, VerifyOptions {2});
+    REQUIRE(clean->verifyFile(recordName(3)).status == IntegrityStatus::OK);
+    REQUIRE(clean->verifyFile("vault_store/unlisted.bin").status == IntegrityStatus::OK);
+    REQUIRE(clean->wait().status == IntegrityStatus::OK);
+    REQUIRE(clean->ready());
+
+    write(recordName(20), "tampered");
+    auto tampered = IntegrityChecker::verifyDeferred(root, vmk, {}, VerifyOptions {4});
+    REQUIRE(tampered->verifyFile(recordName(20)).status == IntegrityStatus::HashMismatch);
+    REQUIRE(tampered->verifyFile(recordName(21)).status == IntegrityStatus::OK);
+    const auto report = tampered->wait();
+    REQUIRE(report.status == IntegrityStatus::HashMismatch);
+    REQUIRE(report.message.find("record_0020") != std::string::npos);
+
+    // A manifest that does not authenticate fails before any file is hashed.
+    auto wrongKey = IntegrityChecker::verifyDeferred(root, std::vector<unsigned char>(32, 0x01), {});
+    REQUIRE(wrongKey->ready());
+    REQUIRE(wrongKey->status() == IntegrityStatus::HMACMismatch);
+}
+
+TEST_CASE("Stat cache vouches only for files whose stat tuple is unchanged") {
+    const auto root = (fs::temp_directory_path() / "encora_test_integrity_stat").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    auto write = [&](const std::string &rel, const std::string &content) {
+        std::ofstream(root + "/" + rel, std::ios::binary) << content;
+        // Well before the cache is written, so entries are not racily clean.
+        fs::last_write_time(root + "/" + rel, fs::file_time_type::clock::now() - std::chrono::hours(1));
+    };
+
+    write("vault.meta", "meta");
+    write(recordName(1), "one");
+    write(recordName(2), "two");
+    std::string err;
+    REQUIRE(ManifestWriter::update(root, vmk, err));
+
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+    REQUIRE(fs::exists(root + "/" + StatCache::FILE_NAME));
+    {
+        StatCache cache(root, vmk, FileHash::preferred());
+        const auto stat = StatCache::stat(root + "/" + recordName(1));
+        REQUIRE(stat);
+        REQUIRE(cache.lookup(recordName(1), *stat));
+        REQUIRE_FALSE(StatCache(root, std::vector<unsigned char>(32, 0x01), FileHash::preferred()).lookup(recordName(1), *stat));
+    }
+
+    // Same size, mtime put back: ctime still gives it away.
+    const auto before = fs::last_write_time(root + "/" + recordName(2));
+    std::ofstream(root + "/" + recordName(2), std::ios::binary) << "owt";
+    fs::last_write_time(root + "/" + recordName(2), before);
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::HashMismatch);
+
+    VerifyOptions paranoid;
+    paranoid.paranoid = true;
+    REQUIRE(IntegrityChecker::verify(root, vmk, paranoid).status == IntegrityStatus::HashMismatch);
+}
@@ -0,0 +1,87 @@
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "security/IntegrityChecker.h"
+#include "security/ManifestWriter.h"
+
+namespace fs = std::filesystem;
+
+static std::string slurp(const fs::path &path) {
+    std::ifstream ifs(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+// The incremental manifest on disk must be exactly what a full rebuild writes, and verify.
+static void requireSameAsRebuild(const std::string &root, const std::vector<unsigned char> &vmk) {
+    const auto patchedJson = slurp(fs::path(root) / "MANIFEST.json");
+    const auto patchedHmac = slurp(fs::path(root) / "MANIFEST.hmac");
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+
+    std::string err;
+    REQUIRE(ManifestWriter::update(root, vmk, err));
+    REQUIRE(slurp(fs::path(root) / "MANIFEST.json") == patchedJson);
+    REQUIRE(slurp(fs::path(root) / "MANIFEST.hmac") == patchedHmac);
+}
+
+TEST_CASE("Incremental ManifestWriter updates match a full rebuild") {
+    const auto root = (fs::temp_directory_path() / "encora_test_manifest_writer").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    auto write = [&](const std::string &rel, const std::string &content, const std::ios::openmode mode = std::ios::trunc) {
+        std::ofstream(root + "/" + rel, std::ios::binary | mode) << content;
+    };
+
+    write("vault.meta", "meta");
+    write("vault_store/index.log", std::string(3000, 'i'));
+    // Larger than one read of FileHash, so resuming crosses read boundaries.
+    write("vault_store/segment_000001.dat", std::string(300 * 1024, 'a'));
+    write("vault_store/segment_000002.dat", std::string(5000, 'b'));
+
+    ManifestWriter writer(root, vmk);
+    std::string err;
+    REQUIRE(writer.rebuild(err));
+    requireSameAsRebuild(root, vmk);
+
+    SECTION("a segment grown by appends") {
+        for (int round = 0; round < 3; ++round) {
+            write("vault_store/segment_000002.dat", std::string(static_cast<std::size_t>(7000 + round), 'c'), std::ios::app);
+            write("vault_store/index.log", "frame", std::ios::app);
+            ManifestWriter::Changes changes;
+            changes.appended = {"vault_store/segment_000002.dat", "vault_store/index.log"};
+            REQUIRE(writer.update(changes, err));
+            requireSameAsRebuild(root, vmk);
+        }
+    }
+
+    SECTION("a file replaced, and one created") {
+        // Shorter than before: cannot be resumed even if reported as appended.
+        write("vault_store/index.log", "checkpoint");
+        write("vault_store/segment_000003.dat", std::string(4096, 'd'));
+        ManifestWriter::Changes changes;
+        changes.replaced = {"vault_store/segment_000003.dat"};
+        changes.appended = {"vault_store/index.log"};
+        REQUIRE(writer.update(changes, err));
+        requireSameAsRebuild(root, vmk);
+
+        write("vault_store/segment_000001.dat", std::string(300 * 1024, 'e'));
+        changes.clear();
+        changes.replaced = {"vault_store/segment_000001.dat"};
+        REQUIRE(writer.update(changes, err));
+        requireSameAsRebuild(root, vmk);
+    }
+
+    SECTION("a file deleted") {
+        fs::remove(root + "/vault_store/segment_000001.dat");
+        ManifestWriter::Changes changes;
+        changes.replaced = {"vault_store/segment_000001.dat"};
+        REQUIRE(writer.update(changes, err));
+        requireSameAsRebuild(root, vmk);
+        REQUIRE(slurp(fs::path(root) / "MANIFEST.json").find("segment_000001") == std::string::npos);
+    }
+}
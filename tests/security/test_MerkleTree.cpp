@@ -0,0 +1,151 @@
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "security/IntegrityChecker.h"
+#include "security/ManifestWriter.h"
+#include "security/MerkleTree.h"
+#include "utils/FileHash.h"
+
+namespace fs = std::filesystem;
+
+static MerkleTree::Hash digestOf(unsigned char fill) {
+    MerkleTree::Hash digest;
+    digest.fill(fill);
+    return digest;
+}
+
+static std::vector<MerkleTree::Hash> leavesOf(std::size_t count) {
+    std::vector<MerkleTree::Hash> leaves;
+    for (std::size_t i = 0; i < count; ++i) {
+        leaves.push_back(MerkleTree::leafHash("file_" + std::to_string(i), digestOf(static_cast<unsigned char>(i))));
+    }
+    return leaves;
+}
+
+TEST_CASE("MerkleTree proves every leaf and tracks leaf updates") {
+    for (const std::size_t count : std::vector<std::size_t>{1, 2, 3, 5, 8, 13}) {
+        const auto leaves = leavesOf(count);
+        MerkleTree tree(leaves);
+        REQUIRE(tree.size() == count);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto proof = tree.proof(i);
+            REQUIRE(MerkleTree::verify(leaves[i], proof, tree.root()));
+            REQUIRE_FALSE(MerkleTree::verify(MerkleTree::leafHash("other", digestOf(0xEE)), proof, tree.root()));
+        }
+
+        // In-place update matches a rebuild.
+        auto changed = leaves;
+        changed[count / 2] = MerkleTree::leafHash("changed", digestOf(0xAB));
+        const auto before = tree.root();
+        tree.set(count / 2, changed[count / 2]);
+        REQUIRE(tree.root() != before);
+        REQUIRE(tree.root() == MerkleTree(changed).root());
+        REQUIRE_FALSE(MerkleTree::verify(leaves[count / 2], tree.proof(count / 2), tree.root()));
+    }
+
+    REQUIRE(MerkleTree().root() != MerkleTree(leavesOf(1)).root());
+}
+
+TEST_CASE("Manifest v2 verifies single files against the signed root") {
+    const auto root = (fs::temp_directory_path() / "encora_test_manifest").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x5A);
+    auto write = [&](const std::string &rel, const std::string &content) {
+        std::ofstream(root + "/" + rel, std::ios::binary) << content;
+    };
+    write("vault.meta", "meta");
+    write("vault_store/index.log", "index");
+    write("vault_store/segment_000001.dat", "records");
+
+    ManifestWriter writer(root, vmk);
+    std::string err;
+    REQUIRE(writer.rebuild(err));
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+
+    // Appends are picked up incrementally.
+    std::ofstream(root + "/vault_store/segment_000001.dat", std::ios::binary | std::ios::app) << "more";
+    ManifestWriter::Changes changes;
+    changes.appended.insert("vault_store/segment_000001.dat");
+    REQUIRE(writer.update(changes, err));
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+
+    // A damaged file fails on its own; the others still verify.
+    write("vault_store/index.log", "tampered");
+    REQUIRE(IntegrityChecker::verifyFile(root, vmk, "vault_store/index.log").status == IntegrityStatus::HashMismatch);
+    REQUIRE(IntegrityChecker::verifyFile(root, vmk, "vault_store/segment_000001.dat").status == IntegrityStatus::OK);
+    REQUIRE(IntegrityChecker::verifyFile(root, vmk, "vault.meta").status == IntegrityStatus::OK);
+    REQUIRE(IntegrityChecker::verifySubtree(root, vmk, "vault_store/").status == IntegrityStatus::HashMismatch);
+    REQUIRE(IntegrityChecker::verifyFile(root, vmk, "vault_store/missing.dat").status == IntegrityStatus::HashMismatch);
+
+    // Only the key holder can sign a root.
+    REQUIRE(IntegrityChecker::verify(root, std::vector<unsigned char>(32, 0x01)).status == IntegrityStatus::HMACMismatch);
+}
+
+TEST_CASE("Manifest v3 records and signs its digest algorithm; v2 still verifies") {
+    const auto root = (fs::temp_directory_path() / "encora_test_manifest_alg").string();
+    fs::remove_all(root);
+    fs::create_directories(root + "/vault_store");
+    const std::vector<unsigned char> vmk(32, 0x5A);
+    auto write = [&](const std::string &rel, const std::string &content) {
+        std::ofstream(root + "/" + rel, std::ios::binary) << content;
+    };
+    auto readManifest = [&] {
+        std::ifstream ifs(root + "/MANIFEST.json", std::ios::binary);
+        return nlohmann::json::parse(ifs);
+    };
+    write("vault.meta", "meta");
+    write("vault_store/index.log", "index");
+    write("vault_store/segment_000001.dat", "records");
+
+    for (const auto algorithm : {FileHash::Algorithm::Sha256, FileHash::Algorithm::Blake2b256}) {
+        ManifestWriter writer(root, vmk);
+        writer.setAlgorithm(algorithm);
+        std::string err;
+        REQUIRE(writer.rebuild(err));
+
+        auto j = readManifest();
+        REQUIRE(j["version"] == ManifestWriter::VERSION);
+        REQUIRE(j["alg"] == std::string(FileHash::name(algorithm)));
+        REQUIRE(j["files"][0]["digest"] == FileHash::toHex(FileHash::digest(root + "/vault.meta", algorithm)));
+        REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+
+        // The algorithm is covered by the HMAC.
+        j["alg"] = std::string(FileHash::name(algorithm == FileHash::Algorithm::Sha256 ? FileHash::Algorithm::Blake2b256 : FileHash::Algorithm::Sha256));
+        std::ofstream(root + "/MANIFEST.json", std::ios::binary | std::ios::trunc) << j.dump();
+        REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::HMACMismatch);
+    }
+
+    // A v2 manifest: SHA-256 "sha256" entries, root signed without an algorithm id.
+    std::vector<MerkleTree::Hash> leaves;
+    nlohmann::json files = nlohmann::json::array();
+    for (const auto *rel : {"vault.meta", "vault_store/index.log", "vault_store/segment_000001.dat"}) {
+        const auto digest = FileHash::sha256(root + "/" + rel);
+        leaves.push_back(MerkleTree::leafHash(rel, digest));
+        files.push_back({{"path", rel}, {"sha256", FileHash::toHex(digest)}});
+    }
+    const MerkleTree tree(leaves);
+    std::ofstream(root + "/MANIFEST.json", std::ios::binary | std::ios::trunc)
+        << nlohmann::json {{"files", files}, {"root", FileHash::toHex(tree.root())}, {"version", 2}}.dump();
+    const auto mac = ManifestWriter::signRoot(tree.root(), tree.size(), FileHash::Algorithm::Sha256, vmk, 2);
+    std::ofstream(root + "/MANIFEST.hmac", std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char *>(mac.data()),
+        static_cast<std::streamsize>(mac.size()));
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+
+    // An incremental update keeps SHA-256 and rewrites it as v3.
+    ManifestWriter writer(root, vmk);
+    writer.setAlgorithm(FileHash::Algorithm::Blake2b256);
+    std::ofstream(root + "/vault_store/segment_000001.dat", std::ios::binary | std::ios::app) << "more";
+    ManifestWriter::Changes changes;
+    changes.appended.insert("vault_store/segment_000001.dat");
+    std::string err;
+    REQUIRE(writer.update(changes, err));
+    REQUIRE(readManifest()["alg"] == "sha256");
+    REQUIRE(IntegrityChecker::verify(root, vmk).status == IntegrityStatus::OK);
+}
@@ -0,0 +1,22 @@
+#ifndef TESTS_STORAGE_SCRATCH_VAULT_H
+#define TESTS_STORAGE_SCRATCH_VAULT_H
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// EncryptedVaultStorage works on ./data: run in a scratch directory with a vault.meta to list.
+struct ScratchVault {
+    std::filesystem::path previous = std::filesystem::current_path();
+
+    explicit ScratchVault(const std::string &name) {
+        const auto dir = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "data");
+        std::filesystem::current_path(dir);
+        std::ofstream("data/vault.meta") << "meta";
+    }
+    ~ScratchVault() { std::filesystem::current_path(previous); }
+};
+
+#endif //TESTS_STORAGE_SCRATCH_VAULT_H
@@ -0,0 +1,178 @@
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ScratchVault.h"
+#include "security/IntegrityChecker.h"
+#include "storage/EncryptedVaultStorage.h"
+#include "storage/SegmentStore.h"
+#include "utils/Logger.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<EncryptedVaultStorage::NewRecord> recordsOf(const int count) {
+    std::vector<EncryptedVaultStorage::NewRecord> records;
+    for (int i = 0; i < count; ++i) {
+        const auto text = "secret #" + std::to_string(i);
+        records.push_back({"rec_" + std::to_string(i), "note", std::vector<unsigned char>(text.begin(), text.end())});
+    }
+    return records;
+}
+
+TEST_CASE("addRecords commits a batch with one manifest update, visible after reopen") {
+    ScratchVault scratch("encora_test_batch_add");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    const auto records = recordsOf(40);
+
+    {
+        EncryptedVaultStorage storage(vmk);
+        // Count manifest writes of the batch alone in the log.
+        std::ostringstream log;
+        EncoraLogger::Logger::init("logs", log);
+        REQUIRE(storage.addRecords(records) == records.size());
+        EncoraLogger::Logger::shutdown();
+
+        std::size_t updates = 0;
+        for (auto at = log.str().find("Manifest updated"); at != std::string::npos; at = log.str().find("Manifest updated", at + 1)) {
+            ++updates;
+        }
+        REQUIRE(updates == 1);
+    }
+
+    EncryptedVaultStorage reopened(vmk);
+    REQUIRE(reopened.list("rec_").size() == records.size());
+    for (const auto &record : records) {
+        REQUIRE(reopened.loadRecord(record.name) == record.data);
+    }
+    REQUIRE(IntegrityChecker::verify("data", vmk).status == IntegrityStatus::OK);
+}
+
+TEST_CASE("removeRecords with an unknown name removes nothing") {
+    ScratchVault scratch("encora_test_batch_remove");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    const auto records = recordsOf(5);
+
+    {
+        EncryptedVaultStorage storage(vmk);
+        storage.addRecords(records);
+        const std::vector<std::string> names {"rec_0", "rec_3", "missing", "rec_4"};
+        REQUIRE_THROWS_AS(storage.removeRecords(names), std::runtime_error);
+        REQUIRE(storage.list("rec_").size() == records.size());
+    }
+
+    EncryptedVaultStorage reopened(vmk);
+    for (const auto &record : records) {
+        REQUIRE(reopened.loadRecord(record.name) == record.data);
+    }
+    const std::vector<std::string> known {"rec_0", "rec_3"};
+    REQUIRE(reopened.removeRecords(known) == 2);
+    REQUIRE(reopened.list("rec_").size() == records.size() - 2);
+}
+
+TEST_CASE("compact leaves no empty segment behind when nothing is live") {
+    ScratchVault scratch("encora_test_compact_empty");
+    const std::vector<unsigned char> vmk(32, 0x42);
+    const auto records = recordsOf(5);
+    std::vector<std::string> names;
+    for (const auto &record : records) {
+        names.push_back(record.name);
+    }
+
+    {
+        EncryptedVaultStorage storage(vmk);
+        storage.addRecords(records);
+        REQUIRE(storage.removeRecords(names) == records.size());
+
+        CompactionOptions options;
+        options.minDeadRatio = 0;
+        options.minDeadBytes = 0;
+        const auto report = storage.compact(options);
+        REQUIRE(report.segmentsRewritten >= 1);
+        REQUIRE(report.recordsMoved == 0);
+        for (const auto &file : fs::directory_iterator("data/vault_store")) {
+            if (file.path().extension() == ".dat") {
+                REQUIRE(file.file_size() > SegmentStore::HEADER_SIZE);
+            }
+        }
+        REQUIRE(IntegrityChecker::verify("data", vmk).status == IntegrityStatus::OK);
+
+        storage.addRecords(recordsOf(1));
+    }
+
+    EncryptedVaultStorage reopened(vmk);
+    REQUIRE(reopened.loadRecord("rec_0") == recordsOf(1).front().data);
+    REQUIRE(IntegrityChecker::verify("data", vmk).status == IntegrityStatus::OK);
+}
+
+// Bytes in all segments of the scratch vault.
+static std::uint64_t segmentBytes() {
+    std::uint64_t total = 0;
+    for (const auto &file : fs::directory_iterator("data/vault_store")) {
+        if (file.path().extension() == ".dat") {
+            total += file.file_size();
+        }
+    }
+    return total;
+}
+
+TEST_CASE("Deduplicated records share chunks, keep them when replaced, and compact drops them once unreferenced") {
+    ScratchVault scratch("encora_test_dedup_vault");
+    const std::vector<unsigned char> vmk(32, 0x42);
+
+    // Incompressible and well over DEDUPLICATION_MIN_SIZE; the twin differs in 100 bytes.
+    std::mt19937 rng(7);
+    std::vector<unsigned char> original(256 * 1024);
+    for (auto &byte : original) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    auto twin = original;
+    std::fill_n(twin.begin() + 128 * 1024, 100, 0xAB);
+    const auto kept = recordsOf(1).front();
+
+    {
+        EncryptedVaultStorage storage(vmk);
+        storage.setAutoCompaction(std::nullopt);
+        storage.setAutoGc(std::nullopt);
+
+        REQUIRE(storage.addRecord("original", "file", original));
+        const auto afterOriginal = segmentBytes();
+        REQUIRE(storage.addRecord("twin", "file", twin));
+        // Only the chunks around the change are new.
+        REQUIRE(segmentBytes() - afterOriginal < original.size() / 4);
+        REQUIRE(storage.list() == std::vector<std::string> {"original", "twin"});
+        REQUIRE(storage.loadRecord("original") == original);
+        REQUIRE(storage.loadRecord("twin") == twin);
+        REQUIRE(storage.recordSize("twin") == twin.size());
+
+        // Replaced by the same content: its chunks gain a reference before losing the old one.
+        auto again = original;
+        REQUIRE(storage.addRecord("original", "file", again));
+        CompactionOptions all;
+        all.minDeadRatio = 0;
+        all.minDeadBytes = 0;
+        REQUIRE(storage.compact(all).chunksDropped == 0);
+        REQUIRE(storage.loadRecord("original") == original);
+        REQUIRE(storage.loadRecord("twin") == twin);
+
+        auto small = kept.data;
+        REQUIRE(storage.addRecord(kept.name, kept.type, small));
+        const std::vector<std::string> both {"original", "twin"};
+        REQUIRE(storage.removeRecords(both) == 2);
+        const auto report = storage.compact(all);
+        REQUIRE(report.chunksDropped > 0);
+        REQUIRE(segmentBytes() < original.size() / 4);
+    }
+
+    EncryptedVaultStorage reopened(vmk);
+    REQUIRE(reopened.list() == std::vector<std::string> {kept.name});
+    REQUIRE(reopened.loadRecord(kept.name) == kept.data);
+    REQUIRE(IntegrityChecker::verify("data", vmk).status == IntegrityStatus::OK);
+}
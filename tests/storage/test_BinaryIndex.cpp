@@ -0,0 +1,64 @@
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "storage/BinaryIndex.h"
+#include "storage/StorageError.h"
+
+namespace fs = std::filesystem;
+
+static StorageIndex sampleIndex() {
+    StorageIndex index;
+    StorageIndex::Salt salt;
+    for (const auto *name : {"mail/work", "db/prod", "mail/home", "api/key", "db/stage"}) {
+        salt.fill(static_cast<unsigned char>(name[0]));
+        index.upsert(name, std::string("id_") + name, "note", salt, 42);
+    }
+    return index;
+}
+
+TEST_CASE("BinaryIndex binary-searches and prefix-scans a mapped file") {
+    const auto path = (fs::temp_directory_path() / "encora_test_index.bin").string();
+    BinaryIndex::write(path, sampleIndex());
+
+    BinaryIndex view;
+    REQUIRE(view.open(path));
+    REQUIRE(view.size() == 5);
+    REQUIRE(view.at(0).name == "api/key");
+
+    const auto hit = view.find("db/prod");
+    REQUIRE(hit.has_value());
+    REQUIRE(hit->id == "id_db/prod");
+    REQUIRE(hit->salt[0] == 'd');
+    REQUIRE_FALSE(view.find("db").has_value());
+    REQUIRE_FALSE(view.find("zzz").has_value());
+
+    std::vector<std::string> mail;
+    view.forEachWithPrefix("mail/", [&mail](const BinaryIndex::EntryView &e) { mail.emplace_back(e.name); });
+    REQUIRE(mail == std::vector<std::string>{"mail/home", "mail/work"});
+
+    StorageIndex loaded;
+    view.load(loaded);
+    REQUIRE(loaded.size() == 5);
+    REQUIRE(loaded.find("db/stage") != nullptr);
+
+    view.close();
+    fs::remove(path);
+}
+
+TEST_CASE("BinaryIndex rejects damaged images") {
+    auto image = BinaryIndex::serialize(sampleIndex());
+    BinaryIndex view;
+
+    auto badMagic = image;
+    badMagic[0] = 'X';
+    REQUIRE_THROWS_AS(view.attach(badMagic), StorageError);
+
+    const std::vector<unsigned char> truncated(image.begin(), image.begin() + 100);
+    REQUIRE_THROWS_AS(view.attach(truncated), StorageError);
+
+    view.attach(image);
+    REQUIRE(view.find("api/key").has_value());
+}
@@ -0,0 +1,118 @@
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "storage/ChunkStore.h"
+
+static const std::vector<unsigned char> VMK(32, 0x5A);
+
+// Deterministic pseudo-random bytes.
+static std::vector<unsigned char> dataOf(const std::size_t size, const unsigned char seed) {
+    std::vector<unsigned char> out(size);
+    std::uint64_t state = seed;
+    for (auto &byte : out) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        byte = static_cast<unsigned char>(state >> 56);
+    }
+    return out;
+}
+
+// Chunk lengths of 'data', cut front to back.
+static std::vector<std::size_t> cutAll(std::span<const unsigned char> data) {
+    std::vector<std::size_t> lengths;
+    while (!data.empty()) {
+        lengths.push_back(ChunkStore::cut(data));
+        data = data.subspan(lengths.back());
+    }
+    return lengths;
+}
+
+TEST_CASE("ChunkStore cuts content-defined chunks within bounds") {
+    const auto data = dataOf(2 * 1024 * 1024, 1);
+    const auto lengths = cutAll(data);
+    REQUIRE(cutAll(data) == lengths);
+
+    for (std::size_t i = 0; i + 1 < lengths.size(); ++i) {
+        REQUIRE(lengths[i] > ChunkStore::MIN_CHUNK);
+        REQUIRE(lengths[i] <= ChunkStore::MAX_CHUNK);
+    }
+    const auto average = data.size() / lengths.size();
+    REQUIRE(average > ChunkStore::AVERAGE_CHUNK / 2);
+    REQUIRE(average < ChunkStore::AVERAGE_CHUNK * 2);
+
+    // Short input is one chunk; uniform input is cut at the maximum.
+    REQUIRE(ChunkStore::cut(std::span(data).first(100)) == 100);
+    REQUIRE(ChunkStore::cut(std::vector<unsigned char>(256 * 1024, 0)) == ChunkStore::MAX_CHUNK);
+
+    // Bytes inserted near the front: the cuts find their way back, most chunks are shared.
+    auto edited = data;
+    edited.insert(edited.begin() + 1000, {1, 2, 3, 4, 5, 6, 7});
+    const auto editedLengths = cutAll(edited);
+    std::size_t shared = 0;
+    for (std::size_t i = 1; i <= std::min(lengths.size(), editedLengths.size()); ++i) {
+        if (lengths[lengths.size() - i] != editedLengths[editedLengths.size() - i]) break;
+        ++shared;
+    }
+    REQUIRE(shared + 2 >= lengths.size());
+}
+
+TEST_CASE("ChunkStore ids are keyed hashes; lists round-trip") {
+    const ChunkStore store(VMK);
+    const auto chunk = dataOf(5000, 2);
+    const auto ref = store.refOf(chunk);
+    REQUIRE(ref.size == chunk.size());
+    REQUIRE(store.refOf(chunk).id == ref.id);
+    REQUIRE(store.refOf(dataOf(5000, 3)).id != ref.id);
+    // Another vault's key: another id for the same bytes.
+    REQUIRE(ChunkStore(std::vector<unsigned char>(32, 0x11)).refOf(chunk).id != ref.id);
+
+    const auto name = ChunkStore::nameOf(ref.id);
+    REQUIRE(ChunkStore::isChunkName(name));
+    REQUIRE_FALSE(ChunkStore::isChunkName("chunk:" + name.substr(1)));
+    REQUIRE(ChunkStore::idOf(name) == ref.id);
+    REQUIRE_THROWS(ChunkStore::idOf(name.substr(0, name.size() - 1)));
+
+    const std::vector refs {ref, store.refOf(std::span(chunk).first(10))};
+    const auto list = ChunkStore::encode(refs);
+    REQUIRE(list.size() == 2 * ChunkStore::REF_SIZE);
+    const auto decoded = ChunkStore::decode(list);
+    REQUIRE(decoded.size() == 2);
+    REQUIRE(decoded[1].id == refs[1].id);
+    REQUIRE(decoded[1].size == 10);
+    REQUIRE(ChunkStore::totalSize(decoded) == 5010);
+    REQUIRE_THROWS(ChunkStore::decode(std::span(list).first(list.size() - 1)));
+    REQUIRE_THROWS(store.refOf(std::vector<unsigned char>(ChunkStore::MAX_CHUNK + 1)));
+}
+
+TEST_CASE("ChunkStore counts references once asked to") {
+    ChunkStore store(VMK);
+    const auto a = store.refOf(dataOf(3000, 4));
+    const auto b = store.refOf(dataOf(3000, 5));
+
+    // Not counted yet: everything is in use, nothing is released.
+    REQUIRE(store.inUse(a.id));
+    store.reference(std::vector {a});
+    REQUIRE(store.release(std::vector {a}).empty());
+
+    const std::vector<std::vector<ChunkStore::ChunkRef>> lists {{a, b}, {a}};
+    store.count(lists);
+    REQUIRE(store.counted());
+    REQUIRE(store.release(std::vector {b}) == std::vector {b.id});
+    REQUIRE_FALSE(store.inUse(b.id));
+    REQUIRE(store.release(std::vector {a}).empty());
+    REQUIRE(store.inUse(a.id));
+
+    // Held while a record using it is written; referenced again once it is.
+    store.hold(b.id);
+    REQUIRE(store.inUse(b.id));
+    store.reference(std::vector {b});
+    store.unhold(b.id);
+    REQUIRE(store.inUse(b.id));
+
+    store.reset();
+    REQUIRE_FALSE(store.counted());
+}
@@ -0,0 +1,151 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "storage/ChunkedAead.h"
+
+static std::vector<unsigned char> plaintextOf(const std::size_t size) {
+    std::vector<unsigned char> plain(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        plain[i] = static_cast<unsigned char>(i * 7 + i / 251);
+    }
+    return plain;
+}
+
+// Header || chunks, sealed in one call.
+static std::vector<unsigned char> sealAll(const ChunkedAead &aead, const ChunkedAead::Header &header, const std::vector<unsigned char> &plain) {
+    std::vector<unsigned char> sealed(ChunkedAead::sealedSize(plain.size()));
+    std::copy(header.begin(), header.end(), sealed.begin());
+    const auto written = aead.seal(0, plain, true, std::span(sealed).subspan(ChunkedAead::HEADER_SIZE));
+    REQUIRE(written + ChunkedAead::HEADER_SIZE == sealed.size());
+    return sealed;
+}
+
+static std::vector<unsigned char> openAll(const ChunkedAead &aead, const std::vector<unsigned char> &sealed) {
+    std::vector<unsigned char> plain(ChunkedAead::plainSize(sealed.size()));
+    plain.resize(aead.open(0, std::span(sealed).subspan(ChunkedAead::HEADER_SIZE), true, plain));
+    return plain;
+}
+
+// Every suite this CPU can run.
+static std::vector<CipherSuite> suites() {
+    std::vector<CipherSuite> out {CipherSuite::XChaCha20Poly1305};
+    if (CryptoEngine::available(CipherSuite::Aes256Gcm)) {
+        out.push_back(CipherSuite::Aes256Gcm);
+    }
+    return out;
+}
+
+TEST_CASE("ChunkedAead round-trips records of any size, in one go or in batches") {
+    const auto suite = GENERATE(from_range(suites()));
+    INFO("suite " << CryptoEngine::name(suite));
+    std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+    randombytes_buf(key.data(), key.size());
+    const auto header = ChunkedAead::newHeader(suite);
+    const ChunkedAead aead(key, header, 4);
+    REQUIRE(aead.suite() == suite);
+
+    constexpr auto C = ChunkedAead::CHUNK_SIZE;
+    for (const auto size : std::vector<std::size_t> {0, 1, C - 1, C, C + 1, 5 * C, 7 * C + 123}) {
+        INFO("size " << size);
+        const auto plain = plaintextOf(size);
+        const auto sealed = sealAll(aead, header, plain);
+        REQUIRE(ChunkedAead::plainSize(sealed.size()) == size);
+        REQUIRE(openAll(aead, sealed) == plain);
+
+        // Sealing two whole chunks at a time gives the same record, bar an empty final chunk
+        // when the size is a multiple of the chunk size.
+        std::vector<unsigned char> streamed(header.begin(), header.end());
+        std::vector<unsigned char> out(2 * ChunkedAead::SEALED_CHUNK_SIZE);
+        std::size_t at = 0;
+        for (bool last = false; !last;) {
+            const auto take = std::min(2 * C, size - at);
+            last = take < 2 * C;
+            const auto n = aead.seal(at / C, std::span(plain).subspan(at, take), last, out);
+            streamed.insert(streamed.end(), out.begin(), out.begin() + static_cast<std::ptrdiff_t>(n));
+            at += take;
+        }
+        REQUIRE(openAll(aead, streamed) == plain);
+    }
+}
+
+TEST_CASE("ChunkedAead opens any chunk alone and rejects moved, cut or altered chunks") {
+    const auto suite = GENERATE(from_range(suites()));
+    INFO("suite " << CryptoEngine::name(suite));
+    std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+    randombytes_buf(key.data(), key.size());
+    const auto header = ChunkedAead::newHeader(suite);
+    const ChunkedAead aead(key, header);
+
+    constexpr auto C = ChunkedAead::CHUNK_SIZE;
+    constexpr auto S = ChunkedAead::SEALED_CHUNK_SIZE;
+    constexpr auto H = ChunkedAead::HEADER_SIZE;
+    const auto plain = plaintextOf(3 * C + 10);
+    const auto sealed = sealAll(aead, header, plain);
+    REQUIRE(ChunkedAead::chunkCount(sealed.size()) == 4);
+
+    // Chunk 2 on its own.
+    std::vector<unsigned char> out(C);
+    REQUIRE(aead.open(2, std::span(sealed).subspan(H + 2 * S, S), false, out) == C);
+    REQUIRE(std::equal(out.begin(), out.end(), plain.begin() + 2 * C));
+
+    // At another index, or claimed final when it is not.
+    REQUIRE_THROWS_AS(aead.open(1, std::span(sealed).subspan(H + 2 * S, S), false, out), std::runtime_error);
+    REQUIRE_THROWS_AS(aead.open(2, std::span(sealed).subspan(H + 2 * S, S), true, out), std::runtime_error);
+
+    // Cut after chunk 2: the new last chunk is not final.
+    std::vector<unsigned char> cut(sealed.begin(), sealed.begin() + static_cast<std::ptrdiff_t>(H + 3 * S));
+    REQUIRE_THROWS_AS(openAll(aead, cut), std::runtime_error);
+
+    // Swapped chunks.
+    auto swapped = sealed;
+    std::swap_ranges(swapped.begin() + H, swapped.begin() + H + S, swapped.begin() + H + S);
+    REQUIRE_THROWS_AS(openAll(aead, swapped), std::runtime_error);
+
+    // Another header (same key) opens nothing.
+    auto otherHeader = header;
+    otherHeader.back() ^= 1;
+    const ChunkedAead other(key, otherHeader);
+    REQUIRE_THROWS_AS(openAll(other, sealed), std::runtime_error);
+
+    // Another suite named in the header.
+    auto otherSuite = header;
+    otherSuite[5] ^= 1;
+    REQUIRE_THROWS_AS(openAll(ChunkedAead(key, otherSuite), sealed), std::runtime_error);
+
+    // Unknown layout or suite, impossible sizes.
+    auto badHeader = header;
+    badHeader[4] = ChunkedAead::VERSION + 1;
+    REQUIRE_THROWS_AS(ChunkedAead(key, badHeader), std::runtime_error);
+    badHeader = header;
+    badHeader[5] = 0x7F;
+    REQUIRE_THROWS_AS(ChunkedAead(key, badHeader), std::runtime_error);
+    REQUIRE_THROWS_AS(ChunkedAead::plainSize(H + 3), std::runtime_error);
+    REQUIRE_THROWS_AS(ChunkedAead::plainSize(H + S + 5), std::runtime_error);
+}
+
+TEST_CASE("ChunkedAead throughput, one thread vs all", "[!benchmark]") {
+    std::vector<unsigned char> key(CryptoEngine::KEY_SIZE);
+    randombytes_buf(key.data(), key.size());
+    const auto plain = plaintextOf(64 * 1024 * 1024);
+    std::vector<unsigned char> sealed(ChunkedAead::sealedSize(plain.size()));
+    std::vector<unsigned char> opened(plain.size());
+
+    for (const auto suite : suites()) {
+        const auto header = ChunkedAead::newHeader(suite);
+        for (const unsigned jobs : {1u, 0u}) {
+            const ChunkedAead aead(key, header, jobs);
+            const auto label = std::string(CryptoEngine::name(suite)) + ", jobs " + std::to_string(jobs);
+            BENCHMARK("seal 64 MiB, " + label) {
+                return aead.seal(0, plain, true, sealed);
+            };
+            BENCHMARK("open 64 MiB, " + label) {
+                return aead.open(0, std::span(sealed).subspan(0, sealed.size() - ChunkedAead::HEADER_SIZE), true, opened);
+            };
+        }
+    }
+}
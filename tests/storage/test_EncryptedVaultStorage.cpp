@@ -0,0 +1,337 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ScratchVault.h"
+#include "security/IntegrityChecker.h"
+#include "storage/ChunkedAead.h"
+#include "storage/EncryptedVaultStorage.h"
+#include "storage/IndexLog.h"
+#include "storage/SegmentStore.h"
+#include "utils/Base64.h"
+
+namespace fs = std::filesystem;
+
+// Heap allocations of the thread that has counting on (see loadRecordInto below).
+static std::atomic<std::size_t> g_allocations {0};
+static thread_local bool t_countAllocations = false;
+
+void *operator new(const std::size_t size) {
+    if (t_countAllocations) {
+        ++g_allocations;
+    }
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static const std::vector<unsigned char> VMK(32, 0x42);
+
+static std::vector<unsigned char> bytesOf(const std::string &text) {
+    return {text.begin(), text.end()};
+}
+
+// Bytes in all segments of the scratch vault.
+static std::uint64_t segmentBytes() {
+    std::uint64_t total = 0;
+    for (const auto &file : fs::directory_iterator("data/vault_store")) {
+        if (file.path().extension() == ".dat") {
+            total += file.file_size();
+        }
+    }
+    return total;
+}
+
+// The store with nothing running behind the test's back.
+static void quiet(EncryptedVaultStorage &storage) {
+    storage.setAutoCompaction(std::nullopt);
+    storage.setAutoGc(std::nullopt);
+}
+
+// A record read back every way there is: whole, into a buffer of recordSize() bytes, and its size.
+static void requireReadsBack(EncryptedVaultStorage &storage, const std::string &name, const std::vector<unsigned char> &data) {
+    REQUIRE(storage.recordSize(name) == data.size());
+    REQUIRE(storage.loadRecord(name) == data);
+    std::vector<unsigned char> buffer(data.size());
+    REQUIRE(storage.loadRecordInto(name, buffer) == data.size());
+    REQUIRE(buffer == data);
+}
+
+// Small JSON-ish entries, alike but not the same.
+static std::string note(const std::size_t i) {
+    return R"({"site":"example-)" + std::to_string(i % 97) + R"(.com","username":"user)" + std::to_string(i)
+        + R"(@mail.example.org","password":"pw-)" + std::to_string(i * 7919) + R"(","notes":"created by import, rotate yearly"})";
+}
+
+TEST_CASE("Compressed records read back whole, into buffers and by size, before and after a dictionary") {
+    ScratchVault scratch("encora_test_vault_compressed");
+    std::vector<EncryptedVaultStorage::NewRecord> notes;
+    for (std::size_t i = 0; i < 2000; ++i) {
+        notes.push_back({"note_" + std::to_string(i), "note", bytesOf(note(i))});
+    }
+    std::string text;
+    while (text.size() < 24 * 1024) {
+        text += "the same line of text, over and over; ";
+    }
+    const auto repetitive = bytesOf(text);
+    const auto lateNote = bytesOf(note(5000));
+
+    {
+        EncryptedVaultStorage storage(VMK);
+        quiet(storage);
+
+        // Compressed on its own: a fraction of its size in the segment.
+        auto copy = repetitive;
+        auto before = segmentBytes();
+        REQUIRE(storage.addRecord("repetitive", "text", copy));
+        REQUIRE(segmentBytes() - before < repetitive.size() / 4);
+        requireReadsBack(storage, "repetitive", repetitive);
+
+        before = segmentBytes();
+        REQUIRE(storage.addRecords(notes) == notes.size());
+        const auto perNoteBefore = (segmentBytes() - before) / notes.size();
+
+        const auto report = storage.trainDictionary();
+        REQUIRE(report.id != 0);
+        REQUIRE(report.samples == notes.size());
+
+        // Compressed against the dictionary: smaller than the notes stored before it.
+        copy = lateNote;
+        before = segmentBytes();
+        REQUIRE(storage.addRecord("late_note", "note", copy));
+        REQUIRE(segmentBytes() - before < perNoteBefore);
+
+        requireReadsBack(storage, "late_note", lateNote);
+        requireReadsBack(storage, "note_7", notes[7].data);
+        requireReadsBack(storage, "repetitive", repetitive);
+    }
+
+    EncryptedVaultStorage reopened(VMK);
+    requireReadsBack(reopened, "late_note", lateNote);
+    requireReadsBack(reopened, "note_1999", notes[1999].data);
+    requireReadsBack(reopened, "repetitive", repetitive);
+    REQUIRE(IntegrityChecker::verify("data", VMK).status == IntegrityStatus::OK);
+}
+
+static std::vector<unsigned char> randomBytes(const std::size_t size, const unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<unsigned char> bytes(size);
+    for (auto &byte : bytes) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    return bytes;
+}
+
+// A record as the first versions stored it: record_<id>.bin (nonce || XChaCha20-Poly1305 ciphertext under
+// HMAC-SHA256(VMK, salt)), listed in a plaintext index.json that opening the store migrates.
+static void writeLegacyRecord(const std::string &name, const std::string &id, const std::vector<unsigned char> &plain) {
+    std::vector<unsigned char> salt(32);
+    randombytes_buf(salt.data(), salt.size());
+    unsigned char key[crypto_auth_hmacsha256_BYTES];
+    crypto_auth_hmacsha256_state state;
+    crypto_auth_hmacsha256_init(&state, VMK.data(), VMK.size());
+    crypto_auth_hmacsha256_update(&state, salt.data(), salt.size());
+    crypto_auth_hmacsha256_final(&state, key);
+
+    std::vector<unsigned char> sealed(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + plain.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+    randombytes_buf(sealed.data(), crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+    crypto_aead_xchacha20poly1305_ietf_encrypt(sealed.data() + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, nullptr, plain.data(),
+        plain.size(), nullptr, 0, nullptr, sealed.data(), key);
+
+    fs::create_directories("data/vault_store");
+    std::ofstream("data/vault_store/record_" + id + ".bin", std::ios::binary)
+        .write(reinterpret_cast<const char *>(sealed.data()), static_cast<std::streamsize>(sealed.size()));
+    std::ofstream("data/vault_store/index.json", std::ios::app) << R"({"id":")" << id << R"(","name":")" << name
+        << R"(","type":"note","created_at":0,"salt_b64":")" << Base64::encode(salt) << "\"}\n";
+}
+
+TEST_CASE("loadRecordInto and recordSize serve every record format") {
+    REQUIRE(sodium_init() >= 0);
+    ScratchVault scratch("encora_test_vault_load_into");
+    const auto legacy = bytesOf("written before segments existed");
+    writeLegacyRecord("legacy", "1700000000000000000", legacy);
+
+    EncryptedVaultStorage storage(VMK);
+    quiet(storage);
+    // Plain formats only: nothing compressed or deduplicated.
+    storage.setCompression(std::nullopt);
+    storage.setDeduplication(std::nullopt);
+
+    const auto sealed = randomBytes(5000, 1);
+    const auto randomAccess = randomBytes(EncryptedVaultStorage::PARALLEL_SEAL_SIZE + 12345, 2);
+    const std::vector<unsigned char> empty;
+    for (const auto &[name, data] : {std::pair {"sealed", sealed}, std::pair {"random_access", randomAccess}, std::pair {"empty", empty}}) {
+        auto copy = data;
+        REQUIRE(storage.addRecord(name, "file", copy));
+    }
+
+    for (const auto &[name, data] : {std::pair {"sealed", sealed}, std::pair {"random_access", randomAccess}, std::pair {"empty", empty},
+             std::pair {"legacy", legacy}}) {
+        requireReadsBack(storage, name, data);
+        REQUIRE(storage.recordSize(name) == storage.loadRecord(name).size());
+
+        // A bigger buffer is filled up to the record's size.
+        std::vector<unsigned char> roomy(data.size() + 10, 0xEE);
+        REQUIRE(storage.loadRecordInto(name, roomy) == data.size());
+        REQUIRE(std::equal(data.begin(), data.end(), roomy.begin()));
+
+        if (!data.empty()) {
+            std::vector<unsigned char> tooSmall(data.size() - 1);
+            REQUIRE_THROWS_AS(storage.loadRecordInto(name, tooSmall), std::invalid_argument);
+        }
+    }
+    REQUIRE_THROWS(storage.recordSize("missing"));
+    std::vector<unsigned char> buffer(16);
+    REQUIRE_THROWS(storage.loadRecordInto("missing", buffer));
+}
+
+TEST_CASE("loadRecordInto opens a Sealed record without a heap allocation") {
+    ScratchVault scratch("encora_test_vault_no_alloc");
+    EncryptedVaultStorage storage(VMK);
+    quiet(storage);
+    storage.setCompression(std::nullopt);
+    const auto data = randomBytes(4096, 3);
+    auto copy = data;
+    REQUIRE(storage.addRecord("sealed", "file", copy));
+
+    std::vector<unsigned char> buffer(data.size());
+    // The first load maps the segment.
+    REQUIRE(storage.loadRecordInto("sealed", buffer) == data.size());
+
+    g_allocations = 0;
+    t_countAllocations = true;
+    const auto loaded = storage.loadRecordInto("sealed", buffer);
+    t_countAllocations = false;
+    REQUIRE(loaded == data.size());
+    REQUIRE(g_allocations == 0);
+    REQUIRE(buffer == data);
+}
+
+TEST_CASE("addRecordFrom and loadRecordTo stream records of any size") {
+    ScratchVault scratch("encora_test_vault_stream");
+    EncryptedVaultStorage storage(VMK);
+    quiet(storage);
+    const bool deduplicated = GENERATE(false, true);
+    if (!deduplicated) {
+        storage.setDeduplication(std::nullopt);
+    }
+
+    const std::size_t batch = EncryptedVaultStorage::STREAM_BATCH_CHUNKS * ChunkedAead::CHUNK_SIZE;
+    const std::size_t sizes[] = {0, 1, 3 * ChunkedAead::CHUNK_SIZE, batch, batch + 2 * ChunkedAead::CHUNK_SIZE + 77};
+    for (const auto size : sizes) {
+        const auto data = randomBytes(size, static_cast<unsigned>(size));
+        std::istringstream in(std::string(data.begin(), data.end()));
+        REQUIRE(storage.addRecordFrom("streamed", "file", in) == size);
+        REQUIRE(storage.recordSize("streamed") == size);
+
+        std::ostringstream out;
+        REQUIRE(storage.loadRecordTo("streamed", out) == size);
+        REQUIRE(out.str() == std::string(data.begin(), data.end()));
+        REQUIRE(storage.loadRecord("streamed") == data);
+    }
+
+    // Through file descriptors, as the CLI streams stdin and stdout.
+    const auto data = randomBytes(batch + 5, 9);
+    std::ofstream("input.bin", std::ios::binary).write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    const int input = ::open("input.bin", O_RDONLY);
+    REQUIRE(input >= 0);
+    REQUIRE(storage.addRecordFrom("from_fd", "file", input) == data.size());
+    ::close(input);
+    const int output = ::open("output.bin", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    REQUIRE(output >= 0);
+    REQUIRE(storage.loadRecordTo("from_fd", output) == data.size());
+    ::close(output);
+    REQUIRE(fs::file_size("output.bin") == data.size());
+    REQUIRE(storage.loadRecordRange("from_fd", batch - 3, 8) == std::vector<unsigned char>(data.end() - 8, data.end()));
+
+    std::ostringstream out;
+    REQUIRE_THROWS(storage.loadRecordTo("missing", out));
+}
+
+// A record as addRecordFrom first stored it (RecordFormat::Chunked): crypto_secretstream_xchacha20poly1305 under
+// HMAC-SHA256(VMK, salt), STREAM_CHUNK_SIZE bytes per chunk and a shorter, possibly empty, final one.
+static void writeChunkedRecord(const std::string &name, const std::vector<unsigned char> &plain) {
+    StorageIndex::Salt salt {};
+    randombytes_buf(salt.data(), salt.size());
+    unsigned char key[crypto_auth_hmacsha256_BYTES];
+    crypto_auth_hmacsha256_state hmac;
+    crypto_auth_hmacsha256_init(&hmac, VMK.data(), VMK.size());
+    crypto_auth_hmacsha256_update(&hmac, salt.data(), salt.size());
+    crypto_auth_hmacsha256_final(&hmac, key);
+
+    std::vector<unsigned char> sealed(crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+    crypto_secretstream_xchacha20poly1305_state state;
+    crypto_secretstream_xchacha20poly1305_init_push(&state, sealed.data(), key);
+    for (std::size_t at = 0;; at += EncryptedVaultStorage::STREAM_CHUNK_SIZE) {
+        const auto size = std::min(EncryptedVaultStorage::STREAM_CHUNK_SIZE, plain.size() - at);
+        const bool last = size < EncryptedVaultStorage::STREAM_CHUNK_SIZE;
+        const auto offset = sealed.size();
+        sealed.resize(offset + size + crypto_secretstream_xchacha20poly1305_ABYTES);
+        crypto_secretstream_xchacha20poly1305_push(&state, sealed.data() + offset, nullptr, plain.data() + at, size, nullptr, 0,
+            last ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : 0);
+        if (last) break;
+    }
+
+    RecordLocation location;
+    {
+        SegmentStore segments("data/vault_store");
+        location = segments.append(sealed, static_cast<std::uint32_t>(EncryptedVaultStorage::RecordFormat::Chunked));
+        segments.sync();
+    }
+    IndexLog log(VMK);
+    log.open("data/vault_store/index.log");
+    log.put(name, name, "file", salt, 0, location);
+    log.flush();
+}
+
+TEST_CASE("Chunked records written by earlier versions still read back") {
+    ScratchVault scratch("encora_test_vault_chunked");
+    fs::create_directories("data/vault_store");
+    const auto full = randomBytes(2 * EncryptedVaultStorage::STREAM_CHUNK_SIZE, 4);
+    const auto partial = randomBytes(2 * EncryptedVaultStorage::STREAM_CHUNK_SIZE + 100, 5);
+    const std::vector<unsigned char> empty;
+    writeChunkedRecord("full", full);
+    writeChunkedRecord("partial", partial);
+    writeChunkedRecord("empty", empty);
+
+    EncryptedVaultStorage storage(VMK);
+    quiet(storage);
+    for (const auto &[name, data] : {std::pair {"full", full}, std::pair {"partial", partial}, std::pair {"empty", empty}}) {
+        requireReadsBack(storage, name, data);
+        std::ostringstream out;
+        REQUIRE(storage.loadRecordTo(name, out) == data.size());
+        REQUIRE(out.str() == std::string(data.begin(), data.end()));
+    }
+    REQUIRE(storage.loadRecordRange("partial", EncryptedVaultStorage::STREAM_CHUNK_SIZE - 2, 4)
+        == std::vector<unsigned char>(partial.begin() + EncryptedVaultStorage::STREAM_CHUNK_SIZE - 2,
+            partial.begin() + EncryptedVaultStorage::STREAM_CHUNK_SIZE + 2));
+
+    // Replaced through the current writer, it reads back the same.
+    std::istringstream in(std::string(partial.begin(), partial.end()));
+    REQUIRE(storage.addRecordFrom("partial", "file", in) == partial.size());
+    requireReadsBack(storage, "partial", partial);
+}
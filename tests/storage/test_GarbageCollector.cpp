@@ -0,0 +1,74 @@
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "storage/GarbageCollector.h"
+#include "storage/SegmentStore.h"
+
+namespace fs = std::filesystem;
+
+static std::string storeDir() {
+    const auto dir = (fs::temp_directory_path() / "encora_test_gc").string();
+    fs::remove_all(dir);
+    fs::remove_all(dir + "_quarantine");
+    fs::create_directories(dir);
+    return dir;
+}
+
+static void writeFile(const std::string &path, std::size_t size) {
+    std::ofstream out(path, std::ios::binary);
+    out << std::string(size, 'x');
+}
+
+static bool hasOrphan(const SpaceReport &report, const std::string &name) {
+    return std::any_of(report.orphans.begin(), report.orphans.end(), [&](const auto &orphan) { return orphan.name == name; });
+}
+
+TEST_CASE("GarbageCollector finds unreferenced files and accounts live vs dead bytes") {
+    const auto dir = storeDir();
+    RecordLocation kept;
+    {
+        SegmentStore segments(dir);
+        kept = segments.append(std::vector<unsigned char>(100, 0x01));
+        (void) segments.append(std::vector<unsigned char>(300, 0x02));   // superseded
+        segments.rollover();
+        (void) segments.append(std::vector<unsigned char>(50, 0x03));    // whole segment dead
+    }
+    writeFile(dir + "/record_live.bin", 40);
+    writeFile(dir + "/record_gone.bin", 60);
+    writeFile(dir + "/index.log.tmp", 10);
+    writeFile(dir + "/notes.txt", 5);
+
+    StorageIndex index;
+    index.upsert("a", "seg", "note", {}, 0, kept);
+    index.upsert("b", "live", "note", {}, 0);
+
+    const auto report = GarbageCollector::scan(dir, index, {});
+    REQUIRE(report.liveRecords == 2);
+    REQUIRE(report.liveBytes == SegmentStore::RECORD_HEADER_SIZE + 100 + 40);
+    REQUIRE(report.deadBytes == SegmentStore::RECORD_HEADER_SIZE + 300);
+    REQUIRE(report.orphans.size() == 3);
+    REQUIRE(hasOrphan(report, "segment_000002.dat"));
+    REQUIRE(hasOrphan(report, "record_gone.bin"));
+    REQUIRE(hasOrphan(report, "index.log.tmp"));
+    REQUIRE(report.deadFraction() > 0.0);
+
+    // The segment new records go to is never an orphan.
+    REQUIRE_FALSE(hasOrphan(GarbageCollector::scan(dir, index, {2}), "segment_000002.dat"));
+
+    std::size_t handled = 0;
+    REQUIRE(GarbageCollector::sweep(dir, report, dir + "_quarantine", handled) == report.orphanBytes);
+    REQUIRE(handled == 3);
+    REQUIRE(fs::exists(dir + "_quarantine/record_gone.bin"));
+    REQUIRE(fs::exists(dir + "/record_live.bin"));
+    REQUIRE(fs::exists(dir + "/segment_000001.dat"));
+    REQUIRE(fs::exists(dir + "/notes.txt"));
+
+    const auto after = GarbageCollector::scan(dir, index, {});
+    REQUIRE(after.orphans.empty());
+    REQUIRE(after.liveBytes == report.liveBytes);
+}
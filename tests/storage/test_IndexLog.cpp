@@ -0,0 +1,95 @@
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "storage/IndexLog.h"
+#include "storage/StorageError.h"
+
+namespace fs = std::filesystem;
+
+static const std::vector<unsigned char> VMK(32, 0x5A);
+
+static std::string logPath() {
+    const auto path = (fs::temp_directory_path() / "encora_test_index.log").string();
+    fs::remove(path);
+    return path;
+}
+
+static StorageIndex::Salt saltOf(unsigned char b) {
+    StorageIndex::Salt salt;
+    salt.fill(b);
+    return salt;
+}
+
+TEST_CASE("IndexLog replays puts and removes across checkpoints") {
+    const auto path = logPath();
+    {
+        IndexLog log(VMK);
+        log.open(path);
+        for (std::size_t i = 0; i < IndexLog::CHECKPOINT_INTERVAL + 10; ++i) {
+            log.put("rec_" + std::to_string(i), std::to_string(i), "note", saltOf(static_cast<unsigned char>(i)), 1);
+        }
+        REQUIRE(log.remove("rec_3"));
+        REQUIRE_FALSE(log.remove("missing"));
+        log.put("rec_5", "five", "file", saltOf(5), 2);
+    }
+
+    IndexLog log(VMK);
+    log.open(path);
+    REQUIRE_FALSE(log.find("rec_3").has_value());
+    REQUIRE(log.find("rec_5")->id == "five");
+    REQUIRE(log.find("rec_200")->salt[0] == 200);
+    REQUIRE(log.names("").size() == IndexLog::CHECKPOINT_INTERVAL + 9);
+    REQUIRE(log.names("rec_26").size() == 7); // rec_26, rec_260 .. rec_265
+    fs::remove(path);
+}
+
+TEST_CASE("IndexLog keeps names off disk and detects tampering") {
+    const auto path = logPath();
+    {
+        IndexLog log(VMK);
+        log.open(path);
+        log.put("very-secret-name", "1", "note", saltOf(1), 1);
+        log.put("another-name", "2", "note", saltOf(2), 1);
+    }
+
+    std::ifstream ifs(path, std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(ifs)), {});
+    ifs.close();
+    REQUIRE(bytes.find("very-secret-name") == std::string::npos);
+
+    SECTION("wrong key") {
+        IndexLog other(std::vector<unsigned char>(32, 0x01));
+        REQUIRE_THROWS_AS(other.open(path), StorageError);
+    }
+
+    SECTION("flipped byte") {
+        std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+        fs.seekp(static_cast<std::streamoff>(bytes.size() - 3));
+        fs.put(static_cast<char>(bytes[bytes.size() - 3] ^ 0x01));
+        fs.close();
+
+        IndexLog log(VMK);
+        REQUIRE_THROWS_AS(log.open(path), StorageError);
+    }
+
+    SECTION("torn tail is truncated") {
+        fs::resize_file(path, bytes.size() - 5);
+
+        IndexLog log(VMK);
+        log.open(path);
+        REQUIRE(log.find("very-secret-name").has_value());
+        REQUIRE_FALSE(log.find("another-name").has_value());
+
+        log.put("third", "3", "note", saltOf(3), 1);
+        log.flush();
+        IndexLog reopened(VMK);
+        reopened.open(path);
+        REQUIRE(reopened.find("third").has_value());
+    }
+
+    fs::remove(path);
+}
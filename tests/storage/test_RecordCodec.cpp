@@ -0,0 +1,128 @@
+#include <catch2/catch_all.hpp>
+
+#include <sodium.h>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "storage/RecordCodec.h"
+#include "storage/StorageError.h"
+
+namespace fs = std::filesystem;
+
+static const std::vector<unsigned char> VMK(32, 0x5A);
+
+static std::string storeDir() {
+    const auto dir = fs::temp_directory_path() / "encora_test_codec";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir.string();
+}
+
+static std::vector<unsigned char> bytesOf(const std::string &text) {
+    return {text.begin(), text.end()};
+}
+
+// Small JSON-ish entries, alike but not the same.
+static std::vector<std::vector<unsigned char>> notes(const std::size_t count) {
+    std::vector<std::vector<unsigned char>> out;
+    for (std::size_t i = 0; i < count; ++i) {
+        out.push_back(bytesOf(R"({"site":"example-)" + std::to_string(i % 97) + R"(.com","username":"user)" + std::to_string(i)
+            + R"(@mail.example.org","password":"pw-)" + std::to_string(i * 7919) + R"(","notes":"created by import, rotate yearly"})"));
+    }
+    return out;
+}
+
+static std::vector<unsigned char> roundTrip(const RecordCodec &codec, const std::vector<unsigned char> &compressed,
+    const RecordCodec::Header &header) {
+    std::vector<unsigned char> plain(static_cast<std::size_t>(header.size));
+    codec.decompress(RecordCodec::Header::parse(header.bytes()), compressed, plain);
+    return plain;
+}
+
+TEST_CASE("RecordCodec compresses what pays and leaves the rest") {
+    const RecordCodec codec(storeDir(), VMK);
+    const CompressionOptions options;
+    RecordCodec::Header header;
+
+    const std::vector<unsigned char> text(256 * 1024, 'a');
+    const auto compressed = codec.compress(text, options, header);
+    REQUIRE(header.codec == RecordCodec::Codec::Zstd);
+    REQUIRE(header.size == text.size());
+    REQUIRE(compressed.size() < text.size() / 100);
+    REQUIRE(roundTrip(codec, compressed, header) == text);
+
+    std::vector<unsigned char> noise(64 * 1024);
+    randombytes_buf(noise.data(), noise.size());
+    REQUIRE(codec.compress(noise, options, header).empty());
+    REQUIRE(header.codec == RecordCodec::Codec::None);
+
+    const std::vector<unsigned char> tiny(options.minSize - 1, 'a');
+    REQUIRE(codec.compress(tiny, options, header).empty());
+    REQUIRE(header.codec == RecordCodec::Codec::None);
+
+    // A frame that does not decompress to the size in the header is refused.
+    header = {RecordCodec::Codec::Zstd, 0, text.size() - 1};
+    std::vector<unsigned char> shorter(text.size() - 1);
+    REQUIRE_THROWS(codec.decompress(header, compressed, shorter));
+}
+
+TEST_CASE("RecordCodec headers reject unknown codecs and stray bytes") {
+    const RecordCodec::Header header {RecordCodec::Codec::ZstdDictionary, 3, 12345};
+    auto bytes = header.bytes();
+    const auto parsed = RecordCodec::Header::parse(bytes);
+    REQUIRE(parsed.codec == header.codec);
+    REQUIRE(parsed.dictionary == 3);
+    REQUIRE(parsed.size == 12345);
+
+    for (const std::size_t at : {std::size_t {0}, std::size_t {1}}) {
+        auto bad = bytes;
+        bad[at] = 0x7F;
+        REQUIRE_THROWS(RecordCodec::Header::parse(bad));
+    }
+    // Zstd never names a dictionary, ZstdDictionary always does.
+    bytes[0] = static_cast<unsigned char>(RecordCodec::Codec::Zstd);
+    REQUIRE_THROWS(RecordCodec::Header::parse(bytes));
+    REQUIRE_THROWS(RecordCodec::Header::parse(RecordCodec::Header {}.bytes()));
+}
+
+TEST_CASE("RecordCodec trains a sealed dictionary that small records compress against") {
+    const auto dir = storeDir();
+    const auto samples = notes(2000);
+    const std::vector<std::span<const unsigned char>> spans(samples.begin(), samples.end());
+    const auto record = notes(2001).back();
+
+    std::vector<unsigned char> alone;
+    std::vector<unsigned char> withDictionary;
+    RecordCodec::Header header;
+    {
+        RecordCodec codec(dir, VMK);
+        REQUIRE(codec.current() == 0);
+        alone = codec.compress(record, CompressionOptions {}, header);
+
+        const auto [id, size] = codec.train(spans, 16 * 1024);
+        REQUIRE(id == 1);
+        REQUIRE(size > 0);
+        REQUIRE(codec.current() == 1);
+
+        withDictionary = codec.compress(record, CompressionOptions {}, header);
+        REQUIRE(header.codec == RecordCodec::Codec::ZstdDictionary);
+        REQUIRE(header.dictionary == 1);
+        REQUIRE(withDictionary.size() < (alone.empty() ? record.size() : alone.size()) / 2);
+    }
+
+    // Reloaded from dictionaries.bin.
+    const RecordCodec reopened(dir, VMK);
+    REQUIRE(reopened.current() == 1);
+    REQUIRE(roundTrip(reopened, withDictionary, header) == record);
+
+    // Sealed under the VMK.
+    REQUIRE_THROWS_AS(RecordCodec(dir, std::vector<unsigned char>(32, 0x11)), StorageError);
+
+    // Too little to learn from: no dictionary, nothing written.
+    const std::vector<std::span<const unsigned char>> few(spans.begin(), spans.begin() + 2);
+    RecordCodec fresh(storeDir(), VMK);
+    REQUIRE(fresh.train(few, 16 * 1024).first == 0);
+    REQUIRE(fresh.current() == 0);
+}
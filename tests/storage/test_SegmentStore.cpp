@@ -0,0 +1,191 @@
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "storage/SegmentStore.h"
+#include "storage/StorageError.h"
+
+namespace fs = std::filesystem;
+
+static std::string segmentDir() {
+    const auto dir = (fs::temp_directory_path() / "encora_test_segments").string();
+    fs::remove_all(dir);
+    return dir;
+}
+
+static std::vector<unsigned char> recordOf(std::size_t size, unsigned char fill) {
+    return std::vector<unsigned char>(size, fill);
+}
+
+TEST_CASE("SegmentStore reads back appended records") {
+    const auto dir = segmentDir();
+    SegmentStore store(dir);
+
+    const auto a = store.append(recordOf(100, 0xA1));
+    const auto b = store.append(recordOf(1, 0xB2));
+    const auto empty = store.append({});
+
+    REQUIRE(a.segment == 1);
+    REQUIRE(a.offset == SegmentStore::HEADER_SIZE + SegmentStore::RECORD_HEADER_SIZE);
+    REQUIRE(b.offset == a.offset + a.length + SegmentStore::RECORD_HEADER_SIZE);
+    REQUIRE(store.read(a) == recordOf(100, 0xA1));
+    REQUIRE(store.read(b) == recordOf(1, 0xB2));
+    REQUIRE(store.read(empty).empty());
+    REQUIRE(store.segmentIds() == std::vector<std::uint32_t>{1});
+}
+
+TEST_CASE("SegmentStore rolls over to a new segment at the size limit") {
+    const auto dir = segmentDir();
+    std::vector<RecordLocation> locations;
+    {
+        SegmentStore store(dir, 256);
+        for (unsigned char i = 0; i < 10; ++i) {
+            locations.push_back(store.append(recordOf(100, i)));
+        }
+        // Bigger than a whole segment: gets one of its own.
+        locations.push_back(store.append(recordOf(1000, 0xFF)));
+    }
+
+    SegmentStore store(dir, 256);
+    REQUIRE(store.segmentIds().size() == 6);
+    for (unsigned char i = 0; i < 10; ++i) {
+        REQUIRE(store.read(locations[i]) == recordOf(100, i));
+    }
+    REQUIRE(store.read(locations.back()) == recordOf(1000, 0xFF));
+
+    // Reopened store keeps appending to the newest segment.
+    const auto next = store.append(recordOf(10, 0x01));
+    REQUIRE(next.segment == locations.back().segment + 1);
+    REQUIRE(store.read(next) == recordOf(10, 0x01));
+}
+
+TEST_CASE("SegmentStore rejects locations it cannot serve") {
+    const auto dir = segmentDir();
+    SegmentStore store(dir);
+    const auto loc = store.append(recordOf(16, 0x10));
+
+    REQUIRE_THROWS_AS(store.read(RecordLocation{}), StorageError);
+    REQUIRE_THROWS_AS(store.read(RecordLocation{7, 16, loc.offset}), StorageError);
+    REQUIRE_THROWS_AS(store.read(RecordLocation{loc.segment, 64, loc.offset}), StorageError);
+
+    REQUIRE(SegmentStore::isSegmentFile("segment_000001.dat"));
+    REQUIRE_FALSE(SegmentStore::isSegmentFile("segment_.dat"));
+    REQUIRE_FALSE(SegmentStore::isSegmentFile("record_1.bin"));
+}
+
+TEST_CASE("SegmentStore rollover and segment removal") {
+    const auto dir = segmentDir();
+    SegmentStore store(dir);
+    const auto first = store.append(recordOf(32, 0x01));
+
+    store.rollover();
+    const auto second = store.append(recordOf(32, 0x02));
+    REQUIRE(second.segment == first.segment + 1);
+    REQUIRE(store.activeId() == second.segment);
+
+    store.removeSegment(first.segment);
+    REQUIRE(store.segmentIds() == std::vector<std::uint32_t>{second.segment});
+    REQUIRE_THROWS_AS(store.read(first), StorageError);
+    REQUIRE(store.read(second) == recordOf(32, 0x02));
+}
+
+TEST_CASE("SegmentStore maps segments once and remaps them as they grow") {
+    const auto dir = segmentDir();
+    SegmentStore store(dir);
+    const auto a = store.append(recordOf(64, 0xA1));
+
+    const auto mapping = store.map(a.segment, a.offset + a.length);
+    REQUIRE(std::equal(mapping->data() + a.offset, mapping->data() + a.offset + a.length, recordOf(64, 0xA1).begin()));
+    REQUIRE(store.map(a.segment, a.offset + a.length) == mapping);
+
+    // A record past the mapped end gets a new mapping; the old one stays readable.
+    const auto b = store.append(recordOf(16, 0xB2));
+    const auto grown = store.map(b.segment, b.offset + b.length);
+    REQUIRE(grown != mapping);
+    REQUIRE(grown->data()[b.offset] == 0xB2);
+    REQUIRE(mapping->data()[a.offset] == 0xA1);
+
+    REQUIRE_THROWS_AS(store.map(a.segment, grown->size() + 1), StorageError);
+    store.rollover();
+    store.removeSegment(a.segment);
+    REQUIRE(grown->data()[b.offset] == 0xB2);
+    REQUIRE_THROWS_AS(store.map(a.segment, 1), StorageError);
+}
+
+TEST_CASE("SegmentStore streams a record into a segment of its own") {
+    const auto dir = segmentDir();
+    SegmentStore store(dir);
+    const auto before = store.append(recordOf(32, 0x01), 0);
+
+    auto writer = store.beginStream(7);
+    REQUIRE(writer.segment() != before.segment);
+    REQUIRE(store.isStreaming(writer.segment()));
+    REQUIRE(store.openSegments() == std::vector<std::uint32_t>{writer.segment(), before.segment});
+
+    // Appends meanwhile stay out of the streamed segment.
+    const auto during = store.append(recordOf(16, 0x02), 3);
+    REQUIRE(during.segment == before.segment);
+
+    for (unsigned char i = 0; i < 3; ++i) {
+        writer.write(recordOf(1000, i));
+    }
+    const auto streamed = writer.finish();
+    store.endStream(streamed.segment, false);
+    REQUIRE_FALSE(store.isStreaming(streamed.segment));
+    REQUIRE(streamed.length == 3000);
+
+    auto expected = recordOf(1000, 0);
+    expected.insert(expected.end(), 1000, 1);
+    expected.insert(expected.end(), 1000, 2);
+    REQUIRE(store.read(streamed) == expected);
+    REQUIRE(store.format(streamed) == 7);
+    REQUIRE(store.format(during) == 3);
+
+    // Copies keep the format; new segments never reuse the streamed one's id.
+    store.rollover();
+    const auto copied = store.copy(streamed);
+    REQUIRE(copied.segment > streamed.segment);
+    REQUIRE(store.read(copied) == expected);
+    REQUIRE(store.format(copied) == 7);
+
+    // An abandoned stream leaves nothing behind.
+    auto abandoned = store.beginStream(7);
+    abandoned.write(recordOf(10, 0x03));
+    const auto abandonedId = abandoned.segment();
+    store.endStream(abandonedId, true);
+    REQUIRE_FALSE(fs::exists(store.segmentPath(abandonedId)));
+}
+
+TEST_CASE("SegmentStore streams several records into one segment") {
+    SegmentStore store(segmentDir());
+    auto writer = store.beginStream(9);
+    writer.write(recordOf(100, 0x01));
+    const auto first = writer.next(4);
+    writer.write(recordOf(50, 0x02));
+    writer.write(recordOf(50, 0x03));
+    const auto second = writer.next(5);
+    writer.write(recordOf(10, 0x04));
+    const auto last = writer.finish();
+    store.endStream(writer.segment(), false);
+
+    REQUIRE(first.segment == last.segment);
+    REQUIRE(first.length == 100);
+    REQUIRE(second.offset == first.offset + first.length + SegmentStore::RECORD_HEADER_SIZE);
+    REQUIRE(second.length == 100);
+    REQUIRE(last.length == 10);
+    REQUIRE(store.read(first) == recordOf(100, 0x01));
+    REQUIRE(store.read(last) == recordOf(10, 0x04));
+    REQUIRE(store.format(first) == 4);
+    REQUIRE(store.format(second) == 5);
+    REQUIRE(store.format(last) == 9);
+
+    // The last record may take a format only known at the end.
+    auto other = store.beginStream(9);
+    other.write(recordOf(8, 0x05));
+    const auto relabelled = other.finish(6);
+    store.endStream(other.segment(), false);
+    REQUIRE(store.format(relabelled) == 6);
+}
@@ -0,0 +1,61 @@
+#include <catch2/catch_all.hpp>
+
+#include <filesystem>
+#include <string>
+
+#include "storage/StorageIndex.h"
+
+namespace fs = std::filesystem;
+
+static StorageIndex::Salt saltOf(unsigned char b) {
+    StorageIndex::Salt salt;
+    salt.fill(b);
+    return salt;
+}
+
+TEST_CASE("StorageIndex finds, replaces and erases entries") {
+    StorageIndex index;
+    for (int i = 0; i < 1000; ++i) {
+        index.upsert("name_" + std::to_string(i), std::to_string(i), "note", saltOf(static_cast<unsigned char>(i)), i);
+    }
+    REQUIRE(index.size() == 1000);
+
+    const auto *e = index.find("name_42");
+    REQUIRE(e != nullptr);
+    REQUIRE(e->id == "42");
+    REQUIRE(e->salt[0] == 42);
+
+    index.upsert("name_42", "new", "file", saltOf(7), 1);
+    REQUIRE(index.size() == 1000);
+    REQUIRE(index.find("name_42")->id == "new");
+    REQUIRE(index.find("name_42")->type == "file");
+
+    for (int i = 0; i < 1000; i += 2) {
+        REQUIRE(index.erase("name_" + std::to_string(i)));
+    }
+    REQUIRE_FALSE(index.erase("name_0"));
+    REQUIRE(index.size() == 500);
+
+    for (int i = 0; i < 1000; ++i) {
+        const bool present = index.find("name_" + std::to_string(i)) != nullptr;
+        REQUIRE(present == (i % 2 == 1));
+    }
+}
+
+TEST_CASE("StorageIndex round-trips JSON lines") {
+    const auto path = (fs::temp_directory_path() / "encora_test_index.json").string();
+
+    StorageIndex index;
+    index.upsert("alpha", "1", "note", saltOf(1), 100);
+    index.upsert("beta", "2", "file", saltOf(2), 200);
+    index.saveJsonLines(path);
+
+    StorageIndex loaded;
+    loaded.loadJsonLines(path);
+    fs::remove(path);
+
+    REQUIRE(loaded.size() == 2);
+    REQUIRE(loaded.find("beta") != nullptr);
+    REQUIRE(loaded.find("beta")->salt == saltOf(2));
+    REQUIRE(loaded.find("beta")->createdAt == 200);
+}
@@ -0,0 +1,180 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage/StorageError.h"
+#include "storage/WriteAheadLog.h"
+
+namespace fs = std::filesystem;
+
+static const std::vector<unsigned char> VMK(32, 0x3C);
+
+static std::string walPath() {
+    const auto path = (fs::temp_directory_path() / "encora_test_vault.wal").string();
+    fs::remove(path);
+    return path;
+}
+
+static WriteAheadLog::Operation putOp(const std::string &name, std::uint32_t offset) {
+    WriteAheadLog::Operation op;
+    op.kind = WriteAheadLog::Operation::Kind::Put;
+    op.name = name;
+    op.id = "id_" + name;
+    op.type = "note";
+    op.salt.fill(0x11);
+    op.createdAt = 1700000000;
+    op.location = {1, 42, offset};
+    return op;
+}
+
+static WriteAheadLog::Operation removeOp(const std::string &name) {
+    WriteAheadLog::Operation op;
+    op.kind = WriteAheadLog::Operation::Kind::Remove;
+    op.name = name;
+    return op;
+}
+
+using Replayed = std::vector<std::vector<WriteAheadLog::Operation>>;
+
+static std::size_t reopen(const std::string &path, Replayed &out) {
+    WriteAheadLog wal(VMK);
+    return wal.open(path, [&](std::uint64_t, const std::vector<WriteAheadLog::Operation> &ops) { out.push_back(ops); });
+}
+
+TEST_CASE("WriteAheadLog replays committed transactions in order") {
+    const auto path = walPath();
+    {
+        WriteAheadLog wal(VMK);
+        REQUIRE(wal.open(path, [](std::uint64_t, const auto &) {}) == 0);
+        REQUIRE(wal.empty());
+        REQUIRE(wal.commit({putOp("a", 16), putOp("b", 80)}) == 0);
+        REQUIRE(wal.commit({removeOp("a")}) == 1);
+    }
+
+    Replayed replayed;
+    REQUIRE(reopen(path, replayed) == 2);
+    REQUIRE(replayed[0].size() == 2);
+    REQUIRE(replayed[0][1].name == "b");
+    REQUIRE(replayed[0][1].id == "id_b");
+    REQUIRE(replayed[0][1].location.offset == 80);
+    REQUIRE(replayed[0][1].salt == putOp("b", 80).salt);
+    REQUIRE(replayed[1].size() == 1);
+    REQUIRE(replayed[1][0].kind == WriteAheadLog::Operation::Kind::Remove);
+    REQUIRE(replayed[1][0].name == "a");
+}
+
+TEST_CASE("WriteAheadLog drops a torn transaction and keeps sequence across reset") {
+    const auto path = walPath();
+    {
+        WriteAheadLog wal(VMK);
+        (void) wal.open(path, [](std::uint64_t, const auto &) {});
+        wal.commit({putOp("a", 16)});
+        wal.commit({putOp("b", 80), putOp("c", 144)});
+    }
+
+    // Crash in the middle of the second group write.
+    fs::resize_file(path, fs::file_size(path) - 5);
+    {
+        Replayed replayed;
+        REQUIRE(reopen(path, replayed) == 1);
+        REQUIRE(replayed[0][0].name == "a");
+    }
+
+    {
+        WriteAheadLog wal(VMK);
+        (void) wal.open(path, [](std::uint64_t, const auto &) {});
+        REQUIRE(wal.nextSeq() == 1);
+        wal.reset();
+        REQUIRE(wal.empty());
+        REQUIRE(wal.commit({putOp("d", 16)}) == 1);
+    }
+
+    Replayed replayed;
+    REQUIRE(reopen(path, replayed) == 1);
+    REQUIRE(replayed[0][0].name == "d");
+
+    // Frames are bound to the vault key.
+    WriteAheadLog other(std::vector<unsigned char>(32, 0x01));
+    REQUIRE(other.open(path, [](std::uint64_t, const auto &) {}) == 0);
+}
+
+TEST_CASE("WriteAheadLog refuses a corrupt frame that committed frames follow") {
+    const auto path = walPath();
+    std::vector<std::uintmax_t> ends;
+    {
+        WriteAheadLog wal(VMK);
+        (void) wal.open(path, [](std::uint64_t, const auto &) {});
+        for (const auto *name : {"a", "b", "c"}) {
+            wal.commit({putOp(name, 16)});
+            ends.push_back(fs::file_size(path));
+        }
+    }
+    auto flipLastByte = [&](const std::uintmax_t end) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(end - 1));
+        const char byte = static_cast<char>(file.get() ^ 0x01);
+        file.seekp(static_cast<std::streamoff>(end - 1));
+        file.put(byte);
+    };
+
+    // A bit-flip in the middle frame: nothing replayed, nothing truncated.
+    flipLastByte(ends[1]);
+    Replayed replayed;
+    REQUIRE_THROWS_AS(reopen(path, replayed), StorageError);
+    REQUIRE(replayed.empty());
+    REQUIRE(fs::file_size(path) == ends[2]);
+    flipLastByte(ends[1]);
+
+    // The same in the last frame looks like a torn write: dropped.
+    flipLastByte(ends[2]);
+    REQUIRE(reopen(path, replayed) == 2);
+    REQUIRE(replayed[1][0].name == "b");
+    REQUIRE(fs::file_size(path) == ends[1]);
+}
+
+TEST_CASE("WriteAheadLog refuses commits after a failed group write") {
+    const auto path = walPath();
+    WriteAheadLog wal(VMK);
+    (void) wal.open(path, [](std::uint64_t, const auto &) {});
+    REQUIRE_FALSE(wal.failed());
+
+    wal.setBeforeSync([] { throw std::runtime_error("disk full"); });
+    REQUIRE_THROWS_AS(wal.commit({putOp("a", 16)}), StorageError);
+    REQUIRE(wal.failed());
+    REQUIRE_THROWS_AS(wal.enqueue({putOp("b", 16)}), StorageError);
+}
+
+TEST_CASE("WriteAheadLog group commit shares fsyncs between threads") {
+    const auto path = walPath();
+    constexpr int threads = 8;
+    constexpr int perThread = 50;
+    std::atomic<int> syncs {0};
+    {
+        WriteAheadLog wal(VMK);
+        (void) wal.open(path, [](std::uint64_t, const auto &) {});
+        wal.setBeforeSync([&] { ++syncs; });
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < perThread; ++i) {
+                    wal.commit({putOp("t" + std::to_string(t) + "_" + std::to_string(i), 16)});
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        REQUIRE(wal.nextSeq() == threads * perThread);
+    }
+
+    REQUIRE(syncs.load() <= threads * perThread);
+    Replayed replayed;
+    REQUIRE(reopen(path, replayed) == threads * perThread);
+}